@@ -43,6 +43,18 @@
 #include "config.h"
 #endif
 
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#else
+#error need errno.h
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#error need string.h
+#endif
+
 #include "Util.h"
 #include "Exception.h"
 #include "AlsaDspSource.h"
@@ -83,7 +95,13 @@ AlsaDspSource :: init (  const char      * name )
     pcmName       = Util::strDup( name);
     captureHandle = 0;
     bufferTime    = 1000000; // Do 1s buffering
+    periodSize    = 0;       // derived from the buffer time
+    periods       = 4;
+    useMmap       = false;
     running       = false;
+    xruns         = 0;
+    pollFds       = 0;
+    numPollFds    = 0;
 }
 
 
@@ -115,20 +133,35 @@ AlsaDspSource :: open ( void )
         return false;
     }
 
-    switch ( getBitsPerSample() ) {
-        case 8:
+    switch ( getSampleFormat() ) {
+        case SampleFormat::u8:
             format = SND_PCM_FORMAT_S8;
             break;
 
-        case 16:
+        case SampleFormat::s16:
             format = SND_PCM_FORMAT_S16;
             break;
-            
+
+        case SampleFormat::s24_3:
+            format = isBigEndian() ? SND_PCM_FORMAT_S24_3BE
+                                   : SND_PCM_FORMAT_S24_3LE;
+            break;
+
+        case SampleFormat::s32:
+            format = SND_PCM_FORMAT_S32;
+            break;
+
+        case SampleFormat::float32:
+            format = SND_PCM_FORMAT_FLOAT;
+            break;
+
         default:
             return false;
     }
 
-    if (snd_pcm_open(&captureHandle, pcmName, SND_PCM_STREAM_CAPTURE, 0) < 0) {
+    // non-blocking, as waiting is up to canRead() and read()
+    if (snd_pcm_open(&captureHandle, pcmName, SND_PCM_STREAM_CAPTURE,
+                     SND_PCM_NONBLOCK) < 0) {
         captureHandle = 0;
         return false;
     }
@@ -147,7 +180,9 @@ AlsaDspSource :: open ( void )
     }
 
     if (snd_pcm_hw_params_set_access(captureHandle, hwParams,
-                                     SND_PCM_ACCESS_RW_INTERLEAVED) < 0) {
+                                     useMmap
+                                     ? SND_PCM_ACCESS_MMAP_INTERLEAVED
+                                     : SND_PCM_ACCESS_RW_INTERLEAVED) < 0) {
         snd_pcm_hw_params_free(hwParams);
         close();
         throw Exception( __FILE__, __LINE__, "can't set access type");
@@ -173,7 +208,19 @@ AlsaDspSource :: open ( void )
         throw Exception( __FILE__, __LINE__, "can't set channels", u);
     }
 
-    u = 4;
+    if (periodSize) {
+        snd_pcm_uframes_t   frames = periodSize;
+
+        if (snd_pcm_hw_params_set_period_size_near(captureHandle, hwParams,
+                                                   &frames, 0) < 0) {
+            snd_pcm_hw_params_free(hwParams);
+            close();
+            throw Exception( __FILE__, __LINE__, "can't set period size",
+                             periodSize);
+        }
+    }
+
+    u = periods;
     if (snd_pcm_hw_params_set_periods_near(captureHandle, hwParams, &u, 0)
                                                                           < 0) {
         snd_pcm_hw_params_free(hwParams);
@@ -181,8 +228,10 @@ AlsaDspSource :: open ( void )
         throw Exception( __FILE__, __LINE__, "can't set interrupt frequency");
     }
 
+    // the size and the number of periods make the buffer size otherwise
     u = getBufferTime();
-    if (snd_pcm_hw_params_set_buffer_time_near(captureHandle, hwParams, &u, 0)
+    if (!periodSize
+     && snd_pcm_hw_params_set_buffer_time_near(captureHandle, hwParams, &u, 0)
                                                                           < 0) {
         snd_pcm_hw_params_free(hwParams);
         close();
@@ -195,20 +244,145 @@ AlsaDspSource :: open ( void )
         throw Exception( __FILE__, __LINE__, "can't set hardware parameters");
     }
 
+    snd_pcm_uframes_t   period;
+    snd_pcm_uframes_t   buffer;
+
+    snd_pcm_hw_params_get_period_size(hwParams, &period, 0);
+    snd_pcm_hw_params_get_buffer_size(hwParams, &buffer);
     snd_pcm_hw_params_free(hwParams);
 
+    reportEvent( 4, "AlsaDspSource :: open, period size", period,
+                    "buffer size", buffer);
+
     if (snd_pcm_prepare(captureHandle) < 0) {
         close();
         throw Exception( __FILE__, __LINE__, "can't prepare audio interface "\
                         "for use");
     }
 
+    numPollFds = snd_pcm_poll_descriptors_count(captureHandle);
+    pollFds    = new struct pollfd[numPollFds];
+    if (snd_pcm_poll_descriptors(captureHandle, pollFds, numPollFds) < 0) {
+        close();
+        throw Exception( __FILE__, __LINE__, "can't get poll descriptors");
+    }
+
     bytesPerFrame = getChannel() * getBitsPerSample() / 8;
+    xruns         = 0;
 
     return true;
 }
 
 
+/*------------------------------------------------------------------------------
+ *  Recover the PCM from an error
+ *----------------------------------------------------------------------------*/
+void
+AlsaDspSource :: recover ( int  err )
+{
+    if ( err == -EBADFD ) {
+        Exception e = Exception(__FILE__, __LINE__,
+                                "ALSA/PCM device is in a bad state: ",
+                                std::to_string(snd_pcm_state(captureHandle)).c_str());
+        close();
+        throw e;
+    }
+
+    // Check for buffer overrun
+    if ( err == -EPIPE ) {
+        ++xruns;
+        if ( (xruns & (xruns - 1)) == 0 ) {
+            reportEvent( 1, "AlsaDspSource :: Buffer overrun! overruns:",
+                            xruns);
+        }
+    }
+
+    if ( snd_pcm_recover(captureHandle, err, 1) < 0
+      || snd_pcm_start(captureHandle) < 0 ) {
+        Exception e = Exception(__FILE__, __LINE__, snd_strerror(err));
+        close();
+        throw e;
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Get the number of frames ready to be read
+ *----------------------------------------------------------------------------*/
+snd_pcm_uframes_t
+AlsaDspSource :: getAvailable ( void )
+{
+    snd_pcm_sframes_t   avail;
+
+    if ( !running ) {
+        snd_pcm_start(captureHandle); 
+        running = true;
+    }
+
+    while ( (avail = snd_pcm_avail_update(captureHandle)) < 0 ) {
+        recover(avail);
+    }
+
+    return avail;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Wait for the PCM to have a period of frames ready
+ *----------------------------------------------------------------------------*/
+bool
+AlsaDspSource :: waitForData ( unsigned long long   usec )
+{
+    unsigned long long  deadline = Util::getMonotonicTime() + usec;
+
+    for (;;) {
+        unsigned long long  now = Util::getMonotonicTime();
+        unsigned short      revents;
+        int                 ret;
+
+        if ( now >= deadline ) {
+            return false;
+        }
+
+        ret = poll(pollFds, numPollFds, (deadline - now + 999) / 1000);
+        if ( ret < 0 && errno != EINTR ) {
+            throw Exception( __FILE__, __LINE__, "poll error", errno);
+        }
+        if ( ret <= 0 ) {
+            continue;
+        }
+
+        snd_pcm_poll_descriptors_revents(captureHandle,
+                                         pollFds,
+                                         numPollFds,
+                                         &revents);
+        if ( revents & POLLERR ) {
+            // an overrun or a suspend, recover and wait again,
+            // in any other state poll() would report the error again at once
+            switch ( snd_pcm_state(captureHandle) ) {
+                case SND_PCM_STATE_XRUN:
+                    recover(-EPIPE);
+                    continue;
+
+                case SND_PCM_STATE_SUSPENDED:
+                    recover(-ESTRPIPE);
+                    continue;
+
+                case SND_PCM_STATE_DISCONNECTED:
+                    recover(-ENODEV);
+                    continue;
+
+                default:
+                    recover(-EBADFD);
+            }
+        }
+        if ( revents & POLLIN ) {
+            return true;
+        }
+    }
+}
+
+
 /*------------------------------------------------------------------------------
  *  Check whether read() would return anything
  *----------------------------------------------------------------------------*/
@@ -220,20 +394,60 @@ AlsaDspSource :: canRead ( unsigned int    sec,
         return false;
     }
 
-    if ( !running ) {
-        snd_pcm_start(captureHandle); 
-        running = true;
+    if ( getAvailable() > 0 ) {
+        return true;
     }
 
-    /*
-     * FIXME How to check for available frames? It
-     * seems like snd_pcm_wait stops working when
-     * it comes to ALSA plugins... :-(
-     *
-     * int milliDelay = sec * 1000 + usec/1000;
-     * return snd_pcm_wait(captureHandle, milliDelay)!=0;
-     */
-    return true; // bad!!
+    return waitForData( sec * 1000000ULL + usec);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Copy frames from the memory mapped device buffer
+ *----------------------------------------------------------------------------*/
+snd_pcm_uframes_t
+AlsaDspSource :: readMmap ( unsigned char     * buf,
+                            snd_pcm_uframes_t   frames )
+{
+    snd_pcm_uframes_t   done = 0;
+
+    // the frames may be in two parts, wrapping around the buffer's end
+    while ( done < frames ) {
+        const snd_pcm_channel_area_t  * areas;
+        snd_pcm_uframes_t               offset;
+        snd_pcm_uframes_t               count = frames - done;
+        snd_pcm_sframes_t               committed;
+        int                             err;
+
+        if ( (err = snd_pcm_mmap_begin(captureHandle,
+                                       &areas,
+                                       &offset,
+                                       &count)) < 0 ) {
+            recover(err);
+            break;
+        }
+        if ( count == 0 ) {
+            break;
+        }
+
+        // interleaved, so all channels are in the first area
+        memcpy(buf + done * bytesPerFrame,
+               (unsigned char *) areas[0].addr
+                            + (areas[0].first + offset * areas[0].step) / 8,
+               count * bytesPerFrame);
+
+        committed = snd_pcm_mmap_commit(captureHandle, offset, count);
+        if ( committed < 0 ) {
+            recover(committed);
+            break;
+        }
+        done += committed;
+        if ( (snd_pcm_uframes_t) committed != count ) {
+            break;
+        }
+    }
+
+    return done;
 }
 
 
@@ -244,39 +458,49 @@ unsigned int
 AlsaDspSource :: read (    void          * buf,
                            unsigned int    len )
 {
-    snd_pcm_sframes_t ret;
+    unsigned char     * b      = (unsigned char *) buf;
+    snd_pcm_uframes_t   frames = len / bytesPerFrame;
+    snd_pcm_uframes_t   done   = 0;
 
     if ( !isOpen() ) {
         return 0;
     }
 
-    do {
-        ret = snd_pcm_readi(captureHandle, buf, len/bytesPerFrame);
-
-        // Check for buffer overrun
-        if (ret == -EPIPE) {
-            reportEvent(1, "AlsaDspSource :: Buffer overrun!");
-            snd_pcm_prepare(captureHandle);
-            ret = -EAGAIN;
+    // fill the buffer, waiting a period at a time, but give up with
+    // what was read if the device stops delivering
+    while ( done < frames ) {
+        snd_pcm_uframes_t   avail = getAvailable();
+        snd_pcm_sframes_t   ret;
+
+        if ( avail == 0 ) {
+            if ( !waitForData( 2ULL * getBufferTime()) ) {
+                reportEvent( 2, "AlsaDspSource :: read, no audio for",
+                                2 * getBufferTime(), "usec");
+                break;
+            }
+            continue;
+        }
+        if ( avail > frames - done ) {
+            avail = frames - done;
         }
-    } while (ret == -EAGAIN);
 
-    if ( ret == -EBADFD ) {
-        Exception e = Exception(__FILE__, __LINE__,
-                                "ALSA/PCM device is in a bad state: ",
-                                std::to_string(snd_pcm_state(captureHandle)).c_str());
-        close();
-        throw e;
-    }
+        if ( useMmap ) {
+            done += readMmap( b + done * bytesPerFrame, avail);
+            continue;
+        }
 
-    if ( ret < 0 ) {
-        Exception e = Exception(__FILE__, __LINE__, snd_strerror(ret));
-        close();
-        throw e;
+        ret = snd_pcm_readi(captureHandle, b + done * bytesPerFrame, avail);
+        if ( ret == -EAGAIN ) {
+            continue;
+        }
+        if ( ret < 0 ) {
+            recover(ret);
+            continue;
+        }
+        done += ret;
     }
 
-    running = true;
-    return ret * bytesPerFrame;
+    return done * bytesPerFrame;
 }
 
 
@@ -292,6 +516,9 @@ AlsaDspSource :: close ( void )
 
     snd_pcm_close(captureHandle);
 
+    delete[] pollFds;
+    pollFds        = 0;
+    numPollFds     = 0;
     captureHandle  = 0;
     running        = false;
 }
@@ -55,6 +55,12 @@
 #error configure for ALSA 
 #endif
 
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#else
+#error need poll.h
+#endif
+
 
 /* ================================================================ constants */
 
@@ -100,6 +106,81 @@ class AlsaDspSource : public AudioSource, public virtual Reporter
          */
         unsigned int bufferTime;
 
+        /**
+         *  Number of frames in a period, the unit the device delivers
+         *  audio in. 0 to derive it from the buffer time.
+         */
+        unsigned int periodSize;
+
+        /**
+         *  Number of periods in the device buffer.
+         */
+        unsigned int periods;
+
+        /**
+         *  Read through the memory mapped device buffer, instead of
+         *  having snd_pcm_readi() copy it.
+         */
+        bool useMmap;
+
+        /**
+         *  Number of overruns of the device buffer since opening.
+         */
+        unsigned long xruns;
+
+        /**
+         *  The descriptors to poll for the PCM.
+         */
+        struct pollfd *pollFds;
+
+        /**
+         *  Number of descriptors in pollFds.
+         */
+        unsigned int numPollFds;
+
+        /**
+         *  Recover the PCM from an error, and restart it.
+         *  Overruns are counted and reported.
+         *
+         *  @param err the error code returned by ALSA.
+         *  @exception Exception if the PCM can not be recovered.
+         */
+        void
+        recover ( int   err );
+
+        /**
+         *  Get the number of frames ready to be read, recovering the
+         *  PCM from errors.
+         *
+         *  @return the number of frames that can be read right away.
+         *  @exception Exception
+         */
+        snd_pcm_uframes_t
+        getAvailable ( void );
+
+        /**
+         *  Wait for the PCM to have at least a period of frames ready.
+         *
+         *  @param usec the micro seconds to wait at most.
+         *  @return true if there are frames ready, false on timeout.
+         *  @exception Exception
+         */
+        bool
+        waitForData ( unsigned long long  usec );
+
+        /**
+         *  Copy frames from the memory mapped device buffer.
+         *
+         *  @param buf the buffer to copy into.
+         *  @param frames the number of frames to copy at most,
+         *                no more than getAvailable() returned.
+         *  @return the number of frames copied.
+         *  @exception Exception
+         */
+        snd_pcm_uframes_t
+        readMmap (  unsigned char     * buf,
+                    snd_pcm_uframes_t   frames );
+
 
     protected:
 
@@ -285,6 +366,46 @@ class AlsaDspSource : public AudioSource, public virtual Reporter
         setBufferTime( unsigned int time ) {
             bufferTime = time;
         }
+
+        /**
+         *  Set the size and the number of the periods of the device
+         *  buffer, in place of the buffer time. Call before open().
+         *
+         *  @param size the number of frames in a period,
+         *              0 to derive it from the buffer time.
+         *  @param count the number of periods in the buffer.
+         */
+        inline void
+        setPeriods( unsigned int    size,
+                    unsigned int    count )
+        {
+            periodSize = size;
+            periods    = count;
+        }
+
+        /**
+         *  Set whether to read through the memory mapped device buffer.
+         *  Call before open().
+         *
+         *  @param mmap true to read through the memory mapped buffer.
+         */
+        inline void
+        setMmap( bool   mmap )
+        {
+            useMmap = mmap;
+        }
+
+        /**
+         *  Get the number of overruns of the device buffer since the
+         *  source was opened.
+         *
+         *  @return the number of overruns.
+         */
+        inline virtual unsigned long
+        getOverruns ( void ) const                      throw ()
+        {
+            return xruns;
+        }
 };
 
 
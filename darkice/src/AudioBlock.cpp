@@ -0,0 +1,457 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : AudioBlock.cpp
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_SCHED_H
+#include <sched.h>
+#else
+#error need sched.h
+#endif
+
+
+#include "Util.h"
+#include "ConvKernels.h"
+#include "AudioBlock.h"
+
+
+/* ===================================================  local data structures */
+
+
+/* ================================================  local constants & macros */
+
+/*------------------------------------------------------------------------------
+ *  File identity
+ *----------------------------------------------------------------------------*/
+static const char fileid[] = "$Id$";
+
+
+/* ===============================================  local function prototypes */
+
+
+/* =============================================================  module code */
+
+/*------------------------------------------------------------------------------
+ *  Claim the making of a view, or wait for it to be made
+ *----------------------------------------------------------------------------*/
+bool
+AudioBlock :: claimView ( std::atomic<int>    & state )        throw ()
+{
+    int     expected;
+
+    for ( ;; ) {
+        // empty again if the thread making it failed, try it here then
+        expected = viewEmpty;
+        if ( state.compare_exchange_strong( expected,
+                                            viewBusy,
+                                            std::memory_order_acquire,
+                                            std::memory_order_acquire) ) {
+            return true;
+        }
+        if ( expected == viewReady ) {
+            return false;
+        }
+
+        // making a view takes a few micro-seconds, not worth sleeping on
+        sched_yield();
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Make room for the views
+ *----------------------------------------------------------------------------*/
+void
+AudioBlock :: reserveViews ( void )
+{
+    unsigned int    samples = frames * channels;
+
+    if ( samples <= viewCapacity ) {
+        return;
+    }
+
+    // only the thread that claimed the first view gets here, as all
+    // other views are made from the one made of the raw data: the
+    // interleaved 16 bit view, or the interleaved float view for audio
+    // wider than 16 bits
+    delete[] interleaved16;
+    delete[] planar16;
+    delete[] planarFloat;
+    delete[] mono16;
+    delete[] interleavedFloat;
+    delete[] monoFloat;
+    interleaved16    = new int16_t[samples];
+    planar16         = new int16_t[samples];
+    planarFloat      = new float[samples];
+    mono16           = new int16_t[samples];
+    interleavedFloat = new float[samples];
+    monoFloat        = new float[samples];
+    viewCapacity     = samples;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Get the interleaved 16 bit view
+ *----------------------------------------------------------------------------*/
+const int16_t *
+AudioBlock :: getInterleaved16 ( void )
+{
+    if ( !hasViews() ) {
+        return 0;
+    }
+
+    if ( SampleFormat::isWide( sampleFormat) ) {
+        const float   * in = getInterleavedFloat();
+
+        if ( claimView( interleaved16State) ) {
+            ConvKernels::get()->toInt16( in, frames * channels, interleaved16);
+            interleaved16State.store( viewReady, std::memory_order_release);
+        }
+
+        return interleaved16;
+    }
+
+    if ( claimView( interleaved16State) ) {
+        try {
+            reserveViews();
+            SampleFormat::toInt16( sampleFormat,
+                                   data,
+                                   frames * channels,
+                                   interleaved16,
+                                   bigEndian);
+        } catch ( ... ) {
+            interleaved16State.store( viewEmpty, std::memory_order_release);
+            throw;
+        }
+        interleaved16State.store( viewReady, std::memory_order_release);
+    }
+
+    return interleaved16;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Get a channel of the planar 16 bit view
+ *----------------------------------------------------------------------------*/
+const int16_t *
+AudioBlock :: getPlanar16 ( unsigned int      channel )
+{
+    if ( !hasViews() || channel >= channels ) {
+        return 0;
+    }
+
+    const int16_t * in = getInterleaved16();
+
+    if ( claimView( planar16State) ) {
+        if ( channels == 2 ) {
+            ConvKernels::get()->split16( in,
+                                         frames,
+                                         planar16,
+                                         planar16 + frames,
+                                         false);
+        } else {
+            for ( unsigned int c = 0; c < channels; ++c ) {
+                int16_t       * out = planar16 + c * frames;
+
+                for ( unsigned int i = 0, j = c;
+                      i < frames;
+                      ++i, j += channels ) {
+                    out[i] = in[j];
+                }
+            }
+        }
+        planar16State.store( viewReady, std::memory_order_release);
+    }
+
+    return planar16 + channel * frames;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Get a channel of the planar float view
+ *----------------------------------------------------------------------------*/
+const float *
+AudioBlock :: getPlanarFloat ( unsigned int   channel )
+{
+    if ( !hasViews() || channel >= channels ) {
+        return 0;
+    }
+
+    if ( SampleFormat::isWide( sampleFormat) ) {
+        const float   * in = getInterleavedFloat();
+
+        if ( claimView( planarFloatState) ) {
+            for ( unsigned int c = 0; c < channels; ++c ) {
+                float         * out = planarFloat + c * frames;
+
+                for ( unsigned int i = 0, j = c;
+                      i < frames;
+                      ++i, j += channels ) {
+                    out[i] = in[j];
+                }
+            }
+            planarFloatState.store( viewReady, std::memory_order_release);
+        }
+
+        return planarFloat + channel * frames;
+    }
+
+    const int16_t * in = getPlanar16( 0);
+
+    if ( claimView( planarFloatState) ) {
+        float         * out = planarFloat;
+
+        // the planar samples are converted as one long channel
+        ConvKernels::get()->toFloat16( in, frames * channels, 1, &out);
+        planarFloatState.store( viewReady, std::memory_order_release);
+    }
+
+    return planarFloat + channel * frames;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Get the interleaved float view
+ *----------------------------------------------------------------------------*/
+const float *
+AudioBlock :: getInterleavedFloat ( void )
+{
+    if ( !hasViews() ) {
+        return 0;
+    }
+
+    if ( !SampleFormat::isWide( sampleFormat) ) {
+        const int16_t * in = getInterleaved16();
+
+        if ( claimView( interleavedFloatState) ) {
+            float         * out = interleavedFloat;
+
+            ConvKernels::get()->toFloat16( in, frames * channels, 1, &out);
+            interleavedFloatState.store( viewReady, std::memory_order_release);
+        }
+
+        return interleavedFloat;
+    }
+
+    if ( claimView( interleavedFloatState) ) {
+        try {
+            reserveViews();
+            SampleFormat::toFloat( sampleFormat,
+                                   data,
+                                   frames * channels,
+                                   interleavedFloat,
+                                   bigEndian);
+        } catch ( ... ) {
+            interleavedFloatState.store( viewEmpty, std::memory_order_release);
+            throw;
+        }
+        interleavedFloatState.store( viewReady, std::memory_order_release);
+    }
+
+    return interleavedFloat;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Get the mono 16 bit view
+ *----------------------------------------------------------------------------*/
+const int16_t *
+AudioBlock :: getMono16 ( void )
+{
+    if ( !hasViews() ) {
+        return 0;
+    }
+
+    const int16_t * in = getInterleaved16();
+
+    if ( channels == 1 ) {
+        return in;
+    }
+
+    if ( claimView( mono16State) ) {
+        if ( channels == 2 ) {
+            Util::downmix( in, frames, mono16);
+        } else {
+            for ( unsigned int i = 0, j = 0; i < frames; ++i ) {
+                int     sum = 0;
+
+                for ( unsigned int c = 0; c < channels; ++c, ++j ) {
+                    sum += in[j];
+                }
+                mono16[i] = sum / (int) channels;
+            }
+        }
+        mono16State.store( viewReady, std::memory_order_release);
+    }
+
+    return mono16;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Get the mono float view
+ *----------------------------------------------------------------------------*/
+const float *
+AudioBlock :: getMonoFloat ( void )
+{
+    if ( !hasViews() ) {
+        return 0;
+    }
+
+    const float   * in = getInterleavedFloat();
+
+    if ( channels == 1 ) {
+        return in;
+    }
+
+    if ( claimView( monoFloatState) ) {
+        if ( channels == 2 ) {
+            for ( unsigned int i = 0; i < frames; ++i ) {
+                monoFloat[i] = (in[2 * i] + in[2 * i + 1]) * 0.5f;
+            }
+        } else {
+            float   scale = 1.0f / channels;
+
+            for ( unsigned int i = 0, j = 0; i < frames; ++i ) {
+                float   sum = 0.0f;
+
+                for ( unsigned int c = 0; c < channels; ++c, ++j ) {
+                    sum += in[j];
+                }
+                monoFloat[i] = sum * scale;
+            }
+        }
+        monoFloatState.store( viewReady, std::memory_order_release);
+    }
+
+    return monoFloat;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Add the audio at another sample rate
+ *----------------------------------------------------------------------------*/
+float *
+AudioBlock :: addResampled (    unsigned int    sampleRate,
+                                unsigned int    channels,
+                                unsigned int    frames )
+{
+    if ( numResampled == maxResampled ) {
+        Resampled     * r = new Resampled[maxResampled + 1];
+
+        // hand over the buffers, so that they are not freed
+        for ( unsigned int i = 0; i < maxResampled; ++i ) {
+            r[i].sampleRate = resampled[i].sampleRate;
+            r[i].channels   = resampled[i].channels;
+            r[i].samples    = resampled[i].samples;
+            r[i].samples16  = resampled[i].samples16;
+            r[i].frames     = resampled[i].frames;
+            r[i].capacity   = resampled[i].capacity;
+            resampled[i].samples   = 0;
+            resampled[i].samples16 = 0;
+        }
+        delete[] resampled;
+        resampled = r;
+        ++maxResampled;
+    }
+
+    Resampled     * r       = resampled + numResampled;
+    unsigned int    samples = frames * channels;
+
+    if ( samples > r->capacity ) {
+        delete[] r->samples;
+        delete[] r->samples16;
+        r->samples   = 0;
+        r->samples16 = 0;
+        r->capacity  = 0;
+        r->samples   = new float[samples];
+        r->samples16 = new int16_t[samples];
+        r->capacity  = samples;
+    }
+    r->sampleRate = sampleRate;
+    r->channels   = channels;
+    r->frames     = 0;
+
+    return r->samples;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Get the audio at another sample rate, as float samples
+ *----------------------------------------------------------------------------*/
+const float *
+AudioBlock :: getResampledFloat (   unsigned int    sampleRate,
+                                    unsigned int    channels,
+                                    unsigned int  & frames ) const  throw ()
+{
+    for ( unsigned int i = 0; i < numResampled; ++i ) {
+        if ( resampled[i].sampleRate == sampleRate
+          && resampled[i].channels   == channels ) {
+            frames = resampled[i].frames;
+            return resampled[i].samples;
+        }
+    }
+
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Get the audio at another sample rate, as 16 bit samples
+ *----------------------------------------------------------------------------*/
+const int16_t *
+AudioBlock :: getResampled16 (  unsigned int    sampleRate,
+                                unsigned int    channels,
+                                unsigned int  & frames )        throw ()
+{
+    for ( unsigned int i = 0; i < numResampled; ++i ) {
+        Resampled     * r = resampled + i;
+
+        if ( r->sampleRate != sampleRate || r->channels != channels ) {
+            continue;
+        }
+
+        // the buffer was allocated along with the float samples
+        if ( claimView( r->samples16State) ) {
+            ConvKernels::get()->toInt16( r->samples,
+                                         r->frames * channels,
+                                         r->samples16);
+            r->samples16State.store( viewReady, std::memory_order_release);
+        }
+        frames = r->frames;
+        return r->samples16;
+    }
+
+    return 0;
+}
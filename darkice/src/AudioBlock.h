@@ -0,0 +1,562 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : AudioBlock.h
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+#ifndef AUDIO_BLOCK_H
+#define AUDIO_BLOCK_H
+
+#ifndef __cplusplus
+#error This is a C++ include file
+#endif
+
+
+/* ============================================================ include files */
+
+#include <atomic>
+#include <stdint.h>
+
+#include "SampleFormat.h"
+
+
+/* ================================================================ constants */
+
+
+/* =================================================================== macros */
+
+
+/* =============================================================== data types */
+
+/**
+ *  A block of audio read from a source, shared read-only by all the
+ *  sinks it is handed to, without copying. Blocks are kept by an
+ *  AudioBlockPool, and go back to it when the last user releases them.
+ *
+ *  Besides the raw data, a block can present the audio as canonical
+ *  16 bit samples: interleaved, planar, or mixed down to mono, and
+ *  as float samples, also mixed down to mono. Float samples of audio
+ *  wider than 16 bits are made from the raw data, keeping all its
+ *  precision. The audio resampled by the connector is kept as float
+ *  samples too, and made into 16 bit samples only if asked. These views
+ *  are made on first request only, by whichever user asks first, and
+ *  are then shared by all the other users of the block. Thus each
+ *  conversion is done once per block, not once per encoder.
+ *
+ *  @author  $Author$
+ *  @version $Revision$
+ */
+class AudioBlock
+{
+    private:
+
+        /**
+         *  The states of a view: not made, being made, ready to read.
+         */
+        enum ViewState { viewEmpty, viewBusy, viewReady };
+
+        /**
+         *  The audio of the block at another sample rate.
+         */
+        class Resampled
+        {
+            public:
+                /**
+                 *  The sample rate of the samples.
+                 */
+                unsigned int        sampleRate;
+
+                /**
+                 *  The number of channels of the samples.
+                 */
+                unsigned int        channels;
+
+                /**
+                 *  The float samples, channels interleaved.
+                 */
+                float             * samples;
+
+                /**
+                 *  The samples made into 16 bit samples, when first
+                 *  asked for.
+                 */
+                int16_t           * samples16;
+
+                /**
+                 *  The state of samples16.
+                 */
+                std::atomic<int>    samples16State;
+
+                /**
+                 *  The number of sample frames.
+                 */
+                unsigned int        frames;
+
+                /**
+                 *  The number of samples the buffer can hold.
+                 */
+                unsigned int        capacity;
+
+                /**
+                 *  Default constructor.
+                 */
+                inline
+                Resampled ( void )                          throw ()
+                {
+                    sampleRate = 0;
+                    channels   = 0;
+                    samples    = 0;
+                    samples16  = 0;
+                    frames     = 0;
+                    capacity   = 0;
+                    samples16State.store( viewEmpty,
+                                          std::memory_order_relaxed);
+                }
+
+                /**
+                 *  Destructor.
+                 */
+                inline
+                ~Resampled ( void )                         throw ()
+                {
+                    delete[] samples;
+                    delete[] samples16;
+                }
+        };
+
+        /**
+         *  The state of the interleaved 16 bit view.
+         */
+        std::atomic<int>            interleaved16State;
+
+        /**
+         *  The state of the planar 16 bit view.
+         */
+        std::atomic<int>            planar16State;
+
+        /**
+         *  The state of the planar float view.
+         */
+        std::atomic<int>            planarFloatState;
+
+        /**
+         *  The state of the mono 16 bit view.
+         */
+        std::atomic<int>            mono16State;
+
+        /**
+         *  The state of the interleaved float view.
+         */
+        std::atomic<int>            interleavedFloatState;
+
+        /**
+         *  The state of the mono float view.
+         */
+        std::atomic<int>            monoFloatState;
+
+        /**
+         *  The interleaved 16 bit samples.
+         */
+        int16_t                   * interleaved16;
+
+        /**
+         *  The planar 16 bit samples, channel after channel.
+         */
+        int16_t                   * planar16;
+
+        /**
+         *  The planar float samples, channel after channel.
+         */
+        float                     * planarFloat;
+
+        /**
+         *  The 16 bit samples mixed down to mono.
+         */
+        int16_t                   * mono16;
+
+        /**
+         *  The interleaved float samples.
+         */
+        float                     * interleavedFloat;
+
+        /**
+         *  The float samples mixed down to mono.
+         */
+        float                     * monoFloat;
+
+        /**
+         *  The number of samples the view buffers can hold.
+         */
+        unsigned int                viewCapacity;
+
+        /**
+         *  The audio at other sample rates.
+         */
+        Resampled                 * resampled;
+
+        /**
+         *  The number of valid elements in resampled.
+         */
+        unsigned int                numResampled;
+
+        /**
+         *  The number of elements allocated in resampled.
+         */
+        unsigned int                maxResampled;
+
+        /**
+         *  Copy constructor. Not supported.
+         */
+        AudioBlock ( const AudioBlock &     block );
+
+        /**
+         *  Assignment operator. Not supported.
+         */
+        AudioBlock &
+        operator= ( const AudioBlock &      block );
+
+        /**
+         *  Claim the making of a view. If some other thread is making
+         *  it, wait until it is done. If that thread failed to make it,
+         *  the view is claimed for the caller to try again.
+         *
+         *  @param state the state of the view.
+         *  @return true if the caller has to make the view,
+         *          false if the view is ready.
+         */
+        bool
+        claimView ( std::atomic<int>      & state )        throw ();
+
+        /**
+         *  Make sure the view buffers can hold all samples of the block.
+         *  Only called while a view is claimed.
+         *
+         *  @exception Exception
+         */
+        void
+        reserveViews ( void );
+
+
+    public:
+        /**
+         *  The audio data.
+         */
+        unsigned char             * data;
+
+        /**
+         *  The number of bytes the block can hold.
+         */
+        unsigned int                capacity;
+
+        /**
+         *  The number of bytes of audio in the block.
+         */
+        unsigned int                size;
+
+        /**
+         *  The number of sample frames in the block,
+         *  0 if the format is not known.
+         */
+        unsigned int                frames;
+
+        /**
+         *  The time the block was read from the source, in
+         *  micro-seconds as returned by Util::getMonotonicTime().
+         */
+        unsigned long long          timestamp;
+
+        /**
+         *  The sample rate of the audio, 0 if not known.
+         */
+        unsigned int                sampleRate;
+
+        /**
+         *  The number of channels of the audio, 0 if not known.
+         */
+        unsigned int                channels;
+
+        /**
+         *  The number of bits per sample of the audio, 0 if not known.
+         */
+        unsigned int                bitsPerSample;
+
+        /**
+         *  The format of the samples, unknown if not known.
+         */
+        SampleFormat::Format        sampleFormat;
+
+        /**
+         *  Tells if the samples are big endian.
+         */
+        bool                        bigEndian;
+
+        /**
+         *  The number of users of the block.
+         */
+        std::atomic<unsigned int>   references;
+
+        /**
+         *  Next block in the list of free blocks of the pool.
+         */
+        AudioBlock                * next;
+
+        /**
+         *  Constructor.
+         *
+         *  @param capacity the number of bytes the block can hold.
+         */
+        inline
+        AudioBlock ( unsigned int   capacity )
+        {
+            this->data          = new unsigned char[capacity];
+            this->capacity      = capacity;
+            this->size          = 0;
+            this->frames        = 0;
+            this->timestamp     = 0;
+            this->sampleRate    = 0;
+            this->channels      = 0;
+            this->bitsPerSample = 0;
+            this->sampleFormat  = SampleFormat::unknown;
+            this->bigEndian     = false;
+            this->references    = 0;
+            this->next          = 0;
+            this->interleaved16 = 0;
+            this->planar16      = 0;
+            this->planarFloat   = 0;
+            this->mono16        = 0;
+            this->interleavedFloat = 0;
+            this->monoFloat     = 0;
+            this->viewCapacity  = 0;
+            this->resampled     = 0;
+            this->maxResampled  = 0;
+            resetViews();
+        }
+
+        /**
+         *  Destructor.
+         */
+        inline
+        ~AudioBlock ( void )
+        {
+            delete[] data;
+            delete[] interleaved16;
+            delete[] planar16;
+            delete[] planarFloat;
+            delete[] mono16;
+            delete[] interleavedFloat;
+            delete[] monoFloat;
+            delete[] resampled;
+        }
+
+        /**
+         *  Forget the views made of the previous contents of the block.
+         *  Call when the block is filled anew. The view buffers are kept,
+         *  to be reused.
+         */
+        inline void
+        resetViews ( void )                                 throw ()
+        {
+            interleaved16State.store( viewEmpty, std::memory_order_relaxed);
+            planar16State.store( viewEmpty, std::memory_order_relaxed);
+            planarFloatState.store( viewEmpty, std::memory_order_relaxed);
+            mono16State.store( viewEmpty, std::memory_order_relaxed);
+            interleavedFloatState.store( viewEmpty, std::memory_order_relaxed);
+            monoFloatState.store( viewEmpty, std::memory_order_relaxed);
+            numResampled = 0;
+        }
+
+        /**
+         *  Tell if the block can be presented through the views.
+         *
+         *  @return true if the format of the block is known.
+         */
+        inline bool
+        hasViews ( void ) const                             throw ()
+        {
+            return channels > 0
+                && sampleFormat != SampleFormat::unknown;
+        }
+
+        /**
+         *  Get the audio as 16 bit samples, channels interleaved.
+         *  The samples are the same as SampleFormat::toInt16() would
+         *  make.
+         *
+         *  @return frames * channels samples, or NULL if
+         *          the block has no views.
+         *  @exception Exception
+         */
+        const int16_t *
+        getInterleaved16 ( void );
+
+        /**
+         *  Get one channel of the audio as 16 bit samples.
+         *
+         *  @param channel the channel to get, from 0.
+         *  @return frames samples, or NULL if the block has no views.
+         *  @exception Exception
+         */
+        const int16_t *
+        getPlanar16 ( unsigned int      channel );
+
+        /**
+         *  Get one channel of the audio as float samples in [-1, 1].
+         *  The samples are the same as Util::conv() would make
+         *  from the 16 bit samples, or for audio wider than 16 bits,
+         *  as SampleFormat::toFloat() makes from the raw data.
+         *
+         *  @param channel the channel to get, from 0.
+         *  @return frames samples, or NULL if the block has no views.
+         *  @exception Exception
+         */
+        const float *
+        getPlanarFloat ( unsigned int   channel );
+
+        /**
+         *  Get the audio as float samples in [-1, 1], channels
+         *  interleaved. The samples are the same as in
+         *  getPlanarFloat().
+         *
+         *  @return frames * channels samples, or NULL if
+         *          the block has no views.
+         *  @exception Exception
+         */
+        const float *
+        getInterleavedFloat ( void );
+
+        /**
+         *  Get the audio mixed down to mono, as 16 bit samples.
+         *  Each sample is the average of all channels, rounded towards
+         *  zero. For mono audio this is the interleaved view itself.
+         *
+         *  @return frames samples, or NULL if the block has no views.
+         *  @exception Exception
+         */
+        const int16_t *
+        getMono16 ( void );
+
+        /**
+         *  Get the audio mixed down to mono, as float samples.
+         *  Each sample is the average of all channels of the float
+         *  view, keeping its precision. For mono audio this is the
+         *  interleaved float view itself.
+         *
+         *  @return frames samples, or NULL if the block has no views.
+         *  @exception Exception
+         */
+        const float *
+        getMonoFloat ( void );
+
+        /**
+         *  Get a buffer to put the audio of the block at another sample
+         *  rate into. Only for the one filling the block, before the
+         *  block is handed to others. The audio becomes part of the
+         *  block only with setResampledFrames(), so that a failed
+         *  conversion leaves no trace.
+         *
+         *  @param sampleRate the sample rate of the samples.
+         *  @param channels the number of channels of the samples.
+         *  @param frames the maximum number of sample frames.
+         *  @return a buffer for frames * channels float samples.
+         *  @exception Exception
+         */
+        float *
+        addResampled (  unsigned int    sampleRate,
+                        unsigned int    channels,
+                        unsigned int    frames );
+
+        /**
+         *  Set the number of sample frames put into the buffer
+         *  got by the last call to addResampled(), and make the
+         *  audio part of the block.
+         *
+         *  @param frames the number of sample frames.
+         */
+        inline void
+        setResampledFrames ( unsigned int   frames )        throw ()
+        {
+            Resampled     * r = resampled + numResampled++;
+
+            r->frames = frames;
+            r->samples16State.store( viewEmpty, std::memory_order_relaxed);
+        }
+
+        /**
+         *  Get the audio of the block at another sample rate, if
+         *  it was added to the block, as float samples.
+         *
+         *  @param sampleRate the sample rate wanted.
+         *  @param channels the number of channels wanted.
+         *  @param frames return the number of sample frames here.
+         *  @return the float samples, channels interleaved, or NULL
+         *          if the block has no such audio.
+         */
+        const float *
+        getResampledFloat ( unsigned int    sampleRate,
+                            unsigned int    channels,
+                            unsigned int  & frames ) const  throw ();
+
+        /**
+         *  Get the audio of the block at another sample rate, if
+         *  it was added to the block, as 16 bit samples. These are
+         *  made from the float samples on first request.
+         *
+         *  @param sampleRate the sample rate wanted.
+         *  @param channels the number of channels wanted.
+         *  @param frames return the number of sample frames here.
+         *  @return the 16 bit samples, channels interleaved, or NULL
+         *          if the block has no such audio.
+         */
+        const int16_t *
+        getResampled16 (    unsigned int    sampleRate,
+                            unsigned int    channels,
+                            unsigned int  & frames )        throw ();
+
+        /**
+         *  Set the number of bytes of audio in the block, and the number
+         *  of sample frames along with it.
+         *
+         *  @param size the number of bytes of audio in the block.
+         */
+        inline void
+        setSize ( unsigned int  size )                      throw ()
+        {
+            unsigned int    frameSize = channels * (bitsPerSample / 8);
+
+            this->size   = size;
+            this->frames = frameSize ? size / frameSize : 0;
+        }
+};
+
+
+/* ================================================= external data structures */
+
+
+/* ====================================================== function prototypes */
+
+
+
+#endif  /* AUDIO_BLOCK_H */
+
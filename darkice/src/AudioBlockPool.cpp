@@ -0,0 +1,202 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : AudioBlockPool.cpp
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "AudioBlockPool.h"
+
+
+/* ===================================================  local data structures */
+
+
+/* ================================================  local constants & macros */
+
+/*------------------------------------------------------------------------------
+ *  File identity
+ *----------------------------------------------------------------------------*/
+static const char fileid[] = "$Id$";
+
+
+/* ===============================================  local function prototypes */
+
+
+/* =============================================================  module code */
+
+/*------------------------------------------------------------------------------
+ *  Constructor
+ *----------------------------------------------------------------------------*/
+AudioBlockPool :: AudioBlockPool ( void )
+{
+    freeBlocks    = 0;
+    blockSize     = 0;
+    numBlocks     = 0;
+    numGrown      = 0;
+    sampleRate    = 0;
+    channels      = 0;
+    bitsPerSample = 0;
+    sampleFormat  = SampleFormat::unknown;
+    bigEndian     = false;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Destructor
+ *----------------------------------------------------------------------------*/
+AudioBlockPool :: ~AudioBlockPool ( void )                  throw ()
+{
+    clear();
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Set the format of the audio in the blocks
+ *----------------------------------------------------------------------------*/
+void
+AudioBlockPool :: setFormat ( unsigned int            sampleRate,
+                              unsigned int            channels,
+                              SampleFormat::Format    sampleFormat,
+                              bool                    bigEndian )
+                                                            throw ()
+{
+    this->sampleRate    = sampleRate;
+    this->channels      = channels;
+    this->bitsPerSample = SampleFormat::getBytes( sampleFormat) * 8;
+    this->sampleFormat  = sampleFormat;
+    this->bigEndian     = bigEndian;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Allocate the blocks up front
+ *----------------------------------------------------------------------------*/
+void
+AudioBlockPool :: reserve ( unsigned int    blocks,
+                            unsigned int    blockSize )
+{
+    if ( blockSize != this->blockSize ) {
+        clear();
+        this->blockSize = blockSize;
+    }
+
+    while ( numBlocks < blocks ) {
+        pushFree( new AudioBlock( blockSize));
+        ++numBlocks;
+    }
+    numGrown = 0;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Put a block onto the free stack
+ *----------------------------------------------------------------------------*/
+void
+AudioBlockPool :: pushFree ( AudioBlock   * block )         throw ()
+{
+    AudioBlock    * top = freeBlocks.load( std::memory_order_relaxed);
+
+    do {
+        block->next = top;
+    } while ( !freeBlocks.compare_exchange_weak( top,
+                                                 block,
+                                                 std::memory_order_release,
+                                                 std::memory_order_relaxed) );
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Take a block from the free stack
+ *----------------------------------------------------------------------------*/
+AudioBlock *
+AudioBlockPool :: acquire ( void )
+{
+    AudioBlock    * block = freeBlocks.load( std::memory_order_acquire);
+
+    // there is only one taker, so a block seen on top stays there
+    // until we take it, only others may be pushed above it
+    while ( block && !freeBlocks.compare_exchange_weak(
+                                                block,
+                                                block->next,
+                                                std::memory_order_acquire,
+                                                std::memory_order_acquire) );
+
+    if ( !block ) {
+        block = new AudioBlock( blockSize);
+        ++numBlocks;
+        ++numGrown;
+    }
+
+    block->size          = 0;
+    block->frames        = 0;
+    block->timestamp     = 0;
+    block->sampleRate    = sampleRate;
+    block->channels      = channels;
+    block->bitsPerSample = bitsPerSample;
+    block->sampleFormat  = sampleFormat;
+    block->bigEndian     = bigEndian;
+    block->references    = 1;
+    block->next          = 0;
+    block->resetViews();
+
+    return block;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Drop a reference to a block, and put it back if it's not used anymore
+ *----------------------------------------------------------------------------*/
+void
+AudioBlockPool :: release ( AudioBlock    * block )         throw ()
+{
+    if ( block->references.fetch_sub( 1, std::memory_order_acq_rel) == 1 ) {
+        pushFree( block);
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Delete all the free blocks
+ *----------------------------------------------------------------------------*/
+void
+AudioBlockPool :: clear ( void )                            throw ()
+{
+    AudioBlock    * block = freeBlocks.exchange( 0);
+
+    while ( block ) {
+        AudioBlock    * next = block->next;
+
+        delete block;
+        --numBlocks;
+        block = next;
+    }
+}
+
@@ -0,0 +1,232 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : AudioBlockPool.h
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+#ifndef AUDIO_BLOCK_POOL_H
+#define AUDIO_BLOCK_POOL_H
+
+#ifndef __cplusplus
+#error This is a C++ include file
+#endif
+
+
+/* ============================================================ include files */
+
+#include <atomic>
+
+#include "AudioBlock.h"
+
+
+/* ================================================================ constants */
+
+
+/* =================================================================== macros */
+
+
+/* =============================================================== data types */
+
+/**
+ *  A pool of AudioBlocks of the same size, allocated up front, so that
+ *  passing audio around does not allocate memory.
+ *
+ *  The free blocks are kept on a lock-free stack. Any thread may
+ *  release blocks, but only one thread at a time may acquire them,
+ *  which keeps the stack safe from a block being taken and put back
+ *  while another thread is taking it.
+ *
+ *  @author  $Author$
+ *  @version $Revision$
+ */
+class AudioBlockPool
+{
+    private:
+
+        /**
+         *  The top of the stack of free blocks.
+         */
+        std::atomic<AudioBlock*>    freeBlocks;
+
+        /**
+         *  The number of bytes each block holds.
+         */
+        unsigned int                blockSize;
+
+        /**
+         *  The number of blocks allocated.
+         */
+        std::atomic<unsigned int>   numBlocks;
+
+        /**
+         *  The number of blocks allocated because the pool ran empty,
+         *  after reserve() was called.
+         */
+        std::atomic<unsigned int>   numGrown;
+
+        /**
+         *  The sample rate of the audio put into the blocks.
+         */
+        unsigned int                sampleRate;
+
+        /**
+         *  The number of channels of the audio put into the blocks.
+         */
+        unsigned int                channels;
+
+        /**
+         *  The number of bits per sample of the audio put into the blocks.
+         */
+        unsigned int                bitsPerSample;
+
+        /**
+         *  The format of the samples put into the blocks.
+         */
+        SampleFormat::Format        sampleFormat;
+
+        /**
+         *  Tells if the audio put into the blocks is big endian.
+         */
+        bool                        bigEndian;
+
+        /**
+         *  Put a block onto the stack of free blocks.
+         *
+         *  @param block the block to put.
+         */
+        void
+        pushFree ( AudioBlock     * block )                 throw ();
+
+        /**
+         *  Copy constructor. Not supported.
+         */
+        AudioBlockPool ( const AudioBlockPool &     pool );
+
+        /**
+         *  Assignment operator. Not supported.
+         */
+        AudioBlockPool &
+        operator= ( const AudioBlockPool &          pool );
+
+
+    public:
+
+        /**
+         *  Constructor. The pool is empty until reserve() is called.
+         */
+        AudioBlockPool ( void );
+
+        /**
+         *  Destructor. All blocks must have been released.
+         */
+        ~AudioBlockPool ( void )                            throw ();
+
+        /**
+         *  Set the format of the audio put into the blocks, to be
+         *  recorded with each block acquired.
+         *
+         *  @param sampleRate the sample rate, 0 if not known.
+         *  @param channels the number of channels, 0 if not known.
+         *  @param sampleFormat the format of the samples,
+         *                      unknown if not known.
+         *  @param bigEndian tells if the samples are big endian.
+         */
+        void
+        setFormat ( unsigned int            sampleRate,
+                    unsigned int            channels,
+                    SampleFormat::Format    sampleFormat,
+                    bool                    bigEndian )     throw ();
+
+        /**
+         *  Make sure the pool has at least a number of blocks of a size.
+         *  If the size differs from the blocks in the pool, those are
+         *  freed first. Must not be called while any block is in use.
+         *
+         *  @param blocks the number of blocks to have.
+         *  @param blockSize the number of bytes each block holds.
+         */
+        void
+        reserve ( unsigned int      blocks,
+                  unsigned int      blockSize );
+
+        /**
+         *  Take a free block from the pool. Allocates a new block if the
+         *  pool is empty. Only one thread at a time may acquire blocks.
+         *
+         *  @return a block with no audio, one reference, and the format
+         *          of the pool.
+         */
+        AudioBlock *
+        acquire ( void );
+
+        /**
+         *  Drop a reference to a block. The block goes back to the pool
+         *  when there are no references left. May be called by any thread.
+         *
+         *  @param block the block to drop a reference to.
+         */
+        void
+        release ( AudioBlock      * block )                 throw ();
+
+        /**
+         *  Free all the blocks not in use.
+         */
+        void
+        clear ( void )                                      throw ();
+
+        /**
+         *  Get the number of blocks allocated.
+         *
+         *  @return the number of blocks allocated.
+         */
+        inline unsigned int
+        getNumBlocks ( void ) const                         throw ()
+        {
+            return numBlocks;
+        }
+
+        /**
+         *  Get the number of blocks allocated because the pool ran empty.
+         *  Should stay 0 if the pool was reserved big enough.
+         *
+         *  @return the number of blocks allocated on demand.
+         */
+        inline unsigned int
+        getNumGrown ( void ) const                          throw ()
+        {
+            return numGrown;
+        }
+};
+
+
+/* ================================================= external data structures */
+
+
+/* ====================================================== function prototypes */
+
+
+
+#endif  /* AUDIO_BLOCK_POOL_H */
+
@@ -39,6 +39,7 @@
 #include "Referable.h"
 #include "Sink.h"
 #include "AudioSource.h"
+#include "AudioBlock.h"
 
 
 /* ================================================================ constants */
@@ -86,6 +87,11 @@ class AudioEncoder : public Sink, public virtual Referable
          */
         unsigned int        inBitsPerSample;
 
+        /**
+         *  The format of the samples of the input.
+         */
+        SampleFormat::Format    inSampleFormat;
+
         /**
          *  Number of channels of the input.
          */
@@ -150,6 +156,7 @@ class AudioEncoder : public Sink, public virtual Referable
             this->sink             = sink;
             this->inSampleRate     = inSampleRate;
             this->inBitsPerSample  = inBitsPerSample;
+            this->inSampleFormat   = SampleFormat::fromBits( inBitsPerSample);
             this->inChannel        = inChannel;
             this->inBigEndian      = inBigEndian;
             this->outBitrateMode   = outBitrateMode;
@@ -262,6 +269,7 @@ class AudioEncoder : public Sink, public virtual Referable
                   outQuality,
                   outSampleRate ? outSampleRate : as->getSampleRate(),
                   outChannel    ? outChannel    : as->getChannel() );
+            inSampleFormat = as->getSampleFormat();
         }
 
         /**
@@ -282,6 +290,59 @@ class AudioEncoder : public Sink, public virtual Referable
                    encoder.outQuality,
                    encoder.outSampleRate,
                    encoder.outChannel );
+            inSampleFormat = encoder.inSampleFormat;
+        }
+
+        /**
+         *  Tell if the sample views of a block can be used in place of
+         *  its raw data, that is, if the block holds audio in the
+         *  input format of the encoder.
+         *
+         *  @param block the block to check.
+         *  @return true if the views of the block can be used.
+         */
+        inline bool
+        canUseViews ( const AudioBlock    * block ) const   throw ()
+        {
+            return block->hasViews()
+                && block->channels      == inChannel
+                && block->sampleFormat  == inSampleFormat
+                && block->bigEndian     == inBigEndian;
+        }
+
+        /**
+         *  Convert raw input of samples wider than 16 bits into 16 bit
+         *  samples, for the write() of encoders that work on those.
+         *  The views of the blocks given to writeBlock() keep the
+         *  precision instead.
+         *
+         *  @param buf the raw input.
+         *  @param len the number of bytes in buf, set to the number of
+         *             bytes of the 16 bit samples if converted.
+         *  @return the 16 bit samples in the byte order of this machine,
+         *          to be freed with delete[], or NULL if the input is
+         *          not wider than 16 bits.
+         *  @exception Exception
+         */
+        inline int16_t *
+        narrowInput (   const void    * buf,
+                        unsigned int  & len ) const
+        {
+            if ( !SampleFormat::isWide( inSampleFormat) ) {
+                return 0;
+            }
+
+            unsigned int    samples = len / (inBitsPerSample / 8);
+            int16_t       * narrow  = new int16_t[samples];
+
+            SampleFormat::toInt16( inSampleFormat,
+                                   (const unsigned char *) buf,
+                                   samples,
+                                   narrow,
+                                   inBigEndian);
+            len = samples * sizeof(int16_t);
+
+            return narrow;
         }
 
         /**
@@ -307,6 +368,7 @@ class AudioEncoder : public Sink, public virtual Referable
                        encoder.outQuality,
                        encoder.outSampleRate,
                        encoder.outChannel );
+                inSampleFormat = encoder.inSampleFormat;
             }
 
             return *this;
@@ -381,6 +443,17 @@ class AudioEncoder : public Sink, public virtual Referable
             return inBitsPerSample;
         }
 
+        /**
+         *  Get the format of the samples of the input.
+         *
+         *  @return the format of the samples of the input.
+         */
+        inline SampleFormat::Format
+        getInSampleFormat ( void ) const    throw ()
+        {
+            return inSampleFormat;
+        }
+
         /**
          *  Get the number of channels of the output.
          *
@@ -464,6 +537,37 @@ class AudioEncoder : public Sink, public virtual Referable
         virtual void
         stop ( void )                                               = 0;
 
+        /**
+         *  Tell if the encoder can take its input already resampled to
+         *  its output sample rate, from the views of the blocks given
+         *  to writeBlock(). The connector then may resample once for
+         *  all encoders that need the same conversion.
+         *
+         *  @return true if the encoder takes resampled blocks.
+         */
+        inline virtual bool
+        canTakeResampled ( void ) const                 throw ()
+        {
+            return false;
+        }
+
+        /**
+         *  Encode a block of audio. Encoders that work on converted
+         *  samples override this to take the prepared views of the
+         *  block, instead of converting the raw data themselves. The
+         *  block is shared with other encoders, and must not be changed.
+         *  By default the raw data of the block is encoded by write().
+         *
+         *  @param block the audio to encode.
+         *  @return the number of bytes of the block processed.
+         *  @exception Exception
+         */
+        inline virtual unsigned int
+        writeBlock ( AudioBlock       * block )
+        {
+            return write( block->data, block->size);
+        }
+
         /**
          *  Cut what the sink has been doing so far, and start anew.
          *  This usually means separating the data sent to the sink up
@@ -54,6 +54,22 @@ static const char fileid[] = "$Id$";
 
 /* =============================================================  module code */
 
+/*------------------------------------------------------------------------------
+ *  Convert a pacing name to a Pacing
+ *----------------------------------------------------------------------------*/
+AudioSource::Pacing
+AudioSource :: strToPacing ( const char   * name )
+{
+    if ( Util::strEq( name, "realtime") ) {
+        return realtime;
+    } else if ( Util::strEq( name, "batch") ) {
+        return batch;
+    }
+
+    throw Exception( __FILE__, __LINE__, "invalid pacing: ", name);
+}
+
+
 /*------------------------------------------------------------------------------
  *  Return an audio source based on the compiled DSP supports and the
  *  supplied device name parameter.
@@ -67,7 +83,27 @@ AudioSource :: createDspSource( const char    * deviceName,
                                 int             channel)
 {
     
-    if ( Util::strEq( deviceName, "/dev/tty", 8) ) {
+    if ( Util::strEq( deviceName, "file:", 5) ) {
+        Reporter::reportEvent( 1, "Using file input:", deviceName + 5);
+        return new FileSource( deviceName + 5,
+                               sampleRate,
+                               bitsPerSample,
+                               channel);
+    } else if ( Util::strEq( deviceName, "stdin") ) {
+        Reporter::reportEvent( 1, "Using the standard input as input.");
+        return new FileSource( "-",
+                               sampleRate,
+                               bitsPerSample,
+                               channel);
+    } else if ( Util::strEq( deviceName, "generator", 9) ) {
+        const char    * signal = deviceName[9] == ':' ? deviceName + 10
+                                                      : "sine";
+        Reporter::reportEvent( 1, "Using the signal generator:", signal);
+        return new GeneratorSource( GeneratorSource::strToSignal( signal),
+                                    sampleRate,
+                                    bitsPerSample,
+                                    channel);
+    } else if ( Util::strEq( deviceName, "/dev/tty", 8) ) {
 #if defined( SUPPORT_SERIAL_ULAW )
         Reporter::reportEvent( 1, "Using Serial Ulaw input device:",
                                   deviceName);
@@ -41,6 +41,7 @@
 
 #include "Source.h"
 #include "Reporter.h"
+#include "SampleFormat.h"
 
 
 /* ================================================================ constants */
@@ -101,6 +102,15 @@
  */
 class AudioSource : public Source, public virtual Reporter
 {
+    public:
+
+        /**
+         *  How fast a source that is not a sound card hands out audio.
+         *  realtime: at the sample rate, batch: as fast as it is read.
+         */
+        enum Pacing { realtime, batch };
+
+
     private:
 
         /**
@@ -119,6 +129,11 @@ class AudioSource : public Source, public virtual Reporter
          */
         unsigned int    bitsPerSample;
 
+        /**
+         *  The format of the samples.
+         */
+        SampleFormat::Format    sampleFormat;
+
         /**
          *  Initialize the object.
          *
@@ -135,6 +150,7 @@ class AudioSource : public Source, public virtual Reporter
             this->sampleRate     = sampleRate;
             this->bitsPerSample  = bitsPerSample;
             this->channel        = channel;
+            this->sampleFormat   = SampleFormat::fromBits( bitsPerSample);
         }
 
         /**
@@ -180,6 +196,7 @@ class AudioSource : public Source, public virtual Reporter
             : Source( as )
         {
             init ( as.sampleRate, as.bitsPerSample, as.channel);
+            sampleFormat = as.sampleFormat;
         }
 
         /**
@@ -196,6 +213,7 @@ class AudioSource : public Source, public virtual Reporter
                 strip();
                 Source::operator=( as );
                 init ( as.sampleRate, as.bitsPerSample, as.channel);
+                sampleFormat = as.sampleFormat;
             }
 
             return *this;
@@ -263,6 +281,76 @@ class AudioSource : public Source, public virtual Reporter
             return bitsPerSample;
         }
 
+        /**
+         *  Get the format of the samples of this AudioSource.
+         *
+         *  @return the format of the samples.
+         */
+        inline SampleFormat::Format
+        getSampleFormat ( void ) const      throw ()
+        {
+            return sampleFormat;
+        }
+
+        /**
+         *  Set the format of the samples to read, in place of the
+         *  integer samples of the bits per sample given at construction.
+         *  Call before open(). A source that can not read samples of
+         *  the format fails to open.
+         *
+         *  @param sampleFormat the format of the samples.
+         */
+        inline void
+        setSampleFormat ( SampleFormat::Format  sampleFormat )  throw ()
+        {
+            this->sampleFormat  = sampleFormat;
+            this->bitsPerSample = SampleFormat::getBytes( sampleFormat) * 8;
+        }
+
+        /**
+         *  Get the number of times the device dropped audio because
+         *  it was not read in time, since the source was opened.
+         *
+         *  @return the number of overruns, 0 if the source can't tell.
+         */
+        inline virtual unsigned long
+        getOverruns ( void ) const          throw ()
+        {
+            return 0;
+        }
+
+        /**
+         *  Set how fast the source hands out audio. Call before open().
+         *  A sound card is paced by its own clock, and ignores this.
+         *
+         *  @param pacing the pacing.
+         */
+        inline virtual void
+        setPacing ( Pacing      pacing )            throw ()
+        {
+        }
+
+        /**
+         *  Get how fast the source hands out audio.
+         *
+         *  @return the pacing.
+         */
+        inline virtual Pacing
+        getPacing ( void ) const            throw ()
+        {
+            return realtime;
+        }
+
+        /**
+         *  Convert a pacing name, "realtime" or "batch", to a Pacing.
+         *
+         *  @param name the name of the pacing.
+         *  @return the pacing.
+         *  @exception Exception if the name is not a pacing.
+         */
+        static Pacing
+        strToPacing ( const char      * name );
+
         /**
          *  Get the number of bytes for a sample for each channel
          *  (returns 4 bytes for 16 bits par sample in stereo)
@@ -280,7 +368,10 @@ class AudioSource : public Source, public virtual Reporter
          *  appropriate type, based on the compiled DSP support and
          *  the supplied DSP name parameter.
          *
-         *  @param deviceName the audio device (/dev/dspX, hwplug:0,0, etc)
+         *  @param deviceName the audio device (/dev/dspX, hwplug:0,0, etc),
+         *                    file:name for a file, stdin for the
+         *                    standard input, generator:signal for
+         *                    a test signal
          *  @param jackClientName the source name for jack server
          *  @param paSourceName the pulse audio source
          *  @param sampleRate samples per second (e.g. 44100 for 44.1kHz).
@@ -329,6 +420,9 @@ class AudioSource : public Source, public virtual Reporter
 #include "SerialUlaw.h"
 #endif
 
+#include "FileSource.h"
+#include "GeneratorSource.h"
+
 
 /* ====================================================== function prototypes */
 
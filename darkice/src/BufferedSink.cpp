@@ -9,19 +9,16 @@
    Author   : $Author$
    Location : $HeadURL$
    
-     the buffer is filled like this:
-     
-     buffer                                         bufferEnd
-      |                                                    |
-      +----------+--------------------------+--------------+
-                 |<---- valid data -------->|
-                outp                       inp 
+     the buffer is filled like this, the same memory mapped twice:
 
-     buffer                                         bufferEnd
-      |                                                    |
-      +----------------+--------------+--------------------+
-      -- valid data -->|              |--- valid data ----->
-                      inp            outp
+     buffer                  buffer + bufferSize     buffer + 2 * bufferSize
+      |                               |                               |
+      +-------+--------------+--------+-------+--------------+--------+
+      - data >|              |<----- valid data ----->|
+             inp            outp
+
+     where outp = sent % bufferSize and inp = queued % bufferSize,
+     so the valid data always starts at outp, in one piece
 
 
 
@@ -55,8 +52,28 @@
 #error need string.h
 #endif
 
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#else
+#error need errno.h
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#else
+#error need unistd.h
+#endif
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#else
+#error need sys/mman.h
+#endif
+
 
 #include "Exception.h"
+#include "Util.h"
+#include "CastSink.h"
 #include "BufferedSink.h"
 
 
@@ -90,17 +107,26 @@ BufferedSink :: init (  Sink          * sink,
 
     this->sink         = sink;                    // create a reference
     this->chunkSize    = chunkSize ? chunkSize : 1;
-    this->bufferSize   = size;
-    // make bufferSize a multiple of chunkSize
-    this->bufferSize  -= this->bufferSize % this->chunkSize;
     this->peak         = 0;
-    this->misalignment = 0;
-    this->buffer       = new unsigned char[bufferSize];
-    this->bufferEnd    = buffer + bufferSize;
-    this->inp          = buffer;
-    this->outp         = buffer;
+    this->bufferSize   = size;
+    this->buffer       = 0;                       // made when first written
+    this->mapped       = false;
     this->bOpen        = true;
     this->openAttempts = 0; 
+    this->selfReopen   = true;
+    this->network      = 0;
+    this->socket       = 0;
+    this->slot         = -1;
+    this->queued.store( 0);
+    this->sent.store( 0);
+    this->overruns     = 0;
+    this->spill        = 0;
+    this->reopenAt     = 0;
+    this->byteRate     = 0;
+    this->paceRate     = 0;
+    this->paceBurst    = 0;
+    this->tokens       = 0.0;
+    this->tokensAt     = 0;
 }
 
 
@@ -112,10 +138,15 @@ BufferedSink :: BufferedSink (  const BufferedSink &  buffer )
     init( buffer.sink.get(), buffer.bufferSize, buffer.chunkSize);
 
     this->peak         = buffer.peak;
-    this->misalignment = buffer.misalignment;
     this->bOpen        = buffer.bOpen;
     this->openAttempts = buffer.openAttempts; 
-    memcpy( this->buffer, buffer.buffer, this->bufferSize);
+    this->selfReopen   = buffer.selfReopen;
+    this->queued.store( buffer.queued.load());
+    this->sent.store( buffer.sent.load());
+    if ( buffer.buffer ) {
+        mapBuffer();
+        put( 0, buffer.buffer, this->bufferSize);
+    }
 }
 
 
@@ -130,7 +161,109 @@ BufferedSink :: strip ( void )
     }
 
     sink = 0;                                   // delete the reference
-    delete buffer;
+    unmapBuffer();
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Map the buffer twice, back to back
+ *----------------------------------------------------------------------------*/
+void
+BufferedSink :: mapBuffer ( void )
+{
+    long    pageSize = sysconf( _SC_PAGESIZE);
+
+    if ( pageSize <= 0 ) {
+        pageSize = 4096;
+    }
+
+    // the halves are mapped at page boundaries
+    bufferSize = bufferSize ? ((bufferSize + pageSize - 1) / pageSize)
+                              * pageSize
+                            : pageSize;
+    mapped     = false;
+
+#ifdef HAVE_MEMFD_CREATE
+    int             fd;
+    unsigned char * p;
+
+    // reserve room for both halves, then map the same memory into each
+    fd = memfd_create( "BufferedSink", MFD_CLOEXEC);
+    if ( fd != -1 && ftruncate( fd, bufferSize) == 0 ) {
+        p = (unsigned char *) mmap( 0, 2 * bufferSize, PROT_NONE,
+                                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if ( p != MAP_FAILED ) {
+            if ( mmap( p, bufferSize, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED
+              && mmap( p + bufferSize, bufferSize, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED ) {
+                ::close( fd);
+                buffer = p;
+                mapped = true;
+                return;
+            }
+            munmap( p, 2 * bufferSize);
+        }
+    }
+    reportEvent( 4, "BufferedSink, can't map the buffer twice, "
+                    "copying instead", errno);
+    if ( fd != -1 ) {
+        ::close( fd);
+    }
+#endif
+
+    buffer = new unsigned char[2 * bufferSize];
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Release the buffer
+ *----------------------------------------------------------------------------*/
+void
+BufferedSink :: unmapBuffer ( void )                        throw ()
+{
+    if ( !buffer ) {
+        return;
+    }
+    if ( mapped ) {
+        munmap( buffer, 2 * bufferSize);
+    } else {
+        delete[] buffer;
+    }
+    buffer = 0;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Copy data into the buffer
+ *----------------------------------------------------------------------------*/
+void
+BufferedSink :: put (   unsigned int            pos,
+                        const unsigned char   * buf,
+                        unsigned int            len )       throw ()
+{
+    memcpy( buffer + pos, buf, len);
+    mirror( pos, len);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Keep the two halves of the buffer the same
+ *----------------------------------------------------------------------------*/
+void
+BufferedSink :: mirror (    unsigned int        pos,
+                            unsigned int        len )       throw ()
+{
+    if ( mapped ) {
+        return;
+    }
+
+    if ( pos + len <= bufferSize ) {
+        memcpy( buffer + bufferSize + pos, buffer + pos, len);
+    } else {
+        memcpy( buffer + bufferSize + pos, buffer + pos, bufferSize - pos);
+        memcpy( buffer, buffer + bufferSize, pos + len - bufferSize);
+    }
 }
 
 
@@ -146,10 +279,15 @@ BufferedSink :: operator= (     const BufferedSink &  buffer )
         init( buffer.sink.get(), buffer.bufferSize, buffer.chunkSize);
         
         this->peak         = buffer.peak;
-        this->misalignment = buffer.misalignment;
         this->bOpen        = buffer.bOpen;
         this->openAttempts = buffer.openAttempts;
-        memcpy( this->buffer, buffer.buffer, this->bufferSize);
+        this->selfReopen   = buffer.selfReopen;
+        this->queued.store( buffer.queued.load());
+        this->sent.store( buffer.sent.load());
+        if ( buffer.buffer ) {
+            mapBuffer();
+            put( 0, buffer.buffer, this->bufferSize);
+        }
     }
 
     return *this;
@@ -158,20 +296,16 @@ BufferedSink :: operator= (     const BufferedSink &  buffer )
 
 /*------------------------------------------------------------------------------
  *  Store bufferSize bytes into the buffer
- *  All data is consumed. The return value is less then bufferSize only
- *  if the BufferedSink's internal buffer is smaller than bufferSize,
- *  thus can't hold that much
- *  The data to be stored is treated as parts with chunkSize size
- *  Only full chunkSize sized parts are stored
+ *  Either all data is stored, or none of it, if it doesn't fit. The data
+ *  already in the buffer is kept, as the network thread may be sending
+ *  the oldest of it right now
  *----------------------------------------------------------------------------*/
 unsigned int
 BufferedSink :: store (     const void    * buffer,
                             unsigned int    bufferSize )
 {
-    const unsigned char   * buf;
-    unsigned int            size;
-    unsigned int            i;
-    unsigned char         * oldInp;
+    unsigned long long  q;
+    unsigned int        used;
 
     if ( !buffer ) {
         throw Exception( __FILE__, __LINE__, "buffer is null");
@@ -181,113 +315,175 @@ BufferedSink :: store (     const void    * buffer,
         return 0;
     }
 
-    unsigned int remaining = this->bufferSize - ( outp <= inp ? inp - outp : 
-                             (bufferEnd - outp) + (inp - this->buffer) );
-
-    // react only to the first overrun whenever there is a series of overruns
-    if ( remaining + chunkSize <= bufferSize && remaining > chunkSize  ) {
-        reportEvent(3,"BufferedSink :: store, buffer overrun");
-        throw Exception( __FILE__, __LINE__,
-                         "buffer overrun");
+    // outputs that never get to write don't take up memory
+    if ( !this->buffer ) {
+        mapBuffer();
+        reportEvent( 4, "BufferedSink, buffer of", this->bufferSize,
+                     mapped ? "bytes, mapped twice" : "bytes");
     }
 
-    oldInp = inp;
-    buf    = (const unsigned char *) buffer;
-    
-    // adjust so it is a multiple of chunkSize
-    bufferSize -= bufferSize % chunkSize;
+    q    = queued.load( std::memory_order_relaxed);
+    used = q - sent.load( std::memory_order_acquire);
 
-    // cut the front of the supplied buffer if it wouldn't fit
-    if ( bufferSize > this->bufferSize ) {
-        size  = this->bufferSize - 1;
-        size -= size % chunkSize;       // keep it a multiple of chunkSize
-        buf  += bufferSize - size;
-    } else {
-        size = bufferSize;
+    // once spilling, all goes to the spill until it is moved back,
+    // so that nothing overtakes what is there
+    if ( spill != 0
+      && (!spill->isEmpty() || bufferSize > this->bufferSize - used) ) {
+        if ( spill->isEmpty() ) {
+            reportEvent( 2, "BufferedSink, spilling to",
+                         spill->getFileName());
+        }
+        if ( spill->append( (const unsigned char *) buffer, bufferSize) ) {
+            return bufferSize;
+        }
     }
 
-    // copy the data into the buffer
-    i = bufferEnd - inp;
-    if ( (i % chunkSize) != 0 ) {
-        throw Exception( __FILE__, __LINE__, "copy quantity not aligned", i);
+    if ( bufferSize > this->bufferSize - used
+      || (spill != 0 && !spill->isEmpty()) ) {
+        ++overruns;
+        if ( (overruns & (overruns - 1)) == 0 ) {
+            reportEvent( 3, "BufferedSink :: store, buffer overrun, "
+                            "writes dropped:", overruns);
+        }
+        return 0;
     }
 
-    if ( size <= i ) {
-        // the place between inp and bufferEnd is
-        // big enough to hold the data
-        
-        memcpy( inp, buf, size);
-        inp = slidePointer( inp, size);
+    put( q % this->bufferSize, (const unsigned char *) buffer, bufferSize);
+    queued.store( q + bufferSize, std::memory_order_release);
+
+    return bufferSize;
+}
 
-        // adjust outp, lose the data that was overwritten, if any
-        if ( outp > oldInp && outp <= inp ) {
-            outp = slidePointer( inp, chunkSize);
-        }
 
+/*------------------------------------------------------------------------------
+ *  Let a network thread send the buffer
+ *----------------------------------------------------------------------------*/
+void
+BufferedSink :: setNetworkThread (  NetworkThread  * network )
+{
+    CastSink      * castSink = dynamic_cast<CastSink*>( sink.get());
+
+    // only a socket can be sent to by the network thread
+    if ( network && castSink && castSink->getSocket() ) {
+        this->network = network;
+        this->socket  = castSink->getSocket();
     } else {
-        // the place between inp and bufferEnd is not
-        // big enough to hold the data
-        // writing will take place in two turns, once from
-        // inp -> bufferEnd, then from buffer ->
-
-        memcpy( inp, buf, i);
-        i = size - i;
-        if ( (i % chunkSize) != 0 ) {
-            throw Exception(__FILE__, __LINE__, "copy quantity not aligned", i);
-        }
-        memcpy( this->buffer, buf, i);
-        inp = slidePointer( this->buffer, i);
-        
-        // adjust outp, lose the data that was overwritten, if any
-        if ( outp <= oldInp ) {
-            if ( outp < inp ) {
-                outp = slidePointer( inp, chunkSize);
-            }
-        } else {
-            outp = slidePointer( inp, chunkSize);
-        }
+        this->network = 0;
+        this->socket  = 0;
     }
+}
 
-    updatePeak();
 
-    if ( ((inp - this->buffer) % chunkSize) != 0 ) {
-        throw Exception( __FILE__, __LINE__,
-                         "inp not aligned", inp - this->buffer);
+/*------------------------------------------------------------------------------
+ *  Keep what doesn't fit in a file
+ *----------------------------------------------------------------------------*/
+void
+BufferedSink :: setSpill (  SpillBuffer       * spill )
+{
+    this->spill = spill;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Pace sending with a token bucket
+ *----------------------------------------------------------------------------*/
+void
+BufferedSink :: setPacing ( unsigned int        byteRate,
+                            double              catchUp,
+                            double              burstSecs )
+{
+    this->byteRate  = byteRate;
+    this->paceRate  = (unsigned int) (byteRate * catchUp);
+    this->paceBurst = (unsigned int) (byteRate * burstSecs);
+    if ( this->paceBurst < chunkSize ) {
+        this->paceBurst = chunkSize;
+    }
+    this->tokens    = this->paceBurst;
+    this->tokensAt  = 0;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Let the token bucket limit the data to send
+ *----------------------------------------------------------------------------*/
+unsigned int
+BufferedSink :: pace (  unsigned int            len,
+                        unsigned long long      now )       throw ()
+{
+    if ( paceRate == 0 ) {
+        return len;
     }
-    if ( ((outp - this->buffer) % chunkSize) != 0 ) {
-        throw Exception( __FILE__, __LINE__,
-                         "outp not aligned", outp - this->buffer);
+
+    // tokens flow in by the clock, not by the data written
+    if ( tokensAt ) {
+        tokens += (now - tokensAt) * (paceRate / 1000000.0);
+        if ( tokens > paceBurst ) {
+            tokens = paceBurst;
+        }
     }
+    tokensAt = now;
 
-    return size;
+    return tokens < len ? (unsigned int) tokens : len;
 }
 
 
 /*------------------------------------------------------------------------------
- *  Write some data to the sink
- *  if len == 0, try to flush the buffer
+ *  Move the spill back into the buffer
  *----------------------------------------------------------------------------*/
-unsigned int
-BufferedSink :: write (    const void    * buf,
-                           unsigned int    len )
+void
+BufferedSink :: refill ( void )
 {
-    unsigned int    length = 0;
-    unsigned int    soFar = 0;
-    unsigned char * b = (unsigned char *) buf;
+    unsigned long long  q;
+    unsigned long long  spilled;
+    unsigned int        n;
 
-    if ( !buf ) {
-        throw Exception( __FILE__, __LINE__, "buf is null");
+    if ( spill == 0 || spill->isEmpty() || !buffer ) {
+        return;
     }
 
-    if ( !isOpen() ) {
-        return 0;
+    // as much as fits, sending it is paced anyway
+    q  = queued.load( std::memory_order_relaxed);
+    n  = bufferSize - (q - sent.load( std::memory_order_acquire));
+    n -= n % chunkSize;
+    if ( n == 0 ) {
+        return;
     }
 
-    if ( !align() ) {
-        return 0;
+    spilled = spill->getPeak();
+    n       = spill->take( buffer + q % bufferSize, n);
+    mirror( q % bufferSize, n);
+    queued.store( q + n, std::memory_order_release);
+
+    if ( spill->isEmpty() ) {
+        reportEvent( 2, "BufferedSink, caught up with spill, most bytes held:",
+                     spilled);
     }
-    
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Try to reopen the underlying sink
+ *----------------------------------------------------------------------------*/
+void
+BufferedSink :: reopen ( void )
+{
+    if ( !sink->isOpen() && !selfReopen ) {
+        // connecting may take long, and the writer can't wait for it
+        throw Exception( __FILE__, __LINE__, "underlying sink closed");
+    }
+
     if ( !sink->isOpen() && openAttempts < 10 ) {
+        if ( spill != 0 ) {
+            // the spill keeps the stream for long, so keep on trying,
+            // but not on each write, as connecting takes its time
+            unsigned long long  now = Util::getMonotonicTime();
+
+            if ( now < reopenAt ) {
+                return;
+            }
+            reopenAt = now + 1000000ULL;
+        }
+
         // try to reopen underlying sink, because it has closed on its own
         openAttempts++;
         try {
@@ -301,110 +497,202 @@ BufferedSink :: write (    const void    * buf,
                          openAttempts, "/ 10" );
         }
         
-        if( openAttempts == 10 ) {
+        if ( openAttempts == 10 && spill != 0 ) {
+            openAttempts = 0;
+        } else if( openAttempts == 10 ) {
             // all the attempts have been used, give up
             close();
             throw Exception( __FILE__, __LINE__,
                              "reopen failed");
         }
     }
+}
 
-    // make it a multiple of chunkSize
-    len -= len % chunkSize;
 
-    // try to write data from the buffer first, if any
-    if ( inp != outp ) {
-        unsigned int    size  = 0;
-        unsigned int    total = 0;
-
-        if ( outp > inp ) {
-            // valuable data is between outp -> bufferEnd and buffer -> inp
-            // try to write the outp -> bufferEnd
-            // the rest will be written in the next if
-
-            size    = bufferEnd - outp;
-            size   -= size % chunkSize;
-            if( size > len * 2 ) {
-                // do not try to send the content of the entire buffer at once,
-                // but limit sending to a multiple of len
-                // this prevents a surge of data to underlying buffer
-                // which is important especially during a lot of packet loss
-                size = len * 2;
-            }
-            soFar   = 0;
-
-            while ( outp > inp && soFar < size && sink->canWrite( 0, 0) ) {
-                try {
-                    length  = sink->write( outp + soFar, size - soFar);
-                } catch (Exception &e) {
-                    length = 0;
-                    reportEvent(3,"Exception caught in BufferedSink :: write1");
-                }
-                outp    = slidePointer( outp, length);
-                soFar  += length;
-            }
+/*------------------------------------------------------------------------------
+ *  Hand the socket to the network thread
+ *----------------------------------------------------------------------------*/
+void
+BufferedSink :: attach ( void )
+{
+    if ( slot >= 0 || !socket->isOpen() ) {
+        return;
+    }
+
+    // the login was sent blocking, from now on the thread sends
+    socket->setNonBlocking( true);
+
+    // what was queued for the previous connection is stale by now,
+    // unless it is kept for the stream to go on where it stopped
+    if ( spill == 0 ) {
+        sent.store( queued.load());
+    }
+    slot = network->add( socket->getFd(), this);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Take the socket back from the network thread
+ *----------------------------------------------------------------------------*/
+void
+BufferedSink :: detach ( void )                             throw ()
+{
+    if ( slot < 0 ) {
+        return;
+    }
+
+    network->remove( slot);
+    slot = -1;
+}
+
 
-            total += soFar;
+/*------------------------------------------------------------------------------
+ *  Append data for the network thread to send
+ *----------------------------------------------------------------------------*/
+unsigned int
+BufferedSink :: enqueue (   const unsigned char   * buf,
+                            unsigned int            len )
+{
+    if ( slot >= 0 && network->hasFailed( slot) ) {
+        // the network thread found the connection broken, take it back
+        // and reopen it here, as when sending without the thread
+        detach();
+        sink->close();
+    }
+
+    if ( slot < 0 ) {
+        reopen();
+        if ( !sink->isOpen() ) {
+            // nobody to send to, what was encoded meanwhile is lost,
+            // unless spilled
+            if ( spill != 0 ) {
+                store( buf, len);
+                updatePeak();
+            }
+            return len;
         }
+        attach();
+    }
+
+    refill();
+    if ( store( buf, len) || hasQueued() ) {
+        network->wake( slot);
+    }
+    updatePeak();
 
-        if ( outp < inp ) {
-            // valuable data is between outp and inp
-            // in the previous if wrote all data from the end
-            // this part will write the rest
+    return len;
+}
 
-            size    = inp - outp;
-            if( size > len * 2 ) {
-                // prevent a surge of data to underlying buffer
-                size = len * 2;
+
+/*------------------------------------------------------------------------------
+ *  Send the buffer to the socket, called by the network thread
+ *----------------------------------------------------------------------------*/
+bool
+BufferedSink :: sendQueued ( unsigned long long   * resumeAt )
+{
+    unsigned long long  now;
+    unsigned long long  s;
+    unsigned long long  q;
+    unsigned int        size;
+    unsigned int        need;
+    unsigned int        length;
+
+    now       = Util::getMonotonicTime();
+    *resumeAt = 0;
+    s         = sent.load( std::memory_order_relaxed);
+    q         = queued.load( std::memory_order_acquire);
+
+    while ( s < q ) {
+        size = pace( q - s, now);
+        if ( size == 0 ) {
+            // come back when there are tokens for a 20 ms slice at least,
+            // so that the backlog goes out in a few sizable writes
+            need = paceRate / 50;
+            if ( need > q - s ) {
+                need = q - s;
             }
-            soFar   = 0;
-
-            while ( soFar < size && sink->canWrite( 0, 0) ) {
-                try {
-                    length  = sink->write( outp + soFar, size - soFar);
-                } catch (Exception &e) {
-                    length = 0;
-                    reportEvent(3,"Exception caught in BufferedSink :: write2" );
-                }
-                outp    = slidePointer( outp, length);
-                soFar  += length;
+            if ( need < 1 ) {
+                need = 1;
             }
-
-            total += soFar;
+            *resumeAt = now + (unsigned long long)
+                        ((need - tokens) * 1000000.0 / paceRate) + 1;
+            return false;
         }
 
-        while ( (outp - buffer) % chunkSize ) {
-            slidePointer( outp, 1);
+        length = sink->write( buffer + s % bufferSize, size);
+        if ( paceRate ) {
+            tokens -= length;
+        }
+        if ( length == 0 ) {
+            return false;
         }
 
-        // calulate the misalignment to chunkSize boundaries
-        misalignment = (chunkSize - (total % chunkSize)) % chunkSize;
+        s += length;
+        sent.store( s, std::memory_order_release);
     }
 
-    if ( !align() ) {
+    return true;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Write some data to the sink
+ *  if len == 0, try to flush the buffer
+ *  The data is appended to the buffer, and the buffer is sent from, so
+ *  that the backlog and the fresh data go out in one write
+ *----------------------------------------------------------------------------*/
+unsigned int
+BufferedSink :: write (    const void    * buf,
+                           unsigned int    len )
+{
+    unsigned long long  s;
+    unsigned int        size;
+    unsigned int        length;
+
+    if ( !buf ) {
+        throw Exception( __FILE__, __LINE__, "buf is null");
+    }
+
+    if ( !isOpen() ) {
         return 0;
     }
 
-    // the internal buffer is empty, try to write the fresh data
-    soFar = 0;
-    if ( inp == outp ) { 
-        while ( soFar < len && sink->canWrite( 0, 0) ) {
-            try {
-                soFar += sink->write( b + soFar, len - soFar);
-            } catch (Exception &e) {
-                reportEvent(3,"Exception caught in BufferedSink :: write3");
-            }
-        }
+    if ( network != 0 ) {
+        return enqueue( (const unsigned char *) buf, len);
     }
-    length = soFar;
 
-    // calulate the misalignment to chunkSize boundaries
-    misalignment = (chunkSize - (length % chunkSize)) % chunkSize;
+    reopen();
+
+    // make it a multiple of chunkSize, so that only whole chunks are
+    // stored or dropped, and the underlying stream stays aligned
+    len -= len % chunkSize;
 
-    if ( length < len ) {
-        // if not all fresh could be written, store the remains
+    refill();
+    store( buf, len);
+
+    // do not try to send the content of the entire buffer at once,
+    // but let the backlog out at the pace rate, or a multiple of len
+    // if not paced
+    // this prevents a surge of data to underlying buffer
+    // which is important especially during a lot of packet loss
+    s    = sent.load( std::memory_order_relaxed);
+    size = pace( queued.load( std::memory_order_relaxed) - s,
+                 Util::getMonotonicTime());
+    if ( paceRate == 0 && size > len * 3 ) {
+        size = len * 3;
+    }
 
-        store( b + length, len - length);
+    if ( size > 0 && sink->canWrite( 0, 0) ) {
+        try {
+            length = sink->write( buffer + s % bufferSize, size);
+        } catch (Exception &e) {
+            length = 0;
+            reportEvent(3,"Exception caught in BufferedSink :: write");
+        }
+        if ( paceRate ) {
+            tokens -= length;
+        }
+        sent.store( s + length, std::memory_order_relaxed);
     }
 
     updatePeak();
@@ -424,9 +712,24 @@ BufferedSink :: close ( void )
         return;
     }
 
-    flush();
+    if ( slot >= 0 ) {
+        // send what the socket takes right away, the rest is lost
+        unsigned long long  resumeAt;
+
+        detach();
+        try {
+            sendQueued( &resumeAt);
+        } catch ( Exception   & e ) {
+        }
+    } else if ( sink->isOpen() ) {
+        // nothing to flush into a sink that closed on its own
+        flush();
+    }
     sink->close();
-    inp = outp = buffer;
+    sent.store( queued.load());
+    if ( spill != 0 ) {
+        spill->clear();
+    }
     bOpen = false;
 }
 
@@ -36,9 +36,14 @@
 
 /* ============================================================ include files */
 
+#include <atomic>
+
 #include "Ref.h"
 #include "Reporter.h"
 #include "Sink.h"
+#include "TcpSocket.h"
+#include "NetworkThread.h"
+#include "SpillBuffer.h"
 
 
 /* ================================================================ constants */
@@ -51,10 +56,31 @@
 
 /**
  *  A Sink First-In First-Out buffer.
- *  This buffer can always be written to, it overwrites any
- *  data contained if needed.
+ *  This buffer can always be written to, data that does not fit
+ *  is dropped.
  *  The class is not thread-safe.
  *
+ *  The memory of the buffer is mapped twice, back to back, so that
+ *  any part of it can be read or written in one go, even if it wraps
+ *  around the end. Where this is not possible, the second half is a
+ *  copy of the first one, kept up to date by hand.
+ *
+ *  When given a NetworkThread, and the underlying Sink is a CastSink,
+ *  writing only appends to the buffer, and the network thread sends
+ *  from it. Then the buffer is a lock-free queue with one writer and
+ *  one reader.
+ *
+ *  When given a SpillBuffer, data that does not fit into the buffer,
+ *  and all data after it, goes to the spill file instead of being
+ *  dropped, while the underlying Sink can't take it. Once the Sink
+ *  takes data again, the spill is moved back into the buffer, so that
+ *  the stream stays gapless.
+ *
+ *  Sending may be paced by a token bucket: tokens flow in at a given
+ *  rate, a few times the bit rate of the stream, up to a burst, and
+ *  each byte sent takes one. So a backlog is sent at that rate, while
+ *  the stream as it comes passes unhindered.
+ *
  *  @author  $Author$
  *  @version $Revision$
  */
@@ -63,19 +89,22 @@ class BufferedSink : public Sink, public virtual Reporter
     private:
 
         /**
-         *  The buffer.
+         *  The buffer, followed by the same bufferSize bytes again.
+         *  Made when first written into.
          */
         unsigned char     * buffer;
 
         /**
-         *  The end of the buffer.
+         *  The size of the buffer, a multiple of the page size once
+         *  the buffer is made.
          */
-        unsigned char     * bufferEnd;
+        unsigned int        bufferSize;
 
         /**
-         *  The size of the buffer.
+         *  Tells if the second half of the buffer maps the same memory
+         *  as the first one. If not, writes are copied into both.
          */
-        unsigned int        bufferSize;
+        bool                mapped;
 
         /**
          *  The highest usage of the buffer.
@@ -88,22 +117,6 @@ class BufferedSink : public Sink, public virtual Reporter
          */
         unsigned int        chunkSize;
 
-        /**
-         *  Number of bytes the underlying stream is misaligned with
-         *  chunkSize. (It needs this many bytes more to be aligned.)
-         */
-        unsigned int        misalignment;
-
-        /**
-         *  Start of free territory in buffer.
-         */
-        unsigned char     * inp;
-
-        /**
-         *  Start of sensible data in buffer.
-         */
-        unsigned char     * outp;
-
 
         /**
          *  The underlying Sink.
@@ -121,6 +134,82 @@ class BufferedSink : public Sink, public virtual Reporter
           */
         unsigned int       openAttempts;  
 
+        /**
+         *  Tells if the underlying Sink is reopened here when it has
+         *  closed on its own, or left to whoever writes into us.
+         */
+        bool               selfReopen;
+
+        /**
+         *  The thread sending the buffer to the socket, if any.
+         */
+        Ref<NetworkThread>  network;
+
+        /**
+         *  The socket underneath, if the network thread sends to it.
+         */
+        TcpSocket         * socket;
+
+        /**
+         *  The slot of the socket in the network thread, -1 if the
+         *  socket is not handed to the thread.
+         */
+        int                 slot;
+
+        /**
+         *  The number of bytes put into the buffer. Only written by
+         *  the writer.
+         */
+        std::atomic<unsigned long long>     queued;
+
+        /**
+         *  The number of bytes sent from the buffer. Only written by
+         *  the network thread, when it sends from the buffer.
+         */
+        std::atomic<unsigned long long>     sent;
+
+        /**
+         *  The number of writes dropped as the buffer was full.
+         */
+        unsigned long       overruns;
+
+        /**
+         *  The file data goes to when the buffer is full, if any.
+         */
+        Ref<SpillBuffer>    spill;
+
+        /**
+         *  The bytes per second of the stream, 0 if not known.
+         */
+        unsigned int        byteRate;
+
+        /**
+         *  The bytes per second sending is paced at, 0 for no pacing.
+         */
+        unsigned int        paceRate;
+
+        /**
+         *  The most tokens the bucket holds.
+         */
+        unsigned int        paceBurst;
+
+        /**
+         *  The tokens in the bucket, the bytes that may be sent now.
+         *  Used by the network thread only, when there is one.
+         */
+        double              tokens;
+
+        /**
+         *  When tokens were last added, see Util::getMonotonicTime().
+         */
+        unsigned long long  tokensAt;
+
+        /**
+         *  When to try to reopen the underlying Sink next, when
+         *  spilling, see Util::getMonotonicTime().
+         */
+        unsigned long long  reopenAt;
+
         /**
          *  Initialize the object.
          *
@@ -143,25 +232,53 @@ class BufferedSink : public Sink, public virtual Reporter
         strip ( void );
 
         /**
-         *  Slide a pointer in the internal buffer by offset. If the pointer
-         *  would reach beyond the end of the buffer, it goes wraps around.
+         *  Map the memory of the buffer twice, back to back, at least
+         *  bufferSize bytes. Rounds bufferSize up to whole pages and
+         *  sets mapped.
          *
-         *  @param p the pointer to slide.
-         *  @param offset the amount to slide with.
-         *  @return pointer p + offset, wrapped around if needed.
-         */
-        inline unsigned char *
-        slidePointer (
-                        unsigned char * p,
-                        unsigned int    offset )        throw ()
-        {
-            p += offset;
-            while ( p >= bufferEnd ) {
-                p -= bufferSize;
-            }
+         *  @exception Exception
+         */
+        void
+        mapBuffer ( void );
 
-            return p;
-        }
+        /**
+         *  Release the memory of the buffer.
+         */
+        void
+        unmapBuffer ( void )                            throw ();
+
+        /**
+         *  Copy data into the buffer, past its end if it wraps around.
+         *
+         *  @param pos the position in the buffer to copy to,
+         *             less than bufferSize.
+         *  @param buf the data to copy.
+         *  @param len the number of bytes to copy, at most bufferSize.
+         */
+        void
+        put (   unsigned int            pos,
+                const unsigned char   * buf,
+                unsigned int            len )           throw ();
+
+        /**
+         *  Copy what was written into one half of the buffer into the
+         *  other half, if the two are not mapped to the same memory.
+         *
+         *  @param pos the position written to, less than bufferSize.
+         *  @param len the number of bytes written, at most bufferSize.
+         */
+        void
+        mirror (    unsigned int        pos,
+                    unsigned int        len )           throw ();
+
+        /**
+         *  Move data from the spill back into the buffer, as much as
+         *  fits and the catch-up rate allows.
+         *
+         *  @exception Exception
+         */
+        void
+        refill ( void );
 
         /**
          *  Update the peak buffer usage indicator.
@@ -171,15 +288,41 @@ class BufferedSink : public Sink, public virtual Reporter
         inline void
         updatePeak ( void )                             throw ()
         {
-            unsigned int    u;
+            updatePeak( queued.load( std::memory_order_relaxed)
+                      - sent.load( std::memory_order_relaxed));
+        }
 
-            u = outp <= inp ? inp - outp : (bufferEnd - outp) + (inp - buffer);
-            
+        /**
+         *  Tell how much of the data to send the token bucket lets
+         *  through right now.
+         *
+         *  @param len the number of bytes to send.
+         *  @param now the time now, see Util::getMonotonicTime().
+         *  @return the number of bytes that may be sent, at most len.
+         */
+        unsigned int
+        pace (  unsigned int            len,
+                unsigned long long      now )           throw ();
+
+        /**
+         *  Update the peak buffer usage indicator.
+         *
+         *  @param u the number of bytes in the buffer.
+         */
+        inline void
+        updatePeak ( unsigned int   u )                 throw ()
+        {
             // report new peaks if it is either significantly more severe than
             // the previously reported peak
             if ( peak * 2 < u ) {
                 peak = u;
-                reportEvent( 4, "BufferedSink, new peak:", peak, " / ", bufferSize);
+                if ( byteRate ) {
+                    reportEvent( 4, "BufferedSink, new peak:", peak,
+                                 "bytes, seconds of backlog:",
+                                 peak / (double) byteRate);
+                } else {
+                    reportEvent( 4, "BufferedSink, new peak:", peak, " / ", bufferSize);
+                }
             }
             
             if ( peak > 0 && u == 0 ) {
@@ -189,33 +332,41 @@ class BufferedSink : public Sink, public virtual Reporter
         }
 
         /**
-         *  If the underlying Sink is misaligned on chunkSize, write as
-         *  many 0s as needed to get it aligned.
+         *  Try to reopen the underlying Sink if it has closed on its own,
+         *  giving up after 10 attempts.
          *
-         *  @see #misalignment
-         *  @see #chunkSize
+         *  @exception Exception if the last attempt failed, or at once
+         *             if reopening is not up to us.
          */
-        inline bool
-        align ( void )
-        {
-            char    b[] = { 0 };
+        void
+        reopen ( void );
 
-            while ( misalignment ) {
-                if ( sink->canWrite( 0, 0) ) {
-                    unsigned int    ret;
-                    
-                    if ( !(ret = sink->write( b, 1)) ) {
-                        return false;
-                    }
-                    --misalignment;
+        /**
+         *  Hand the socket underneath to the network thread, after it
+         *  was opened.
+         *
+         *  @exception Exception
+         */
+        void
+        attach ( void );
 
-                } else {
-                    return false;
-                }
-            }
+        /**
+         *  Take the socket underneath back from the network thread.
+         */
+        void
+        detach ( void )                                 throw ();
 
-            return true;
-        }
+        /**
+         *  Append data to the buffer for the network thread to send.
+         *
+         *  @param buf the data to append.
+         *  @param len the number of bytes to append.
+         *  @return len
+         *  @exception Exception
+         */
+        unsigned int
+        enqueue (   const unsigned char   * buf,
+                    unsigned int            len );
 
 
     protected:
@@ -243,13 +394,13 @@ class BufferedSink : public Sink, public virtual Reporter
         }
 
         /**
-         *  Store data in the internal buffer. If there is not enough space,
-         *  discard all in the buffer and the beginning of the supplied
-         *  buffer if needed.
+         *  Store data in the internal buffer. If there is not enough
+         *  space, nothing is stored, and the overrun is counted.
          *  
          *  @param buffer the data to store.
          *  @param bufferSize the amount of data to store in bytes.
-         *  @return number of bytes really stored.
+         *  @return number of bytes really stored, 0 on an overrun.
+         *  @exception Exception
          */
         unsigned int
         store (     const void    * buffer,
@@ -315,6 +466,95 @@ class BufferedSink : public Sink, public virtual Reporter
             return peak;
         }
 
+        /**
+         *  Let a network thread send the buffer, if the underlying Sink
+         *  is a CastSink. Not to be called when open.
+         *
+         *  @param network the network thread, 0 to send when writing.
+         */
+        void
+        setNetworkThread ( NetworkThread  * network );
+
+        /**
+         *  Keep the data that does not fit into the buffer in a file,
+         *  instead of dropping it. Not to be called when open.
+         *
+         *  @param spill the file to keep the data in, 0 to drop it.
+         */
+        void
+        setSpill (  SpillBuffer       * spill );
+
+        /**
+         *  Pace sending with a token bucket. Not to be called when open.
+         *
+         *  @param byteRate the bytes per second of the stream.
+         *  @param catchUp how many times byteRate a backlog is sent at,
+         *                 0 for no pacing.
+         *  @param burstSecs the most seconds of the stream sent at once,
+         *                   after not sending for a while.
+         */
+        void
+        setPacing ( unsigned int        byteRate,
+                    double              catchUp,
+                    double              burstSecs );
+
+        /**
+         *  Tell if the underlying Sink is to be reopened on writing,
+         *  when it has closed on its own, which may block for long.
+         *  If not, writing throws an Exception instead, and it is up
+         *  to the caller to close and open this BufferedSink again.
+         *
+         *  @param selfReopen true to reopen on writing, the default.
+         */
+        inline void
+        setSelfReopen ( bool    selfReopen )                throw ()
+        {
+            this->selfReopen = selfReopen;
+        }
+
+        /**
+         *  Get the data waiting to be sent, in seconds of the stream.
+         *
+         *  @return the backlog in seconds, 0 if the bit rate of the
+         *          stream is not known.
+         */
+        inline double
+        getBacklogSecs ( void ) const                   throw ()
+        {
+            return byteRate ? (queued.load( std::memory_order_relaxed)
+                             - sent.load( std::memory_order_relaxed))
+                              / (double) byteRate
+                            : 0.0;
+        }
+
+        /**
+         *  Send the data in the buffer to the socket, until the socket
+         *  takes no more, or pacing allows no more. Called by the
+         *  network thread.
+         *
+         *  @param resumeAt set to when pacing allows sending again, if it
+         *                  held sending back, see Util::getMonotonicTime().
+         *                  Set to 0 otherwise.
+         *  @return true if all the data was sent, false if the socket
+         *          takes no more, or pacing held sending back.
+         *  @exception Exception if the connection is broken.
+         */
+        bool
+        sendQueued ( unsigned long long   * resumeAt );
+
+        /**
+         *  Tell if there is data in the buffer to send.
+         *  Called by the network thread.
+         *
+         *  @return true if there is data to send.
+         */
+        inline bool
+        hasQueued ( void ) const                        throw ()
+        {
+            return queued.load( std::memory_order_acquire)
+                != sent.load( std::memory_order_relaxed);
+        }
+
         /**
          *  Open the BufferedSink. Opens the underlying Sink.
          *  
@@ -326,6 +566,9 @@ class BufferedSink : public Sink, public virtual Reporter
         {
             bOpen = sink->open();
             openAttempts = 0;
+            if ( bOpen && network != 0 ) {
+                attach();
+            }
             return bOpen;
         }
 
@@ -359,9 +602,10 @@ class BufferedSink : public Sink, public virtual Reporter
         /**
          *  Write data to the BufferedSink.
          *  Always reads the maximum number of chunkSize chunks buf
-         *  holds. If the data can not be written to the underlying
-         *  stream, it is buffered. If the buffer overflows, the oldest
-         *  data is discarded.
+         *  holds. The data is buffered, and as much of the buffer is
+         *  written to the underlying stream as it takes, in one go.
+         *  If the buffer overflows, the data that does not fit is
+         *  discarded.
          *
          *  @param buf the data to write.
          *  @param len number of bytes to write from buf.
@@ -395,7 +639,14 @@ class BufferedSink : public Sink, public virtual Reporter
         cut ( void )                                    throw ()
         {
             flush();
-            sink->cut();
+            // keep the network thread from writing while cutting
+            if ( slot >= 0 ) {
+                network->lock();
+                sink->cut();
+                network->unlock();
+            } else {
+                sink->cut();
+            }
         }
 
         /**
@@ -174,6 +174,10 @@ class CastSink : public Sink, public virtual Reporter
             return getSocket();
         }
 
+
+
+    public:
+
         /**
          *  Get the TcpSocket underneath this CastSink.
          *
@@ -185,9 +189,6 @@ class CastSink : public Sink, public virtual Reporter
             return socket.get();
         }
 
-
-    public:
-
         /**
          *  Constructor.
          *
@@ -29,12 +29,34 @@
 
 /* ============================================================ include files */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#else
+#error need pthread.h
+#endif
+
 #include "Exception.h"
 #include "Connector.h"
 
 
 /* ===================================================  local data structures */
 
+/*------------------------------------------------------------------------------
+ *  A sink being opened in a thread of its own
+ *----------------------------------------------------------------------------*/
+typedef struct {
+    Sink          * sink;
+    pthread_t       thread;
+    bool            started;
+    bool            opened;
+    bool            thrown;
+    Exception       exception;
+} Opening;
+
 
 /* ================================================  local constants & macros */
 
@@ -46,9 +68,34 @@ static const char fileid[] = "$Id$";
 
 /* ===============================================  local function prototypes */
 
+/*------------------------------------------------------------------------------
+ *  Open a sink, the body of the opening thread
+ *----------------------------------------------------------------------------*/
+static void *
+openSink (  void          * arg );
+
 
 /* =============================================================  module code */
 
+/*------------------------------------------------------------------------------
+ *  Open a sink, keeping what went wrong
+ *----------------------------------------------------------------------------*/
+static void *
+openSink (  void          * arg )
+{
+    Opening   * opening = (Opening *) arg;
+
+    try {
+        opening->opened = opening->sink->open();
+    } catch ( Exception   & e ) {
+        opening->exception = e;
+        opening->thrown    = true;
+    }
+
+    return 0;
+}
+
+
 /*------------------------------------------------------------------------------
  *  Initialize the object
  *----------------------------------------------------------------------------*/
@@ -224,28 +271,101 @@ Connector :: open ( void )
         }
     }
 
+    Sink         ** toOpen = new Sink*[numSinks];
+    bool          * opened = new bool[numSinks];
+    bool            ok     = true;
+
     for ( u = 0; u < numSinks; ++u ) {
-        if ( !sinks[u]->isOpen() ) {
-            if ( !sinks[u]->open() ) {
-                break;
+        toOpen[u] = sinks[u].get();
+    }
+
+    try {
+        ok = openSinks( toOpen, numSinks, opened);
+    } catch ( Exception   & e ) {
+        for ( u = 0; u < numSinks; ++u ) {
+            if ( opened[u] ) {
+                sinks[u]->close();
             }
         }
+        source->close();
+        delete[] opened;
+        delete[] toOpen;
+        throw;
     }
 
     // if not all could be opened, close those that were
-    if ( u < numSinks ) {
-        unsigned int        v;
-
-        for ( v = 0; v < u; ++v ) {
-            sinks[v]->close();
+    if ( !ok ) {
+        for ( u = 0; u < numSinks; ++u ) {
+            if ( opened[u] ) {
+                sinks[u]->close();
+            }
         }
 
         source->close();
+    }
 
-        return false;
+    delete[] opened;
+    delete[] toOpen;
+
+    return ok;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Open sinks side by side
+ *----------------------------------------------------------------------------*/
+bool
+Connector :: openSinks (    Sink * const      * sinks,
+                            unsigned int        n,
+                            bool              * opened )
+{
+    Opening       * openings = new Opening[n];
+    unsigned int    u;
+    bool            ok;
+
+    // each one in a thread of its own, so that a server slow to answer
+    // does not hold up connecting to the others
+    for ( u = 0; u < n; ++u ) {
+        openings[u].sink    = sinks[u];
+        openings[u].started = false;
+        openings[u].opened  = false;
+        openings[u].thrown  = false;
+
+        // opened even if it tells it is open, as a BufferedSink does
+        // before its sink is
+        if ( n > 1 && pthread_create( &openings[u].thread,
+                                      0,
+                                      openSink,
+                                      openings + u) == 0 ) {
+            openings[u].started = true;
+        } else {
+            openSink( openings + u);
+        }
+    }
+
+    ok = true;
+    for ( u = 0; u < n; ++u ) {
+        if ( openings[u].started ) {
+            pthread_join( openings[u].thread, 0);
+        }
+        opened[u] = openings[u].opened;
+        if ( !opened[u] ) {
+            ok = false;
+        }
+    }
+
+    for ( u = 0; u < n; ++u ) {
+        if ( openings[u].thrown ) {
+            Exception   e = openings[u].exception;
+
+            delete[] openings;
+            throw e;
+        }
     }
 
-    return true;
+    delete[] openings;
+
+    return ok;
 }
 
 
@@ -206,6 +206,23 @@ class Connector : public virtual Referable, public virtual Reporter
         virtual bool
         open ( void )                                   ;
 
+        /**
+         *  Open a number of sinks at the same time, each in a thread of
+         *  its own, waiting for all of them to finish. If opening any of
+         *  them throws, the first such Exception is thrown again once all
+         *  are done, and opened tells which ones are open anyway.
+         *
+         *  @param sinks the sinks to open.
+         *  @param n the number of sinks.
+         *  @param opened for each sink, set to true if it is open.
+         *  @return true if all the sinks are open, false otherwise.
+         *  @exception Exception
+         */
+        static bool
+        openSinks ( Sink * const      * sinks,
+                    unsigned int        n,
+                    bool              * opened )        ;
+
         /**
          *  Transfer a given amount of data from the Source to all the
          *  Sinks attached.
@@ -0,0 +1,1019 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : ConvKernels.cpp
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#error need string.h
+#endif
+
+#ifdef HAVE_MATH_H
+#include <math.h>
+#else
+#error need math.h
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CONV_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) && !defined(WORDS_BIGENDIAN)
+#define CONV_NEON
+#include <arm_neon.h>
+#endif
+
+#include "ConvKernels.h"
+
+
+/* ===================================================  local data structures */
+
+
+/* ================================================  local constants & macros */
+
+/*------------------------------------------------------------------------------
+ *  File identity
+ *----------------------------------------------------------------------------*/
+static const char fileid[] = "$Id$";
+
+/*------------------------------------------------------------------------------
+ *  Compile a function for an instruction set the compiler does not
+ *  target by default, it is only called if the processor has it
+ *----------------------------------------------------------------------------*/
+#ifdef CONV_X86
+#define SSE2_TARGET     __attribute__((target("sse2")))
+#define AVX2_TARGET     __attribute__((target("avx2")))
+#endif
+
+
+
+/* ===============================================  local function prototypes */
+
+
+/* =============================================================  module code */
+
+/*------------------------------------------------------------------------------
+ *  The plain C kernels. These are the reference for all the others.
+ *----------------------------------------------------------------------------*/
+static inline int16_t
+swapBytes ( int16_t     value )
+{
+    uint16_t    v = (uint16_t) value;
+
+    return (int16_t) (uint16_t) ((v << 8) | (v >> 8));
+}
+
+static void
+copy16Scalar (  const int16_t     * in,
+                size_t              samples,
+                int16_t           * out,
+                bool                swap )
+{
+    if ( !swap ) {
+        memmove( out, in, samples * sizeof(int16_t));
+        return;
+    }
+
+    for ( size_t i = 0; i < samples; ++i ) {
+        out[i] = swapBytes( in[i]);
+    }
+}
+
+static void
+split16Scalar ( const int16_t     * in,
+                size_t              frames,
+                int16_t           * left,
+                int16_t           * right,
+                bool                swap )
+{
+    for ( size_t i = 0; i < frames; ++i ) {
+        left[i]  = swap ? swapBytes( in[2 * i])     : in[2 * i];
+        right[i] = swap ? swapBytes( in[2 * i + 1]) : in[2 * i + 1];
+    }
+}
+
+static void
+toFloat16Tail ( const int16_t     * in,
+                size_t              from,
+                size_t              frames,
+                unsigned int        channels,
+                float            ** out )
+{
+    for ( size_t i = from, j = from * channels; i < frames; ++i ) {
+        for ( unsigned int c = 0; c < channels; ++c ) {
+            out[c][i] = ((float) in[j++]) / 32768.f;
+        }
+    }
+}
+
+static void
+toFloat16Scalar (   const int16_t     * in,
+                    size_t              frames,
+                    unsigned int        channels,
+                    float            ** out )
+{
+    toFloat16Tail( in, 0, frames, channels, out);
+}
+
+static void
+toFloat24Scalar (   const unsigned char   * in,
+                    size_t                  samples,
+                    float                 * out )
+{
+    for ( size_t i = 0; i < samples; ++i, in += 3 ) {
+        // put the sample into the top of an int, to get the sign right
+        int32_t     value = (int32_t) (((uint32_t) in[0] << 8)
+                                     | ((uint32_t) in[1] << 16)
+                                     | ((uint32_t) in[2] << 24)) >> 8;
+
+        out[i] = ((float) value) / 8388608.f;
+    }
+}
+
+static void
+toFloat32Scalar (   const int32_t     * in,
+                    size_t              samples,
+                    float             * out )
+{
+    for ( size_t i = 0; i < samples; ++i ) {
+        out[i] = ((float) in[i]) / 2147483648.f;
+    }
+}
+
+static void
+toInt16Scalar ( const float       * in,
+                size_t              samples,
+                int16_t           * out )
+{
+    for ( size_t i = 0; i < samples; ++i ) {
+        float   s = in[i] * 32768.f;
+
+        // written so that not-a-number ends up at the lower limit,
+        // the same way the min and max instructions do
+        s      = s > -32768.f ? s : -32768.f;
+        s      = s <  32767.f ? s :  32767.f;
+        out[i] = (int16_t) lrintf( s);
+    }
+}
+
+static void
+downmixScalar ( const int16_t     * in,
+                size_t              frames,
+                int16_t           * out )
+{
+    for ( size_t i = 0; i < frames; ++i ) {
+        out[i] = (in[2 * i] + in[2 * i + 1]) / 2;
+    }
+}
+
+
+#ifdef CONV_X86
+/*------------------------------------------------------------------------------
+ *  The SSE2 kernels
+ *----------------------------------------------------------------------------*/
+SSE2_TARGET static inline __m128i
+swapBytesSse2 ( __m128i     v )
+{
+    return _mm_or_si128( _mm_slli_epi16( v, 8), _mm_srli_epi16( v, 8));
+}
+
+SSE2_TARGET static void
+copy16Sse2 (    const int16_t     * in,
+                size_t              samples,
+                int16_t           * out,
+                bool                swap )
+{
+    size_t      i = 0;
+
+    if ( !swap ) {
+        memmove( out, in, samples * sizeof(int16_t));
+        return;
+    }
+
+    for ( ; i + 8 <= samples; i += 8 ) {
+        __m128i     v = _mm_loadu_si128( (const __m128i *) (in + i));
+
+        _mm_storeu_si128( (__m128i *) (out + i), swapBytesSse2( v));
+    }
+    copy16Scalar( in + i, samples - i, out + i, swap);
+}
+
+SSE2_TARGET static void
+split16Sse2 (   const int16_t     * in,
+                size_t              frames,
+                int16_t           * left,
+                int16_t           * right,
+                bool                swap )
+{
+    size_t      i = 0;
+
+    for ( ; i + 8 <= frames; i += 8 ) {
+        __m128i     a = _mm_loadu_si128( (const __m128i *) (in + 2 * i));
+        __m128i     b = _mm_loadu_si128( (const __m128i *) (in + 2 * i + 8));
+
+        if ( swap ) {
+            a = swapBytesSse2( a);
+            b = swapBytesSse2( b);
+        }
+
+        // the low halves of the 32 bit words are the left samples,
+        // the high halves the right ones
+        _mm_storeu_si128( (__m128i *) (left + i),
+            _mm_packs_epi32( _mm_srai_epi32( _mm_slli_epi32( a, 16), 16),
+                             _mm_srai_epi32( _mm_slli_epi32( b, 16), 16)));
+        _mm_storeu_si128( (__m128i *) (right + i),
+            _mm_packs_epi32( _mm_srai_epi32( a, 16),
+                             _mm_srai_epi32( b, 16)));
+    }
+    split16Scalar( in + 2 * i, frames - i, left + i, right + i, swap);
+}
+
+SSE2_TARGET static void
+toFloat16Sse2 (     const int16_t     * in,
+                    size_t              frames,
+                    unsigned int        channels,
+                    float            ** out )
+{
+    const __m128    scale = _mm_set1_ps( 1.f / 32768.f);
+    size_t          i     = 0;
+
+    if ( channels == 1 ) {
+        for ( ; i + 8 <= frames; i += 8 ) {
+            __m128i     v  = _mm_loadu_si128( (const __m128i *) (in + i));
+            __m128i     lo = _mm_srai_epi32( _mm_unpacklo_epi16( v, v), 16);
+            __m128i     hi = _mm_srai_epi32( _mm_unpackhi_epi16( v, v), 16);
+
+            _mm_storeu_ps( out[0] + i,
+                           _mm_mul_ps( _mm_cvtepi32_ps( lo), scale));
+            _mm_storeu_ps( out[0] + i + 4,
+                           _mm_mul_ps( _mm_cvtepi32_ps( hi), scale));
+        }
+    } else if ( channels == 2 ) {
+        for ( ; i + 4 <= frames; i += 4 ) {
+            __m128i     v = _mm_loadu_si128( (const __m128i *) (in + 2 * i));
+            __m128i     l = _mm_srai_epi32( _mm_slli_epi32( v, 16), 16);
+            __m128i     r = _mm_srai_epi32( v, 16);
+
+            _mm_storeu_ps( out[0] + i, _mm_mul_ps( _mm_cvtepi32_ps( l), scale));
+            _mm_storeu_ps( out[1] + i, _mm_mul_ps( _mm_cvtepi32_ps( r), scale));
+        }
+    }
+    toFloat16Tail( in, i, frames, channels, out);
+}
+
+SSE2_TARGET static void
+toFloat32Sse2 (     const int32_t     * in,
+                    size_t              samples,
+                    float             * out )
+{
+    const __m128    scale = _mm_set1_ps( 1.f / 2147483648.f);
+    size_t          i     = 0;
+
+    for ( ; i + 4 <= samples; i += 4 ) {
+        __m128i     v = _mm_loadu_si128( (const __m128i *) (in + i));
+
+        _mm_storeu_ps( out + i, _mm_mul_ps( _mm_cvtepi32_ps( v), scale));
+    }
+    toFloat32Scalar( in + i, samples - i, out + i);
+}
+
+SSE2_TARGET static void
+toInt16Sse2 (   const float       * in,
+                size_t              samples,
+                int16_t           * out )
+{
+    const __m128    scale = _mm_set1_ps( 32768.f);
+    const __m128    lower = _mm_set1_ps( -32768.f);
+    const __m128    upper = _mm_set1_ps( 32767.f);
+    size_t          i     = 0;
+
+    for ( ; i + 8 <= samples; i += 8 ) {
+        __m128  a = _mm_mul_ps( _mm_loadu_ps( in + i), scale);
+        __m128  b = _mm_mul_ps( _mm_loadu_ps( in + i + 4), scale);
+
+        // max gives its second operand for not-a-number
+        a = _mm_min_ps( _mm_max_ps( a, lower), upper);
+        b = _mm_min_ps( _mm_max_ps( b, lower), upper);
+
+        _mm_storeu_si128( (__m128i *) (out + i),
+                          _mm_packs_epi32( _mm_cvtps_epi32( a),
+                                           _mm_cvtps_epi32( b)));
+    }
+    toInt16Scalar( in + i, samples - i, out + i);
+}
+
+SSE2_TARGET static void
+downmixSse2 (   const int16_t     * in,
+                size_t              frames,
+                int16_t           * out )
+{
+    const __m128i   ones = _mm_set1_epi16( 1);
+    size_t          i    = 0;
+
+    for ( ; i + 8 <= frames; i += 8 ) {
+        __m128i     a = _mm_loadu_si128( (const __m128i *) (in + 2 * i));
+        __m128i     b = _mm_loadu_si128( (const __m128i *) (in + 2 * i + 8));
+
+        // left + right of each frame, as 32 bit values
+        a = _mm_madd_epi16( a, ones);
+        b = _mm_madd_epi16( b, ones);
+
+        // divide by 2, rounding towards zero as the scalar code does
+        a = _mm_srai_epi32( _mm_add_epi32( a, _mm_srli_epi32( a, 31)), 1);
+        b = _mm_srai_epi32( _mm_add_epi32( b, _mm_srli_epi32( b, 31)), 1);
+
+        _mm_storeu_si128( (__m128i *) (out + i), _mm_packs_epi32( a, b));
+    }
+    downmixScalar( in + 2 * i, frames - i, out + i);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  The AVX2 kernels. The pack instructions work on the two 128 bit
+ *  lanes separately, so their results are put in order by a permute.
+ *----------------------------------------------------------------------------*/
+AVX2_TARGET static inline __m256i
+swapBytesAvx2 ( __m256i     v )
+{
+    return _mm256_or_si256( _mm256_slli_epi16( v, 8),
+                            _mm256_srli_epi16( v, 8));
+}
+
+AVX2_TARGET static void
+copy16Avx2 (    const int16_t     * in,
+                size_t              samples,
+                int16_t           * out,
+                bool                swap )
+{
+    size_t      i = 0;
+
+    if ( !swap ) {
+        memmove( out, in, samples * sizeof(int16_t));
+        return;
+    }
+
+    for ( ; i + 16 <= samples; i += 16 ) {
+        __m256i     v = _mm256_loadu_si256( (const __m256i *) (in + i));
+
+        _mm256_storeu_si256( (__m256i *) (out + i), swapBytesAvx2( v));
+    }
+    copy16Scalar( in + i, samples - i, out + i, swap);
+}
+
+AVX2_TARGET static void
+split16Avx2 (   const int16_t     * in,
+                size_t              frames,
+                int16_t           * left,
+                int16_t           * right,
+                bool                swap )
+{
+    size_t      i = 0;
+
+    for ( ; i + 16 <= frames; i += 16 ) {
+        __m256i     a = _mm256_loadu_si256( (const __m256i *) (in + 2 * i));
+        __m256i     b = _mm256_loadu_si256(
+                                    (const __m256i *) (in + 2 * i + 16));
+        __m256i     l;
+        __m256i     r;
+
+        if ( swap ) {
+            a = swapBytesAvx2( a);
+            b = swapBytesAvx2( b);
+        }
+
+        l = _mm256_packs_epi32(
+                    _mm256_srai_epi32( _mm256_slli_epi32( a, 16), 16),
+                    _mm256_srai_epi32( _mm256_slli_epi32( b, 16), 16));
+        r = _mm256_packs_epi32( _mm256_srai_epi32( a, 16),
+                                _mm256_srai_epi32( b, 16));
+
+        _mm256_storeu_si256( (__m256i *) (left + i),
+                             _mm256_permute4x64_epi64( l, 0xd8));
+        _mm256_storeu_si256( (__m256i *) (right + i),
+                             _mm256_permute4x64_epi64( r, 0xd8));
+    }
+    split16Scalar( in + 2 * i, frames - i, left + i, right + i, swap);
+}
+
+AVX2_TARGET static void
+toFloat16Avx2 (     const int16_t     * in,
+                    size_t              frames,
+                    unsigned int        channels,
+                    float            ** out )
+{
+    const __m256    scale = _mm256_set1_ps( 1.f / 32768.f);
+    size_t          i     = 0;
+
+    if ( channels == 1 ) {
+        for ( ; i + 8 <= frames; i += 8 ) {
+            __m256i     v = _mm256_cvtepi16_epi32(
+                            _mm_loadu_si128( (const __m128i *) (in + i)));
+
+            _mm256_storeu_ps( out[0] + i,
+                              _mm256_mul_ps( _mm256_cvtepi32_ps( v), scale));
+        }
+    } else if ( channels == 2 ) {
+        for ( ; i + 8 <= frames; i += 8 ) {
+            __m256i     v = _mm256_loadu_si256(
+                                        (const __m256i *) (in + 2 * i));
+            __m256i     l = _mm256_srai_epi32( _mm256_slli_epi32( v, 16), 16);
+            __m256i     r = _mm256_srai_epi32( v, 16);
+
+            _mm256_storeu_ps( out[0] + i,
+                              _mm256_mul_ps( _mm256_cvtepi32_ps( l), scale));
+            _mm256_storeu_ps( out[1] + i,
+                              _mm256_mul_ps( _mm256_cvtepi32_ps( r), scale));
+        }
+    }
+    toFloat16Tail( in, i, frames, channels, out);
+}
+
+AVX2_TARGET static void
+toFloat24Avx2 (     const unsigned char   * in,
+                    size_t                  samples,
+                    float                 * out )
+{
+    // put the 3 bytes of each sample into the top of a 32 bit word
+    const __m256i   shuffle = _mm256_setr_epi8(
+                                -128,  0,  1,  2, -128,  3,  4,  5,
+                                -128,  6,  7,  8, -128,  9, 10, 11,
+                                -128,  0,  1,  2, -128,  3,  4,  5,
+                                -128,  6,  7,  8, -128,  9, 10, 11);
+    const __m256    scale   = _mm256_set1_ps( 1.f / 8388608.f);
+    size_t          i       = 0;
+
+    // each step reads 4 bytes beyond the 24 it converts
+    for ( ; 3 * i + 28 <= 3 * samples; i += 8 ) {
+        __m256i     v = _mm256_inserti128_si256(
+                _mm256_castsi128_si256(
+                    _mm_loadu_si128( (const __m128i *) (in + 3 * i))),
+                _mm_loadu_si128( (const __m128i *) (in + 3 * i + 12)),
+                1);
+
+        v = _mm256_srai_epi32( _mm256_shuffle_epi8( v, shuffle), 8);
+        _mm256_storeu_ps( out + i,
+                          _mm256_mul_ps( _mm256_cvtepi32_ps( v), scale));
+    }
+    toFloat24Scalar( in + 3 * i, samples - i, out + i);
+}
+
+AVX2_TARGET static void
+toFloat32Avx2 (     const int32_t     * in,
+                    size_t              samples,
+                    float             * out )
+{
+    const __m256    scale = _mm256_set1_ps( 1.f / 2147483648.f);
+    size_t          i     = 0;
+
+    for ( ; i + 8 <= samples; i += 8 ) {
+        __m256i     v = _mm256_loadu_si256( (const __m256i *) (in + i));
+
+        _mm256_storeu_ps( out + i,
+                          _mm256_mul_ps( _mm256_cvtepi32_ps( v), scale));
+    }
+    toFloat32Scalar( in + i, samples - i, out + i);
+}
+
+AVX2_TARGET static void
+toInt16Avx2 (   const float       * in,
+                size_t              samples,
+                int16_t           * out )
+{
+    const __m256    scale = _mm256_set1_ps( 32768.f);
+    const __m256    lower = _mm256_set1_ps( -32768.f);
+    const __m256    upper = _mm256_set1_ps( 32767.f);
+    size_t          i     = 0;
+
+    for ( ; i + 16 <= samples; i += 16 ) {
+        __m256  a = _mm256_mul_ps( _mm256_loadu_ps( in + i), scale);
+        __m256  b = _mm256_mul_ps( _mm256_loadu_ps( in + i + 8), scale);
+
+        a = _mm256_min_ps( _mm256_max_ps( a, lower), upper);
+        b = _mm256_min_ps( _mm256_max_ps( b, lower), upper);
+
+        _mm256_storeu_si256( (__m256i *) (out + i),
+            _mm256_permute4x64_epi64(
+                _mm256_packs_epi32( _mm256_cvtps_epi32( a),
+                                    _mm256_cvtps_epi32( b)),
+                0xd8));
+    }
+    toInt16Scalar( in + i, samples - i, out + i);
+}
+
+AVX2_TARGET static void
+downmixAvx2 (   const int16_t     * in,
+                size_t              frames,
+                int16_t           * out )
+{
+    const __m256i   ones = _mm256_set1_epi16( 1);
+    size_t          i    = 0;
+
+    for ( ; i + 16 <= frames; i += 16 ) {
+        __m256i     a = _mm256_loadu_si256( (const __m256i *) (in + 2 * i));
+        __m256i     b = _mm256_loadu_si256(
+                                    (const __m256i *) (in + 2 * i + 16));
+
+        a = _mm256_madd_epi16( a, ones);
+        b = _mm256_madd_epi16( b, ones);
+
+        a = _mm256_srai_epi32(
+                _mm256_add_epi32( a, _mm256_srli_epi32( a, 31)), 1);
+        b = _mm256_srai_epi32(
+                _mm256_add_epi32( b, _mm256_srli_epi32( b, 31)), 1);
+
+        _mm256_storeu_si256( (__m256i *) (out + i),
+            _mm256_permute4x64_epi64( _mm256_packs_epi32( a, b), 0xd8));
+    }
+    downmixScalar( in + 2 * i, frames - i, out + i);
+}
+#endif  // CONV_X86
+
+
+#ifdef CONV_NEON
+/*------------------------------------------------------------------------------
+ *  The NEON kernels
+ *----------------------------------------------------------------------------*/
+static inline int16x8_t
+swapBytesNeon ( int16x8_t   v )
+{
+    return vreinterpretq_s16_u8( vrev16q_u8( vreinterpretq_u8_s16( v)));
+}
+
+static void
+copy16Neon (    const int16_t     * in,
+                size_t              samples,
+                int16_t           * out,
+                bool                swap )
+{
+    size_t      i = 0;
+
+    if ( !swap ) {
+        memmove( out, in, samples * sizeof(int16_t));
+        return;
+    }
+
+    for ( ; i + 8 <= samples; i += 8 ) {
+        vst1q_s16( out + i, swapBytesNeon( vld1q_s16( in + i)));
+    }
+    copy16Scalar( in + i, samples - i, out + i, swap);
+}
+
+static void
+split16Neon (   const int16_t     * in,
+                size_t              frames,
+                int16_t           * left,
+                int16_t           * right,
+                bool                swap )
+{
+    size_t      i = 0;
+
+    for ( ; i + 8 <= frames; i += 8 ) {
+        int16x8x2_t     v = vld2q_s16( in + 2 * i);
+
+        if ( swap ) {
+            v.val[0] = swapBytesNeon( v.val[0]);
+            v.val[1] = swapBytesNeon( v.val[1]);
+        }
+        vst1q_s16( left + i, v.val[0]);
+        vst1q_s16( right + i, v.val[1]);
+    }
+    split16Scalar( in + 2 * i, frames - i, left + i, right + i, swap);
+}
+
+static inline void
+storeFloat16Neon (  int16x8_t   v,
+                    float     * out )
+{
+    const float     scale = 1.f / 32768.f;
+
+    vst1q_f32( out,
+               vmulq_n_f32( vcvtq_f32_s32( vmovl_s16( vget_low_s16( v))),
+                            scale));
+    vst1q_f32( out + 4,
+               vmulq_n_f32( vcvtq_f32_s32( vmovl_s16( vget_high_s16( v))),
+                            scale));
+}
+
+static void
+toFloat16Neon (     const int16_t     * in,
+                    size_t              frames,
+                    unsigned int        channels,
+                    float            ** out )
+{
+    size_t      i = 0;
+
+    if ( channels == 1 ) {
+        for ( ; i + 8 <= frames; i += 8 ) {
+            storeFloat16Neon( vld1q_s16( in + i), out[0] + i);
+        }
+    } else if ( channels == 2 ) {
+        for ( ; i + 8 <= frames; i += 8 ) {
+            int16x8x2_t     v = vld2q_s16( in + 2 * i);
+
+            storeFloat16Neon( v.val[0], out[0] + i);
+            storeFloat16Neon( v.val[1], out[1] + i);
+        }
+    }
+    toFloat16Tail( in, i, frames, channels, out);
+}
+
+static inline int32x4_t
+join24Neon (    uint16x4_t  low,
+                int16x4_t   high )
+{
+    return vorrq_s32( vshlq_n_s32( vmovl_s16( high), 16),
+                      vreinterpretq_s32_u32( vmovl_u16( low)));
+}
+
+static void
+toFloat24Neon (     const unsigned char   * in,
+                    size_t                  samples,
+                    float                 * out )
+{
+    const float     scale = 1.f / 8388608.f;
+    size_t          i     = 0;
+
+    for ( ; i + 16 <= samples; i += 16 ) {
+        uint8x16x3_t    v = vld3q_u8( in + 3 * i);
+        // the low 16 bits, and the sign extended high 8 bits
+        uint16x8_t      lowA = vorrq_u16(
+                                vmovl_u8( vget_low_u8( v.val[0])),
+                                vshlq_n_u16( vmovl_u8( vget_low_u8( v.val[1])),
+                                             8));
+        uint16x8_t      lowB = vorrq_u16(
+                                vmovl_u8( vget_high_u8( v.val[0])),
+                                vshlq_n_u16( vmovl_u8( vget_high_u8( v.val[1])),
+                                             8));
+        int16x8_t       highA = vmovl_s8( vreinterpret_s8_u8(
+                                                vget_low_u8( v.val[2])));
+        int16x8_t       highB = vmovl_s8( vreinterpret_s8_u8(
+                                                vget_high_u8( v.val[2])));
+
+        vst1q_f32( out + i,
+                   vmulq_n_f32( vcvtq_f32_s32( join24Neon(
+                        vget_low_u16( lowA), vget_low_s16( highA))), scale));
+        vst1q_f32( out + i + 4,
+                   vmulq_n_f32( vcvtq_f32_s32( join24Neon(
+                        vget_high_u16( lowA), vget_high_s16( highA))), scale));
+        vst1q_f32( out + i + 8,
+                   vmulq_n_f32( vcvtq_f32_s32( join24Neon(
+                        vget_low_u16( lowB), vget_low_s16( highB))), scale));
+        vst1q_f32( out + i + 12,
+                   vmulq_n_f32( vcvtq_f32_s32( join24Neon(
+                        vget_high_u16( lowB), vget_high_s16( highB))), scale));
+    }
+    toFloat24Scalar( in + 3 * i, samples - i, out + i);
+}
+
+static void
+toFloat32Neon (     const int32_t     * in,
+                    size_t              samples,
+                    float             * out )
+{
+    const float     scale = 1.f / 2147483648.f;
+    size_t          i     = 0;
+
+    for ( ; i + 4 <= samples; i += 4 ) {
+        vst1q_f32( out + i,
+                   vmulq_n_f32( vcvtq_f32_s32( vld1q_s32( in + i)), scale));
+    }
+    toFloat32Scalar( in + i, samples - i, out + i);
+}
+
+#ifdef __aarch64__
+static void
+toInt16Neon (   const float       * in,
+                size_t              samples,
+                int16_t           * out )
+{
+    const float32x4_t   lower = vdupq_n_f32( -32768.f);
+    const float32x4_t   upper = vdupq_n_f32( 32767.f);
+    size_t              i     = 0;
+
+    for ( ; i + 4 <= samples; i += 4 ) {
+        float32x4_t     s = vmulq_n_f32( vld1q_f32( in + i), 32768.f);
+
+        // compare and select, as the NEON max passes not-a-number on
+        s = vbslq_f32( vcgtq_f32( s, lower), s, lower);
+        s = vbslq_f32( vcltq_f32( s, upper), s, upper);
+        vst1_s16( out + i, vqmovn_s32( vcvtnq_s32_f32( s)));
+    }
+    toInt16Scalar( in + i, samples - i, out + i);
+}
+#endif
+
+static void
+downmixNeon (   const int16_t     * in,
+                size_t              frames,
+                int16_t           * out )
+{
+    size_t      i = 0;
+
+    for ( ; i + 8 <= frames; i += 8 ) {
+        int16x8x2_t     v  = vld2q_s16( in + 2 * i);
+        int32x4_t       lo = vaddl_s16( vget_low_s16( v.val[0]),
+                                        vget_low_s16( v.val[1]));
+        int32x4_t       hi = vaddl_s16( vget_high_s16( v.val[0]),
+                                        vget_high_s16( v.val[1]));
+
+        // divide by 2, rounding towards zero as the scalar code does
+        lo = vshrq_n_s32( vaddq_s32( lo, vreinterpretq_s32_u32(
+                    vshrq_n_u32( vreinterpretq_u32_s32( lo), 31))), 1);
+        hi = vshrq_n_s32( vaddq_s32( hi, vreinterpretq_s32_u32(
+                    vshrq_n_u32( vreinterpretq_u32_s32( hi), 31))), 1);
+
+        vst1q_s16( out + i, vcombine_s16( vmovn_s32( lo), vmovn_s32( hi)));
+    }
+    downmixScalar( in + 2 * i, frames - i, out + i);
+}
+#endif  // CONV_NEON
+
+
+/*------------------------------------------------------------------------------
+ *  The kernel sets
+ *----------------------------------------------------------------------------*/
+const ConvKernels::Set ConvKernels::scalar = {
+    "scalar",
+    copy16Scalar,
+    split16Scalar,
+    toFloat16Scalar,
+    toFloat24Scalar,
+    toFloat32Scalar,
+    toInt16Scalar,
+    downmixScalar
+};
+
+ConvKernels::Set ConvKernels::active = {
+    "scalar",
+    copy16Scalar,
+    split16Scalar,
+    toFloat16Scalar,
+    toFloat24Scalar,
+    toFloat32Scalar,
+    toInt16Scalar,
+    downmixScalar
+};
+
+#ifdef CONV_X86
+static const ConvKernels::Set sse2Kernels = {
+    "sse2",
+    copy16Sse2,
+    split16Sse2,
+    toFloat16Sse2,
+    toFloat24Scalar,    // needs a byte shuffle, which SSE2 does not have
+    toFloat32Sse2,
+    toInt16Sse2,
+    downmixSse2
+};
+
+static const ConvKernels::Set avx2Kernels = {
+    "avx2",
+    copy16Avx2,
+    split16Avx2,
+    toFloat16Avx2,
+    toFloat24Avx2,
+    toFloat32Avx2,
+    toInt16Avx2,
+    downmixAvx2
+};
+#endif
+
+#ifdef CONV_NEON
+static const ConvKernels::Set neonKernels = {
+    "neon",
+    copy16Neon,
+    split16Neon,
+    toFloat16Neon,
+    toFloat24Neon,
+    toFloat32Neon,
+#ifdef __aarch64__
+    toInt16Neon,
+#else
+    toInt16Scalar,      // 32 bit ARM has no round to nearest conversion
+#endif
+    downmixNeon
+};
+#endif
+
+/*------------------------------------------------------------------------------
+ *  The names of the checks, as reported on failure
+ *----------------------------------------------------------------------------*/
+const char * const ConvKernels::checkNames[ConvKernels::numChecks] = {
+    "copy16",
+    "copy16 swapped",
+    "split16",
+    "split16 swapped",
+    "toFloat16 mono",
+    "toFloat16 stereo",
+    "toFloat16 3 channels",
+    "toFloat24",
+    "toFloat32",
+    "toInt16",
+    "downmix",
+    "downmix in place"
+};
+
+/*------------------------------------------------------------------------------
+ *  Choose the kernels before main() starts, so that no threads race
+ *  on it. Anything running earlier gets the plain C kernels.
+ *----------------------------------------------------------------------------*/
+static const bool kernelsSelected = ConvKernels::select();
+
+
+/*------------------------------------------------------------------------------
+ *  Choose the fastest kernels the processor supports
+ *----------------------------------------------------------------------------*/
+bool
+ConvKernels :: select ( void )                              throw ()
+{
+    const Set     * kernels = getSupported( 0);
+
+    if ( kernels ) {
+        active = *kernels;
+    }
+
+    return true;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Get the sets of kernels the processor supports, the fastest first
+ *----------------------------------------------------------------------------*/
+const ConvKernels::Set *
+ConvKernels :: getSupported (   unsigned int    i )         throw ()
+{
+    const Set     * sets[2];
+    unsigned int    n = 0;
+
+#ifdef CONV_X86
+    __builtin_cpu_init();
+    if ( __builtin_cpu_supports( "avx2") ) {
+        sets[n++] = &avx2Kernels;
+    }
+    if ( __builtin_cpu_supports( "sse2") ) {
+        sets[n++] = &sse2Kernels;
+    }
+#endif
+#ifdef CONV_NEON
+    sets[n++] = &neonKernels;
+#endif
+
+    return i < n ? sets[i] : 0;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Check a set of kernels against the plain C ones
+ *----------------------------------------------------------------------------*/
+const char *
+ConvKernels :: check (  const Set         * kernels )       throw ()
+{
+    // lengths around the widths of the kernels, and a long one
+    static const size_t lengths[] = { 0, 1, 3, 4, 7, 8, 9, 15, 16, 17,
+                                      31, 32, 33, 63, CONV_CHECK_FRAMES };
+    CheckData           data;
+    CheckData           out[2];
+    uint32_t            seed = 12345;
+
+    // random samples, with the edge cases at the start
+    for ( size_t i = 0; i < CONV_CHECK_SAMPLES; ++i ) {
+        seed             = seed * 1103515245 + 12345;
+        data.shorts[i]   = (int16_t) (seed >> 16);
+        data.ints[i]     = (int32_t) (seed ^ (seed << 13));
+        data.floats[i]   = ((float) (int32_t) seed) / 1073741824.f;
+        data.bytes[3*i]  = (unsigned char) (seed >> 24);
+        data.bytes[3*i+1] = (unsigned char) (seed >> 8);
+        data.bytes[3*i+2] = (unsigned char) (seed >> 20);
+    }
+    data.shorts[0] = -32768;
+    data.shorts[1] = 32767;
+    data.shorts[2] = -1;
+    data.shorts[3] = -32767;
+    data.shorts[4] = -32768;
+    data.shorts[5] = -3;
+    data.ints[0]   = INT32_MIN;
+    data.ints[1]   = INT32_MAX;
+    data.ints[2]   = -1;
+    data.floats[0] = NAN;
+    data.floats[1] = INFINITY;
+    data.floats[2] = -INFINITY;
+    data.floats[3] = 1.f;
+    data.floats[4] = -1.f;
+    data.floats[5] = -0.f;
+    data.floats[6] = 0.5f / 32768.f;
+    data.floats[7] = 1.5f / 32768.f;
+    data.floats[8] = -2.5f / 32768.f;
+    data.floats[9] = 32767.5f / 32768.f;
+
+    for ( unsigned int check = 0; check < numChecks; ++check ) {
+        for ( size_t i = 0; i < sizeof(lengths)/sizeof(size_t); ++i ) {
+            // fill the outputs, to catch writes beyond the end
+            memset( out, 0x55, sizeof(out));
+            runCheck( &scalar, check, lengths[i], &data, &out[0]);
+            runCheck( kernels, check, lengths[i], &data, &out[1]);
+            if ( memcmp( &out[0], &out[1], sizeof(CheckData)) ) {
+                return checkNames[check];
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Run one check on a set of kernels
+ *----------------------------------------------------------------------------*/
+void
+ConvKernels :: runCheck (   const Set         * kernels,
+                            unsigned int        check,
+                            size_t              frames,
+                            const CheckData   * in,
+                            CheckData         * out )       throw ()
+{
+    float     * floats[CONV_CHECK_CHANNELS];
+
+    for ( unsigned int c = 0; c < CONV_CHECK_CHANNELS; ++c ) {
+        floats[c] = out->floats + c * CONV_CHECK_FRAMES;
+    }
+
+    switch ( check ) {
+        case checkCopy16:
+            kernels->copy16( in->shorts, frames, out->shorts, false);
+            break;
+        case checkSwap16:
+            kernels->copy16( in->shorts, frames, out->shorts, true);
+            break;
+        case checkSplit16:
+            kernels->split16( in->shorts, frames, out->shorts,
+                              out->shorts + CONV_CHECK_FRAMES, false);
+            break;
+        case checkSplitSwap16:
+            kernels->split16( in->shorts, frames, out->shorts,
+                              out->shorts + CONV_CHECK_FRAMES, true);
+            break;
+        case checkToFloat16Mono:
+            kernels->toFloat16( in->shorts, frames, 1, floats);
+            break;
+        case checkToFloat16Stereo:
+            kernels->toFloat16( in->shorts, frames, 2, floats);
+            break;
+        case checkToFloat16Other:
+            kernels->toFloat16( in->shorts, frames, CONV_CHECK_CHANNELS, floats);
+            break;
+        case checkToFloat24:
+            kernels->toFloat24( in->bytes, frames * CONV_CHECK_CHANNELS,
+                                out->floats);
+            break;
+        case checkToFloat32:
+            kernels->toFloat32( in->ints, frames * CONV_CHECK_CHANNELS,
+                                out->floats);
+            break;
+        case checkToInt16:
+            kernels->toInt16( in->floats, frames * CONV_CHECK_CHANNELS,
+                              out->shorts);
+            break;
+        case checkDownmix:
+            kernels->downmix( in->shorts, frames, out->shorts);
+            break;
+        case checkDownmixOver:
+            memcpy( out->shorts, in->shorts, sizeof(out->shorts));
+            kernels->downmix( out->shorts, frames, out->shorts);
+            break;
+        default:
+            break;
+    }
+}
+
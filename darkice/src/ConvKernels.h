@@ -0,0 +1,325 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : ConvKernels.h
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+#ifndef CONV_KERNELS_H
+#define CONV_KERNELS_H
+
+#ifndef __cplusplus
+#error This is a C++ include file
+#endif
+
+
+/* ============================================================ include files */
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/* ================================================================ constants */
+
+/**
+ *  The number of sample frames the checks run on: more than the
+ *  widest kernel takes at once, and not a multiple of it.
+ */
+#define CONV_CHECK_FRAMES       203
+
+/**
+ *  The number of channels the checks run on at most.
+ */
+#define CONV_CHECK_CHANNELS     3
+
+/**
+ *  The number of samples the checks run on.
+ */
+#define CONV_CHECK_SAMPLES      (CONV_CHECK_FRAMES * CONV_CHECK_CHANNELS)
+
+
+/* =================================================================== macros */
+
+
+/* =============================================================== data types */
+
+/**
+ *  The inner loops of the sample format conversions, in versions for
+ *  the instruction sets of the processor. The fastest version the
+ *  processor supports is chosen at startup, and each version gives
+ *  exactly the same results as the plain C version. The test run by
+ *  make check makes sure of this, for each version the processor of
+ *  the build host supports.
+ *
+ *  Use through Util::conv() and the like, or as:
+ *
+ *  <pre>
+ *  ConvKernels::get()->toFloat16( samples, frames, channels, floats);
+ *  </pre>
+ *
+ *  @author  $Author$
+ *  @version $Revision$
+ */
+class ConvKernels
+{
+    public:
+
+        /**
+         *  A set of kernels, one function for each conversion.
+         */
+        class Set
+        {
+            public:
+                /**
+                 *  The name of the instruction set, e.g. "sse2".
+                 */
+                const char    * name;
+
+                /**
+                 *  Copy 16 bit samples, swapping their bytes if asked.
+                 *
+                 *  @param in the samples to copy.
+                 *  @param samples the number of samples.
+                 *  @param out put the samples here.
+                 *  @param swap true to swap the two bytes of each sample.
+                 */
+                void (*copy16) ( const int16_t        * in,
+                                 size_t                 samples,
+                                 int16_t              * out,
+                                 bool                   swap );
+
+                /**
+                 *  Split interleaved stereo 16 bit samples into the left
+                 *  and the right channel, swapping their bytes if asked.
+                 *
+                 *  @param in the interleaved samples, 2 * frames values.
+                 *  @param frames the number of sample frames.
+                 *  @param left put the left channel here.
+                 *  @param right put the right channel here.
+                 *  @param swap true to swap the two bytes of each sample.
+                 */
+                void (*split16) ( const int16_t       * in,
+                                  size_t                frames,
+                                  int16_t             * left,
+                                  int16_t             * right,
+                                  bool                  swap );
+
+                /**
+                 *  Convert interleaved 16 bit samples into float samples
+                 *  in [-1, 1), one buffer for each channel.
+                 *
+                 *  @param in the samples, frames * channels values.
+                 *  @param frames the number of sample frames.
+                 *  @param channels the number of channels.
+                 *  @param out a buffer of frames values for each channel.
+                 */
+                void (*toFloat16) ( const int16_t     * in,
+                                    size_t              frames,
+                                    unsigned int        channels,
+                                    float            ** out );
+
+                /**
+                 *  Convert packed little endian 24 bit samples into
+                 *  float samples in [-1, 1).
+                 *
+                 *  @param in the samples, 3 bytes each.
+                 *  @param samples the number of samples.
+                 *  @param out put the float samples here.
+                 */
+                void (*toFloat24) ( const unsigned char * in,
+                                    size_t                samples,
+                                    float               * out );
+
+                /**
+                 *  Convert 32 bit samples into float samples in [-1, 1].
+                 *
+                 *  @param in the samples.
+                 *  @param samples the number of samples.
+                 *  @param out put the float samples here.
+                 */
+                void (*toFloat32) ( const int32_t     * in,
+                                    size_t              samples,
+                                    float             * out );
+
+                /**
+                 *  Convert float samples into 16 bit samples, rounding to
+                 *  the nearest value and saturating at the limits.
+                 *  Not-a-number gives the lowest value.
+                 *
+                 *  @param in the float samples.
+                 *  @param samples the number of samples.
+                 *  @param out put the 16 bit samples here.
+                 */
+                void (*toInt16) ( const float         * in,
+                                  size_t                samples,
+                                  int16_t             * out );
+
+                /**
+                 *  Mix interleaved stereo 16 bit samples down to mono,
+                 *  see Util::downmix().
+                 *
+                 *  @param in the interleaved samples, 2 * frames values.
+                 *  @param frames the number of sample frames.
+                 *  @param out put the mono samples here, may be in.
+                 */
+                void (*downmix) ( const int16_t       * in,
+                                  size_t                frames,
+                                  int16_t             * out );
+        };
+
+
+    private:
+
+        /**
+         *  The checks run on a set of kernels.
+         */
+        enum Check { checkCopy16,
+                     checkSwap16,
+                     checkSplit16,
+                     checkSplitSwap16,
+                     checkToFloat16Mono,
+                     checkToFloat16Stereo,
+                     checkToFloat16Other,
+                     checkToFloat24,
+                     checkToFloat32,
+                     checkToInt16,
+                     checkDownmix,
+                     checkDownmixOver,
+                     numChecks };
+
+        /**
+         *  The names of the checks.
+         */
+        static const char * const   checkNames[numChecks];
+
+        /**
+         *  The samples the checks convert, in all formats.
+         */
+        class CheckData
+        {
+            public:
+                int16_t         shorts[CONV_CHECK_SAMPLES];
+                int32_t         ints[CONV_CHECK_SAMPLES];
+                float           floats[CONV_CHECK_SAMPLES];
+                unsigned char   bytes[3 * CONV_CHECK_SAMPLES];
+        };
+
+        /**
+         *  The kernels in use.
+         */
+        static Set          active;
+
+        /**
+         *  The plain C kernels, the reference for all the others.
+         */
+        static const Set    scalar;
+
+        /**
+         *  Default constructor. Not supported.
+         */
+        ConvKernels ( void );
+
+        /**
+         *  Run one check on a set of kernels.
+         *
+         *  @param kernels the kernels to run.
+         *  @param check the check to run.
+         *  @param frames the number of sample frames to convert.
+         *  @param in the samples to convert.
+         *  @param out put the converted samples here.
+         */
+        static void
+        runCheck (  const Set         * kernels,
+                    unsigned int        check,
+                    size_t              frames,
+                    const CheckData   * in,
+                    CheckData         * out )               throw ();
+
+
+    public:
+
+        /**
+         *  Choose the fastest kernels the processor supports.
+         *  Called once at startup, before main().
+         *
+         *  @return true
+         */
+        static bool
+        select ( void )                                     throw ();
+
+        /**
+         *  Get the sets of kernels compiled in that the processor
+         *  supports, besides the plain C ones. The fastest comes first.
+         *
+         *  @param i the index of the set.
+         *  @return the i-th set, or NULL if there are no more.
+         */
+        static const Set *
+        getSupported ( unsigned int     i )                 throw ();
+
+        /**
+         *  Check that a set of kernels gives the same results as the
+         *  plain C ones, on samples that cover the edge cases.
+         *  Only call with a set the processor supports.
+         *
+         *  @param kernels the kernels to check.
+         *  @return the name of the first check the kernels failed,
+         *          or NULL if they passed all of them.
+         */
+        static const char *
+        check ( const Set         * kernels )               throw ();
+
+        /**
+         *  Get the kernels in use.
+         *
+         *  @return the kernels to call.
+         */
+        static inline const Set *
+        get ( void )                                        throw ()
+        {
+            return &active;
+        }
+
+        /**
+         *  Get the plain C kernels.
+         *
+         *  @return the reference kernels.
+         */
+        static inline const Set *
+        getScalar ( void )                                  throw ()
+        {
+            return &scalar;
+        }
+};
+
+
+/* ================================================= external data structures */
+
+
+/* ====================================================== function prototypes */
+
+
+
+#endif  /* CONV_KERNELS_H */
+
@@ -0,0 +1,93 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : ConvKernelsCheck.cpp
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Abstract :
+
+    Test of the sample conversion kernels, run by make check
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <iostream>
+
+#include "ConvKernels.h"
+
+
+/* ===================================================  local data structures */
+
+
+/* ================================================  local constants & macros */
+
+/*------------------------------------------------------------------------------
+ *  File identity
+ *----------------------------------------------------------------------------*/
+static const char fileid[] = "$Id$";
+
+
+/* ===============================================  local function prototypes */
+
+
+/* =============================================================  module code */
+
+/*------------------------------------------------------------------------------
+ *  Check each set of kernels the processor supports against the plain C
+ *  ones. Exits with 1 if any of them gives different results.
+ *----------------------------------------------------------------------------*/
+int
+main (
+    int     argc,
+    char  * argv[] )
+{
+    const ConvKernels::Set    * kernels;
+    const char                * failed;
+    int                         res = 0;
+
+    for ( unsigned int i = 0; (kernels = ConvKernels::getSupported( i)); ++i ) {
+        if ( (failed = ConvKernels::check( kernels)) ) {
+            std::cerr << kernels->name << ": " << failed
+                      << " differs from the plain C kernel" << std::endl;
+            res = 1;
+        } else {
+            std::cout << kernels->name << ": ok" << std::endl;
+        }
+    }
+
+    // the plain C kernels have to pass against themselves
+    if ( ConvKernels::check( ConvKernels::getScalar()) ) {
+        std::cerr << "scalar: the check does not give the same results "
+                     "twice" << std::endl;
+        res = 1;
+    }
+
+    return res;
+}
+
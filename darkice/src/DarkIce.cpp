@@ -34,6 +34,12 @@
 #include "config.h"
 #endif
 
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#else
+#error need stdio.h
+#endif
+
 #ifdef HAVE_STDLIB_H
 #include <stdlib.h>
 #else
@@ -73,10 +79,12 @@
 
 
 #include "Util.h"
+#include "ConvKernels.h"
 #include "IceCast.h"
 #include "IceCast2.h"
 #include "ShoutCast.h"
 #include "FileCast.h"
+#include "NullSink.h"
 #include "MultiThreadedConnector.h"
 #include "DarkIce.h"
 
@@ -144,16 +152,21 @@ void
 DarkIce :: init ( const Config      & config )              
 {
     unsigned int             bufferSecs;
+    unsigned int             queueDepth;
+    MultiThreadedConnector::OverflowPolicy  queuePolicy;
+    bool                     queuePolicySet;
+    unsigned int             encoderThreads;
     const ConfigSection    * cs;
     const char             * str;
     unsigned int             sampleRate;
     unsigned int             bitsPerSample;
     unsigned int             channel;
-    bool                     reconnect;
     const char             * device;
     const char             * jackClientName;
     const char             * paSourceName;
 
+    reportEvent( 3, "sample conversion kernels:", ConvKernels::get()->name);
+
     // the [general] section
     if ( !(cs = config.get( "general")) ) {
         throw Exception( __FILE__, __LINE__, "no section [general] in config");
@@ -168,6 +181,29 @@ DarkIce :: init ( const Config      & config )
     }
     str           = cs->get( "reconnect");
     reconnect     = str ? (Util::strEq( str, "yes") ? true : false) : true;
+    str           = cs->get( "shareEncoders");
+    shareEncoders = str ? (Util::strEq( str, "yes") ? true : false) : true;
+    str            = cs->get( "connectTimeout");
+    connectTimeout = str ? Util::strToL( str) * 1000
+                         : TcpSocket::defaultConnectTimeout;
+    if ( connectTimeout == 0 ) {
+        throw Exception( __FILE__, __LINE__,
+                         "setting connectTimeout to 0 not supported");
+    }
+
+    // send to the servers from a thread of its own, by default
+    // where epoll is available
+    str           = cs->get( "networkThread");
+#ifdef HAVE_SYS_EPOLL_H
+    if ( !str || Util::strEq( str, "yes") ) {
+        network = new NetworkThread();
+    }
+#else
+    if ( str && Util::strEq( str, "yes") ) {
+        throw Exception( __FILE__, __LINE__,
+                         "no epoll support, can't use a network thread");
+    }
+#endif
 
     // real-time scheduling is enabled by default
     str = cs->get( "realtime" );
@@ -181,6 +217,23 @@ DarkIce :: init ( const Config      & config )
     str = cs->get( "rtprio" );
     realTimeSchedPriority = (str != NULL) ? Util::strToL( str ) : 4;
 
+    // the number of blocks an encoder may lag behind the input
+    str        = cs->get( "queueDepth" );
+    queueDepth = str ? Util::strToL( str)
+                     : MultiThreadedConnector::defaultQueueDepth;
+    if ( queueDepth == 0 ) {
+        throw Exception( __FILE__, __LINE__,
+                         "setting queueDepth to 0 not supported");
+    }
+    str         = cs->get( "queuePolicy" );
+    queuePolicy = str ? MultiThreadedConnector::strToOverflowPolicy( str)
+                      : MultiThreadedConnector::dropOldest;
+    queuePolicySet = str != 0;
+
+    // the number of threads to encode with, as many as CPUs by default
+    str            = cs->get( "encoderThreads" );
+    encoderThreads = str ? Util::strToL( str) : 0;
+
     // the [input] section
     if ( !(cs = config.get( "input")) ) {
         throw Exception( __FILE__, __LINE__, "no section [input] in config");
@@ -202,13 +255,88 @@ DarkIce :: init ( const Config      & config )
                                                     sampleRate,
                                                     bitsPerSample,
                                                     channel );
-    encConnector    = new MultiThreadedConnector( dsp.get(), reconnect );
 
-    noAudioOuts = 0;
+    // the format of the samples, if not integers of bitsPerSample
+    str = cs->get( "sampleFormat");
+    if ( str ) {
+        dsp->setSampleFormat( SampleFormat::fromName( str));
+    }
+
+#ifdef SUPPORT_ALSA_DSP
+    // the device buffer of an ALSA input
+    AlsaDspSource     * alsaDsp = dynamic_cast<AlsaDspSource*>( dsp.get());
+    if ( alsaDsp ) {
+        unsigned int    periodSize;
+        unsigned int    periods;
+
+        str        = cs->get( "periodSize");
+        periodSize = str ? Util::strToL( str) : 0;
+        str        = cs->get( "periods");
+        periods    = str ? Util::strToL( str) : 4;
+        alsaDsp->setPeriods( periodSize, periods);
+
+        str = cs->get( "alsaMmap");
+        alsaDsp->setMmap( str ? (Util::strEq( str, "yes") ? true : false)
+                              : false);
+    }
+#endif
+
+#ifdef SUPPORT_PULSEAUDIO_DSP
+    // the fragments of a PulseAudio input
+    PulseAudioDspSource   * paDsp = dynamic_cast<PulseAudioDspSource*>(
+                                                                dsp.get());
+    if ( paDsp ) {
+        str = cs->get( "paLatency");
+        paDsp->setLatency( str ? Util::strToL( str) : 0);
+
+        str = cs->get( "paSimple");
+        paDsp->setSimple( str ? (Util::strEq( str, "yes") ? true : false)
+                              : false);
+    }
+#endif
+
+    // the test signal of a generator
+    GeneratorSource   * genDsp = dynamic_cast<GeneratorSource*>( dsp.get());
+    if ( genDsp ) {
+        str = cs->get( "generatorFrequency");
+        if ( str ) {
+            genDsp->setFrequency( Util::strToD( str));
+        }
+        str = cs->get( "generatorLevel");
+        if ( str ) {
+            genDsp->setLevel( Util::strToD( str));
+        }
+    }
+
+    // how fast to read a file or a generator
+    str = cs->get( "pacing");
+    if ( str ) {
+        dsp->setPacing( AudioSource::strToPacing( str));
+    }
+
+    // nothing has to be dropped to keep up with a sound card, and
+    // reading at full speed must not starve the rest of the system
+    if ( dsp->getPacing() == AudioSource::batch ) {
+        if ( !queuePolicySet ) {
+            queuePolicy = MultiThreadedConnector::block;
+        }
+        enableRealTime = false;
+    }
+
+    encConnector    = new MultiThreadedConnector( dsp.get(),
+                                                  reconnect,
+                                                  queueDepth,
+                                                  queuePolicy );
+    encConnector->setWorkerThreads( encoderThreads);
+
+    noAudioOuts  = 0;
+    bufferMemory = 0;
     configIceCast( config, bufferSecs);
     configIceCast2( config, bufferSecs);
     configShoutCast( config, bufferSecs);
     configFileCast( config);
+    configNull( config);
+    reportEvent( 3, "buffers of all outputs, at most", bufferMemory, "bytes");
 }
 
 
@@ -222,15 +350,13 @@ DarkIce :: configIceCast (  const Config      & config,
 {
     // look for IceCast encoder output streams,
     // sections [icecast-0], [icecast-1], ...
-    char            stream[]        = "icecast- ";
-    size_t          streamLen       = Util::strLen( stream);
+    char            stream[16];
     unsigned int    u;
 
     for ( u = noAudioOuts; u < maxOutput; ++u ) {
         const ConfigSection    * cs;
 
-        // ugly hack to change the section name to "stream0", "stream1", etc.
-        stream[streamLen-1] = '0' + (u - noAudioOuts);
+        snprintf( stream, sizeof( stream), "icecast-%u", u - noAudioOuts);
 
         if ( !(cs = config.get( stream)) ) {
             break;
@@ -267,7 +393,9 @@ DarkIce :: configIceCast (  const Config      & config,
         bool                        fileAddDate     = false;
         const char                * fileDateFormat  = 0;
         BufferedSink              * audioOut        = 0;
+        Sink                      * encoderSink     = 0;
         int                         bufferSize      = 0;
+        unsigned int                nominalRate     = 0;
 
         str         = cs->get( "sampleRate");
         sampleRate  = str ? Util::strToL( str) : dsp->getSampleRate();
@@ -336,8 +464,13 @@ DarkIce :: configIceCast (  const Config      & config,
         fileAddDate = str ? (Util::strEq( str, "yes") ? true : false) : false;
         fileDateFormat = cs->get("fileDateFormat");
 
-        bufferSize = dsp->getSampleSize() * dsp->getSampleRate() * bufferSecs;
-        reportEvent( 3, "buffer size: ", bufferSize);
+        bufferSize  = outputBufferSize( cs, cs->get( "format"), bitrateMode,
+                                        bitrate, 0, bufferSecs);
+        nominalRate = bitrate ? bitrate
+                              : peakBitrate( cs->get( "format"), bitrateMode,
+                                             bitrate, 0);
+        bufferMemory += bufferSize;
+        reportEvent( 3, stream, "buffer size:", bufferSize, "bytes");
 
         localDumpName = cs->get( "localDumpFile");
 
@@ -358,6 +491,8 @@ DarkIce :: configIceCast (  const Config      & config,
         }
         // streaming related stuff
         audioOuts[u].socket = new TcpSocket( server, port);
+        audioOuts[u].socket->setConnectTimeout( connectTimeout);
+        configSocket( cs, stream, audioOuts[u].socket.get(), nominalRate);
         audioOuts[u].server = new IceCast( audioOuts[u].socket.get(),
                                            password,
                                            mountPoint,
@@ -381,10 +516,21 @@ DarkIce :: configIceCast (  const Config      & config,
         // augment audio outs with a buffer when used from encoder
         audioOut = new BufferedSink( audioOuts[u].server.get(),
                                                   bufferSize, 1);
+        audioOut->setNetworkThread( network.get());
+        configSpill( cs, stream, audioOut);
+        configPacing( cs, stream, audioOut, nominalRate);
+
+        // one encoder may feed several servers
+        encoderSink = shareEncoder( u, stream, str, bitrateMode, bitrate,
+                                    quality, sampleRate, channel,
+                                    lowpass, highpass, audioOut);
+        if ( !encoderSink ) {
+            continue;
+        }
 
 #ifdef HAVE_LAME_LIB
         if ( Util::strEq( str, "mp3") ) {
-            audioOuts[u].encoder = new LameLibEncoder( audioOut,
+            audioOuts[u].encoder = new LameLibEncoder( encoderSink,
                                           dsp.get(),
                                           bitrateMode,
                                           bitrate,
@@ -398,7 +544,7 @@ DarkIce :: configIceCast (  const Config      & config,
 #ifdef HAVE_TWOLAME_LIB
         if ( Util::strEq( str, "mp2") ) {
             audioOuts[u].encoder = new TwoLameLibEncoder(
-                                            audioOut,
+                                            encoderSink,
                                             dsp.get(),
                                             bitrateMode,
                                             bitrate,
@@ -407,11 +553,11 @@ DarkIce :: configIceCast (  const Config      & config,
         }
 #endif
 
-        encConnector->attach( audioOuts[u].encoder.get());
+        attachOutput( cs, audioOuts[u].encoder.get());
 #endif // HAVE_LAME_LIB || HAVE_TWOLAME_LIB
     }
 
-    noAudioOuts += u;
+    noAudioOuts = u;
 }
 
 
@@ -425,15 +571,13 @@ DarkIce :: configIceCast2 (  const Config      & config,
 {
     // look for IceCast2 encoder output streams,
     // sections [icecast2-0], [icecast2-1], ...
-    char            stream[]        = "icecast2- ";
-    size_t          streamLen       = Util::strLen( stream);
+    char            stream[16];
     unsigned int    u;
 
     for ( u = noAudioOuts; u < maxOutput; ++u ) {
         const ConfigSection    * cs;
 
-        // ugly hack to change the section name to "stream0", "stream1", etc.
-        stream[streamLen-1] = '0' + (u - noAudioOuts);
+        snprintf( stream, sizeof( stream), "icecast2-%u", u - noAudioOuts);
 
         if ( !(cs = config.get( stream)) ) {
             break;
@@ -466,7 +610,9 @@ DarkIce :: configIceCast2 (  const Config      & config,
         bool                        fileAddDate     = false;
         const char                * fileDateFormat  = 0;
         BufferedSink              * audioOut        = 0;
+        Sink                      * encoderSink     = 0;
         int                         bufferSize      = 0;
+        unsigned int                nominalRate     = 0;
 
         str         = cs->getForSure( "format", " missing in section ", stream);
         if ( Util::strEq( str, "vorbis") ) {
@@ -555,8 +701,13 @@ DarkIce :: configIceCast2 (  const Config      & config,
         fileAddDate = str ? (Util::strEq( str, "yes") ? true : false) : false;
         fileDateFormat = cs->get( "fileDateFormat");
 
-        bufferSize = dsp->getSampleSize() * dsp->getSampleRate() * bufferSecs;
-        reportEvent( 3, "buffer size: ", bufferSize);
+        bufferSize  = outputBufferSize( cs, cs->get( "format"), bitrateMode,
+                                        bitrate, maxBitrate, bufferSecs);
+        nominalRate = bitrate ? bitrate
+                              : peakBitrate( cs->get( "format"), bitrateMode,
+                                             bitrate, maxBitrate);
+        bufferMemory += bufferSize;
+        reportEvent( 3, stream, "buffer size:", bufferSize, "bytes");
 
         localDumpName = cs->get( "localDumpFile");
 
@@ -577,6 +728,8 @@ DarkIce :: configIceCast2 (  const Config      & config,
 
         // streaming related stuff
         audioOuts[u].socket = new TcpSocket( server, port);
+        audioOuts[u].socket->setConnectTimeout( connectTimeout);
+        configSocket( cs, stream, audioOuts[u].socket.get(), nominalRate);
         audioOuts[u].server = new IceCast2( audioOuts[u].socket.get(),
                                             username,
                                             password,
@@ -592,6 +745,18 @@ DarkIce :: configIceCast2 (  const Config      & config,
 
         audioOut = new BufferedSink( audioOuts[u].server.get(),
                                      bufferSize, 1);
+        audioOut->setNetworkThread( network.get());
+        configSpill( cs, stream, audioOut);
+        configPacing( cs, stream, audioOut, nominalRate);
+
+        // one encoder may feed several servers
+        encoderSink = shareEncoder( u, stream, cs->get( "format"),
+                                    bitrateMode, bitrate, quality,
+                                    sampleRate, channel,
+                                    lowpass, highpass, audioOut);
+        if ( !encoderSink ) {
+            continue;
+        }
 
         switch ( format ) {
             case IceCast2::mp3:
@@ -602,7 +767,7 @@ DarkIce :: configIceCast2 (  const Config      & config,
                                  stream);
 #else
                 audioOuts[u].encoder = new LameLibEncoder(
-                                             audioOut,
+                                             encoderSink,
                                              dsp.get(),
                                              bitrateMode,
                                              bitrate,
@@ -625,7 +790,7 @@ DarkIce :: configIceCast2 (  const Config      & config,
 #else
 
                 audioOuts[u].encoder = new VorbisLibEncoder(
-                                               audioOut,
+                                               encoderSink,
                                                dsp.get(),
                                                bitrateMode,
                                                bitrate,
@@ -646,7 +811,7 @@ DarkIce :: configIceCast2 (  const Config      & config,
 #else
 
                 audioOuts[u].encoder = new OpusLibEncoder(
-                                               audioOut,
+                                               encoderSink,
                                                dsp.get(),
                                                bitrateMode,
                                                bitrate,
@@ -667,7 +832,7 @@ DarkIce :: configIceCast2 (  const Config      & config,
 #else
 
                 audioOuts[u].encoder = new FlacLibEncoder(
-                                               audioOut,
+                                               encoderSink,
                                                dsp.get(),
                                                bitrateMode,
                                                bitrate,
@@ -687,7 +852,7 @@ DarkIce :: configIceCast2 (  const Config      & config,
                                  stream);
 #else
                 audioOuts[u].encoder = new TwoLameLibEncoder(
-                                                audioOut,
+                                                encoderSink,
                                                 dsp.get(),
                                                 bitrateMode,
                                                 bitrate,
@@ -706,7 +871,7 @@ DarkIce :: configIceCast2 (  const Config      & config,
                                 stream);
 #else
                 audioOuts[u].encoder = new FaacEncoder(
-                                          audioOut,
+                                          encoderSink,
                                           dsp.get(),
                                           bitrateMode,
                                           bitrate,
@@ -725,7 +890,7 @@ DarkIce :: configIceCast2 (  const Config      & config,
                                 stream);
 #else
                 audioOuts[u].encoder = new aacPlusEncoder(
-                                             audioOut,
+                                             encoderSink,
                                              dsp.get(),
                                              bitrateMode,
                                              bitrate,
@@ -741,10 +906,10 @@ DarkIce :: configIceCast2 (  const Config      & config,
                                 "Illegal stream format: ", format);
         }
 
-        encConnector->attach( audioOuts[u].encoder.get());
+        attachOutput( cs, audioOuts[u].encoder.get());
     }
 
-    noAudioOuts += u;
+    noAudioOuts = u;
 }
 
 
@@ -758,15 +923,13 @@ DarkIce :: configShoutCast (    const Config      & config,
 {
     // look for Shoutcast encoder output streams,
     // sections [shoutcast-0], [shoutcast-1], ...
-    char            stream[]        = "shoutcast- ";
-    size_t          streamLen       = Util::strLen( stream);
+    char            stream[16];
     unsigned int    u;
 
     for ( u = noAudioOuts; u < maxOutput; ++u ) {
         const ConfigSection    * cs;
 
-        // ugly hack to change the section name to "stream0", "stream1", etc.
-        stream[streamLen-1] = '0' + (u - noAudioOuts);
+        snprintf( stream, sizeof( stream), "shoutcast-%u", u - noAudioOuts);
 
         if ( !(cs = config.get( stream)) ) {
             break;
@@ -870,8 +1033,17 @@ DarkIce :: configShoutCast (    const Config      & config,
         fileAddDate = str ? (Util::strEq( str, "yes") ? true : false) : false;
         fileDateFormat = cs->get( "fileDateFormat");
 
-        bufferSize = dsp->getBitsPerSample() / 8 * dsp->getSampleRate() * dsp->getChannel() * bufferSecs;
-        reportEvent( 3, "buffer size: ", bufferSize);
+        // the buffer is before the encoder here, so it holds raw audio
+        str        = cs->get( "bufferSecs");
+        bufferSize = dsp->getBitsPerSample() / 8 * dsp->getSampleRate()
+                   * dsp->getChannel()
+                   * (str ? Util::strToL( str) : bufferSecs);
+        if ( bufferSize == 0 ) {
+            throw Exception( __FILE__, __LINE__,
+                             "setting bufferSecs to 0 not supported");
+        }
+        bufferMemory += bufferSize;
+        reportEvent( 3, stream, "buffer size:", bufferSize, "bytes");
 
         localDumpName = cs->get( "localDumpFile");
 
@@ -893,6 +1065,10 @@ DarkIce :: configShoutCast (    const Config      & config,
 
         // streaming related stuff
         audioOuts[u].socket = new TcpSocket( server, port);
+        audioOuts[u].socket->setConnectTimeout( connectTimeout);
+        configSocket( cs, stream, audioOuts[u].socket.get(),
+                      bitrate ? bitrate
+                              : peakBitrate( "mp3", bitrateMode, bitrate, 0));
         audioOuts[u].server = new ShoutCast( audioOuts[u].socket.get(),
                                              password,
                                              mountPoint,
@@ -918,11 +1094,11 @@ DarkIce :: configShoutCast (    const Config      & config,
                                       highpass );
         audioOuts[u].encoder = new BufferedSink(encoder, bufferSize, dsp->getSampleSize());
 
-        encConnector->attach( audioOuts[u].encoder.get());
+        attachOutput( cs, audioOuts[u].encoder.get());
 #endif // HAVE_LAME_LIB
     }
 
-    noAudioOuts += u;
+    noAudioOuts = u;
 }
 
 
@@ -935,15 +1111,13 @@ DarkIce :: configFileCast (  const Config      & config )
 {
     // look for FileCast encoder output streams,
     // sections [file-0], [file-1], ...
-    char            stream[]        = "file- ";
-    size_t          streamLen       = Util::strLen( stream);
+    char            stream[16];
     unsigned int    u;
 
     for ( u = noAudioOuts; u < maxOutput; ++u ) {
         const ConfigSection    * cs;
 
-        // ugly hack to change the section name to "stream0", "stream1", etc.
-        stream[streamLen-1] = '0' + (u - noAudioOuts);
+        snprintf( stream, sizeof( stream), "file-%u", u - noAudioOuts);
 
         if ( !(cs = config.get( stream)) ) {
             break;
@@ -1156,10 +1330,453 @@ DarkIce :: configFileCast (  const Config      & config )
                                 "Illegal stream format: ", format);
         }
 
-        encConnector->attach( audioOuts[u].encoder.get());
+        attachOutput( cs, audioOuts[u].encoder.get());
+    }
+
+    noAudioOuts = u;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Look for the null outputs in the config file
+ *----------------------------------------------------------------------------*/
+void
+DarkIce :: configNull (  const Config      & config )
+{
+    // look for null outputs, sections [null-0], [null-1], ...
+    // with no limit of one digit, to load the encoders with many of them
+    char            stream[16];
+    unsigned int    u;
+
+    for ( u = noAudioOuts; u < maxOutput; ++u ) {
+        const ConfigSection    * cs;
+
+        snprintf( stream, sizeof( stream), "null-%u", u - noAudioOuts);
+
+        if ( !(cs = config.get( stream)) ) {
+            break;
+        }
+
+        const char                * str;
+
+        const char                * format          = 0;
+        AudioEncoder::BitrateMode   bitrateMode;
+        unsigned int                bitrate         = 0;
+        double                      quality         = 0.0;
+        unsigned int                sampleRate      = 0;
+        int                         lowpass         = 0;
+        int                         highpass        = 0;
+        unsigned int                compression     = 0;
+
+        format      = cs->getForSure( "format", " missing in section ", stream);
+
+        str         = cs->get( "sampleRate");
+        sampleRate  = str ? Util::strToL( str) : dsp->getSampleRate();
+        str         = cs->get( "bitrate");
+        bitrate     = str ? Util::strToL( str) : 0;
+        str         = cs->get( "quality");
+        quality     = str ? Util::strToD( str) : 0.0;
+        str         = cs->get( "compression");
+        compression = str ? Util::strToL( str) : 5;
+        str         = cs->get( "lowpass");
+        lowpass     = str ? Util::strToL( str) : 0;
+        str         = cs->get( "highpass");
+        highpass    = str ? Util::strToL( str) : 0;
+
+        str         = cs->getForSure( "bitrateMode",
+                                      " not specified in section ",
+                                      stream);
+        if ( Util::strEq( str, "cbr") ) {
+            bitrateMode = AudioEncoder::cbr;
+        } else if ( Util::strEq( str, "abr") ) {
+            bitrateMode = AudioEncoder::abr;
+        } else if ( Util::strEq( str, "vbr") ) {
+            bitrateMode = AudioEncoder::vbr;
+        } else {
+            throw Exception( __FILE__, __LINE__,
+                             "invalid bitrate mode: ", str);
+        }
+        if ( bitrateMode != AudioEncoder::vbr && bitrate == 0 ) {
+            throw Exception( __FILE__, __LINE__,
+                             "bitrate not specified in section ", stream);
+        }
+
+        // go on and create the things
+
+        // the encoder writes straight into the null sink. the sink is
+        // let go if no encoder takes it
+        Ref<Sink>   sink = new NullSink( stream);
+
+        audioOuts[u].socket = 0;
+        audioOuts[u].server = 0;
+
+        if ( Util::strEq( format, "mp3") ) {
+#ifndef HAVE_LAME_LIB
+                throw Exception( __FILE__, __LINE__,
+                                 "DarkIce not compiled with lame support, "
+                                 "thus can't create mp3 stream: ",
+                                 stream);
+#else
+                audioOuts[u].encoder = new LameLibEncoder( sink.get(),
+                                                           dsp.get(),
+                                                           bitrateMode,
+                                                           bitrate,
+                                                           quality,
+                                                           sampleRate,
+                                                           dsp->getChannel(),
+                                                           lowpass,
+                                                           highpass );
+#endif // HAVE_LAME_LIB
+        } else if ( Util::strEq( format, "mp2") ) {
+#ifndef HAVE_TWOLAME_LIB
+                throw Exception( __FILE__, __LINE__,
+                                "DarkIce not compiled with TwoLAME support, "
+                                "thus can't create MPEG Audio Layer 2 stream: ",
+                                stream);
+#else
+                audioOuts[u].encoder = new TwoLameLibEncoder(
+                                                    sink.get(),
+                                                    dsp.get(),
+                                                    bitrateMode,
+                                                    bitrate,
+                                                    sampleRate,
+                                                    dsp->getChannel() );
+#endif // HAVE_TWOLAME_LIB
+        } else if ( Util::strEq( format, "vorbis") ) {
+#ifndef HAVE_VORBIS_LIB
+                throw Exception( __FILE__, __LINE__,
+                                "DarkIce not compiled with Ogg Vorbis support, "
+                                "thus can't Ogg Vorbis stream: ",
+                                stream);
+#else
+                audioOuts[u].encoder = new VorbisLibEncoder(
+                                                    sink.get(),
+                                                    dsp.get(),
+                                                    bitrateMode,
+                                                    bitrate,
+                                                    quality,
+                                                    sampleRate,
+                                                    dsp->getChannel() );
+#endif // HAVE_VORBIS_LIB
+        } else if ( Util::strEq( format, "opus") ) {
+#ifndef HAVE_OPUS_LIB
+                throw Exception( __FILE__, __LINE__,
+                                "DarkIce not compiled with Ogg Opus support, "
+                                "thus can't Ogg Opus stream: ",
+                                stream);
+#else
+                audioOuts[u].encoder = new OpusLibEncoder(
+                                                    sink.get(),
+                                                    dsp.get(),
+                                                    bitrateMode,
+                                                    bitrate,
+                                                    quality,
+                                                    sampleRate,
+                                                    dsp->getChannel() );
+#endif // HAVE_OPUS_LIB
+        } else if ( Util::strEq( format, "flac") ) {
+#ifndef HAVE_FLAC_LIB
+                throw Exception( __FILE__, __LINE__,
+                                "DarkIce not compiled with Ogg FLAC support, "
+                                "thus can't Ogg FLAC stream: ",
+                                stream);
+#else
+                audioOuts[u].encoder = new FlacLibEncoder(
+                                                    sink.get(),
+                                                    dsp.get(),
+                                                    bitrateMode,
+                                                    bitrate,
+                                                    quality,
+                                                    sampleRate,
+                                                    dsp->getChannel(),
+                                                    compression );
+#endif // HAVE_FLAC_LIB
+        } else if ( Util::strEq( format, "aac") ) {
+#ifndef HAVE_FAAC_LIB
+                throw Exception( __FILE__, __LINE__,
+                                "DarkIce not compiled with AAC support, "
+                                "thus can't aac stream: ",
+                                stream);
+#else
+                audioOuts[u].encoder = new FaacEncoder( sink.get(),
+                                                        dsp.get(),
+                                                        bitrateMode,
+                                                        bitrate,
+                                                        quality,
+                                                        sampleRate,
+                                                        dsp->getChannel());
+#endif // HAVE_FAAC_LIB
+        } else if ( Util::strEq( format, "aacp") ) {
+#ifndef HAVE_FDKAAC_LIB
+                throw Exception( __FILE__, __LINE__,
+                                "DarkIce not compiled with AAC+ support, "
+                                "thus can't aacplus stream: ",
+                                stream);
+#else
+                audioOuts[u].encoder = new aacPlusEncoder( sink.get(),
+                                                           dsp.get(),
+                                                           bitrateMode,
+                                                           bitrate,
+                                                           quality,
+                                                           sampleRate,
+                                                           dsp->getChannel());
+#endif // HAVE_FDKAAC_LIB
+        } else {
+                throw Exception( __FILE__, __LINE__,
+                                "Illegal stream format: ", format);
+        }
+
+        attachOutput( cs, audioOuts[u].encoder.get());
     }
 
-    noAudioOuts += u;
+    noAudioOuts = u;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Share the encoder of an earlier output with the same settings
+ *----------------------------------------------------------------------------*/
+Sink *
+DarkIce :: shareEncoder (   unsigned int                u,
+                            const char                * stream,
+                            const char                * format,
+                            AudioEncoder::BitrateMode   bitrateMode,
+                            unsigned int                bitrate,
+                            double                      quality,
+                            unsigned int                sampleRate,
+                            unsigned int                channel,
+                            int                         lowpass,
+                            int                         highpass,
+                            BufferedSink              * target )
+{
+    unsigned int    i;
+
+    // a server reconnecting in the middle of an Ogg stream would miss
+    // its headers, so only streams of self contained frames are shared
+    if ( !shareEncoders
+      || !(Util::strEq( format, "mp3") || Util::strEq( format, "mp2")
+        || Util::strEq( format, "aac") || Util::strEq( format, "aacp")) ) {
+        return target;
+    }
+
+    snprintf( audioOuts[u].encoderKey, sizeof( audioOuts[u].encoderKey),
+              "%s %d %u %g %u %u %d %d",
+              format, (int) bitrateMode, bitrate, quality,
+              sampleRate, channel, lowpass, highpass);
+
+    // the fan out reopens a lost target in a thread of its own, the
+    // target reopening itself would hold up the shared encoder
+    target->setSelfReopen( false);
+
+    for ( i = 0; i < u; ++i ) {
+        if ( audioOuts[i].fanOut != 0
+          && Util::strEq( audioOuts[i].encoderKey, audioOuts[u].encoderKey) ) {
+            audioOuts[i].fanOut->addTarget( target);
+            reportEvent( 2, stream, "shares the encoder of output", i);
+            return 0;
+        }
+    }
+
+    audioOuts[u].fanOut = new FanOutSink( stream, reconnect);
+    audioOuts[u].fanOut->addTarget( target);
+
+    return audioOuts[u].fanOut.get();
+}
+
+
+/*------------------------------------------------------------------------------
+ *  The highest bit rate of an encoder
+ *----------------------------------------------------------------------------*/
+unsigned int
+DarkIce :: peakBitrate (    const char                * format,
+                            AudioEncoder::BitrateMode   bitrateMode,
+                            unsigned int                bitrate,
+                            unsigned int                maxBitrate )
+{
+    if ( maxBitrate ) {
+        return maxBitrate;
+    } else if ( bitrate && bitrateMode == AudioEncoder::cbr ) {
+        return bitrate;
+    } else if ( bitrate ) {
+        // leave room for the peaks around the average
+        return bitrate * 2;
+    } else if ( Util::strEq( format, "mp2") ) {
+        return 384;
+    } else if ( Util::strEq( format, "vorbis") ) {
+        return 500;
+    } else if ( Util::strEq( format, "opus") ) {
+        return 510;
+    } else if ( Util::strEq( format, "flac") ) {
+        // lossless may be as big as the raw audio
+        return dsp->getSampleSize() * dsp->getSampleRate() / 125;
+    }
+
+    return 320;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  The size of the buffer of an output
+ *----------------------------------------------------------------------------*/
+unsigned int
+DarkIce :: outputBufferSize (   const ConfigSection       * cs,
+                                const char                * format,
+                                AudioEncoder::BitrateMode   bitrateMode,
+                                unsigned int                bitrate,
+                                unsigned int                maxBitrate,
+                                unsigned int                bufferSecs )
+{
+    const char    * str;
+    unsigned int    secs;
+    unsigned int    size;
+
+    str  = cs->get( "bufferSecs");
+    secs = str ? Util::strToL( str) : bufferSecs;
+    if ( secs == 0 ) {
+        throw Exception( __FILE__, __LINE__,
+                         "setting bufferSecs to 0 not supported");
+    }
+
+    size = peakBitrate( format, bitrateMode, bitrate, maxBitrate) * 125 * secs;
+
+    // hold an Ogg page, or a burst of frames, at the least
+    if ( size < 65536 ) {
+        size = 65536;
+    }
+
+    return size;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Let an output keep its stream in a file while its server is gone
+ *----------------------------------------------------------------------------*/
+void
+DarkIce :: configSpill (    const ConfigSection    * cs,
+                            const char             * stream,
+                            BufferedSink           * sink )
+{
+    const char            * fileName;
+    const char            * str;
+    unsigned long long      size;
+    SpillBuffer           * spill;
+
+    if ( !(fileName = cs->get( "spillFile")) ) {
+        return;
+    }
+
+    str     = cs->get( "spillSize");
+    size    = (str ? Util::strToL( str) : 64) * 1024ULL * 1024ULL;
+    if ( size == 0 ) {
+        throw Exception( __FILE__, __LINE__,
+                         "setting spillSize to 0 not supported in ", stream);
+    }
+
+    spill = new SpillBuffer( fileName, size);
+    sink->setSpill( spill);
+
+    reportEvent( 3, stream, "spill file of", spill->getSize(), "bytes");
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Let an output send its backlog at a bounded rate
+ *----------------------------------------------------------------------------*/
+void
+DarkIce :: configPacing (   const ConfigSection    * cs,
+                            const char             * stream,
+                            BufferedSink           * sink,
+                            unsigned int             bitrate )
+{
+    const char            * str;
+    double                  catchUp;
+    double                  burst;
+
+    str     = cs->get( "catchUpRate");
+    catchUp = str ? Util::strToD( str) : 2.0;
+    str     = cs->get( "catchUpBurst");
+    burst   = str ? Util::strToD( str) : 1.0;
+    if ( catchUp <= 1.0 || burst <= 0.0 ) {
+        throw Exception( __FILE__, __LINE__,
+                         "catchUpRate must be above 1 and catchUpBurst "
+                         "above 0 in ", stream);
+    }
+
+    sink->setPacing( bitrate * 125, catchUp, burst);
+
+    reportEvent( 4, stream, "backlog paced at", bitrate * 125 * catchUp,
+                 "bytes per second");
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Set the options of the socket of an output
+ *----------------------------------------------------------------------------*/
+void
+DarkIce :: configSocket (   const ConfigSection    * cs,
+                            const char             * stream,
+                            TcpSocket              * socket,
+                            unsigned int             bitrate )
+{
+    const char    * str;
+    bool            lowLatency;
+    unsigned int    sendBufferBytes = 0;
+    unsigned int    notSentLowat    = 0;
+    bool            noDelay         = false;
+    unsigned int    userTimeout     = 0;
+
+    // keep half a second of the stream in the kernel at most, wake up
+    // to send when a little is left unsent, and drop a peer that does
+    // not acknowledge for ten seconds
+    str        = cs->get( "lowLatency");
+    lowLatency = str ? Util::strEq( str, "yes") : false;
+    if ( lowLatency ) {
+        sendBufferBytes = bitrate * 125 / 2;
+        if ( sendBufferBytes < 32768 ) {
+            sendBufferBytes = 32768;
+        }
+        notSentLowat    = 16384;
+        noDelay         = true;
+        userTimeout     = 10000;
+    }
+
+    // the settings of their own override the preset
+    str             = cs->get( "sendBufferBytes");
+    sendBufferBytes = str ? Util::strToL( str) : sendBufferBytes;
+    str             = cs->get( "notSentLowat");
+    notSentLowat    = str ? Util::strToL( str) : notSentLowat;
+    str             = cs->get( "noDelay");
+    noDelay         = str ? Util::strEq( str, "yes") : noDelay;
+    str             = cs->get( "userTimeoutMs");
+    userTimeout     = str ? Util::strToL( str) : userTimeout;
+
+    socket->setSocketOptions( sendBufferBytes, notSentLowat,
+                              noDelay, userTimeout);
+
+    if ( lowLatency ) {
+        reportEvent( 3, stream, "low latency socket options");
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Attach an output to the encoding connector
+ *----------------------------------------------------------------------------*/
+void
+DarkIce :: attachOutput (   const ConfigSection    * cs,
+                            Sink                   * sink )
+{
+    const char                                * str;
+    unsigned int                                queueDepth;
+    MultiThreadedConnector::OverflowPolicy      queuePolicy;
+
+    str         = cs->get( "queueDepth");
+    queueDepth  = str ? Util::strToL( str) : 0;
+    str         = cs->get( "queuePolicy");
+    queuePolicy = str ? MultiThreadedConnector::strToOverflowPolicy( str)
+                      : encConnector->getQueuePolicy();
+
+    encConnector->attach( sink, queueDepth, queuePolicy);
 }
 
 
@@ -1260,6 +1877,18 @@ DarkIce :: encode ( void )
     unsigned int       len;
     unsigned long      bytes;
 
+    // read the sound card in a thread of its own, at the real-time
+    // priority, so that it is not held up by handing data to the encoders
+    encConnector->setCaptureRate( dsp->getSampleRate() * dsp->getSampleSize());
+    encConnector->setCapturePriority( enableRealTime ? realTimeSchedPriority
+                                                     : 0);
+    // the workers encode below the capture thread, and only in real-time
+    // when the capture thread is, as reading a file at full speed must
+    // not starve the rest of the system
+    encConnector->setWorkerPriority( !enableRealTime ? 0
+                                   : realTimeSchedPriority > 1
+                                   ? realTimeSchedPriority - 1 : 1);
+
     if ( !encConnector->open() ) {
         throw Exception( __FILE__, __LINE__, "can't open connector");
     }
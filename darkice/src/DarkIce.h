@@ -54,10 +54,12 @@
 #include "Ref.h"
 #include "AudioSource.h"
 #include "BufferedSink.h"
-#include "Connector.h"
+#include "MultiThreadedConnector.h"
 #include "AudioEncoder.h"
 #include "TcpSocket.h"
 #include "CastSink.h"
+#include "FanOutSink.h"
+#include "NetworkThread.h"
 #include "DarkIceConfig.h"
 
 
@@ -83,7 +85,7 @@ class DarkIce : public virtual Referable, public virtual Reporter
          *  The maximum number of supported outputs. This should be
          *  <supported output types> * <outputs per type>
          */
-        static const unsigned int       maxOutput = 4 * 7;
+        static const unsigned int       maxOutput = 8 * 8;
         
         /**
          *  Type describing each lame library output.
@@ -92,6 +94,8 @@ class DarkIce : public virtual Referable, public virtual Reporter
             Ref<Sink>               encoder;
             Ref<TcpSocket>          socket;
             Ref<CastSink>           server;
+            Ref<FanOutSink>         fanOut;
+            char                    encoderKey[64];
         } Output;
 
         /**
@@ -117,7 +121,33 @@ class DarkIce : public virtual Referable, public virtual Reporter
         /**
          *  The encoding Connector, connecting the dsp to the encoders.
          */
-        Ref<Connector>          encConnector;
+        Ref<MultiThreadedConnector>     encConnector;
+
+        /**
+         *  Reconnect the outputs that fail.
+         */
+        bool                    reconnect;
+
+        /**
+         *  Let outputs with the same encoder settings share one encoder.
+         */
+        bool                    shareEncoders;
+
+        /**
+         *  The bytes of buffer memory the outputs may use together.
+         */
+        unsigned long           bufferMemory;
+
+        /**
+         *  The time to give up connecting to a server after,
+         *  in milliseconds.
+         */
+        unsigned int            connectTimeout;
+
+        /**
+         *  The thread sending to the servers, if any.
+         */
+        Ref<NetworkThread>      network;
 
         /**
          *  Should we turn real-time scheduling on ?
@@ -200,6 +230,150 @@ class DarkIce : public virtual Referable, public virtual Reporter
         configFileCast  (   const Config   & config )
                                                             ;
 
+        /**
+         *  Look for null outputs from the config file, that encode and
+         *  throw the result away. Called from init()
+         *
+         *  @param config the config Object to read initialization
+         *                information from.
+         *  @exception Exception
+         */
+        void
+        configNull      (   const Config   & config )       ;
+
+        /**
+         *  Let an output share the encoder of an earlier output with
+         *  the same encoder settings, or make the encoder of this
+         *  output sharable. Only formats that a server can pick up in
+         *  the middle of the stream are shared, not Ogg ones.
+         *
+         *  @param u the index of the output.
+         *  @param stream the name of the config section of the output.
+         *  @param format the name of the format of the encoder.
+         *  @param bitrateMode the bit rate mode of the encoder.
+         *  @param bitrate the bit rate of the encoder.
+         *  @param quality the quality of the encoder.
+         *  @param sampleRate the sample rate of the encoder.
+         *  @param channel the number of channels of the encoder.
+         *  @param lowpass the lowpass setting of the encoder.
+         *  @param highpass the highpass setting of the encoder.
+         *  @param target the sink the encoded stream is sent to. If
+         *                shared, it is reopened by the encoder, not
+         *                on its own.
+         *  @return the sink the encoder of this output has to write
+         *          into, or 0 if an earlier encoder takes care of it.
+         *  @exception Exception
+         */
+        Sink *
+        shareEncoder (  unsigned int                u,
+                        const char                * stream,
+                        const char                * format,
+                        AudioEncoder::BitrateMode   bitrateMode,
+                        unsigned int                bitrate,
+                        double                      quality,
+                        unsigned int                sampleRate,
+                        unsigned int                channel,
+                        int                         lowpass,
+                        int                         highpass,
+                        BufferedSink              * target )    ;
+
+        /**
+         *  Tell the highest bit rate an encoder may produce.
+         *
+         *  @param format the name of the format of the encoder.
+         *  @param bitrateMode the bit rate mode of the encoder.
+         *  @param bitrate the bit rate of the encoder, 0 if not set.
+         *  @param maxBitrate the highest bit rate of the encoder,
+         *                    0 if not set.
+         *  @return the highest bit rate, in kbps.
+         */
+        unsigned int
+        peakBitrate (   const char                * format,
+                        AudioEncoder::BitrateMode   bitrateMode,
+                        unsigned int                bitrate,
+                        unsigned int                maxBitrate )        ;
+
+        /**
+         *  Give an output a file to keep its stream in while its server
+         *  is gone, if its config section asks for one.
+         *
+         *  @param cs the config section describing the output.
+         *  @param stream the name of the config section.
+         *  @param sink the buffer of the output.
+         *  @exception Exception
+         */
+        void
+        configSpill (   const ConfigSection    * cs,
+                        const char             * stream,
+                        BufferedSink           * sink )                 ;
+
+        /**
+         *  Let an output send a backlog no faster than catchUpRate times
+         *  the bit rate of its stream, in bursts of catchUpBurst seconds.
+         *
+         *  @param cs the config section describing the output.
+         *  @param stream the name of the config section.
+         *  @param sink the buffer of the output.
+         *  @param bitrate the nominal bit rate of the stream, in kbps.
+         *  @exception Exception
+         */
+        void
+        configPacing (  const ConfigSection    * cs,
+                        const char             * stream,
+                        BufferedSink           * sink,
+                        unsigned int             bitrate )              ;
+
+        /**
+         *  Set the options of the socket of an output, from its config
+         *  section: lowLatency, sendBufferBytes, notSentLowat, noDelay
+         *  and userTimeoutMs.
+         *
+         *  @param cs the config section describing the output.
+         *  @param stream the name of the config section.
+         *  @param socket the socket of the output.
+         *  @param bitrate the nominal bit rate of the stream, in kbps.
+         */
+        void
+        configSocket (  const ConfigSection    * cs,
+                        const char             * stream,
+                        TcpSocket              * socket,
+                        unsigned int             bitrate )              ;
+
+        /**
+         *  Tell how big a buffer an output needs for the encoded stream,
+         *  from the highest bit rate its encoder may produce.
+         *
+         *  @param cs the config section describing the output, which
+         *            may override bufferSecs.
+         *  @param format the name of the format of the encoder.
+         *  @param bitrateMode the bit rate mode of the encoder.
+         *  @param bitrate the bit rate of the encoder, 0 if not set.
+         *  @param maxBitrate the highest bit rate of the encoder,
+         *                    0 if not set.
+         *  @param bufferSecs the number of seconds to buffer for.
+         *  @return the size of the buffer, in bytes.
+         *  @exception Exception
+         */
+        unsigned int
+        outputBufferSize (  const ConfigSection       * cs,
+                            const char                * format,
+                            AudioEncoder::BitrateMode   bitrateMode,
+                            unsigned int                bitrate,
+                            unsigned int                maxBitrate,
+                            unsigned int                bufferSecs )    ;
+
+        /**
+         *  Attach an output to the encoding connector, with the queueing
+         *  options of its config section.
+         *
+         *  @param cs the config section describing the output.
+         *  @param sink the sink of the output, fed by the connector.
+         *  @exception Exception
+         */
+        void
+        attachOutput (  const ConfigSection    * cs,
+                        Sink                   * sink )             ;
+
         /**
          *  Set POSIX real-time scheduling for the encoding process,
          *  if user permissions enable it.
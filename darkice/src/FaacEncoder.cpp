@@ -122,7 +122,6 @@ FaacEncoder :: open ( void )
         converterData.src_ratio      = resampleRatio;
         converterData.end_of_input   = 0;
 #else
-        converter->initialize( resampleRatio, getInChannel());
         //needed 2x(converted input samples) to handle offsets
 	int         outCount = 2 * getInChannel() * (inputSamples + 1);
         if (resampleRatio > 1)
@@ -151,6 +150,16 @@ FaacEncoder :: write (  const void    * buf,
 
     unsigned int    channels         = getInChannel();
     unsigned int    bitsPerSample    = getInBitsPerSample();
+    unsigned int    inSampleSize     = (bitsPerSample / 8) * channels;
+    unsigned int    inProcessed      = len - (len % inSampleSize);
+    int16_t       * narrowBuffer     = narrowInput( buf, len);
+
+    // samples wider than 16 bits are encoded as 16 bit ones
+    if ( narrowBuffer ) {
+        buf           = narrowBuffer;
+        bitsPerSample = 16;
+    }
+
     unsigned int    sampleSize       = (bitsPerSample / 8) * channels;
     unsigned char * b                = (unsigned char*) buf;
     unsigned int    processed        = len - (len % sampleSize);
@@ -172,54 +181,21 @@ FaacEncoder :: write (  const void    * buf,
              throw Exception (__FILE__, __LINE__, "libsamplerate error: ", src_strerror (srcError));
         converted = converterData.output_frames_gen;
 #else
-        int         inCount  = nSamples;
         short int     * shortBuffer  = new short int[samples];
-        int         outCount = (int) (inCount * resampleRatio);
-        Util::conv( bitsPerSample, b, processed, shortBuffer, isInBigEndian());
-        converted = converter->resample( inCount,
-                                         outCount+1,
-                                         shortBuffer,
+        Util::conv( bitsPerSample,
+                    b,
+                    processed,
+                    shortBuffer,
+                    narrowBuffer ? SampleFormat::isHostBigEndian()
+                                 : isInBigEndian());
+        converted = converter->resample( shortBuffer,
+                                         nSamples,
                                          &resampledOffset[resampledOffsetSize*channels]);
         delete[] shortBuffer;
 #endif
         resampledOffsetSize += converted;
 
-        // encode samples (if enough)
-        while(resampledOffsetSize - processedSamples >= inputSamples/channels) {
-            int outputBytes;
-#ifdef HAVE_SRC_LIB
-            short *shortData = new short[inputSamples];
-            src_float_to_short_array(resampledOffset + (processedSamples * channels),
-                                     shortData, inputSamples) ;
-            outputBytes = faacEncEncode(encoderHandle,
-                                       (int32_t*) shortData,
-                                        inputSamples,
-                                        faacBuf,
-                                        maxOutputBytes);
-            delete [] shortData;
-#else
-            outputBytes = faacEncEncode(encoderHandle,
-                                       (int32_t*) &resampledOffset[processedSamples*channels],
-                                        inputSamples,
-                                        faacBuf,
-                                        maxOutputBytes);
-#endif
-            getSink()->write(faacBuf, outputBytes);
-            processedSamples+=inputSamples/channels;
-        }
-
-        if (processedSamples && (int) resampledOffsetSize >= processedSamples) {
-            resampledOffsetSize -= processedSamples;
-            //move least part of resampled data to beginning
-            if(resampledOffsetSize)
-#ifdef HAVE_SRC_LIB
-                resampledOffset = (float *) memmove(resampledOffset, &resampledOffset[processedSamples*channels],
-                                                    resampledOffsetSize*channels*sizeof(float));
-#else
-                resampledOffset = (short *) memmove(resampledOffset, &resampledOffset[processedSamples*channels],
-                                                    resampledOffsetSize*sampleSize);
-#endif
-        }
+        encodeResampled();
     } else {
         while (processedSamples < samples) {
             int     outputBytes;
@@ -239,8 +215,103 @@ FaacEncoder :: write (  const void    * buf,
     }
 
     delete[] faacBuf;
+    delete[] narrowBuffer;
+
+    return inProcessed;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Encode the resampled audio collected so far
+ *----------------------------------------------------------------------------*/
+void
+FaacEncoder :: encodeResampled ( void )
+{
+    unsigned int    channels         = getInChannel();
+    unsigned char * faacBuf          = new unsigned char[maxOutputBytes];
+    int             processedSamples = 0;
+
+    // encode samples (if enough)
+    while(resampledOffsetSize - processedSamples >= inputSamples/channels) {
+        int outputBytes;
+#ifdef HAVE_SRC_LIB
+        short *shortData = new short[inputSamples];
+        src_float_to_short_array(resampledOffset + (processedSamples * channels),
+                                 shortData, inputSamples) ;
+        outputBytes = faacEncEncode(encoderHandle,
+                                   (int32_t*) shortData,
+                                    inputSamples,
+                                    faacBuf,
+                                    maxOutputBytes);
+        delete [] shortData;
+#else
+        outputBytes = faacEncEncode(encoderHandle,
+                                   (int32_t*) &resampledOffset[processedSamples*channels],
+                                    inputSamples,
+                                    faacBuf,
+                                    maxOutputBytes);
+#endif
+        getSink()->write(faacBuf, outputBytes);
+        processedSamples+=inputSamples/channels;
+    }
+
+    if (processedSamples && (int) resampledOffsetSize >= processedSamples) {
+        resampledOffsetSize -= processedSamples;
+        //move least part of resampled data to beginning
+        if(resampledOffsetSize)
+#ifdef HAVE_SRC_LIB
+            resampledOffset = (float *) memmove(resampledOffset, &resampledOffset[processedSamples*channels],
+                                                resampledOffsetSize*channels*sizeof(float));
+#else
+            resampledOffset = (short *) memmove(resampledOffset, &resampledOffset[processedSamples*channels],
+                                                resampledOffsetSize*channels*sizeof(short));
+#endif
+    }
+
+    delete[] faacBuf;
+
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Encode a block of audio, taking it from the shared resampler
+ *----------------------------------------------------------------------------*/
+unsigned int
+FaacEncoder :: writeBlock ( AudioBlock     * block )
+{
+    if ( !isOpen() || block->size == 0 ) {
+        return 0;
+    }
+
+    unsigned int        channels = getInChannel();
+    unsigned int        frames   = 0;
+#ifdef HAVE_SRC_LIB
+    // resampledOffset holds float samples, as the shared resampler makes
+    const float       * samples  = 0;
+
+    if ( converter && canUseViews( block) ) {
+        samples = block->getResampledFloat( getOutSampleRate(),
+                                            channels,
+                                            frames);
+    }
+#else
+    const int16_t     * samples  = 0;
+
+    if ( converter && canUseViews( block) ) {
+        samples = block->getResampled16( getOutSampleRate(), channels, frames);
+    }
+#endif
+    if ( !samples ) {
+        return write( block->data, block->size);
+    }
+
+    memcpy( resampledOffset + resampledOffsetSize * channels,
+            samples,
+            frames * channels * sizeof(*samples));
+    resampledOffsetSize += frames;
+    encodeResampled();
 
-    return samples * sampleSize;
+    return block->frames * channels * (block->bitsPerSample / 8);
 }
 
 
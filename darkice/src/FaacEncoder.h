@@ -56,7 +56,7 @@
 #ifdef HAVE_SRC_LIB
 #include <samplerate.h>
 #else
-#include "aflibConverter.h"
+#include "Resampler.h"
 #endif
 
 
@@ -117,7 +117,7 @@ class FaacEncoder : public AudioEncoder, public virtual Reporter
         SRC_DATA                    converterData;
         float                       *resampledOffset;
 #else
-        aflibConverter              *converter;
+        Resampler                   *converter;
         short                       *resampledOffset;
 #endif
         unsigned int                resampledOffsetSize;
@@ -137,7 +137,7 @@ class FaacEncoder : public AudioEncoder, public virtual Reporter
             this->faacOpen        = false;
             this->lowpass         = lowpass;
 
-            if ( getInBitsPerSample() != 16 && getInBitsPerSample() != 8 ) {
+            if ( getInSampleFormat() == SampleFormat::unknown ) {
                 throw Exception( __FILE__, __LINE__,
                                  "specified bits per sample not supported",
                                  getInBitsPerSample() );
@@ -160,7 +160,8 @@ class FaacEncoder : public AudioEncoder, public virtual Reporter
             if ( getOutSampleRate() == getInSampleRate() ) {
                 resampleRatio = 1;
                 converter     = 0;
-            } else if (getInBitsPerSample() == 16) {
+            } else if (getInBitsPerSample() == 16
+                    || SampleFormat::isWide( getInSampleFormat())) {
                 resampleRatio = ( (double) getOutSampleRate() /
                                   (double) getInSampleRate() );
 
@@ -191,10 +192,8 @@ class FaacEncoder : public AudioEncoder, public virtual Reporter
                 // If we get here and useLinear is still true, then we have
                 // a power of two.
 
-                // open the aflibConverter in
-                // - high quality
-                // - linear or quadratic (non-linear) based on algorithm
-                // - not filter interpolation
+                // open the converter with linear or sinc interpolation
+                // based on the ratio
 #ifdef HAVE_SRC_LIB
                 int srcError = 0;
                 converter = src_new(useLinear == true ? SRC_LINEAR : SRC_SINC_FASTEST,
@@ -202,7 +201,11 @@ class FaacEncoder : public AudioEncoder, public virtual Reporter
                 if(srcError)
                     throw Exception (__FILE__, __LINE__, "libsamplerate error: ", src_strerror (srcError));
 #else
-                converter = new aflibConverter( true, useLinear, false);
+                converter = new Resampler( getInSampleRate(),
+                                           getOutSampleRate(),
+                                           getInChannel(),
+                                           useLinear ? Resampler::low
+                                                     : Resampler::medium);
 #endif
             } else {
                 throw Exception( __FILE__, __LINE__,
@@ -230,6 +233,15 @@ class FaacEncoder : public AudioEncoder, public virtual Reporter
             }
         }
 
+        /**
+         *  Encode the resampled audio collected in resampledOffset,
+         *  as far as it makes whole encoder frames, and keep the rest.
+         *
+         *  @exception Exception
+         */
+        void
+        encodeResampled ( void )                        ;
+
 
     protected:
 
@@ -489,6 +501,30 @@ class FaacEncoder : public AudioEncoder, public virtual Reporter
         write (        const void    * buf,
                        unsigned int    len )        ;
 
+        /**
+         *  Encode a block of audio. If the connector resampled the block
+         *  to the output sample rate, that audio is encoded, otherwise
+         *  the raw data of the block is given to write().
+         *
+         *  @param block the audio to encode.
+         *  @return the number of bytes of the block processed.
+         *  @exception Exception
+         */
+        virtual unsigned int
+        writeBlock (   AudioBlock    * block )      ;
+
+        /**
+         *  Tell that the encoder can take audio already resampled
+         *  to its output sample rate.
+         *
+         *  @return true
+         */
+        inline virtual bool
+        canTakeResampled ( void ) const             throw ()
+        {
+            return true;
+        }
+
         /**
          *  Flush all data that was written to the encoder to the underlying
          *  connection.
@@ -0,0 +1,415 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : FanOutSink.cpp
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+   
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License  
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+   
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+    GNU General Public License for more details.
+   
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "Exception.h"
+#include "Util.h"
+#include "Connector.h"
+#include "FanOutSink.h"
+
+
+/* ===================================================  local data structures */
+
+
+/* ================================================  local constants & macros */
+
+/*------------------------------------------------------------------------------
+ *  File identity
+ *----------------------------------------------------------------------------*/
+static const char fileid[] = "$Id$";
+
+/*------------------------------------------------------------------------------
+ *  The time to wait before reopening a failed target, in micro-seconds
+ *----------------------------------------------------------------------------*/
+#define RETRY_DELAY     1000000ULL
+
+
+/* ===============================================  local function prototypes */
+
+
+/* =============================================================  module code */
+
+/*------------------------------------------------------------------------------
+ *  Initialize the object
+ *----------------------------------------------------------------------------*/
+void
+FanOutSink :: init (    const char    * configName,
+                        bool            reconnect )
+{
+    this->configName = Util::strDup( configName);
+    this->reconnect  = reconnect;
+    numTargets       = 0;
+    opened           = false;
+    reopenStarted    = false;
+    running          = false;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  De-initialize the object
+ *----------------------------------------------------------------------------*/
+void
+FanOutSink :: strip ( void )
+{
+    if ( isOpen() ) {
+        close();
+    }
+
+    delete[] configName;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Add a target
+ *----------------------------------------------------------------------------*/
+void
+FanOutSink :: addTarget (   Sink      * sink )
+{
+    if ( numTargets == maxTargets ) {
+        throw Exception( __FILE__, __LINE__,
+                         "too many outputs for one encoder", configName);
+    }
+
+    targets[numTargets].sink      = sink;
+    targets[numTargets].failed    = false;
+    targets[numTargets].reopening = false;
+    targets[numTargets].reopened  = false;
+    targets[numTargets].retryAt   = 0;
+    ++numTargets;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Take a failed target out of use
+ *----------------------------------------------------------------------------*/
+void
+FanOutSink :: fail (    unsigned int            ix,
+                        unsigned long long      now )       throw ()
+{
+    Target    * target = targets + ix;
+
+    reportEvent( 2, configName, "lost output", ix);
+
+    target->failed  = true;
+    target->retryAt = now + RETRY_DELAY;
+    try {
+        target->sink->close();
+    } catch ( Exception   & e ) {
+        // it's closed as far as we're concerned
+    }
+
+    retry( ix);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Hand a failed target over to the reopen thread
+ *----------------------------------------------------------------------------*/
+void
+FanOutSink :: retry (   unsigned int            ix )        throw ()
+{
+    if ( reconnect && !targets[ix].reopening.exchange( true) ) {
+        wakeup.notify();
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Reopen the failed targets, in a thread of their own, so that the
+ *  encoder writing into the others is not held up by connecting
+ *----------------------------------------------------------------------------*/
+void
+FanOutSink :: reopenLoop ( void )                           throw ()
+{
+    Sink              * sinks[maxTargets];
+    unsigned int        ixs[maxTargets];
+    bool                isOpened[maxTargets];
+    unsigned long long  now;
+    unsigned long long  next;
+    unsigned int        n;
+    unsigned int        u;
+
+    while ( running ) {
+        // pick the targets due to be tried again
+        now  = Util::getMonotonicTime();
+        next = now + RETRY_DELAY;
+        n    = 0;
+        for ( u = 0; u < numTargets; ++u ) {
+            Target    * target = targets + u;
+
+            if ( !target->reopening ) {
+                continue;
+            }
+            if ( target->retryAt > now ) {
+                next = target->retryAt < next ? target->retryAt : next;
+                continue;
+            }
+            sinks[n] = target->sink.get();
+            ixs[n]   = u;
+            ++n;
+        }
+
+        if ( n == 0 ) {
+            wakeup.wait( (next - now) / 1000000ULL,
+                         (next - now) % 1000000ULL);
+            continue;
+        }
+
+        // connect to all the servers due at the same time
+        try {
+            Connector::openSinks( sinks, n, isOpened);
+        } catch ( Exception   & e ) {
+            // don't care, just try and try again
+        }
+
+        now = Util::getMonotonicTime();
+        for ( u = 0; u < n; ++u ) {
+            Target    * target = targets + ixs[u];
+
+            if ( isOpened[u] && target->sink->isOpen() ) {
+                target->reopening = false;
+                target->reopened  = true;
+            } else {
+                target->retryAt   = now + RETRY_DELAY;
+            }
+        }
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  The function of the reopen thread
+ *----------------------------------------------------------------------------*/
+void *
+FanOutSink :: reopenThreadFunction ( void   * param )
+{
+    FanOutSink    * fanOut = (FanOutSink *) param;
+
+    fanOut->reopenLoop();
+
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Open the sink
+ *----------------------------------------------------------------------------*/
+bool
+FanOutSink :: open ( void )
+{
+    Sink              * sinks[maxTargets];
+    bool                isOpened[maxTargets];
+    unsigned long long  now;
+    unsigned int        u;
+    unsigned int        live;
+
+    if ( isOpen() ) {
+        return false;
+    }
+
+    for ( u = 0; u < numTargets; ++u ) {
+        sinks[u] = targets[u].sink.get();
+    }
+
+    // connect to all the servers at the same time
+    try {
+        Connector::openSinks( sinks, numTargets, isOpened);
+    } catch ( Exception   & e ) {
+        reportEvent( 2, configName, e);
+    }
+
+    now  = Util::getMonotonicTime();
+    live = 0;
+    for ( u = 0; u < numTargets; ++u ) {
+        targets[u].failed    = !isOpened[u];
+        targets[u].reopening = false;
+        targets[u].reopened  = false;
+        targets[u].retryAt   = now + RETRY_DELAY;
+        if ( isOpened[u] ) {
+            ++live;
+        } else {
+            reportEvent( 2, configName, "can't open output", u);
+        }
+    }
+
+    if ( live == 0 ) {
+        return false;
+    }
+
+    if ( reconnect ) {
+        running       = true;
+        reopenStarted = pthread_create( &reopenThread,
+                                        0,
+                                        reopenThreadFunction,
+                                        this) == 0;
+        if ( !reopenStarted ) {
+            running = false;
+            reportEvent( 1, configName,
+                            "can't create thread, outputs won't reconnect");
+        }
+    }
+
+    for ( u = 0; u < numTargets; ++u ) {
+        if ( targets[u].failed ) {
+            retry( u);
+        }
+    }
+
+    opened = true;
+    return true;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Write into all the targets
+ *----------------------------------------------------------------------------*/
+unsigned int
+FanOutSink :: write (   const void    * buf,
+                        unsigned int    len )
+{
+    unsigned long long  now;
+    unsigned int        u;
+    unsigned int        live;
+
+    if ( !isOpen() ) {
+        return 0;
+    }
+
+    now  = Util::getMonotonicTime();
+    live = 0;
+    for ( u = 0; u < numTargets; ++u ) {
+        Target    * target = targets + u;
+
+        if ( target->failed ) {
+            // written into again once the reopen thread opened it
+            if ( !target->reopened.exchange( false) ) {
+                continue;
+            }
+            target->failed = false;
+            reportEvent( 2, configName, "reopened output", u);
+        }
+
+        // a target that can't take all the data now, e.g. because its
+        // buffer is full, just loses it, the others are not held up
+        try {
+            target->sink->write( buf, len);
+        } catch ( Exception   & e ) {
+            fail( u, now);
+            continue;
+        }
+        if ( !target->sink->isOpen() ) {
+            fail( u, now);
+            continue;
+        }
+        ++live;
+    }
+
+    if ( live == 0 && !reconnect ) {
+        throw Exception( __FILE__, __LINE__,
+                         "all outputs of the encoder failed", configName);
+    }
+
+    return len;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Flush the targets
+ *----------------------------------------------------------------------------*/
+void
+FanOutSink :: flush ( void )
+{
+    unsigned int        u;
+
+    for ( u = 0; u < numTargets; ++u ) {
+        if ( targets[u].failed ) {
+            continue;
+        }
+        try {
+            targets[u].sink->flush();
+        } catch ( Exception   & e ) {
+            fail( u, Util::getMonotonicTime());
+        }
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Cut the targets
+ *----------------------------------------------------------------------------*/
+void
+FanOutSink :: cut ( void )                                  throw ()
+{
+    unsigned int        u;
+
+    // the failed ones may be being reopened meanwhile
+    for ( u = 0; u < numTargets; ++u ) {
+        if ( !targets[u].failed ) {
+            targets[u].sink->cut();
+        }
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Close the sink
+ *----------------------------------------------------------------------------*/
+void
+FanOutSink :: close ( void )
+{
+    unsigned int        u;
+
+    if ( !isOpen() ) {
+        return;
+    }
+
+    if ( reopenStarted ) {
+        running = false;
+        wakeup.notify();
+        pthread_join( reopenThread, 0);
+        reopenStarted = false;
+    }
+
+    for ( u = 0; u < numTargets; ++u ) {
+        if ( !targets[u].failed || targets[u].reopened ) {
+            targets[u].sink->close();
+        }
+        targets[u].failed    = false;
+        targets[u].reopening = false;
+        targets[u].reopened  = false;
+    }
+
+    opened = false;
+}
+
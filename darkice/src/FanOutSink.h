@@ -0,0 +1,388 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : FanOutSink.h
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+   
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License  
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+   
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+    GNU General Public License for more details.
+   
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+#ifndef FAN_OUT_SINK_H
+#define FAN_OUT_SINK_H
+
+#ifndef __cplusplus
+#error This is a C++ include file
+#endif
+
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+// check for __NetBSD__ because it won't be found by AC_CHECK_HEADER on NetBSD
+// as pthread.h is in /usr/pkg/include, not /usr/include
+#if defined( HAVE_PTHREAD_H ) || defined( __NetBSD__ )
+#include <pthread.h>
+#else
+#error need pthread.h
+#endif
+
+#include <atomic>
+
+#include "Ref.h"
+#include "Reporter.h"
+#include "Sink.h"
+#include "Notifier.h"
+
+
+/* ================================================================ constants */
+
+
+/* =================================================================== macros */
+
+
+/* =============================================================== data types */
+
+/**
+ *  A sink that writes everything written to it into a number of other
+ *  sinks, so that one encoder can feed several servers.
+ *
+ *  Each target fails and reconnects on its own: a target that can't be
+ *  written is closed, and reopened a second later by a thread of the
+ *  FanOutSink, while the others go on getting the data. The target is
+ *  written into again once it is open. Only when no target is left and
+ *  reconnecting is off does writing throw, to stop the encoder.
+ *  A target must not reopen on writing, see BufferedSink::setSelfReopen(),
+ *  but fail, and leave it to the FanOutSink.
+ *
+ *  @author  $Author$
+ *  @version $Revision$
+ */
+class FanOutSink : public Sink, public virtual Reporter
+{
+    public:
+
+        /**
+         *  The most targets a FanOutSink writes into.
+         */
+        static const unsigned int   maxTargets = 16;
+
+
+    private:
+
+        /**
+         *  A sink written into, and its state.
+         */
+        class Target
+        {
+            public:
+                /**
+                 *  The sink.
+                 */
+                Ref<Sink>               sink;
+
+                /**
+                 *  Tells if the sink failed, and is not written into.
+                 *  Only touched by the thread writing.
+                 */
+                bool                    failed;
+
+                /**
+                 *  Set when the failed sink is handed over to the reopen
+                 *  thread, cleared by it when it reopened the sink.
+                 */
+                std::atomic<bool>       reopening;
+
+                /**
+                 *  Set by the reopen thread when it reopened the sink,
+                 *  cleared when the sink is written into again.
+                 */
+                std::atomic<bool>       reopened;
+
+                /**
+                 *  When to try to reopen the sink if it failed,
+                 *  see Util::getMonotonicTime().
+                 */
+                unsigned long long      retryAt;
+        };
+
+        /**
+         *  The name of the configuration related to this sink,
+         *  the section of the first target.
+         */
+        char                      * configName;
+
+        /**
+         *  Reopen the targets that failed.
+         */
+        bool                        reconnect;
+
+        /**
+         *  The targets.
+         */
+        Target                      targets[maxTargets];
+
+        /**
+         *  The number of targets.
+         */
+        unsigned int                numTargets;
+
+        /**
+         *  Tells if the sink is open.
+         */
+        bool                        opened;
+
+        /**
+         *  The thread reopening the targets that failed.
+         */
+        pthread_t                   reopenThread;
+
+        /**
+         *  Tells if the reopen thread was started.
+         */
+        bool                        reopenStarted;
+
+        /**
+         *  Tells the reopen thread to go on.
+         */
+        std::atomic<bool>           running;
+
+        /**
+         *  Wakes the reopen thread up, when a target is handed over to
+         *  it or when it has to stop.
+         */
+        Notifier                    wakeup;
+
+        /**
+         *  Copy constructor. Not supported.
+         */
+        FanOutSink ( const FanOutSink &     sink );
+
+        /**
+         *  Assignment operator. Not supported.
+         */
+        FanOutSink &
+        operator= ( const FanOutSink &      sink );
+
+        /**
+         *  Initialize the object.
+         *
+         *  @param configName the name of the configuration related to
+         *         this sink.
+         *  @param reconnect reopen the targets that failed.
+         *  @exception Exception
+         */
+        void
+        init (  const char    * configName,
+                bool            reconnect );
+
+        /**
+         *  De-initialize the object.
+         *
+         *  @exception Exception
+         */
+        void
+        strip ( void );
+
+        /**
+         *  Take a target out of use, after it failed.
+         *
+         *  @param ix the index of the target.
+         *  @param now the current time.
+         */
+        void
+        fail (  unsigned int            ix,
+                unsigned long long      now )           throw ();
+
+        /**
+         *  Hand a target that failed over to the reopen thread.
+         *
+         *  @param ix the index of the target.
+         */
+        void
+        retry ( unsigned int            ix )            throw ();
+
+        /**
+         *  Reopen the targets handed over, until the sink is closed.
+         *  Run by the reopen thread.
+         */
+        void
+        reopenLoop ( void )                             throw ();
+
+        /**
+         *  The function of the reopen thread.
+         *
+         *  @param param the sink, a pointer to a FanOutSink.
+         *  @return nothing
+         */
+        static void *
+        reopenThreadFunction ( void   * param );
+
+
+    protected:
+
+        /**
+         *  Default constructor. Always throws an Exception.
+         *
+         *  @exception Exception
+         */
+        inline
+        FanOutSink ( void )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+
+    public:
+
+        /**
+         *  Constructor.
+         *
+         *  @param configName the name of the configuration related to
+         *         this sink, something like "icecast2-0".
+         *  @param reconnect reopen the targets that failed.
+         *  @exception Exception
+         */
+        inline
+        FanOutSink (    const char        * configName,
+                        bool                reconnect )
+        {
+            init( configName, reconnect);
+        }
+
+        /**
+         *  Destructor.
+         *
+         *  @exception Exception
+         */
+        inline virtual
+        ~FanOutSink ( void )
+        {
+            strip();
+        }
+
+        /**
+         *  Add a sink to write into. Not to be called when open.
+         *
+         *  @param sink the sink to add.
+         *  @exception Exception if there are maxTargets targets already.
+         */
+        void
+        addTarget ( Sink      * sink );
+
+        /**
+         *  Get the number of targets.
+         *
+         *  @return the number of sinks written into.
+         */
+        inline unsigned int
+        getTargets ( void ) const                       throw ()
+        {
+            return numTargets;
+        }
+
+        /**
+         *  Open the sink, by opening the targets. The targets that can't
+         *  be opened are retried later.
+         *
+         *  @return true if at least one target could be opened,
+         *          false otherwise.
+         *  @exception Exception
+         */
+        virtual bool
+        open ( void );
+
+        /**
+         *  Check if the sink is open.
+         *
+         *  @return true if the sink is open, false otherwise.
+         */
+        inline virtual bool
+        isOpen ( void ) const                           throw ()
+        {
+            return opened;
+        }
+
+        /**
+         *  Check if the sink is ready to accept data. It always is when
+         *  open, the targets buffer what they can't send right away.
+         *
+         *  @param sec the maximum seconds to block.
+         *  @param usec micro seconds to block after the full seconds.
+         *  @return true if the sink is open, false otherwise.
+         */
+        inline virtual bool
+        canWrite (  unsigned int    sec,
+                    unsigned int    usec )              throw ()
+        {
+            return opened;
+        }
+
+        /**
+         *  Write data into all the targets that have not failed.
+         *
+         *  @param buf the data to write.
+         *  @param len number of bytes to write from buf.
+         *  @return len if open, 0 otherwise.
+         *  @exception Exception if all targets failed and there is
+         *             no reconnecting.
+         */
+        virtual unsigned int
+        write (     const void    * buf,
+                    unsigned int    len );
+
+        /**
+         *  Flush the data written into the targets.
+         *
+         *  @exception Exception
+         */
+        virtual void
+        flush ( void );
+
+        /**
+         *  Cut what the targets that have not failed have been doing
+         *  so far.
+         */
+        virtual void
+        cut ( void )                                    throw ();
+
+        /**
+         *  Close the sink, and the targets.
+         *
+         *  @exception Exception
+         */
+        virtual void
+        close ( void );
+};
+
+
+/* ================================================= external data structures */
+
+
+/* ====================================================== function prototypes */
+
+
+
+#endif  /* FAN_OUT_SINK_H */
+
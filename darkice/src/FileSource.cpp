@@ -30,7 +30,7 @@
 /* ============================================================ include files */
 
 #ifdef HAVE_CONFIG_H
-#include "configure.h"
+#include "config.h"
 #endif
 
 #ifdef HAVE_UNISTD_H
@@ -51,16 +51,22 @@
 #error need sys/stat.h
 #endif
 
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#else
+#error need sys/mman.h
+#endif
+
 #ifdef HAVE_FCNTL_H
 #include <fcntl.h>
 #else
 #error need fcntl.h
 #endif
 
-#ifdef HAVE_SYS_TIME_H
-#include <sys/time.h>
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
 #else
-#error need sys/time.h
+#error need errno.h
 #endif
 
 #ifdef HAVE_STRING_H
@@ -75,6 +81,12 @@
 #error need signal.h
 #endif
 
+#ifdef HAVE_LIMITS_H
+#include <limits.h>
+#else
+#error need limits.h
+#endif
+
 
 #include "Exception.h"
 #include "Util.h"
@@ -91,6 +103,19 @@
  *----------------------------------------------------------------------------*/
 static const char fileid[] = "$Id$";
 
+/*------------------------------------------------------------------------------
+ *  WAV format tags
+ *----------------------------------------------------------------------------*/
+#define WAVE_FORMAT_PCM             0x0001
+#define WAVE_FORMAT_IEEE_FLOAT      0x0003
+#define WAVE_FORMAT_EXTENSIBLE      0xFFFE
+
+/*------------------------------------------------------------------------------
+ *  Little endian values in a WAV header
+ *----------------------------------------------------------------------------*/
+#define LE16(p)     ((unsigned int) (p)[0] | ((unsigned int) (p)[1] << 8))
+#define LE32(p)     (LE16(p) | ((unsigned long) LE16((p) + 2) << 16))
+
 
 /* ===============================================  local function prototypes */
 
@@ -103,8 +128,17 @@ static const char fileid[] = "$Id$";
 void
 FileSource :: init (    const char    * name )          
 {
-    fileName = Util::strDup( name);
-    fileDescriptor = 0;
+    fileName        = Util::strDup( name);
+    fileDescriptor  = -1;
+    map             = 0;
+    mapSize         = 0;
+    mapPosition     = 0;
+    pendingSize     = 0;
+    pendingPosition = 0;
+    dataLeft        = ULLONG_MAX;
+    pacing          = realtime;
+    startTime       = 0;
+    delivered       = 0;
 }
 
 
@@ -119,79 +153,154 @@ FileSource :: strip ( void )
     }
     
     delete[] fileName;
-    fileDescriptor = 0;
 }
 
 
 /*------------------------------------------------------------------------------
- *  Copy Constructor
+ *  Open the source
  *----------------------------------------------------------------------------*/
-FileSource :: FileSource ( const FileSource &     fs )      
+bool
+FileSource :: open ( void )                             
 {
-    init( fs.fileName);
-
-    fileDescriptor = fs.fileDescriptor ? dup( fs.fileDescriptor) : 0;
+    struct stat     st;
 
-    if ( fileDescriptor == -1 ) {
-        strip();
-        throw Exception( __FILE__, __LINE__, "dup failure");
+    if ( isOpen() ) {
+        return false;
     }
-}
-
-
-/*------------------------------------------------------------------------------
- *  Assignment operator
- *----------------------------------------------------------------------------*/
-FileSource &
-FileSource :: operator= ( const FileSource &     fs )       
-{
-    if ( this != &fs ) {
-        init( fs.fileName);
 
-        fileDescriptor = fs.fileDescriptor ? dup( fs.fileDescriptor) : 0;
+    if ( Util::strEq( fileName, "-") ) {
+        fileDescriptor = STDIN_FILENO;
+    } else if ( (fileDescriptor = ::open( fileName, O_RDONLY)) == -1 ) {
+        return false;
+    }
 
-        if ( fileDescriptor == -1 ) {
-            strip();
-            throw Exception( __FILE__, __LINE__, "dup failure");
+    // map a regular file, so that reading it takes no system calls
+    if ( fstat( fileDescriptor, &st) == 0
+      && S_ISREG( st.st_mode)
+      && st.st_size > 0 ) {
+        void      * m = mmap( 0, st.st_size, PROT_READ, MAP_PRIVATE,
+                              fileDescriptor, 0);
+
+        if ( m != MAP_FAILED ) {
+            map     = (unsigned char*) m;
+            mapSize = st.st_size;
+            madvise( m, mapSize, MADV_SEQUENTIAL);
         }
     }
+    mapPosition     = 0;
+    pendingSize     = 0;
+    pendingPosition = 0;
+    dataLeft        = ULLONG_MAX;
+    delivered       = 0;
+
+    try {
+        readHeader();
+    } catch ( Exception   & e ) {
+        close();
+        throw;
+    }
 
-    return *this;
+    reportEvent( 4, "FileSource :: open, memory mapped:", map ? "yes" : "no",
+                    "batch:", pacing == batch ? "yes" : "no");
+
+    return true;
 }
 
 
 /*------------------------------------------------------------------------------
- *  Check wether a file exists
+ *  Look for a WAV header
  *----------------------------------------------------------------------------*/
-bool
-FileSource :: exists ( void ) const               throw ()
+void
+FileSource :: readHeader ( void )
 {
-    struct stat     st;
-
-    if ( stat( (const char*)fileName, &st) == -1 ) {
-        return false;
+    unsigned char   riff[12];
+    unsigned int    len;
+    bool            gotFormat = false;
+
+    len = readFully( riff, sizeof( riff));
+    if ( len < sizeof( riff)
+      || memcmp( riff, "RIFF", 4)
+      || memcmp( riff + 8, "WAVE", 4) ) {
+        // raw samples, hand out what was read first
+        memcpy( pending, riff, len);
+        pendingSize = len;
+        return;
     }
 
-    return true;
-}
+    for (;;) {
+        unsigned char   chunk[8];
+        unsigned char   fmt[40];
+        unsigned long   size;
+        unsigned long   skip;
 
+        if ( readFully( chunk, sizeof( chunk)) < sizeof( chunk) ) {
+            throw Exception( __FILE__, __LINE__,
+                             "no audio in WAV file ", fileName);
+        }
+        size = LE32( chunk + 4);
+
+        if ( !memcmp( chunk, "data", 4) ) {
+            if ( !gotFormat ) {
+                throw Exception( __FILE__, __LINE__,
+                                 "no format in WAV file ", fileName);
+            }
+            // a WAV written to a pipe may not know the size of its audio
+            if ( size != 0 && size != 0xFFFFFFFFUL ) {
+                dataLeft = size;
+            }
+            return;
+        }
 
-/*------------------------------------------------------------------------------
- *  Open the source
- *----------------------------------------------------------------------------*/
-bool
-FileSource :: open ( void )                             
-{
-    if ( isOpen() ) {
-        return false;
-    }
+        skip = size + (size & 1);
+        if ( !memcmp( chunk, "fmt ", 4) ) {
+            unsigned int    tag;
+            unsigned int    channels;
+            unsigned long   rate;
+            unsigned int    bits;
+            bool            isFloat;
+
+            len   = size < sizeof( fmt) ? size : sizeof( fmt);
+            if ( len < 16 || readFully( fmt, len) < len ) {
+                throw Exception( __FILE__, __LINE__,
+                                 "bad format in WAV file ", fileName);
+            }
+            skip -= len;
+
+            tag      = LE16( fmt);
+            channels = LE16( fmt + 2);
+            rate     = LE32( fmt + 4);
+            bits     = LE16( fmt + 14);
+            if ( tag == WAVE_FORMAT_EXTENSIBLE && len >= 26 ) {
+                // the first two bytes of the sub format GUID are the tag
+                tag = LE16( fmt + 24);
+            }
+            isFloat = getSampleFormat() == SampleFormat::float32;
+
+            if ( (tag != WAVE_FORMAT_PCM && tag != WAVE_FORMAT_IEEE_FLOAT)
+              || (tag == WAVE_FORMAT_IEEE_FLOAT) != isFloat
+              || channels != getChannel()
+              || rate != getSampleRate()
+              || bits != getBitsPerSample() ) {
+                reportEvent( 1, "FileSource :: WAV file channels:", channels,
+                                "sample rate:", rate);
+                reportEvent( 1, "FileSource :: WAV file bits per sample:",
+                                bits, "format tag:", tag);
+                throw Exception( __FILE__, __LINE__,
+                                 "the format of the WAV file is not the one "
+                                 "of the [input] section: ", fileName);
+            }
+            gotFormat = true;
+        }
 
-    if ( (fileDescriptor = ::open( fileName, O_RDONLY)) == -1 ) {
-        fileDescriptor = 0;
-        return false;
+        while ( skip > 0 ) {
+            len = skip < sizeof( fmt) ? skip : sizeof( fmt);
+            if ( readFully( fmt, len) < len ) {
+                throw Exception( __FILE__, __LINE__,
+                                 "no audio in WAV file ", fileName);
+            }
+            skip -= len;
+        }
     }
-
-    return true;
 }
 
 
@@ -210,6 +319,9 @@ FileSource :: canRead (     unsigned int    sec,
     if ( !isOpen() ) {
         return false;
     }
+    if ( map || pendingPosition < pendingSize ) {
+        return true;
+    }
 
     FD_ZERO( &fdset);
     FD_SET( fileDescriptor, &fdset);
@@ -231,6 +343,61 @@ FileSource :: canRead (     unsigned int    sec,
 }
 
 
+/*------------------------------------------------------------------------------
+ *  Read from the input, regardless of the WAV data chunk
+ *----------------------------------------------------------------------------*/
+unsigned int
+FileSource :: readInput (   unsigned char     * buf,
+                            unsigned int        len )
+{
+    ssize_t     ret;
+
+    if ( pendingPosition < pendingSize ) {
+        if ( len > pendingSize - pendingPosition ) {
+            len = pendingSize - pendingPosition;
+        }
+        memcpy( buf, pending + pendingPosition, len);
+        pendingPosition += len;
+        return len;
+    }
+
+    if ( map ) {
+        if ( len > mapSize - mapPosition ) {
+            len = mapSize - mapPosition;
+        }
+        memcpy( buf, map + mapPosition, len);
+        mapPosition += len;
+        return len;
+    }
+
+    while ( (ret = ::read( fileDescriptor, buf, len)) == -1 ) {
+        if ( errno != EINTR ) {
+            throw Exception( __FILE__, __LINE__, "read error", errno);
+        }
+    }
+
+    return ret;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Read a number of bytes from the input
+ *----------------------------------------------------------------------------*/
+unsigned int
+FileSource :: readFully (   unsigned char     * buf,
+                            unsigned int        len )
+{
+    unsigned int    done = 0;
+    unsigned int    n;
+
+    while ( done < len && (n = readInput( buf + done, len - done)) > 0 ) {
+        done += n;
+    }
+
+    return done;
+}
+
+
 /*------------------------------------------------------------------------------
  *  Read from the audio source
  *----------------------------------------------------------------------------*/
@@ -238,19 +405,49 @@ unsigned int
 FileSource :: read (        void          * buf,
                             unsigned int    len )       
 {
-    ssize_t     ret;
+    unsigned char     * b          = (unsigned char*) buf;
+    unsigned int        sampleSize = getSampleSize();
+    unsigned int        n;
 
     if ( !isOpen() ) {
         return 0;
     }
 
-    ret = ::read( fileDescriptor, buf, len);
+    if ( len > dataLeft ) {
+        len = dataLeft;
+    }
+    len -= len % sampleSize;
+    if ( len == 0 ) {
+        return 0;
+    }
+
+    // a pipe may hand out part of a frame, wait for the rest of it
+    n  = readInput( b, len);
+    n += readFully( b + n, (sampleSize - n % sampleSize) % sampleSize);
+    n -= n % sampleSize;
 
-    if ( ret == -1 ) {
-        throw Exception( __FILE__, __LINE__, "read error");
+    if ( dataLeft != ULLONG_MAX ) {
+        dataLeft -= n;
     }
 
-    return ret;
+    // hand out the audio no sooner than a sound card would have it
+    if ( pacing == realtime && n > 0 ) {
+        unsigned long long  bytesPerSec = (unsigned long long) getSampleRate()
+                                        * sampleSize;
+        unsigned long long  now         = Util::getMonotonicTime();
+        unsigned long long  due;
+
+        if ( delivered == 0 ) {
+            startTime = now;
+        }
+        due = startTime + (delivered + n) * 1000000ULL / bytesPerSec;
+        if ( due > now ) {
+            Util::sleep( (due - now) / 1000000, (due - now) % 1000000 * 1000);
+        }
+    }
+    delivered += n;
+
+    return n;
 }
 
 
@@ -264,7 +461,15 @@ FileSource :: close ( void )
         return;
     }
 
-    ::close( fileDescriptor);
-    fileDescriptor = 0;
+    if ( map ) {
+        munmap( map, mapSize);
+        map     = 0;
+        mapSize = 0;
+    }
+    // leave the standard input open, for whoever reads it next
+    if ( fileDescriptor != STDIN_FILENO ) {
+        ::close( fileDescriptor);
+    }
+    fileDescriptor = -1;
 }
 
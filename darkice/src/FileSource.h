@@ -0,0 +1,372 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : FileSource.h
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+   
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License  
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+   
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+    GNU General Public License for more details.
+   
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+#ifndef FILE_SOURCE_H
+#define FILE_SOURCE_H
+
+#ifndef __cplusplus
+#error This is a C++ include file
+#endif
+
+
+/* ============================================================ include files */
+
+#include "Reporter.h"
+#include "AudioSource.h"
+
+
+/* ================================================================ constants */
+
+
+/* =================================================================== macros */
+
+
+/* =============================================================== data types */
+
+/**
+ *  An audio input reading PCM audio from a file, a pipe or the standard
+ *  input, either as a WAV file or as raw little endian samples.
+ *
+ *  A WAV header is recognized and skipped, and its format has to be
+ *  the one of the source. Regular files are memory mapped. The audio
+ *  is either handed out no faster than its sample rate, as from a
+ *  sound card, or as fast as it is asked for, to encode an archive or
+ *  to measure how fast the encoders and the outputs can go.
+ *
+ *  @author  $Author$
+ *  @version $Revision$
+ */
+class FileSource : public AudioSource, public virtual Reporter
+{
+    private:
+
+        /**
+         *  The name of the file, "-" for the standard input.
+         */
+        char                  * fileName;
+
+        /**
+         *  The file descriptor of the file, -1 if not open.
+         */
+        int                     fileDescriptor;
+
+        /**
+         *  The file mapped into memory, 0 if it is read instead.
+         */
+        unsigned char         * map;
+
+        /**
+         *  The size of the mapping.
+         */
+        size_t                  mapSize;
+
+        /**
+         *  The position of the next byte to read in the mapping.
+         */
+        size_t                  mapPosition;
+
+        /**
+         *  The bytes read ahead while looking for a WAV header, to be
+         *  handed out before reading any further.
+         */
+        unsigned char           pending[12];
+
+        /**
+         *  The number of bytes in pending.
+         */
+        unsigned int            pendingSize;
+
+        /**
+         *  The number of bytes of pending already handed out.
+         */
+        unsigned int            pendingPosition;
+
+        /**
+         *  The number of bytes of audio left in the WAV data chunk,
+         *  or the most possible if not known.
+         */
+        unsigned long long      dataLeft;
+
+        /**
+         *  How fast the audio is handed out.
+         */
+        Pacing                  pacing;
+
+        /**
+         *  The time of the first read, for realtime pacing.
+         */
+        unsigned long long      startTime;
+
+        /**
+         *  The number of bytes handed out since opening.
+         */
+        unsigned long long      delivered;
+
+        /**
+         *  Initialize the object.
+         *
+         *  @param name the name of the file, "-" for the standard input.
+         *  @exception Exception
+         */
+        void
+        init (  const char    * name );
+
+        /**
+         *  De-initialize the object.
+         *
+         *  @exception Exception
+         */
+        void
+        strip ( void );
+
+        /**
+         *  Read whatever can be read of the input with a single read,
+         *  regardless of the WAV data chunk.
+         *
+         *  @param buf the buffer to read into.
+         *  @param len the number of bytes to read at most.
+         *  @return the number of bytes read, 0 at the end of the input.
+         *  @exception Exception
+         */
+        unsigned int
+        readInput ( unsigned char     * buf,
+                    unsigned int        len );
+
+        /**
+         *  Read a number of bytes of the input, unless it ends earlier.
+         *
+         *  @param buf the buffer to read into.
+         *  @param len the number of bytes to read.
+         *  @return the number of bytes read, less than len only at
+         *          the end of the input.
+         *  @exception Exception
+         */
+        unsigned int
+        readFully ( unsigned char     * buf,
+                    unsigned int        len );
+
+        /**
+         *  Look for a WAV header at the start of the input and check
+         *  its format. If there is none, keep what was read for read().
+         *
+         *  @exception Exception
+         */
+        void
+        readHeader ( void );
+
+
+    protected:
+
+        /**
+         *  Default constructor. Always throws an Exception.
+         *
+         *  @exception Exception
+         */
+        inline
+        FileSource ( void )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+
+    public:
+
+        /**
+         *  Constructor.
+         *
+         *  @param name the name of the file, "-" for the standard input.
+         *  @param sampleRate samples per second (e.g. 44100 for 44.1kHz).
+         *  @param bitsPerSample bits per sample (e.g. 16 bits).
+         *  @param channel number of channels of the audio source
+         *                 (e.g. 1 for mono, 2 for stereo, etc.).
+         *  @exception Exception
+         */
+        inline
+        FileSource (    const char    * name,
+                        int             sampleRate    = 44100,
+                        int             bitsPerSample = 16,
+                        int             channel       = 2 )
+                    : AudioSource( sampleRate, bitsPerSample, channel)
+        {
+            init( name);
+        }
+
+        /**
+         *  Copy constructor. The copy is not open.
+         *
+         *  @param fs the FileSource to copy.
+         *  @exception Exception
+         */
+        inline
+        FileSource (    const FileSource &  fs )
+                    : AudioSource( fs)
+        {
+            init( fs.fileName);
+            pacing = fs.pacing;
+        }
+
+        /**
+         *  Destructor.
+         *
+         *  @exception Exception
+         */
+        inline virtual
+        ~FileSource ( void )
+        {
+            strip();
+        }
+
+        /**
+         *  Assignment operator. This object is not open afterwards.
+         *
+         *  @param fs the FileSource to assign to this one.
+         *  @return a reference to this object.
+         *  @exception Exception
+         */
+        inline virtual FileSource &
+        operator= ( const FileSource &      fs )
+        {
+            if ( this != &fs ) {
+                strip();
+                AudioSource::operator=( fs);
+                init( fs.fileName);
+                pacing = fs.pacing;
+            }
+            return *this;
+        }
+
+        /**
+         *  Set how fast the audio is handed out. Call before open().
+         *
+         *  @param pacing the pacing.
+         */
+        inline virtual void
+        setPacing ( Pacing      pacing )                throw ()
+        {
+            this->pacing = pacing;
+        }
+
+        /**
+         *  Get how fast the audio is handed out.
+         *
+         *  @return the pacing.
+         */
+        inline virtual Pacing
+        getPacing ( void ) const                        throw ()
+        {
+            return pacing;
+        }
+
+        /**
+         *  Get the name of the file.
+         *
+         *  @return the name of the file, "-" for the standard input.
+         */
+        inline const char *
+        getFileName ( void ) const                      throw ()
+        {
+            return fileName;
+        }
+
+        /**
+         *  WAV files, and raw files alike, are little endian.
+         *
+         *  @return false
+         */
+        inline virtual bool
+        isBigEndian ( void ) const                      throw ()
+        {
+            return false;
+        }
+
+        /**
+         *  Open the file, and read its WAV header, if there is one.
+         *
+         *  @return true if opening was successful, false otherwise.
+         *  @exception Exception
+         */
+        virtual bool
+        open ( void );
+
+        /**
+         *  Check if the file is open.
+         *
+         *  @return true if the file is open, false otherwise.
+         */
+        inline virtual bool
+        isOpen ( void ) const                           throw ()
+        {
+            return fileDescriptor != -1;
+        }
+
+        /**
+         *  Check if the file can be read from. A regular file always can,
+         *  at its end read() tells so.
+         *
+         *  @param sec the maximum seconds to block.
+         *  @param usec micro seconds to block after the full seconds.
+         *  @return true if the file can be read from, false otherwise.
+         *  @exception Exception
+         */
+        virtual bool
+        canRead (   unsigned int    sec,
+                    unsigned int    usec );
+
+        /**
+         *  Read whole sample frames from the file. With realtime pacing,
+         *  do not return before the sample clock reached the end of them.
+         *
+         *  @param buf the buffer to read into.
+         *  @param len the number of bytes to read into buf.
+         *  @return the number of bytes read (may be less than len),
+         *          0 at the end of the file.
+         *  @exception Exception
+         */
+        virtual unsigned int
+        read (      void          * buf,
+                    unsigned int    len );
+
+        /**
+         *  Close the file.
+         *
+         *  @exception Exception
+         */
+        virtual void
+        close ( void );
+};
+
+
+/* ================================================= external data structures */
+
+
+/* ====================================================== function prototypes */
+
+
+
+#endif  /* FILE_SOURCE_H */
+
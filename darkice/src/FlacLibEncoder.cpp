@@ -45,9 +45,10 @@ FlacLibEncoder :: init ( unsigned int compression )
 
     this->compression = compression;
 
-    if ( getInBitsPerSample() != 16 ) {
+    if ( getInSampleFormat() == SampleFormat::unknown
+      || getInSampleFormat() == SampleFormat::u8 ) {
         throw Exception( __FILE__, __LINE__,
-                         "only 16 bits per sample supported at the moment",
+                         "specified bits per sample not supported",
                          getInBitsPerSample() );
     }
 
@@ -96,7 +97,7 @@ FlacLibEncoder :: open ( void )
     }
     FLAC__stream_encoder_set_channels(se, getInChannel());
     FLAC__stream_encoder_set_ogg_serial_number(se, rand());
-    FLAC__stream_encoder_set_bits_per_sample(se, getInBitsPerSample());
+    FLAC__stream_encoder_set_bits_per_sample(se, getFlacBitsPerSample());
     FLAC__stream_encoder_set_sample_rate(se, getInSampleRate());
     FLAC__stream_encoder_set_compression_level(se, this->compression);
 
@@ -146,13 +147,13 @@ FlacLibEncoder :: write ( const void   * buf,
     }
     this->written = 0;
 
-    unsigned int   bitsPerSample = getInBitsPerSample();
     unsigned char *b = (unsigned char*)buf;
-    const uint32_t samples = len>>1;
+    const uint32_t samples = len / (getInBitsPerSample() / 8);
     const uint32_t samples_per_channel = samples/getInChannel();
     FLAC__int32 *buffer = new FLAC__int32[samples];
 
-    Util::conv<FLAC__int32>(bitsPerSample, b, len, buffer, isInBigEndian());
+    SampleFormat::toInt32(getInSampleFormat(), b, samples, buffer,
+                          getFlacBitsPerSample(), isInBigEndian());
 
     if (!FLAC__stream_encoder_process_interleaved(se, buffer,
                                                   samples_per_channel)) {
@@ -26,11 +26,6 @@
 #include "Reporter.h"
 #include "AudioEncoder.h"
 #include "Sink.h"
-#ifdef HAVE_SRC_LIB
-#include <samplerate.h>
-#else
-#include "aflibConverter.h"
-#endif
 
 #include <stdio.h>
 #include <cstdlib>
@@ -83,6 +78,22 @@ class FlacLibEncoder : public AudioEncoder, public virtual Reporter
         void
         init ( unsigned int );
 
+        /**
+         *  Get the number of bits per sample of the FLAC stream.
+         *  That is the precision of the input, but at most 24 bits,
+         *  the most that all versions of libFLAC encode.
+         *
+         *  @return the number of bits per sample to encode.
+         */
+        inline unsigned int
+        getFlacBitsPerSample ( void ) const                 throw ()
+        {
+            unsigned int    bits = SampleFormat::getPrecision(
+                                                        getInSampleFormat());
+
+            return bits > 24 ? 24 : bits;
+        }
+
         /**
          * Encoder write callback function
          */
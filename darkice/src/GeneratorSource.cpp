@@ -0,0 +1,375 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : GeneratorSource.cpp
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+   
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License  
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+   
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+    GNU General Public License for more details.
+   
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#error need string.h
+#endif
+
+#ifdef HAVE_MATH_H
+#include <math.h>
+#else
+#error need math.h
+#endif
+
+
+#include "Exception.h"
+#include "Util.h"
+#include "ConvKernels.h"
+#include "GeneratorSource.h"
+
+
+/* ===================================================  local data structures */
+
+
+/* ================================================  local constants & macros */
+
+/*------------------------------------------------------------------------------
+ *  File identity
+ *----------------------------------------------------------------------------*/
+static const char fileid[] = "$Id$";
+
+/*------------------------------------------------------------------------------
+ *  The frequency a sweep starts from
+ *----------------------------------------------------------------------------*/
+#define SWEEP_START     20.0
+
+
+/* ===============================================  local function prototypes */
+
+
+/* =============================================================  module code */
+
+const unsigned int  GeneratorSource :: lanes;
+const unsigned int  GeneratorSource :: chunkFrames;
+const unsigned int  GeneratorSource :: sweepSeconds;
+
+
+/*------------------------------------------------------------------------------
+ *  Initialize the object
+ *----------------------------------------------------------------------------*/
+void
+GeneratorSource :: init (   Signal      signal )
+{
+    this->signal = signal;
+    frequency    = 440.0;
+    amplitude    = 0.5f;
+    pacing       = realtime;
+    opened       = false;
+    phase        = 0.0;
+    frames       = 0;
+    chunk        = 0;
+    startTime    = 0;
+    delivered    = 0;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  De-initialize the object
+ *----------------------------------------------------------------------------*/
+void
+GeneratorSource :: strip ( void )
+{
+    if ( isOpen() ) {
+        close();
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Convert a signal name to a Signal
+ *----------------------------------------------------------------------------*/
+GeneratorSource::Signal
+GeneratorSource :: strToSignal ( const char   * name )
+{
+    if ( Util::strEq( name, "sine") ) {
+        return sine;
+    } else if ( Util::strEq( name, "noise") ) {
+        return noise;
+    } else if ( Util::strEq( name, "silence") ) {
+        return silence;
+    } else if ( Util::strEq( name, "sweep") ) {
+        return sweep;
+    }
+
+    throw Exception( __FILE__, __LINE__, "invalid generator signal: ", name);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Set the level of the signal
+ *----------------------------------------------------------------------------*/
+void
+GeneratorSource :: setLevel ( double      level )               throw ()
+{
+    amplitude = level < 0.0 ? (float) pow( 10.0, level / 20.0) : 1.0f;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Open the source
+ *----------------------------------------------------------------------------*/
+bool
+GeneratorSource :: open ( void )
+{
+    if ( isOpen() ) {
+        return false;
+    }
+
+    // room for a whole number of lanes over the last frame
+    chunk = new float[chunkFrames * getChannel() + lanes];
+
+    for ( unsigned int i = 0; i < lanes; ++i ) {
+        noiseState[i] = 0x9E3779B9u * (i + 1);
+    }
+    phase     = 0.0;
+    frames    = 0;
+    delivered = 0;
+    opened    = true;
+
+    return true;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Make a chunk of a sine
+ *----------------------------------------------------------------------------*/
+void
+GeneratorSource :: makeSine (   unsigned int    n,
+                                double          freq )          throw ()
+{
+    unsigned int    channels = getChannel();
+    double          step     = 2.0 * M_PI * freq / getSampleRate();
+    float           rotRe    = (float) cos( step * lanes);
+    float           rotIm    = (float) sin( step * lanes);
+    float           re[lanes];
+    float           im[lanes];
+    float           mono[chunkFrames];
+    unsigned int    i;
+    unsigned int    k;
+
+    for ( i = 0; i < lanes; ++i ) {
+        re[i] = (float) cos( phase + i * step);
+        im[i] = (float) sin( phase + i * step);
+    }
+
+    // each lane steps lanes samples at a time
+    for ( k = 0; k < n; k += lanes ) {
+        for ( i = 0; i < lanes; ++i ) {
+            float   r = re[i] * rotRe - im[i] * rotIm;
+
+            mono[k + i] = im[i] * amplitude;
+            im[i]       = re[i] * rotIm + im[i] * rotRe;
+            re[i]       = r;
+        }
+    }
+    phase = fmod( phase + n * step, 2.0 * M_PI);
+
+    if ( channels == 1 ) {
+        memcpy( chunk, mono, n * sizeof(float));
+        return;
+    }
+    for ( k = 0; k < n; ++k ) {
+        for ( i = 0; i < channels; ++i ) {
+            chunk[k * channels + i] = mono[k];
+        }
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Make a chunk of noise
+ *----------------------------------------------------------------------------*/
+void
+GeneratorSource :: makeNoise (  unsigned int    n )             throw ()
+{
+    unsigned int    samples = n * getChannel();
+    float           scale   = amplitude / 2147483648.0f;
+
+    // a xorshift generator for each lane
+    for ( unsigned int k = 0; k < samples; k += lanes ) {
+        for ( unsigned int i = 0; i < lanes; ++i ) {
+            uint32_t    x = noiseState[i];
+
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            noiseState[i] = x;
+            chunk[k + i]  = (float) (int32_t) x * scale;
+        }
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Convert the chunk into the format of the source
+ *----------------------------------------------------------------------------*/
+void
+GeneratorSource :: convert (    unsigned int    n,
+                                unsigned char * out )           throw ()
+{
+    unsigned int    samples = n * getChannel();
+    unsigned int    i;
+
+    switch ( getSampleFormat() ) {
+        case SampleFormat::s16:
+            ConvKernels::get()->toInt16( chunk, samples, (int16_t *) out);
+            break;
+
+        case SampleFormat::float32:
+            memcpy( out, chunk, samples * sizeof(float));
+            break;
+
+        case SampleFormat::s32:
+            for ( i = 0; i < samples; ++i, out += 4 ) {
+                int32_t     v = (int32_t) lrint( chunk[i] * 2147483647.0);
+
+                memcpy( out, &v, 4);
+            }
+            break;
+
+        case SampleFormat::s24_3:
+            for ( i = 0; i < samples; ++i, out += 3 ) {
+                long    v = lrintf( chunk[i] * 8388607.0f);
+
+                if ( SampleFormat::isHostBigEndian() ) {
+                    out[0] = v >> 16;
+                    out[1] = v >> 8;
+                    out[2] = v;
+                } else {
+                    out[0] = v;
+                    out[1] = v >> 8;
+                    out[2] = v >> 16;
+                }
+            }
+            break;
+
+        default:
+            for ( i = 0; i < samples; ++i ) {
+                out[i] = (unsigned char) (lrintf( chunk[i] * 127.0f) + 128);
+            }
+            break;
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Make audio
+ *----------------------------------------------------------------------------*/
+unsigned int
+GeneratorSource :: read (   void          * buf,
+                            unsigned int    len )
+{
+    unsigned char     * b          = (unsigned char*) buf;
+    unsigned int        sampleSize = getSampleSize();
+    unsigned int        total      = len / sampleSize;
+    unsigned int        done;
+
+    if ( !isOpen() ) {
+        return 0;
+    }
+
+    for ( done = 0; done < total; ) {
+        unsigned int    n = total - done < chunkFrames
+                          ? total - done : chunkFrames;
+
+        switch ( signal ) {
+            case sine:
+                makeSine( n, frequency);
+                break;
+
+            case sweep: {
+                // up to near the top of the band, by the same ratio
+                // each second
+                double  t   = fmod( (double) frames / getSampleRate(),
+                                    (double) sweepSeconds);
+                double  top = getSampleRate() * 0.45;
+
+                makeSine( n, SWEEP_START * pow( top / SWEEP_START,
+                                                t / sweepSeconds));
+            } break;
+
+            case noise:
+                makeNoise( n);
+                break;
+
+            default:
+                memset( chunk, 0, n * getChannel() * sizeof(float));
+                break;
+        }
+
+        convert( n, b + done * sampleSize);
+        done   += n;
+        frames += n;
+    }
+
+    // hand out the audio no sooner than a sound card would have it
+    if ( pacing == realtime && done > 0 ) {
+        unsigned long long  bytesPerSec = (unsigned long long) getSampleRate()
+                                        * sampleSize;
+        unsigned long long  now         = Util::getMonotonicTime();
+        unsigned long long  due;
+
+        if ( delivered == 0 ) {
+            startTime = now;
+        }
+        due = startTime + (delivered + done * sampleSize) * 1000000ULL
+                                                          / bytesPerSec;
+        if ( due > now ) {
+            Util::sleep( (due - now) / 1000000, (due - now) % 1000000 * 1000);
+        }
+    }
+    delivered += done * sampleSize;
+
+    return done * sampleSize;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Close the source
+ *----------------------------------------------------------------------------*/
+void
+GeneratorSource :: close ( void )
+{
+    if ( !isOpen() ) {
+        return;
+    }
+
+    delete[] chunk;
+    chunk  = 0;
+    opened = false;
+}
+
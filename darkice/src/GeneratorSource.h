@@ -0,0 +1,399 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : GeneratorSource.h
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+   
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License  
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+   
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+    GNU General Public License for more details.
+   
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+#ifndef GENERATOR_SOURCE_H
+#define GENERATOR_SOURCE_H
+
+#ifndef __cplusplus
+#error This is a C++ include file
+#endif
+
+
+/* ============================================================ include files */
+
+#include <stdint.h>
+
+#include "Reporter.h"
+#include "AudioSource.h"
+
+
+/* ================================================================ constants */
+
+
+/* =================================================================== macros */
+
+
+/* =============================================================== data types */
+
+/**
+ *  An audio input making up a test signal, to run the encoders and the
+ *  outputs without a sound card.
+ *
+ *  The signal is made GeneratorSource::lanes samples at a time, each
+ *  lane on its own, so that the compiler can vectorize the loops: a
+ *  sine is made by rotating a phasor for each lane, noise by a
+ *  xorshift generator for each lane. The phasors are set anew from
+ *  the exact phase for each chunk, so that errors do not build up.
+ *
+ *  @author  $Author$
+ *  @version $Revision$
+ */
+class GeneratorSource : public AudioSource, public virtual Reporter
+{
+    public:
+
+        /**
+         *  The kinds of signal: a sine, white noise, silence, or a sine
+         *  sweeping up from 20 Hz over sweepSeconds.
+         */
+        enum Signal { sine, noise, silence, sweep };
+
+        /**
+         *  The number of samples made at once, each in a lane of its own.
+         */
+        static const unsigned int   lanes = 8;
+
+        /**
+         *  The number of frames made with the same phasors.
+         */
+        static const unsigned int   chunkFrames = 256;
+
+        /**
+         *  The length of a sweep, in seconds.
+         */
+        static const unsigned int   sweepSeconds = 10;
+
+
+    private:
+
+        /**
+         *  The kind of signal.
+         */
+        Signal                  signal;
+
+        /**
+         *  The frequency of the sine.
+         */
+        double                  frequency;
+
+        /**
+         *  The peak amplitude of the signal, 1.0 being full scale.
+         */
+        float                   amplitude;
+
+        /**
+         *  How fast the audio is handed out.
+         */
+        Pacing                  pacing;
+
+        /**
+         *  Tells if the source is open.
+         */
+        bool                    opened;
+
+        /**
+         *  The phase of the next sample of the sine, in radians.
+         */
+        double                  phase;
+
+        /**
+         *  The number of frames made since opening.
+         */
+        unsigned long long      frames;
+
+        /**
+         *  The state of the noise generator of each lane.
+         */
+        uint32_t                noiseState[lanes];
+
+        /**
+         *  A chunk of float samples, chunkFrames * channels of them.
+         */
+        float                 * chunk;
+
+        /**
+         *  The time of the first read, for realtime pacing.
+         */
+        unsigned long long      startTime;
+
+        /**
+         *  The number of bytes handed out since opening.
+         */
+        unsigned long long      delivered;
+
+        /**
+         *  Initialize the object.
+         *
+         *  @param signal the kind of signal to make.
+         *  @exception Exception
+         */
+        void
+        init (  Signal          signal );
+
+        /**
+         *  De-initialize the object.
+         *
+         *  @exception Exception
+         */
+        void
+        strip ( void );
+
+        /**
+         *  Make a chunk of a sine into the chunk buffer, the same on
+         *  all channels.
+         *
+         *  @param n the number of frames to make, at most chunkFrames.
+         *  @param freq the frequency of the sine.
+         */
+        void
+        makeSine (  unsigned int    n,
+                    double          freq )                  throw ();
+
+        /**
+         *  Make a chunk of noise into the chunk buffer.
+         *
+         *  @param n the number of frames to make, at most chunkFrames.
+         */
+        void
+        makeNoise ( unsigned int    n )                     throw ();
+
+        /**
+         *  Convert the chunk buffer into the format of the source.
+         *
+         *  @param n the number of frames to convert.
+         *  @param out put the samples here.
+         */
+        void
+        convert (   unsigned int    n,
+                    unsigned char * out )                   throw ();
+
+
+    protected:
+
+        /**
+         *  Default constructor. Always throws an Exception.
+         *
+         *  @exception Exception
+         */
+        inline
+        GeneratorSource ( void )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+
+    public:
+
+        /**
+         *  Constructor.
+         *
+         *  @param signal the kind of signal to make.
+         *  @param sampleRate samples per second (e.g. 44100 for 44.1kHz).
+         *  @param bitsPerSample bits per sample (e.g. 16 bits).
+         *  @param channel number of channels of the audio source
+         *                 (e.g. 1 for mono, 2 for stereo, etc.).
+         *  @exception Exception
+         */
+        inline
+        GeneratorSource (   Signal          signal,
+                            int             sampleRate    = 44100,
+                            int             bitsPerSample = 16,
+                            int             channel       = 2 )
+                    : AudioSource( sampleRate, bitsPerSample, channel)
+        {
+            init( signal);
+        }
+
+        /**
+         *  Copy constructor. The copy is not open.
+         *
+         *  @param gs the GeneratorSource to copy.
+         *  @exception Exception
+         */
+        inline
+        GeneratorSource (   const GeneratorSource &     gs )
+                    : AudioSource( gs)
+        {
+            init( gs.signal);
+            frequency = gs.frequency;
+            amplitude = gs.amplitude;
+            pacing    = gs.pacing;
+        }
+
+        /**
+         *  Destructor.
+         *
+         *  @exception Exception
+         */
+        inline virtual
+        ~GeneratorSource ( void )
+        {
+            strip();
+        }
+
+        /**
+         *  Assignment operator. This object is not open afterwards.
+         *
+         *  @param gs the GeneratorSource to assign to this one.
+         *  @return a reference to this object.
+         *  @exception Exception
+         */
+        inline virtual GeneratorSource &
+        operator= ( const GeneratorSource &     gs )
+        {
+            if ( this != &gs ) {
+                strip();
+                AudioSource::operator=( gs);
+                init( gs.signal);
+                frequency = gs.frequency;
+                amplitude = gs.amplitude;
+                pacing    = gs.pacing;
+            }
+            return *this;
+        }
+
+        /**
+         *  Convert a signal name, "sine", "noise", "silence" or "sweep",
+         *  to a Signal.
+         *
+         *  @param name the name of the signal.
+         *  @return the signal.
+         *  @exception Exception if the name is not a signal.
+         */
+        static Signal
+        strToSignal ( const char      * name );
+
+        /**
+         *  Set the frequency of the sine. Call before open().
+         *
+         *  @param frequency the frequency in Hz.
+         */
+        inline void
+        setFrequency ( double   frequency )             throw ()
+        {
+            this->frequency = frequency;
+        }
+
+        /**
+         *  Set the level of the signal. Call before open().
+         *
+         *  @param level the peak level in dB relative to full scale,
+         *               0 or less.
+         */
+        void
+        setLevel ( double       level )                 throw ();
+
+        /**
+         *  Set how fast the audio is handed out. Call before open().
+         *
+         *  @param pacing the pacing.
+         */
+        inline virtual void
+        setPacing ( Pacing      pacing )                throw ()
+        {
+            this->pacing = pacing;
+        }
+
+        /**
+         *  Get how fast the audio is handed out.
+         *
+         *  @return the pacing.
+         */
+        inline virtual Pacing
+        getPacing ( void ) const                        throw ()
+        {
+            return pacing;
+        }
+
+        /**
+         *  Open the source.
+         *
+         *  @return true if opening was successful, false otherwise.
+         *  @exception Exception
+         */
+        virtual bool
+        open ( void );
+
+        /**
+         *  Check if the source is open.
+         *
+         *  @return true if the source is open, false otherwise.
+         */
+        inline virtual bool
+        isOpen ( void ) const                           throw ()
+        {
+            return opened;
+        }
+
+        /**
+         *  Check if the source can be read from, which it always can
+         *  when open.
+         *
+         *  @param sec the maximum seconds to block.
+         *  @param usec micro seconds to block after the full seconds.
+         *  @return true if the source is open, false otherwise.
+         */
+        inline virtual bool
+        canRead (   unsigned int    sec,
+                    unsigned int    usec )              throw ()
+        {
+            return opened;
+        }
+
+        /**
+         *  Make whole sample frames of the signal. With realtime pacing,
+         *  do not return before the sample clock reached the end of them.
+         *
+         *  @param buf the buffer to put the audio into.
+         *  @param len the number of bytes to put into buf.
+         *  @return the number of bytes put into buf.
+         *  @exception Exception
+         */
+        virtual unsigned int
+        read (      void          * buf,
+                    unsigned int    len );
+
+        /**
+         *  Close the source.
+         *
+         *  @exception Exception
+         */
+        virtual void
+        close ( void );
+};
+
+
+/* ================================================= external data structures */
+
+
+/* ====================================================== function prototypes */
+
+
+
+#endif  /* GENERATOR_SOURCE_H */
+
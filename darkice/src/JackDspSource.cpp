@@ -115,25 +115,28 @@ static const char fileid[] = "$Id$";
 void
 JackDspSource :: init ( const char* name )           
 {
+    unsigned int c;
+
+    if (getChannel() == 0) {
+        throw Exception( __FILE__, __LINE__,
+                        "Invalid number of channels", getChannel());
+    }
+
     // Set defaults
-    ports[0]     = NULL;        // Left Port
-    ports[1]     = NULL;        // Right Port
-    rb[0]        = NULL;        // Left Ring Buffer
-    rb[1]        = NULL;        // Right Ring Buffer
+    ports        = new jack_port_t*[getChannel()];      // One port and
+    rb           = new jack_ringbuffer_t*[getChannel()]; // ring buffer each
+    for (c=0; c < getChannel(); c++) {
+        ports[c] = NULL;
+        rb[c]    = NULL;
+    }
     client       = NULL;
     auto_connect = false;       // Default is to not auto connect the JACK ports
-    tmp_buffer   = NULL;        // Buffer big enough for one 'read' of audio
+    dataReady    = new Notifier();  // Told of each period landed
 
     // Auto connect the ports ?
     if ( Util::strEq( name, "jack_auto", 9) ) {
         auto_connect = true;
     }
-    
-    // Check the sample size
-    if (getBitsPerSample() != 16) {
-        throw Exception( __FILE__, __LINE__,
-                        "JackDspSource doesn't support non 16-bit samples");
-    }
 }
 
 
@@ -147,13 +150,10 @@ JackDspSource :: strip ( void )
     if ( isOpen() ) {
         close();
     }
-    
-    // Free the temporary buffer
-    if (tmp_buffer) {
-        free(tmp_buffer);
-        tmp_buffer = NULL;
-    }
 
+    delete[] ports;
+    delete[] rb;
+    delete dataReady;
 }
 
 /*------------------------------------------------------------------------------
@@ -171,7 +171,7 @@ JackDspSource :: do_auto_connect ( void )
     
     // Get a list of all the jack ports
     all_ports = jack_get_ports (client, NULL, NULL, JackPortIsOutput);
-    if (!ports) {
+    if (!all_ports) {
         throw Exception( __FILE__, __LINE__, "jack_get_ports() returned NULL.");
     }
     
@@ -211,6 +211,13 @@ JackDspSource :: open ( void )
         return false;
     }
 
+    // Check the sample format, float samples are passed on as they are
+    if ( getSampleFormat() != SampleFormat::s16
+      && getSampleFormat() != SampleFormat::float32 ) {
+        throw Exception( __FILE__, __LINE__,
+                        "JackDspSource supports 16-bit or float samples only");
+    }
+
     // Register client with Jack
     if ( jack_client_name != NULL ) {
       snprintf(client_name, 255, "%s", jack_client_name);
@@ -232,35 +239,26 @@ JackDspSource :: open ( void )
     }
 
 
-    // Register ports with Jack
-    if (getChannel() == 1) {
-        if (!(ports[0] = jack_port_register(client,
-                                            "mono",
-                                            JACK_DEFAULT_AUDIO_TYPE,
-                                            JackPortIsInput,
-                                            0))) {
-            throw Exception( __FILE__, __LINE__,
-                            "Cannot register input port", "mono");
+    // Register ports with Jack: mono, left and right, or in_1 ... in_n
+    for (c=0; c < getChannel(); c++) {
+        char    port_name[32];
+
+        if (getChannel() == 1) {
+            snprintf(port_name, sizeof(port_name), "mono");
+        } else if (getChannel() == 2) {
+            snprintf(port_name, sizeof(port_name), c == 0 ? "left" : "right");
+        } else {
+            snprintf(port_name, sizeof(port_name), "in_%u", c + 1);
         }
-    } else if (getChannel() == 2) {
-        if (!(ports[0] = jack_port_register(client,
-                                            "left",
+
+        if (!(ports[c] = jack_port_register(client,
+                                            port_name,
                                             JACK_DEFAULT_AUDIO_TYPE,
                                             JackPortIsInput,
                                             0))) {
             throw Exception( __FILE__, __LINE__,
-                            "Cannot register input port", "left");
-        }
-        if (!(ports[1] = jack_port_register(client,
-                                            "right",
-                                            JACK_DEFAULT_AUDIO_TYPE,
-                                            JackPortIsInput, 0))) {
-            throw Exception( __FILE__, __LINE__,
-                            "Cannot register input port", "right");
+                            "Cannot register input port", port_name);
         }
-    } else {
-        throw Exception( __FILE__, __LINE__,
-                        "Invalid number of channels", getChannel());
     }
 
 
@@ -308,34 +306,39 @@ bool
 JackDspSource :: canRead ( unsigned int   sec,
                            unsigned int   usec )    
 {
-    const unsigned int max_wait_time  = sec * 1000000;
-    const unsigned int wait_increment = 10000;
-    unsigned int       cur_wait       = 0;
+    unsigned long long  deadline;
 
     if ( !isOpen() ) {
         return false;
     }
 
-    while (max_wait_time > cur_wait) {
-        bool canRead = true;
+    deadline = Util::getMonotonicTime() + sec * 1000000ULL + usec;
 
-        for (unsigned int c = 0 ; c < getChannel() ; c++) {
-            if (jack_ringbuffer_read_space(rb[c]) <= 0) {
-                canRead = false;
-            }
-        }
+    // sleep until process_callback() tells of a period landed, a period
+    // landed after the check below is not lost, as it is counted
+    while (!hasData()) {
+        unsigned long long  now = Util::getMonotonicTime();
 
-        if (canRead) {
-            return true;
+        if (now >= deadline) {
+            return false;
         }
-
-        cur_wait += wait_increment;
-        usleep ( wait_increment );
+        dataReady->wait((deadline - now) / 1000000,
+                        (deadline - now) % 1000000);
     }
 
-    usleep( usec );
+    return true;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Check whether all channels have samples to read
+ *----------------------------------------------------------------------------*/
+bool
+JackDspSource :: hasData ( void ) const
+{
     for (unsigned int c = 0 ; c < getChannel() ; c++) {
-        if (jack_ringbuffer_read_space(rb[c]) <= 0) {
+        if (jack_ringbuffer_read_space(rb[c])
+                                < sizeof( jack_default_audio_sample_t )) {
             return false;
         }
     }
@@ -351,64 +354,74 @@ unsigned int
 JackDspSource :: read (   void          * buf,
                           unsigned int    len )     
 {
-    jack_nframes_t samples         = len / 2 / getChannel();
-    jack_nframes_t samples_read[2] = { 0, 0 };
-    short        * output          = (short*) buf;
-    unsigned int c, n;
+    unsigned int   channels    = getChannel();
+    unsigned int   sampleSize  = getBitsPerSample() / 8;
+    size_t         frames      = len / sampleSize / channels;
+    short        * output      = (short*) buf;
+    float        * floatOutput = (float*) buf;
+    bool           isFloat     = getSampleFormat() == SampleFormat::float32;
+    unsigned int   c, v;
+    size_t         n;
 
     if ( !isOpen() ) {
         return 0;
     }
 
-
-    // Ensure the temporary buffer is big enough
-    tmp_buffer = (jack_default_audio_sample_t*)realloc(tmp_buffer,
-                             samples * sizeof( jack_default_audio_sample_t ) );
-    if (!tmp_buffer) {
-        throw Exception( __FILE__, __LINE__, "realloc on tmp_buffer failed");
+    // We must fetch as many samples on all channels
+    for (c=0; c < channels; c++) {
+        size_t readable = jack_ringbuffer_read_space(rb[c])
+                        / sizeof( jack_default_audio_sample_t );
+        if (readable < frames) {
+            frames = readable;
+        }
     }
 
-    // We must be sure to fetch as many data on both channels
-    int minBytesAvailable = samples * sizeof( jack_default_audio_sample_t );
+    for (c=0; c < channels; c++) {
+        // Convert the samples right out of the ring buffer, where they
+        // are in two parts if they wrap around its end
+        jack_ringbuffer_data_t  vector[2];
+        size_t                  done = 0;
 
-    for (c=0; c < getChannel(); c++) {
-        int readable = jack_ringbuffer_read_space(rb[c]);
-        if (readable < minBytesAvailable) {
-            minBytesAvailable = readable;
-        }
-    }
+        jack_ringbuffer_get_read_vector(rb[c], vector);
 
-    for (c=0; c < getChannel(); c++) {    
-        // Copy frames from ring buffer to temporary buffer
-        // and then convert samples to output buffer
-        int bytes_read = jack_ringbuffer_read(rb[c],
-                                             (char*)tmp_buffer,
-                              minBytesAvailable);
-        samples_read[c] = bytes_read / sizeof( jack_default_audio_sample_t );
-        
+        for (v=0; v < 2 && done < frames; v++) {
+            const jack_default_audio_sample_t * in =
+                                (const jack_default_audio_sample_t*) vector[v].buf;
+            size_t  count = vector[v].len / sizeof( jack_default_audio_sample_t );
+
+            if (count > frames - done) {
+                count = frames - done;
+            }
 
-        // Convert samples from float to short and put in output buffer
-        for(n=0; n<samples_read[c]; n++) {
-            int tmp = lrintf(tmp_buffer[n] * 32768.0f);
-            if (tmp > SHRT_MAX) {
-                output[n*getChannel()+c] = SHRT_MAX;
-            } else if (tmp < SHRT_MIN) {
-                output[n*getChannel()+c] = SHRT_MIN;
+            if (isFloat) {
+                // Interleave the float samples into the output buffer
+                float * out = floatOutput + done * channels + c;
+                for (n=0; n < count; n++) {
+                    out[n*channels] = in[n];
+                }
             } else {
-                output[n*getChannel()+c] = (short) tmp;
+                // Convert samples from float to short into the output buffer
+                short * out = output + done * channels + c;
+                for (n=0; n < count; n++) {
+                    long tmp = lrintf(in[n] * 32768.0f);
+                    if (tmp > SHRT_MAX) {
+                        out[n*channels] = SHRT_MAX;
+                    } else if (tmp < SHRT_MIN) {
+                        out[n*channels] = SHRT_MIN;
+                    } else {
+                        out[n*channels] = (short) tmp;
+                    }
+                }
             }
+            done += count;
         }
-    }
 
-    // Didn't get as many samples as we wanted ?
-    if (getChannel() == 2 && samples_read[0] != samples_read[1]) {
-        Reporter::reportEvent( 2,
-                              "Warning: Read a different number of samples "
-                              "for left and right channels");
+        jack_ringbuffer_read_advance(rb[c],
+                             frames * sizeof( jack_default_audio_sample_t ));
     }
 
     // Return the number of bytes put in the output buffer
-    return samples_read[0] * 2 * getChannel();
+    return frames * sampleSize * channels;
 }
 
 
@@ -486,6 +499,9 @@ JackDspSource :: process_callback( jack_nframes_t nframes, void *arg )
         }
     }
 
+    // Wake up the reading thread, if it waits
+    self->dataReady->notify();
+
     // Success
     return 0;
 }
@@ -40,6 +40,7 @@
 
 
 #include "Reporter.h"
+#include "Notifier.h"
 #include "AudioSource.h"
 
 #if defined( HAVE_JACK_LIB )
@@ -73,14 +74,14 @@ class JackDspSource : public AudioSource, public virtual Reporter
         const char                   * jack_client_name;
 
         /**
-         *  The jack port
+         *  The jack ports, one for each channel.
          */
-        jack_port_t                  * ports[2];
+        jack_port_t                 ** ports;
 
         /**
-         *  The jack ring buffer.
+         *  The jack ring buffers, one for each channel.
          */
-        jack_ringbuffer_t            * rb[2];
+        jack_ringbuffer_t           ** rb;
 
         /**
          *  The jack client.
@@ -88,10 +89,11 @@ class JackDspSource : public AudioSource, public virtual Reporter
         jack_client_t                * client;
 
         /**
-         *  The jack audio sample buffer.
+         *  Notified by process_callback() each time a period of samples
+         *  landed in the ring buffers, for canRead() to wait on.
          */
-        jack_default_audio_sample_t * tmp_buffer;
-        
+        Notifier                    * dataReady;
+
          /**
          *  Automatically connect the jack ports ? (default is to not)
          */
@@ -127,6 +129,14 @@ class JackDspSource : public AudioSource, public virtual Reporter
         strip ( void )                              ;
 
 
+        /**
+         *  Check whether all ring buffers hold samples to read.
+         *
+         *  @return true if there is at least one sample for each channel.
+         */
+        bool
+        hasData ( void ) const                      ;
+
         /**
          *  Attempt to connect up the JACK ports automatically
          */
@@ -283,6 +283,17 @@ LameLibEncoder :: write (   const void    * buf,
 
     unsigned int    bitsPerSample = getInBitsPerSample();
     unsigned int    inChannels    = getInChannel();
+    unsigned int    inSampleSize  = (bitsPerSample / 8) * inChannels;
+    unsigned int    inProcessed   = len - (len % inSampleSize);
+    bool            bigEndian     = isInBigEndian();
+    int16_t       * narrowBuffer  = narrowInput( buf, len);
+
+    // samples wider than 16 bits are encoded as 16 bit ones here
+    if ( narrowBuffer ) {
+        buf           = narrowBuffer;
+        bitsPerSample = 16;
+        bigEndian     = SampleFormat::isHostBigEndian();
+    }
 
     unsigned int    sampleSize = (bitsPerSample / 8) * inChannels;
     unsigned char * b = (unsigned char*) buf;
@@ -299,15 +310,46 @@ LameLibEncoder :: write (   const void    * buf,
                       leftBuffer,
                       rightBuffer,
                       inChannels,
-                      isInBigEndian());
+                      bigEndian);
     } else {
         delete[] leftBuffer;
         delete[] rightBuffer;
+        delete[] narrowBuffer;
         throw Exception( __FILE__, __LINE__,
                         "unsupported number of bits per sample for the encoder",
                          bitsPerSample );
     }
 
+    bool            encoded;
+
+    // the sink may throw, let go of the buffers then too
+    try {
+        encoded = encode( leftBuffer,
+                          inChannels == 2 ? rightBuffer : leftBuffer,
+                          nSamples);
+    } catch ( ... ) {
+        delete[] leftBuffer;
+        delete[] rightBuffer;
+        delete[] narrowBuffer;
+        throw;
+    }
+
+    delete[] leftBuffer;
+    delete[] rightBuffer;
+    delete[] narrowBuffer;
+
+    return encoded ? inProcessed : 0;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Encode planar samples and send them to the sink
+ *----------------------------------------------------------------------------*/
+bool
+LameLibEncoder :: encode (  const short int   * leftBuffer,
+                            const short int   * rightBuffer,
+                            unsigned int        nSamples )
+{
     // data chunk size estimate according to lame documentation
     // NOTE: mp3Size is calculated based on the number of input channels
     //       which may be bigger than need, as output channels can be less
@@ -317,21 +359,59 @@ LameLibEncoder :: write (   const void    * buf,
 
     ret = lame_encode_buffer( lameGlobalFlags,
                               leftBuffer,
-                              inChannels == 2 ? rightBuffer : leftBuffer,
+                              rightBuffer,
                               nSamples,
                               mp3Buf,
                               mp3Size );
 
-    delete[] leftBuffer;
-    delete[] rightBuffer;
+    return sendEncoded( mp3Buf, ret);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Encode planar float samples and send them to the sink
+ *----------------------------------------------------------------------------*/
+bool
+LameLibEncoder :: encode (  const float       * leftBuffer,
+                            const float       * rightBuffer,
+                            unsigned int        nSamples )
+{
+    unsigned int    mp3Size = (unsigned int) (1.25 * nSamples + 7200);
+    unsigned char * mp3Buf  = new unsigned char[mp3Size];
+    int             ret;
+
+    ret = lame_encode_buffer_ieee_float( lameGlobalFlags,
+                                         leftBuffer,
+                                         rightBuffer,
+                                         nSamples,
+                                         mp3Buf,
+                                         mp3Size );
+
+    return sendEncoded( mp3Buf, ret);
+}
+
 
+/*------------------------------------------------------------------------------
+ *  Send the output of the encoder to the sink
+ *----------------------------------------------------------------------------*/
+bool
+LameLibEncoder :: sendEncoded ( unsigned char     * mp3Buf,
+                                int                 ret )
+{
     if ( ret < 0 ) {
         reportEvent( 3, "lame encoding error", ret);
         delete[] mp3Buf;
-        return 0;
+        return false;
     }
 
-    unsigned int    written = getSink()->write( mp3Buf, ret);
+    unsigned int    written;
+
+    try {
+        written = getSink()->write( mp3Buf, ret);
+    } catch ( ... ) {
+        delete[] mp3Buf;
+        throw;
+    }
     delete[] mp3Buf;
     // just let go data that could not be written
     if ( written < (unsigned int) ret ) {
@@ -340,7 +420,48 @@ LameLibEncoder :: write (   const void    * buf,
                      ret - written);
     }
 
-    return processed;
+    return true;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Encode a block of audio, using its planar view
+ *----------------------------------------------------------------------------*/
+unsigned int
+LameLibEncoder :: writeBlock ( AudioBlock     * block )
+{
+    if ( !isOpen() || block->size == 0 ) {
+        return 0;
+    }
+
+    if ( !canUseViews( block) ) {
+        return write( block->data, block->size);
+    }
+
+    bool                encoded;
+
+    if ( SampleFormat::isWide( block->sampleFormat) ) {
+        // lame takes float samples, keeping the precision of the source
+        const float       * leftBuffer  = block->getPlanarFloat( 0);
+        const float       * rightBuffer = getInChannel() == 2
+                                        ? block->getPlanarFloat( 1)
+                                        : leftBuffer;
+
+        encoded = encode( leftBuffer, rightBuffer, block->frames);
+    } else {
+        const short int   * leftBuffer  = block->getPlanar16( 0);
+        const short int   * rightBuffer = getInChannel() == 2
+                                        ? block->getPlanar16( 1)
+                                        : leftBuffer;
+
+        encoded = encode( leftBuffer, rightBuffer, block->frames);
+    }
+
+    if ( !encoded ) {
+        return 0;
+    }
+
+    return block->frames * block->channels * (block->bitsPerSample / 8);
 }
 
 
@@ -111,7 +111,7 @@ class LameLibEncoder : public AudioEncoder, public virtual Reporter
             this->lowpass         = lowpass;
             this->highpass        = highpass;
 
-            if ( getInBitsPerSample() != 16 && getInBitsPerSample() != 8 ) {
+            if ( getInSampleFormat() == SampleFormat::unknown ) {
                 throw Exception( __FILE__, __LINE__,
                                  "specified bits per sample not supported",
                                  getInBitsPerSample() );
@@ -134,6 +134,52 @@ class LameLibEncoder : public AudioEncoder, public virtual Reporter
             }
         }
 
+        /**
+         *  Encode samples and send the encoded data to the sink.
+         *
+         *  @param leftBuffer the samples of the left channel.
+         *  @param rightBuffer the samples of the right channel, the same
+         *                     as leftBuffer for mono input.
+         *  @param nSamples the number of samples in each buffer.
+         *  @return true if the samples were encoded, false on
+         *          an encoding error.
+         *  @exception Exception
+         */
+        bool
+        encode (    const short int   * leftBuffer,
+                    const short int   * rightBuffer,
+                    unsigned int        nSamples )      ;
+
+        /**
+         *  Encode float samples in [-1, 1] and send the encoded data
+         *  to the sink.
+         *
+         *  @param leftBuffer the samples of the left channel.
+         *  @param rightBuffer the samples of the right channel, the same
+         *                     as leftBuffer for mono input.
+         *  @param nSamples the number of samples in each buffer.
+         *  @return true if the samples were encoded, false on
+         *          an encoding error.
+         *  @exception Exception
+         */
+        bool
+        encode (    const float       * leftBuffer,
+                    const float       * rightBuffer,
+                    unsigned int        nSamples )      ;
+
+        /**
+         *  Send the output of lame to the sink.
+         *
+         *  @param mp3Buf the encoded data, freed here with delete[].
+         *  @param ret what the lame encoding function returned:
+         *             the number of bytes in mp3Buf, or an error code.
+         *  @return true if there was no encoding error.
+         *  @exception Exception
+         */
+        bool
+        sendEncoded (   unsigned char     * mp3Buf,
+                        int                 ret )       ;
+
         /**
          *  De-initialize the object.
          *
@@ -409,6 +455,17 @@ class LameLibEncoder : public AudioEncoder, public virtual Reporter
         write (        const void    * buf,
                        unsigned int    len )        ;
 
+        /**
+         *  Encode a block of audio, taking the planar 16 bit or float
+         *  samples of the block instead of converting the raw data.
+         *
+         *  @param block the audio to encode.
+         *  @return the number of bytes of the block processed.
+         *  @exception Exception
+         */
+        virtual unsigned int
+        writeBlock (   AudioBlock    * block )      ;
+
         /**
          *  Flush all data that was written to the encoder to the underlying
          *  connection.
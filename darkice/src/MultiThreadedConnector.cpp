@@ -33,14 +33,33 @@
 #include "config.h"
 #endif
 
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#else
+#error need stdio.h
+#endif
+
 #ifdef HAVE_SYS_TYPES_H
 #include <sys/types.h>
 #else
 #error need sys/types.h
 #endif
 
+#ifdef HAVE_LIMITS_H
+#include <limits.h>
+#else
+#error need limits.h
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#else
+#error need unistd.h
+#endif
+
 
 #include "Exception.h"
+#include "AudioSource.h"
 #include "MultiThreadedConnector.h"
 #include "Util.h"
 
@@ -65,13 +84,43 @@ static const char fileid[] = "$Id$";
  *  Initialize the object
  *----------------------------------------------------------------------------*/
 void
-MultiThreadedConnector :: init ( bool    reconnect )    
+MultiThreadedConnector :: init ( bool           reconnect,
+                                 unsigned int   queueDepth,
+                                 OverflowPolicy queuePolicy )
 {
-    this->reconnect = reconnect;
-
-    pthread_mutex_init( &mutexProduce, 0);
-    pthread_cond_init( &condProduce, 0);
-    threads = 0;
+    this->reconnect     = reconnect;
+    this->queueDepth    = queueDepth ? queueDepth : 1;
+    this->queuePolicy   = queuePolicy;
+    this->queueOptions  = 0;
+    this->running       = false;
+
+    producerWaiting   = false;
+    dispatcherWaiting = false;
+    idleThreads       = 0;
+    pendingBlocks     = 0;
+    wakeups           = 0;
+    captureWaiting    = false;
+    captureBlocking   = false;
+    captureDone       = true;
+    captureLimit      = 0;
+    captureBufSize    = 0;
+    captureSec        = 0;
+    captureUsec       = 0;
+    capturedBytes     = 0;
+    capturePriority   = 0;
+    workerPriority    = 0;
+    captureRate       = 0;
+    captureRing.setCapacity( captureRingDepth);
+
+    readyTasks    = 0;
+    sinkData      = 0;
+    resamplers    = 0;
+    numResamplers = 0;
+    threads       = 0;
+    numThreads    = 0;
+    workerThreads = 0;
+
+    reconnectStarted = false;
 }
 
 
@@ -86,8 +135,15 @@ MultiThreadedConnector :: strip ( void )
         threads = 0;
     }
 
-    pthread_cond_destroy( &condProduce);
-    pthread_mutex_destroy( &mutexProduce);
+    delete[] sinkData;
+    sinkData = 0;
+
+    closeResamplers();
+
+    delete[] queueOptions;
+    queueOptions = 0;
+
+    blockPool.clear();
 }
 
 
@@ -97,18 +153,18 @@ MultiThreadedConnector :: strip ( void )
 MultiThreadedConnector :: MultiThreadedConnector (
                                 const MultiThreadedConnector &   connector )
                                                             
-            : Connector( connector)
+            : Connector( connector.source.get() )
 {
-    reconnect       = connector.reconnect;
-    mutexProduce    = connector.mutexProduce;
-    condProduce     = connector.condProduce;
-
-    if ( threads ) {
-        delete[] threads;
-    }
-    threads = new ThreadData[numSinks];
-    for ( unsigned int  i = 0; i < numSinks; ++i ) {
-        threads[i] = connector.threads[i];
+    init( connector.reconnect, connector.queueDepth, connector.queuePolicy);
+    capturePriority = connector.capturePriority;
+    workerPriority  = connector.workerPriority;
+    captureRate     = connector.captureRate;
+    workerThreads   = connector.workerThreads;
+
+    for ( unsigned int  i = 0; i < connector.numSinks; ++i ) {
+        attach( connector.sinks[i].get(),
+                connector.queueOptions[i].depth,
+                connector.queueOptions[i].policy);
     }
 }
 
@@ -121,18 +177,23 @@ MultiThreadedConnector :: operator= ( const MultiThreadedConnector & connector )
                                                             
 {
     if ( this != &connector ) {
-        Connector::operator=( connector);
-
-        reconnect       = connector.reconnect;
-        mutexProduce    = connector.mutexProduce;
-        condProduce     = connector.condProduce;
+        unsigned int    i;
 
-        if ( threads ) {
-            delete[] threads;
+        while ( numSinks ) {
+            detach( sinks[numSinks - 1].get());
         }
-        threads = new ThreadData[numSinks];
-        for ( unsigned int  i = 0; i < numSinks; ++i ) {
-            threads[i] = connector.threads[i];
+        strip();
+        init( connector.reconnect, connector.queueDepth, connector.queuePolicy);
+        capturePriority = connector.capturePriority;
+        workerPriority  = connector.workerPriority;
+        captureRate     = connector.captureRate;
+        workerThreads   = connector.workerThreads;
+        source = connector.source.get();
+
+        for ( i = 0; i < connector.numSinks; ++i ) {
+            attach( connector.sinks[i].get(),
+                    connector.queueOptions[i].depth,
+                    connector.queueOptions[i].policy);
         }
     }
 
@@ -140,21 +201,316 @@ MultiThreadedConnector :: operator= ( const MultiThreadedConnector & connector )
 }
 
 
+/*------------------------------------------------------------------------------
+ *  Parse the name of an overflow policy
+ *----------------------------------------------------------------------------*/
+MultiThreadedConnector :: OverflowPolicy
+MultiThreadedConnector :: strToOverflowPolicy ( const char    * name )
+{
+    if ( Util::strEq( name, "drop-oldest") ) {
+        return dropOldest;
+    } else if ( Util::strEq( name, "drop-newest") ) {
+        return dropNewest;
+    } else if ( Util::strEq( name, "block") ) {
+        return block;
+    }
+
+    throw Exception( __FILE__, __LINE__, "invalid queue policy: ", name);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Attach a sink with the default queueing options
+ *----------------------------------------------------------------------------*/
+void
+MultiThreadedConnector :: attach (  Sink          * sink )
+{
+    attach( sink, queueDepth, queuePolicy);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Attach a sink with its own queueing options
+ *----------------------------------------------------------------------------*/
+void
+MultiThreadedConnector :: attach (  Sink          * sink,
+                                    unsigned int    queueDepth,
+                                    OverflowPolicy  policy )
+{
+    QueueOptions  * q = new QueueOptions[numSinks + 1];
+    unsigned int    u;
+
+    for ( u = 0; u < numSinks; ++u ) {
+        q[u] = queueOptions[u];
+    }
+    q[numSinks].depth  = queueDepth ? queueDepth : this->queueDepth;
+    q[numSinks].policy = policy;
+
+    Connector::attach( sink);
+
+    delete[] queueOptions;
+    queueOptions = q;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Detach a sink, along with its queueing options
+ *----------------------------------------------------------------------------*/
+bool
+MultiThreadedConnector :: detach (  Sink          * sink )
+{
+    unsigned int    ix;
+    unsigned int    u;
+
+    for ( ix = 0; ix < numSinks && sinks[ix].get() != sink; ++ix );
+
+    if ( ix == numSinks || !Connector::detach( sink) ) {
+        return false;
+    }
+
+    for ( u = ix; u < numSinks; ++u ) {
+        queueOptions[u] = queueOptions[u + 1];
+    }
+
+    return true;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Present a block to a sink
+ *----------------------------------------------------------------------------*/
+void
+MultiThreadedConnector :: enqueue ( SinkData      * sd,
+                                    AudioBlock    * dataBlock )
+{
+    AudioBlock    * dropped;
+
+    // counted before the push, as a worker may be done with it right after
+    ++pendingBlocks;
+    while ( !sd->queue.push( dataBlock) ) {
+        switch ( sd->policy ) {
+            case dropOldest:
+                // the sink thread may have taken it meanwhile,
+                // in which case there is room now anyway
+                if ( sd->queue.dropOldest( dropped) ) {
+                    --pendingBlocks;
+                    blockPool.release( dropped);
+                    break;
+                }
+                continue;
+
+            case dropNewest:
+                --pendingBlocks;
+                blockPool.release( dataBlock);
+                break;
+
+            case block:
+                producerWaiting = true;
+                std::atomic_thread_fence( std::memory_order_seq_cst);
+                if ( running && sd->accepting && sd->queue.isFull() ) {
+                    dispatcherWakeup.wait();
+                }
+                producerWaiting = false;
+
+                if ( !running || !sd->accepting ) {
+                    --pendingBlocks;
+                    blockPool.release( dataBlock);
+                    return;
+                }
+                continue;
+        }
+
+        // report the first drop, and then ever more rarely
+        ++sd->dropped;
+        if ( (sd->dropped & (sd->dropped - 1)) == 0 ) {
+            reportEvent( 3, "MultiThreadedConnector :: enqueue, sink",
+                            sd->ixSink,
+                            "queue full, blocks dropped:",
+                            sd->dropped);
+        }
+
+        if ( sd->policy == dropNewest ) {
+            return;
+        }
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Release all the blocks queued for a sink
+ *----------------------------------------------------------------------------*/
+void
+MultiThreadedConnector :: drainQueue ( SinkData   * sd )
+{
+    AudioBlock    * block;
+
+    while ( sd->queue.pop( block) ) {
+        --pendingBlocks;
+        blockPool.release( block);
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Wake the producer up if it waits for room in a queue
+ *----------------------------------------------------------------------------*/
+void
+MultiThreadedConnector :: signalConsumed ( void )
+{
+    wakeUp( producerWaiting, dispatcherWakeup);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Wake a thread up if it is waiting
+ *----------------------------------------------------------------------------*/
+bool
+MultiThreadedConnector :: wakeUp ( std::atomic<bool>  & waiting,
+                                   Notifier           & notifier )
+{
+    // make sure the thread either sees the change made, or is seen waiting
+    std::atomic_thread_fence( std::memory_order_seq_cst);
+    if ( !waiting.exchange( false) ) {
+        return false;
+    }
+
+    ++wakeups;
+    notifier.notify();
+
+    return true;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Wake up a worker thread for a task
+ *----------------------------------------------------------------------------*/
+void
+MultiThreadedConnector :: wakeWorker ( SinkData   * sd )
+{
+    ThreadData    * threadData = threads + sd->ixSink % numThreads;
+    unsigned int    i;
+
+    if ( wakeUp( threadData->sleeping, threadData->wakeup) ) {
+        return;
+    }
+
+    // the worker of the task is busy, let an idle one steal the task
+    for ( i = 0; idleThreads > 0 && i < numThreads; ++i ) {
+        if ( wakeUp( threads[i].sleeping, threads[i].wakeup) ) {
+            return;
+        }
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Put the task of a sink into a work queue
+ *----------------------------------------------------------------------------*/
+bool
+MultiThreadedConnector :: schedule ( SinkData     * sd )
+{
+    ThreadData    * threadData;
+    bool            scheduled = false;
+
+    // make sure that either we see the task done, or the worker sees
+    // the blocks queued before
+    std::atomic_thread_fence( std::memory_order_seq_cst);
+    if ( !sd->scheduled.compare_exchange_strong( scheduled, true) ) {
+        return false;
+    }
+
+    // a sink goes to the same worker each time, unless it is stolen
+    threadData = threads + sd->ixSink % numThreads;
+
+    pthread_mutex_lock( &threadData->mutexTasks);
+    threadData->tasks[(threadData->firstTask + threadData->numTasks)
+                    % threadData->maxTasks] = sd->ixSink;
+    ++threadData->numTasks;
+    pthread_mutex_unlock( &threadData->mutexTasks);
+
+    ++readyTasks;
+
+    return true;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Take a task from the own work queue, or steal one from another worker
+ *----------------------------------------------------------------------------*/
+bool
+MultiThreadedConnector :: takeTask ( ThreadData   * threadData,
+                                     SinkData    *& sd )
+{
+    unsigned int    n;
+
+    for ( n = 0; n < numThreads; ++n ) {
+        ThreadData    * victim = threads
+                               + (threadData->ixThread + n) % numThreads;
+        unsigned int    ixSink = 0;
+        bool            found  = false;
+
+        pthread_mutex_lock( &victim->mutexTasks);
+        if ( victim->numTasks ) {
+            if ( victim == threadData ) {
+                // run the own tasks in order, to be fair to all of them
+                ixSink             = victim->tasks[victim->firstTask];
+                victim->firstTask  = (victim->firstTask + 1) % victim->maxTasks;
+            } else {
+                // steal the newest task, the one least in order to run
+                ixSink = victim->tasks[(victim->firstTask
+                                        + victim->numTasks - 1)
+                                       % victim->maxTasks];
+            }
+            --victim->numTasks;
+            found = true;
+        }
+        pthread_mutex_unlock( &victim->mutexTasks);
+
+        if ( found ) {
+            --readyTasks;
+            sd = sinkData + ixSink;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
 /*------------------------------------------------------------------------------
  *  Open the source and all the sinks if needed
- *  Create the sink threads
+ *  Create the worker threads
  *----------------------------------------------------------------------------*/
 bool
 MultiThreadedConnector :: open ( void )                     
 {
     unsigned int        i;
     size_t              st;
+    long                cpus;
+    AudioSource       * audioSource;
 
     if ( !Connector::open() ) {
         return false;
     }
 
-    running = true;
+    // record the format of the audio along with each block, if known
+    audioSource = dynamic_cast<AudioSource*>( source.get());
+    if ( audioSource ) {
+        blockPool.setFormat( audioSource->getSampleRate(),
+                             audioSource->getChannel(),
+                             audioSource->getSampleFormat(),
+                             audioSource->isBigEndian());
+    } else {
+        blockPool.setFormat( 0, 0, SampleFormat::unknown, false);
+    }
+
+    running         = true;
+    captureStats    = CaptureStats();
+    captureBlocking = false;
+    readyTasks      = 0;
+    idleThreads     = 0;
+    pendingBlocks   = 0;
+    wakeups         = 0;
 
     pthread_attr_init( &threadAttr);
     pthread_attr_getstacksize(&threadAttr, &st);
@@ -166,14 +522,50 @@ MultiThreadedConnector :: open ( void )
     }
     pthread_attr_setdetachstate( &threadAttr, PTHREAD_CREATE_JOINABLE);
 
-    threads = new ThreadData[numSinks];
+    delete[] sinkData;
+    sinkData = new SinkData[numSinks];
     for ( i = 0; i < numSinks; ++i ) {
+        SinkData      * sd = sinkData + i;
+
+        sd->ixSink    = i;
+        sd->encoder   = dynamic_cast<AudioEncoder*>( sinks[i].get());
+        sd->accepting = true;
+        sd->scheduled = false;
+        sd->policy    = queueOptions[i].policy;
+        sd->dropped   = 0;
+        sd->retryAt   = 0;
+        sd->reopening = false;
+        sd->reopened  = false;
+        sd->queue.setCapacity( queueOptions[i].depth);
+        captureBlocking = captureBlocking || sd->policy == block;
+
+        reportEvent( 5, "MultiThreadedConnector :: open, sink", i,
+                        "queue depth", queueOptions[i].depth);
+    }
+
+    openResamplers();
+
+    numThreads = workerThreads;
+    if ( numThreads == 0 ) {
+        cpus       = sysconf( _SC_NPROCESSORS_ONLN);
+        numThreads = cpus > 0 ? cpus : 1;
+    }
+    if ( numThreads > numSinks ) {
+        numThreads = numSinks;
+    }
+    reportEvent( 5, "MultiThreadedConnector :: open, worker threads",
+                    numThreads);
+
+    delete[] threads;
+    threads = new ThreadData[numThreads];
+    for ( i = 0; i < numThreads; ++i ) {
         ThreadData    * threadData = threads + i;
 
-        threadData->connector = this;
-        threadData->ixSink    = i;
-        threadData->accepting = true;
-        threadData->isDone    = true;
+        threadData->connector   = this;
+        threadData->ixThread    = i;
+        threadData->tasks       = new unsigned int[numSinks];
+        threadData->maxTasks    = numSinks;
+
         if ( pthread_create( &(threadData->thread),
                              &threadAttr,
                              ThreadData::threadFunction,
@@ -182,22 +574,33 @@ MultiThreadedConnector :: open ( void )
         }
     }
 
+    // the sinks are reopened by a thread of their own
+    reconnectStarted = false;
+    if ( i == numThreads && reconnect ) {
+        reconnectStarted = pthread_create( &reconnectThread,
+                                           &threadAttr,
+                                           reconnectThreadFunction,
+                                           this ) == 0;
+    }
+
     // if could not create all, delete the ones created
-    if ( i < numSinks ) {
+    if ( i < numThreads || (reconnect && !reconnectStarted) ) {
         unsigned int    j;
 
         // signal to stop for all running threads
-        pthread_mutex_lock( &mutexProduce);
         running = false;
-        pthread_cond_broadcast( &condProduce);
-        pthread_mutex_unlock( &mutexProduce);
+        for ( j = 0; j < i; ++j ) {
+            threads[j].wakeup.notify();
+        }
 
         for ( j = 0; j < i; ++j ) {
             pthread_join( threads[j].thread, 0);
         }
 
         delete[] threads;
-        threads = 0;
+        threads    = 0;
+        numThreads = 0;
+        closeResamplers();
 
         return false;
     }
@@ -206,6 +609,181 @@ MultiThreadedConnector :: open ( void )
 }
 
 
+/*------------------------------------------------------------------------------
+ *  Make the shared resamplers
+ *----------------------------------------------------------------------------*/
+void
+MultiThreadedConnector :: openResamplers ( void )
+{
+    AudioSource       * audioSource;
+    unsigned int        sampleRate;
+    unsigned int        channels;
+    Resampler        ** rs;
+    unsigned int      * users;
+    unsigned int      * sinkGroup;
+    unsigned int        n;
+    unsigned int        i;
+    unsigned int        j;
+
+    closeResamplers();
+
+    audioSource = dynamic_cast<AudioSource*>( source.get());
+    if ( !audioSource ) {
+        return;
+    }
+    sampleRate = audioSource->getSampleRate();
+    channels   = audioSource->getChannel();
+
+    // group the encoders by the conversion they need, sinkGroup[i] is
+    // the index of the conversion of sink i, or numSinks for none
+    sinkGroup = new unsigned int[numSinks];
+    rs        = new Resampler*[numSinks];
+    users     = new unsigned int[numSinks];
+    n         = 0;
+    for ( i = 0; i < numSinks; ++i ) {
+        AudioEncoder  * encoder = sinkData[i].encoder;
+        unsigned int    inRate;
+        unsigned int    outRate;
+        unsigned int    outChannels;
+
+        sinkGroup[i] = numSinks;
+        if ( !encoder
+          || !encoder->canTakeResampled()
+          || (unsigned int) encoder->getInChannel() != channels ) {
+            continue;
+        }
+        inRate      = encoder->getInSampleRate();
+        outRate     = encoder->getOutSampleRate();
+        outChannels = encoder->getOutChannel();
+        if ( inRate != sampleRate || inRate == outRate ) {
+            continue;
+        }
+        // the only remapping is the mono mix down, see resampleBlock()
+        if ( outChannels != channels && outChannels != 1 ) {
+            continue;
+        }
+
+        // all encoders here take the audio of the source, and all
+        // conversions are of the same quality, so the output rate and
+        // channels tell the conversion
+        for ( j = 0; j < n; ++j ) {
+            if ( rs[j]->getOutSampleRate() == outRate
+              && rs[j]->getChannels()      == outChannels ) {
+                break;
+            }
+        }
+        if ( j == n ) {
+            try {
+                rs[n] = new Resampler( inRate,
+                                       outRate,
+                                       outChannels);
+            } catch ( Exception     & e ) {
+                reportEvent( 2, "MultiThreadedConnector :: openResamplers, "
+                                "can't make resampler", e.getDescription());
+                continue;
+            }
+            users[n] = 0;
+            ++n;
+        }
+        ++users[j];
+        sinkGroup[i] = j;
+    }
+
+    // a conversion needed by one encoder only is best left to it,
+    // as it runs in parallel with the others there
+    resamplers    = new Resampler*[n];
+    numResamplers = 0;
+    for ( j = 0; j < n; ++j ) {
+        char        conversion[64];
+        char        outputs[256];
+        size_t      len = 0;
+
+        if ( users[j] < 2 ) {
+            delete rs[j];
+            continue;
+        }
+
+        outputs[0] = '\0';
+        for ( i = 0; i < numSinks; ++i ) {
+            if ( sinkGroup[i] == j && len < sizeof(outputs) ) {
+                len += snprintf( outputs + len,
+                                 sizeof(outputs) - len,
+                                 len ? " %u" : "%u",
+                                 i);
+            }
+        }
+
+        snprintf( conversion,
+                  sizeof(conversion),
+                  "%u Hz -> %u Hz, %u channels",
+                  rs[j]->getInSampleRate(),
+                  rs[j]->getOutSampleRate(),
+                  rs[j]->getChannels());
+        reportEvent( 1, "shared resampler", conversion, "for outputs", outputs);
+
+        resamplers[numResamplers++] = rs[j];
+    }
+
+    delete[] rs;
+    delete[] users;
+    delete[] sinkGroup;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Delete the shared resamplers
+ *----------------------------------------------------------------------------*/
+void
+MultiThreadedConnector :: closeResamplers ( void )          throw ()
+{
+    for ( unsigned int i = 0; i < numResamplers; ++i ) {
+        delete resamplers[i];
+    }
+    delete[] resamplers;
+    resamplers    = 0;
+    numResamplers = 0;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Resample a block for the encoders sharing the resamplers
+ *----------------------------------------------------------------------------*/
+void
+MultiThreadedConnector :: resampleBlock ( AudioBlock      * block )
+                                                            throw ()
+{
+    if ( numResamplers == 0 || !block->hasViews() ) {
+        return;
+    }
+
+    for ( unsigned int i = 0; i < numResamplers; ++i ) {
+        Resampler     * resampler = resamplers[i];
+
+        try {
+            // mono encoders resample the shared mono mix down. float all
+            // the way, so that the encoders working on float samples
+            // get the precision of the source
+            const float   * in  = resampler->getChannels() == block->channels
+                                ? block->getInterleavedFloat()
+                                : block->getMonoFloat();
+            float         * out = block->addResampled(
+                                    resampler->getOutSampleRate(),
+                                    resampler->getChannels(),
+                                    resampler->getMaxOutFrames( block->frames));
+
+            block->setResampledFrames(
+                            resampler->resample( in, block->frames, out));
+        } catch ( Exception     & e ) {
+            // the encoders get a gap, rather than the stream stopping:
+            // the block has no audio at this rate, they fall back to
+            // the raw data
+            reportEvent( 3, "MultiThreadedConnector :: resampleBlock, "
+                            "can't resample", e.getDescription());
+        }
+    }
+}
+
+
 /*------------------------------------------------------------------------------
  *  Transfer some data from the source to the sink
  *----------------------------------------------------------------------------*/
@@ -217,6 +795,8 @@ MultiThreadedConnector :: transfer ( unsigned long       bytes,
                                                             
 {   
     unsigned int        b;
+    unsigned int        i;
+    unsigned int        blocks;
 
     if ( numSinks == 0 ) {
         return 0;
@@ -226,120 +806,438 @@ MultiThreadedConnector :: transfer ( unsigned long       bytes,
         return 0;
     }
 
-    dataBuffer   = new unsigned char[bufSize];
-    dataSize     = 0;
-
     reportEvent( 6, "MultiThreadedConnector :: transfer, bytes", bytes);
 
-    for ( b = 0; !bytes || b < bytes; ) {
-        if ( source->canRead( sec, usec) ) {
-            unsigned int        i;
+    captureLimit   = bytes;
+    captureBufSize = bufSize;
+    captureSec     = sec;
+    captureUsec    = usec;
+    capturedBytes  = 0;
+    captureDone    = false;
+
+    // a block is either in the capture ring, in some sink queues, being
+    // read into, being handed to the sinks or being written by a worker,
+    // so this many blocks are enough to never allocate while running
+    blocks = captureRingDepth + numThreads + 2;
+    for ( i = 0; i < numSinks; ++i ) {
+        blocks += sinkData[i].queue.getCapacity();
+    }
+    blockPool.reserve( blocks, bufSize);
+
+    if ( pthread_create( &captureThread,
+                         &threadAttr,
+                         captureThreadFunction,
+                         this ) ) {
+        captureDone = true;
+        throw Exception( __FILE__, __LINE__, "can't create capture thread");
+    }
 
-            pthread_mutex_lock( &mutexProduce);
-            dataSize = source->read( dataBuffer, bufSize);
-            b       += dataSize;
+    for ( ;; ) {
+        AudioBlock    * block;
 
-            // check for EOF
-            if ( dataSize == 0 ) {
-                reportEvent( 3, "MultiThreadedConnector :: transfer, EOF");
-                pthread_mutex_unlock( &mutexProduce);
+        // wait for the capture thread to read a block
+        if ( !captureRing.pop( block) ) {
+            if ( captureDone ) {
+                // the last blocks may have been pushed right before
+                if ( captureRing.pop( block) ) {
+                    continue;
+                }
                 break;
             }
 
-            for ( i = 0; i < numSinks; ++i ) {
-                threads[i].isDone = false;
+            dispatcherWaiting = true;
+            std::atomic_thread_fence( std::memory_order_seq_cst);
+            if ( !captureDone && captureRing.isEmpty() ) {
+                dispatcherWakeup.wait();
             }
+            dispatcherWaiting = false;
+            continue;
+        }
 
-            // tell sink threads that there is some data available
-            pthread_cond_broadcast( &condProduce);
+        wakeUp( captureWaiting, captureWakeup);
 
-            // wait for all sink threads to get done with this data
-            while ( true ) {
-                for ( i = 0; i < numSinks && threads[i].isDone; ++i );
-                if ( i == numSinks ) {
-                    break;
-                }
-                pthread_cond_wait( &condProduce, &mutexProduce);
+        if ( !running ) {
+            blockPool.release( block);
+            continue;
+        }
+
+        resampleBlock( block);
+
+        // take all the references up front, so that the block
+        // can't be freed while it is being presented
+        block->references = numSinks + 1;
+        for ( i = 0; i < numSinks; ++i ) {
+            SinkData      * sd = sinkData + i;
+
+            if ( sd->accepting ) {
+                enqueue( sd, block);
+            } else {
+                blockPool.release( block);
             }
-            pthread_mutex_unlock( &mutexProduce);
-        } else {
-            reportEvent( 3, "MultiThreadedConnector :: transfer, can't read");
-            break;
+            // a sink not accepting data gets a task too, to reopen it
+            if ( schedule( sd) ) {
+                wakeWorker( sd);
+            }
+        }
+        blockPool.release( block);
+    }
+
+    pthread_join( captureThread, 0);
+    b = capturedBytes;
+
+    // wait for the worker threads to get done with the queued data
+    while ( running && pendingBlocks > 0 ) {
+        producerWaiting = true;
+        std::atomic_thread_fence( std::memory_order_seq_cst);
+        if ( running && pendingBlocks > 0 ) {
+            dispatcherWakeup.wait();
         }
+        producerWaiting = false;
     }
 
-    delete[] dataBuffer;
     return b;
 }
 
 
 /*------------------------------------------------------------------------------
- *  The function for each thread.
- *  Read the presented data
+ *  Read the source in the capture thread
  *----------------------------------------------------------------------------*/
 void
-MultiThreadedConnector :: sinkThread( int       ixSink )
+MultiThreadedConnector :: captureLoop ( void )
 {
-    ThreadData    * threadData = &threads[ixSink];
-    Sink          * sink       = sinks[ixSink].get();
+    unsigned long       b;
+    long long           offset = LLONG_MAX;
 
-    while ( running ) {
-        // wait for some data to become available
-        pthread_mutex_lock( &mutexProduce);
-        while ( running && threadData->isDone ) {
-            pthread_cond_wait( &condProduce, &mutexProduce);
+    for ( b = 0; running && (!captureLimit || b < captureLimit); ) {
+        AudioBlock    * block;
+
+        if ( !source->canRead( captureSec, captureUsec) ) {
+            reportEvent( 3, "MultiThreadedConnector :: captureLoop, "
+                            "can't read");
+            break;
         }
-        if ( !running ) {
-            pthread_mutex_unlock( &mutexProduce);
+
+        // read right into the block, that is what the sinks will get
+        block            = blockPool.acquire();
+        block->setSize( source->read( block->data, captureBufSize));
+        block->timestamp = Util::getMonotonicTime();
+
+        // check for EOF
+        if ( block->size == 0 ) {
+            reportEvent( 3, "MultiThreadedConnector :: captureLoop, EOF");
+            blockPool.release( block);
             break;
         }
 
-        if ( threadData->cut) {
-            sink->cut();
-            threadData->cut = false;
+        b += block->size;
+        measureCapture( block, b, offset);
+
+        while ( captureBlocking && running && captureRing.isFull() ) {
+            captureWaiting = true;
+            std::atomic_thread_fence( std::memory_order_seq_cst);
+            if ( running && captureRing.isFull() ) {
+                captureWakeup.wait();
+            }
+            captureWaiting = false;
         }
 
-        if ( threadData->accepting ) {
-            if ( sink->canWrite( 0, 0) ) {
-                try {
-                    sink->write( dataBuffer, dataSize);
-                } catch ( Exception     & e ) {
-                    // something wrong. don't accept more data, try to
-                    // reopen the sink next time around
-                    threadData->accepting = false;
+        // otherwise never wait here, the source would overrun instead
+        if ( !captureRing.push( block) ) {
+            blockPool.release( block);
+            ++captureStats.overruns;
+            if ( (captureStats.overruns & (captureStats.overruns - 1)) == 0 ) {
+                reportEvent( 3, "MultiThreadedConnector :: captureLoop, "
+                                "capture ring full, blocks dropped:",
+                                captureStats.overruns);
+            }
+            continue;
+        }
+
+        wakeUp( dispatcherWaiting, dispatcherWakeup);
+    }
+
+    capturedBytes = b;
+    captureDone   = true;
+    wakeUp( dispatcherWaiting, dispatcherWakeup);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Measure how late a block was read
+ *  The source delivers data at a steady rate, so the time stamp of a block
+ *  minus the playing time of all the data read up to its end is constant,
+ *  when the capture thread keeps up. Any growth above the smallest such
+ *  difference seen is the lateness of the block.
+ *----------------------------------------------------------------------------*/
+void
+MultiThreadedConnector :: measureCapture ( const AudioBlock   * block,
+                                           unsigned long        bytes,
+                                           long long          & offset )
+{
+    long long           playTime;
+    long long           lateness;
+
+    ++captureStats.blocks;
+
+    if ( !captureRate ) {
+        return;
+    }
+
+    playTime = (long long) bytes * 1000000LL / captureRate;
+    if ( (long long) block->timestamp - playTime < offset ) {
+        offset = (long long) block->timestamp - playTime;
+    }
+
+    // the deadline of a block is its own duration
+    lateness = (long long) block->timestamp - playTime - offset;
+    if ( lateness > captureStats.maxLateness ) {
+        captureStats.maxLateness = lateness;
+    }
+    if ( lateness > (long long) block->size * 1000000LL / captureRate ) {
+        ++captureStats.lateBlocks;
+        if ( (captureStats.lateBlocks & (captureStats.lateBlocks - 1)) == 0 ) {
+            reportEvent( 4, "MultiThreadedConnector :: measureCapture, "
+                            "late blocks:", captureStats.lateBlocks,
+                            "lateness usec:", lateness);
+        }
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  The function of the capture thread
+ *----------------------------------------------------------------------------*/
+void *
+MultiThreadedConnector :: captureThreadFunction ( void    * param )
+{
+    MultiThreadedConnector    * connector = (MultiThreadedConnector*) param;
+
+    if ( connector->capturePriority > 0 ) {
+        struct sched_param  sched;
+
+        sched.sched_priority = connector->capturePriority;
+        if ( pthread_setschedparam( pthread_self(), SCHED_FIFO, &sched) ) {
+            reportEvent( 2, "MultiThreadedConnector :: captureThreadFunction, "
+                            "could not set SCHED_FIFO priority",
+                            sched.sched_priority,
+                            "this may cause recording skips");
+        } else {
+            reportEvent( 5, "MultiThreadedConnector :: captureThreadFunction, "
+                            "SCHED_FIFO priority",
+                            sched.sched_priority);
+        }
+    }
+
+    try {
+        connector->captureLoop();
+    } catch ( Exception     & e ) {
+        reportEvent( 1, "MultiThreadedConnector :: captureThreadFunction, "
+                        "error reading the source:", e);
+        connector->captureDone = true;
+        connector->wakeUp( connector->dispatcherWaiting,
+                           connector->dispatcherWakeup);
+    }
+
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Reopen the sinks the workers handed over
+ *----------------------------------------------------------------------------*/
+void
+MultiThreadedConnector :: reconnectLoop ( void )
+{
+    Sink             ** reopen = new Sink*[numSinks];
+    unsigned int      * ixs    = new unsigned int[numSinks];
+    bool              * opened = new bool[numSinks];
+    unsigned long long  now;
+    unsigned long long  next;
+    unsigned int        n;
+    unsigned int        i;
+
+    while ( running ) {
+        // pick the sinks due to be tried again
+        now  = Util::getMonotonicTime();
+        next = now + 1000000ULL;
+        n    = 0;
+        for ( i = 0; i < numSinks; ++i ) {
+            SinkData      * sd = sinkData + i;
+
+            if ( !sd->reopening || sd->reopened ) {
+                continue;
+            }
+            if ( sd->retryAt > now ) {
+                next = sd->retryAt < next ? sd->retryAt : next;
+                continue;
+            }
+            reportEvent( 4, "MultiThreadedConnector :: reconnectLoop, "
+                            "reconnecting", i);
+            try {
+                sinks[i]->close();
+            } catch ( Exception   & e ) {
+            }
+            reopen[n] = sinks[i].get();
+            ixs[n]    = i;
+            ++n;
+        }
+
+        if ( n > 0 ) {
+            // side by side, so that one server slow to answer does not
+            // hold up the others
+            try {
+                Connector::openSinks( reopen, n, opened);
+            } catch ( Exception   & e ) {
+                // don't care, just try and try again
+            }
+
+            now = Util::getMonotonicTime();
+            for ( i = 0; i < n; ++i ) {
+                SinkData      * sd = sinkData + ixs[i];
+
+                if ( opened[i] && reopen[i]->isOpen() ) {
+                    // the worker lets it accept data when the dispatcher
+                    // schedules its task next
+                    sd->reopening = false;
+                    sd->reopened  = true;
+                } else {
+                    sd->retryAt = now + 1000000ULL;
                 }
-            } else {
-                reportEvent( 4,
-                            "MultiThreadedConnector :: sinkThread can't write ",
-                             ixSink);
-                // don't care if we can't write
             }
+            continue;
+        }
+
+        reconnectWakeup.wait( (next - now) / 1000000ULL,
+                              (next - now) % 1000000ULL);
+    }
+
+    delete[] opened;
+    delete[] ixs;
+    delete[] reopen;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  The function of the reconnect thread
+ *----------------------------------------------------------------------------*/
+void *
+MultiThreadedConnector :: reconnectThreadFunction ( void  * param )
+{
+    MultiThreadedConnector    * connector = (MultiThreadedConnector*) param;
+
+    connector->reconnectLoop();
+
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  The function for each thread.
+ *  Run the tasks of the sinks
+ *----------------------------------------------------------------------------*/
+void
+MultiThreadedConnector :: workerThread( ThreadData    * threadData )
+{
+    while ( running ) {
+        SinkData      * sd;
+
+        // wait for some work to become available
+        if ( !takeTask( threadData, sd) ) {
+            threadData->sleeping = true;
+            ++idleThreads;
+            std::atomic_thread_fence( std::memory_order_seq_cst);
+            if ( running && readyTasks == 0 ) {
+                threadData->wakeup.wait();
+            }
+            --idleThreads;
+            threadData->sleeping = false;
+            continue;
         }
-        threadData->isDone = true;
-        pthread_cond_broadcast( &condProduce);
-        pthread_mutex_unlock( &mutexProduce);
-
-        if ( !threadData->accepting ) {
-            if ( reconnect ) {
-                reportEvent( 4,
-                           "MultiThreadedConnector :: sinkThread reconnecting ",
-                            ixSink);
-                // if we're not accepting, try to reopen the sink
-                try {
-                    sink->close();
-                    Util::sleep(1L, 0L);
-                    sink->open();
-                    sched_yield();
-                    threadData->accepting = sink->isOpen();
-                } catch ( Exception   & e ) {
-                    // don't care, just try and try again
+
+        runTask( sd);
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Write the blocks queued for a sink, or try to reopen it
+ *----------------------------------------------------------------------------*/
+void
+MultiThreadedConnector :: runTask ( SinkData      * sd )
+{
+    Sink          * sink = sinks[sd->ixSink].get();
+    AudioBlock    * block;
+    unsigned int    n;
+
+    // write no more than a queue full, to be fair to the other sinks
+    for ( n = sd->queue.getCapacity();
+          n > 0 && sd->accepting && sd->queue.pop( block);
+          --n ) {
+
+        if ( sd->cut) {
+            sink->cut();
+            sd->cut = false;
+        }
+
+        // the block is only read here, and is not touched by anybody else
+        // until we release it, so there is no need to hold a lock. encoders
+        // share the converted samples of the block, made by the first one
+        // asking for them
+        if ( sink->canWrite( 0, 0) ) {
+            try {
+                if ( sd->encoder ) {
+                    sd->encoder->writeBlock( block);
+                } else {
+                    sink->write( block->data, block->size);
                 }
-            } else {
-                // if !reconnect, just stop the connector
-                running = false;
+            } catch ( Exception     & e ) {
+                // something wrong. don't accept more data, try to
+                // reopen the sink a bit later
+                sd->accepting = false;
+                sd->retryAt   = Util::getMonotonicTime() + 1000000ULL;
             }
+        } else {
+            reportEvent( 4,
+                        "MultiThreadedConnector :: runTask can't write ",
+                         sd->ixSink);
+            // don't care if we can't write
+        }
+
+        --pendingBlocks;
+        blockPool.release( block);
+        signalConsumed();
+    }
+
+    if ( !sd->accepting ) {
+        // drop what is still queued, it won't be written anyway
+        drainQueue( sd);
+        signalConsumed();
+
+        if ( reconnect ) {
+            // if we're not accepting, the reconnect thread reopens the
+            // sink, so that connecting does not keep the worker from the
+            // other sinks meanwhile. once it did, the queue was drained
+            // above, so no stale data is sent to the freshly opened sink
+            if ( sd->reopened.exchange( false) ) {
+                sd->accepting = true;
+            } else if ( !sd->reopening.exchange( true) ) {
+                reconnectWakeup.notify();
+            }
+        } else {
+            // if !reconnect, just stop the connector
+            running = false;
+            wakeUp( producerWaiting, dispatcherWakeup);
+            wakeUp( captureWaiting, captureWakeup);
         }
     }
+
+    // let the task be scheduled again, and do so right away if blocks
+    // were queued that the producer saw as already scheduled
+    sd->scheduled = false;
+    std::atomic_thread_fence( std::memory_order_seq_cst);
+    if ( running && sd->accepting && !sd->queue.isEmpty() ) {
+        schedule( sd);
+    }
 }
 
 
@@ -349,12 +1247,16 @@ MultiThreadedConnector :: sinkThread( int       ixSink )
 void
 MultiThreadedConnector :: cut ( void )                      throw ()
 {
+    if ( !sinkData ) {
+        return;
+    }
+
     for ( unsigned int i = 0; i < numSinks; ++i ) {
-        threads[i].cut = true;
+        sinkData[i].cut = true;
     }
 
-    // TODO: it might be more appropriate to signal all the threads here
-    //       but, they'll get signaled on new data anyway, and it might be
+    // TODO: it might be more appropriate to schedule all the tasks here
+    //       but, they'll get scheduled on new data anyway, and it might be
     //       enough for them to cut at that time
 }
 
@@ -367,19 +1269,60 @@ void
 MultiThreadedConnector :: close ( void )                    
 {
     unsigned int    i;
+    AudioSource   * audioSource;
 
     // signal to stop for all threads
-    pthread_mutex_lock( &mutexProduce);
     running = false;
-    pthread_cond_broadcast( &condProduce);
-    pthread_mutex_unlock( &mutexProduce);
+    for ( i = 0; i < numThreads; ++i ) {
+        threads[i].wakeup.notify();
+    }
+    reconnectWakeup.notify();
 
     // wait for all the threads to finish
-    for ( i = 0; i < numSinks; ++i ) {
+    for ( i = 0; i < numThreads; ++i ) {
         pthread_join( threads[i].thread, 0);
     }
+    if ( reconnectStarted ) {
+        pthread_join( reconnectThread, 0);
+        reconnectStarted = false;
+    }
     pthread_attr_destroy( &threadAttr);
 
+    // release the blocks left in the queues
+    for ( i = 0; i < numSinks; ++i ) {
+        drainQueue( sinkData + i);
+        if ( sinkData[i].dropped ) {
+            reportEvent( 2, "MultiThreadedConnector :: close, sink", i,
+                            "blocks dropped:", sinkData[i].dropped);
+        }
+    }
+    reportEvent( 2, "MultiThreadedConnector :: close, blocks captured:",
+                    captureStats.blocks,
+                    "dropped:", captureStats.overruns);
+    audioSource = dynamic_cast<AudioSource*>( source.get());
+    if ( audioSource && audioSource->getOverruns() ) {
+        reportEvent( 2, "MultiThreadedConnector :: close, source overruns:",
+                        audioSource->getOverruns());
+    }
+    if ( captureStats.blocks ) {
+        reportEvent( 2, "MultiThreadedConnector :: close, thread wakeups:",
+                        wakeups.load(),
+                        "per block:",
+                        (double) wakeups / captureStats.blocks);
+    }
+    if ( captureRate ) {
+        reportEvent( 2, "MultiThreadedConnector :: close, late blocks:",
+                        captureStats.lateBlocks,
+                        "max lateness usec:", captureStats.maxLateness);
+    }
+    if ( blockPool.getNumGrown() ) {
+        reportEvent( 2, "MultiThreadedConnector :: close, blocks allocated "
+                        "while running:", blockPool.getNumGrown(),
+                        "of", blockPool.getNumBlocks());
+    }
+    blockPool.clear();
+    closeResamplers();
+
     Connector::close();
 }
 
@@ -407,8 +1350,17 @@ MultiThreadedConnector :: ThreadData :: threadFunction( void  * param )
                     "INVALID"
     );
 
-    sched.sched_priority = 1;
-    pthread_setschedparam( threadData->thread, SCHED_FIFO, &sched);
+    // the thread inherits the scheduling of the thread that opened the
+    // connector, which may be real-time even if the workers are not to be
+    sched.sched_priority = threadData->connector->workerPriority;
+    if ( pthread_setschedparam( threadData->thread,
+                                sched.sched_priority > 0 ? SCHED_FIFO
+                                                         : SCHED_OTHER,
+                                &sched) ) {
+        reportEvent( 2, "MultiThreadedConnector :: ThreadData :: "
+                        "threadFunction, could not set the priority",
+                        sched.sched_priority);
+    }
 
     pthread_getschedparam( threadData->thread, &sched_type, &sched );
     reportEvent( 5,
@@ -422,7 +1374,7 @@ MultiThreadedConnector :: ThreadData :: threadFunction( void  * param )
                     "INVALID"
     );
 
-    threadData->connector->sinkThread( threadData->ixSink);
+    threadData->connector->workerThread( threadData);
 
     return 0;
 }
@@ -48,12 +48,20 @@
 #error need pthread.h
 #endif
 
+#include <atomic>
+
 #include "Referable.h"
 #include "Ref.h"
 #include "Reporter.h"
 #include "Source.h"
 #include "Sink.h"
 #include "Connector.h"
+#include "AudioEncoder.h"
+#include "SpscQueue.h"
+#include "Notifier.h"
+#include "AudioBlock.h"
+#include "AudioBlockPool.h"
+#include "Resampler.h"
 
 
 /* ================================================================ constants */
@@ -68,15 +76,205 @@
  *  Connects a source to one or more sinks, using a multi-threaded
  *  producer - consumer approach.
  *
+ *  The source is read by a capture thread of its own, which does
+ *  nothing but read blocks, time stamp them and push them into a
+ *  lock-free ring. The thread calling transfer() takes the blocks from
+ *  the ring and hands them to the sinks, so the time it takes to reach
+ *  all the sinks does not delay reading the source.
+ *
+ *  The sinks are written to by a fixed pool of worker threads. Writing
+ *  the blocks queued for a sink is a task, run by one worker at a time,
+ *  and idle workers steal tasks from busy ones.
+ *
+ *  Each sink has its own bounded, lock-free queue of blocks read from
+ *  the source. What happens when a queue is full is decided by the
+ *  overflow policy of the sink, so a slow sink does not hold up reading
+ *  the source, unless it is asked to.
+ *
  *  @author  $Author$
  *  @version $Revision$
  */
 class MultiThreadedConnector : public virtual Connector
 {
+    public:
+
+        /**
+         *  Type to specify what to do when the queue of a sink is full.
+         *  Possible values:
+         *  - dropOldest - discard the oldest block in the queue
+         *  - dropNewest - discard the block just read from the source
+         *  - block      - wait for the sink to make room in the queue
+         */
+        enum OverflowPolicy { dropOldest, dropNewest, block };
+
     private:
 
+        /**
+         *  The queueing options of a sink.
+         */
+        class QueueOptions
+        {
+            public:
+                /**
+                 *  The maximum number of blocks queued for the sink.
+                 */
+                unsigned int                depth;
+
+                /**
+                 *  What to do when the queue is full.
+                 */
+                OverflowPolicy              policy;
+
+                /**
+                 *  Default constructor.
+                 */
+                inline
+                QueueOptions ( void )
+                {
+                    this->depth  = 0;
+                    this->policy = dropOldest;
+                }
+        };
+
+        /**
+         *  Statistics on how well the capture thread keeps up with
+         *  the source.
+         */
+        class CaptureStats
+        {
+            public:
+                /**
+                 *  The number of blocks read from the source.
+                 */
+                unsigned long               blocks;
+
+                /**
+                 *  The number of blocks dropped because the capture
+                 *  ring was full.
+                 */
+                unsigned long               overruns;
+
+                /**
+                 *  The number of blocks read more than a block's
+                 *  duration later than the source delivered them.
+                 */
+                unsigned long               lateBlocks;
+
+                /**
+                 *  The largest lateness seen, in micro-seconds.
+                 */
+                long long                   maxLateness;
+
+                /**
+                 *  Default constructor.
+                 */
+                inline
+                CaptureStats ( void )
+                {
+                    this->blocks      = 0;
+                    this->overruns    = 0;
+                    this->lateBlocks  = 0;
+                    this->maxLateness = 0;
+                }
+        };
+
+        /**
+         *  The state of a sink: the blocks waiting to be written to it,
+         *  and the encoding task that writes them. The task is run by one
+         *  worker thread at a time, so the sink is used sequentially.
+         */
+        class SinkData
+        {
+            public:
+                /**
+                 *  The index of the sink.
+                 */
+                unsigned int                ixSink;
+
+                /**
+                 *  The sink as an encoder, which is given whole blocks
+                 *  to take the prepared sample views from.
+                 *  NULL if the sink is not an encoder.
+                 */
+                AudioEncoder              * encoder;
+
+                /**
+                 *  Marks if the sink is accepting data.
+                 */
+                std::atomic<bool>           accepting;
+
+                /**
+                 *  Marks if the task of the sink is waiting in a work
+                 *  queue or being run by a worker thread.
+                 */
+                std::atomic<bool>           scheduled;
+
+                /**
+                 *  A flag to show that the sink should be made to cut in the
+                 *  next iteration.
+                 */
+                bool                    cut;
+
+                /**
+                 *  The blocks waiting to be written to the sink.
+                 */
+                SpscQueue<AudioBlock*>      queue;
+
+                /**
+                 *  What to do when the queue is full.
+                 */
+                OverflowPolicy              policy;
+
+                /**
+                 *  The number of blocks dropped because the queue was full.
+                 *  Only touched by the producer.
+                 */
+                unsigned long               dropped;
+
+                /**
+                 *  The time to try to reopen the sink at, if it is not
+                 *  accepting data, as returned by Util::getMonotonicTime().
+                 */
+                unsigned long long          retryAt;
+
+                /**
+                 *  Set by the worker when it handed the broken sink over
+                 *  to the reconnect thread, cleared by the reconnect
+                 *  thread when it reopened the sink.
+                 */
+                std::atomic<bool>           reopening;
+
+                /**
+                 *  Set by the reconnect thread when it reopened the sink,
+                 *  cleared by the worker when it lets the sink accept
+                 *  data again.
+                 */
+                std::atomic<bool>           reopened;
+
+                /**
+                 *  Default constructor.
+                 */
+                inline
+                SinkData()
+                {
+                    this->ixSink      = 0;
+                    this->encoder     = 0;
+                    this->accepting   = false;
+                    this->scheduled   = false;
+                    this->cut         = false;
+                    this->policy      = dropOldest;
+                    this->dropped     = 0;
+                    this->retryAt     = 0;
+                    this->reopening   = false;
+                    this->reopened    = false;
+                }
+        };
+
         /**
          *  Helper class to collect information for starting threads.
+         *  Each worker thread has a queue of sink tasks to run. The worker
+         *  runs the tasks of its own queue in order, and when that is
+         *  empty, steals the newest task from another worker.
          */
         class ThreadData
         {
@@ -87,9 +285,9 @@ class MultiThreadedConnector : public virtual Connector
                 MultiThreadedConnector    * connector;
 
                 /**
-                 *  The index of the sink this thread writes to.
+                 *  The index of this worker thread.
                  */
-                unsigned int                ixSink;
+                unsigned int                ixThread;
 
                 /**
                  *  The POSIX thread itself.
@@ -97,21 +295,40 @@ class MultiThreadedConnector : public virtual Connector
                 pthread_t                   thread;
 
                 /**
-                 *  Marks if the thread is accepting data.
+                 *  The mutex protecting the task queue.
                  */
-                bool                        accepting;
+                pthread_mutex_t             mutexTasks;
 
                 /**
-                 *  Marks if the thread has processed the last batch
-                 *  of data.
+                 *  The indexes of the sinks with a task to run, a ring
+                 *  that can hold all the sinks.
                  */
-                bool                        isDone;
+                unsigned int              * tasks;
 
                 /**
-                 *  A flag to show that the sink should be made to cut in the
-                 *  next iteration.
+                 *  The size of the tasks ring.
                  */
-                bool                    cut;
+                unsigned int                maxTasks;
+
+                /**
+                 *  The position of the oldest task in the ring.
+                 */
+                unsigned int                firstTask;
+
+                /**
+                 *  The number of tasks in the ring.
+                 */
+                unsigned int                numTasks;
+
+                /**
+                 *  Wakes this thread up when it sleeps for lack of tasks.
+                 */
+                Notifier                    wakeup;
+
+                /**
+                 *  Set by the thread while it sleeps on wakeup.
+                 */
+                std::atomic<bool>           sleeping;
 
                 /**
                  *  Default constructor.
@@ -119,12 +336,25 @@ class MultiThreadedConnector : public virtual Connector
                 inline
                 ThreadData()
                 {
-                    this->connector = 0;
-                    this->ixSink    = 0;
-                    this->thread    = 0;
-                    this->accepting = false;
-                    this->isDone    = false;
-                    this->cut       = false;
+                    this->connector   = 0;
+                    this->ixThread    = 0;
+                    this->thread      = 0;
+                    this->tasks       = 0;
+                    this->maxTasks    = 0;
+                    this->firstTask   = 0;
+                    this->numTasks    = 0;
+                    this->sleeping    = false;
+                    pthread_mutex_init( &mutexTasks, 0);
+                }
+
+                /**
+                 *  Destructor.
+                 */
+                inline
+                ~ThreadData()
+                {
+                    delete[] tasks;
+                    pthread_mutex_destroy( &mutexTasks);
                 }
 
                 /**
@@ -139,14 +369,38 @@ class MultiThreadedConnector : public virtual Connector
         };
         
         /**
-         *  The mutex of this object.
+         *  The number of tasks waiting in the work queues.
+         */
+        std::atomic<unsigned int>   readyTasks;
+
+        /**
+         *  The number of worker threads sleeping for lack of tasks.
+         */
+        std::atomic<unsigned int>   idleThreads;
+
+        /**
+         *  The number of blocks in the queues of the sinks, counted down
+         *  as the worker threads are done with them.
+         */
+        std::atomic<unsigned int>   pendingBlocks;
+
+        /**
+         *  Wakes the thread calling transfer() up, when it waits for the
+         *  capture thread or for the worker threads.
+         */
+        Notifier                dispatcherWakeup;
+
+        /**
+         *  Set by the thread calling transfer() while it waits for the
+         *  worker threads to make room in a queue, or to be done with
+         *  all the blocks.
          */
-        pthread_mutex_t         mutexProduce;
+        std::atomic<bool>       producerWaiting;
 
         /**
-         *  The conditional variable for presenting new data.
+         *  The number of times a thread was woken up, for the statistics.
          */
-        pthread_cond_t          condProduce;
+        std::atomic<unsigned long>  wakeups;
 
         /**
          *  The thread attributes.
@@ -154,14 +408,35 @@ class MultiThreadedConnector : public virtual Connector
         pthread_attr_t          threadAttr;
 
         /**
-         *  The threads for the sinks.
+         *  The state of each sink, in the order of the sinks.
+         */
+        SinkData              * sinkData;
+
+        /**
+         *  The worker threads encoding for the sinks.
          */
         ThreadData            * threads;
 
+        /**
+         *  The number of worker threads running.
+         */
+        unsigned int            numThreads;
+
+        /**
+         *  The number of worker threads to run, 0 for as many as there
+         *  are CPUs online.
+         */
+        unsigned int            workerThreads;
+
+        /**
+         *  The queueing options for each sink, in the order of the sinks.
+         */
+        QueueOptions          * queueOptions;
+
         /**
          *  Signal if we're running or not, so the threads no if to stop.
          */
-        bool                    running;
+        std::atomic<bool>       running;
 
         /**
          *  Flag to show if the connector should try to reconnect if
@@ -170,14 +445,294 @@ class MultiThreadedConnector : public virtual Connector
         bool                    reconnect;
 
         /**
-         *  The buffer of information presented to each thread.
+         *  The default maximum number of blocks queued for a sink.
          */
-        unsigned char         * dataBuffer;
+        unsigned int            queueDepth;
 
         /**
-         *  The amount of information presented to each thread.
+         *  The default overflow policy of the sinks.
          */
-        unsigned int            dataSize;
+        OverflowPolicy          queuePolicy;
+
+        /**
+         *  The blocks the source is read into. Only the capture thread
+         *  acquires blocks, all threads release them.
+         */
+        AudioBlockPool          blockPool;
+
+        /**
+         *  The thread reading the source.
+         */
+        pthread_t               captureThread;
+
+        /**
+         *  The blocks read by the capture thread, waiting to be
+         *  handed to the sinks.
+         */
+        SpscQueue<AudioBlock*>  captureRing;
+
+        /**
+         *  Set by the thread calling transfer() while it waits for the
+         *  capture thread to push a block or to stop.
+         */
+        std::atomic<bool>       dispatcherWaiting;
+
+        /**
+         *  Wakes the capture thread up when it waits for room in the
+         *  capture ring.
+         */
+        Notifier                captureWakeup;
+
+        /**
+         *  The thread reopening the sinks that are not accepting data,
+         *  so that connecting to a server does not hold up a worker.
+         */
+        pthread_t               reconnectThread;
+
+        /**
+         *  Tells if the reconnect thread was started.
+         */
+        bool                    reconnectStarted;
+
+        /**
+         *  Wakes the reconnect thread up, when a sink is handed over
+         *  to it or when it has to stop.
+         */
+        Notifier                reconnectWakeup;
+
+        /**
+         *  Set by the capture thread while it waits on captureWakeup.
+         */
+        std::atomic<bool>       captureWaiting;
+
+        /**
+         *  Flag to show if the capture thread should wait for room in
+         *  the capture ring, instead of dropping blocks. Set when a sink
+         *  has the block overflow policy, as such a sink asks for the
+         *  reading of the source to be held up.
+         */
+        bool                    captureBlocking;
+
+        /**
+         *  Set by the capture thread when it stopped reading the source.
+         */
+        std::atomic<bool>       captureDone;
+
+        /**
+         *  The number of bytes the capture thread is to read,
+         *  0 for no limit.
+         */
+        unsigned long           captureLimit;
+
+        /**
+         *  The size of the blocks the capture thread reads.
+         */
+        unsigned int            captureBufSize;
+
+        /**
+         *  The number of seconds to wait for the source to have data.
+         */
+        unsigned int            captureSec;
+
+        /**
+         *  The number of micro-seconds to wait for the source to have data.
+         */
+        unsigned int            captureUsec;
+
+        /**
+         *  The number of bytes read by the capture thread.
+         */
+        unsigned long           capturedBytes;
+
+        /**
+         *  The SCHED_FIFO priority of the capture thread,
+         *  0 to keep the scheduling of the thread calling transfer().
+         */
+        int                     capturePriority;
+
+        /**
+         *  The SCHED_FIFO priority of the worker threads,
+         *  0 to run them with SCHED_OTHER.
+         */
+        int                     workerPriority;
+
+        /**
+         *  The rate the source delivers data at in bytes per second,
+         *  0 if not known.
+         */
+        unsigned int            captureRate;
+
+        /**
+         *  Statistics of the capture thread.
+         */
+        CaptureStats            captureStats;
+
+        /**
+         *  The resamplers shared by encoders converting the audio to
+         *  the same sample rate and number of channels. Each block is
+         *  resampled once by the dispatcher, in order, and the
+         *  encoders take the result from the block.
+         */
+        Resampler            ** resamplers;
+
+        /**
+         *  The number of shared resamplers.
+         */
+        unsigned int            numResamplers;
+
+        /**
+         *  Make a shared resampler for each conversion that more than
+         *  one encoder needs.
+         *
+         *  @exception Exception
+         */
+        void
+        openResamplers ( void );
+
+        /**
+         *  Delete the shared resamplers.
+         */
+        void
+        closeResamplers ( void )                            throw ();
+
+        /**
+         *  Add the audio at the sample rates of the shared resamplers
+         *  to a block, before it is handed to the sinks.
+         *
+         *  @param block the block to resample.
+         */
+        void
+        resampleBlock ( AudioBlock    * block )             throw ();
+
+        /**
+         *  Present a block to a sink, applying the overflow policy
+         *  of the sink if its queue is full.
+         *
+         *  @param sd the state of the sink.
+         *  @param dataBlock the block to present, with a reference
+         *                   already taken for the sink.
+         */
+        void
+        enqueue ( SinkData        * sd,
+                  AudioBlock      * dataBlock );
+
+        /**
+         *  Release all blocks in the queue of a sink.
+         *
+         *  @param sd the state of the sink.
+         */
+        void
+        drainQueue ( SinkData     * sd );
+
+        /**
+         *  Tell the producer that a worker thread made room in a queue,
+         *  if the producer is waiting for it.
+         */
+        void
+        signalConsumed ( void );
+
+        /**
+         *  Wake a thread up, if it is waiting. The waiting thread sets
+         *  its flag before it checks what it waits for, so either it
+         *  sees the change made before this call, or it is woken up.
+         *
+         *  @param waiting the flag of the waiting thread, cleared.
+         *  @param notifier the notifier the thread waits on.
+         *  @return true if the thread was waiting.
+         */
+        bool
+        wakeUp ( std::atomic<bool>    & waiting,
+                 Notifier             & notifier );
+
+        /**
+         *  Wake up a worker thread to run a task just scheduled: the
+         *  worker of the task, or if that one is busy, an idle worker
+         *  to steal it.
+         *
+         *  @param sd the state of the sink of the task.
+         */
+        void
+        wakeWorker ( SinkData     * sd );
+
+        /**
+         *  Put the task of a sink into the work queue of its worker
+         *  thread, unless it is scheduled already.
+         *
+         *  @param sd the state of the sink.
+         *  @return true if the task was put into a work queue.
+         */
+        bool
+        schedule ( SinkData       * sd );
+
+        /**
+         *  Take a task to run: the oldest one from the work queue of
+         *  the worker, or the newest one from the queue of another worker.
+         *
+         *  @param threadData the worker thread looking for work.
+         *  @param sd the state of the sink of the task taken, if any.
+         *  @return true if a task was taken.
+         */
+        bool
+        takeTask ( ThreadData     * threadData,
+                   SinkData      *& sd );
+
+        /**
+         *  Run the task of a sink: write the blocks queued for it, or
+         *  hand it over to the reconnect thread if it is not accepting
+         *  data.
+         *
+         *  @param sd the state of the sink, scheduled.
+         */
+        void
+        runTask ( SinkData        * sd );
+
+        /**
+         *  Reopen the sinks handed over by the workers, until the
+         *  connector is stopped. Run by the reconnect thread.
+         */
+        void
+        reconnectLoop ( void );
+
+        /**
+         *  The function of the reconnect thread.
+         *
+         *  @param param the connector, a pointer to a MultiThreadedConnector
+         *  @return nothing
+         */
+        static void *
+        reconnectThreadFunction ( void      * param );
+
+        /**
+         *  Read the source and push the blocks read into the capture
+         *  ring, until the limit given to transfer() is reached, the
+         *  source has no more data, or the connector is stopped.
+         */
+        void
+        captureLoop ( void );
+
+        /**
+         *  Update the capture statistics with a block just read.
+         *
+         *  @param block the block read, time stamped.
+         *  @param bytes the number of bytes read so far, including
+         *               the block.
+         *  @param offset the smallest difference between the time stamp
+         *                and the playing time of the data read so far,
+         *                updated.
+         */
+        void
+        measureCapture ( const AudioBlock * block,
+                         unsigned long      bytes,
+                         long long        & offset );
+
+        /**
+         *  The function of the capture thread.
+         *
+         *  @param param the connector, a pointer to a MultiThreadedConnector
+         *  @return nothing
+         */
+        static void *
+        captureThreadFunction ( void      * param );
 
         /**
          *  Initialize the object.
@@ -185,10 +740,15 @@ class MultiThreadedConnector : public virtual Connector
          *  @param reconnect flag to indicate if the connector should
          *                   try to reconnect if the connection was
          *                   dropped by the other end
+         *  @param queueDepth the default maximum number of blocks queued
+         *                    for each sink
+         *  @param queuePolicy the default overflow policy of the sinks
          *  @exception Exception
          */
         void
-        init ( bool     reconnect )                 ;
+        init ( bool             reconnect,
+               unsigned int     queueDepth,
+               OverflowPolicy   queuePolicy )       ;
 
         /**
          *  De-initialize the object.
@@ -211,9 +771,30 @@ class MultiThreadedConnector : public virtual Connector
             throw Exception( __FILE__, __LINE__);
         }
 
+        /**
+         *  Detach an already attached Sink from the Source of this Connector.
+         *
+         *  @param sink the Sink to detach.
+         *  @return true if the detachment was successful, false otherwise.
+         *  @exception Exception
+         */
+        virtual bool
+        detach (    Sink          * sink )          ;
+
 
     public:
 
+        /**
+         *  The default maximum number of blocks queued for each sink thread.
+         */
+        static const unsigned int   defaultQueueDepth = 4;
+
+        /**
+         *  The number of blocks the capture thread may be ahead of
+         *  handing them to the sinks.
+         */
+        static const unsigned int   captureRingDepth = 32;
+
         /**
          *  Constructor based on a Source.
          *
@@ -221,15 +802,21 @@ class MultiThreadedConnector : public virtual Connector
          *  @param reconnect flag to indicate if the connector should
          *                   try to reconnect if the connection was
          *                   dropped by the other end
+         *  @param queueDepth the default maximum number of blocks queued
+         *                    for each sink
+         *  @param queuePolicy the default overflow policy of the sinks
          *  @exception Exception
          */
         inline
         MultiThreadedConnector (    Source        * source,
-                                    bool            reconnect )
+                                    bool            reconnect,
+                                    unsigned int    queueDepth
+                                                        = defaultQueueDepth,
+                                    OverflowPolicy  queuePolicy = dropOldest )
                                                             
                     : Connector( source )
         {
-            init(reconnect);
+            init(reconnect, queueDepth, queuePolicy);
         }
 
         /**
@@ -240,16 +827,23 @@ class MultiThreadedConnector : public virtual Connector
          *  @param reconnect flag to indicate if the connector should
          *                   try to reconnect if the connection was
          *                   dropped by the other end
+         *  @param queueDepth the default maximum number of blocks queued
+         *                    for each sink
+         *  @param queuePolicy the default overflow policy of the sinks
          *  @exception Exception
          */
         inline
         MultiThreadedConnector ( Source            * source,
                                  Sink              * sink,
-                                 bool                reconnect )
+                                 bool                reconnect,
+                                 unsigned int        queueDepth
+                                                        = defaultQueueDepth,
+                                 OverflowPolicy      queuePolicy = dropOldest )
                                                             
-                    : Connector( source, sink)
+                    : Connector( source )
         {
-            init(reconnect);
+            init(reconnect, queueDepth, queuePolicy);
+            attach( sink);
         }
 
         /**
@@ -283,6 +877,104 @@ class MultiThreadedConnector : public virtual Connector
         operator= ( const MultiThreadedConnector &   connector )
                                                             ;
 
+        /**
+         *  Parse the name of an overflow policy.
+         *
+         *  @param name the name of the policy: "drop-oldest",
+         *              "drop-newest" or "block"
+         *  @return the overflow policy.
+         *  @exception Exception if the name is not a known policy.
+         */
+        static OverflowPolicy
+        strToOverflowPolicy ( const char      * name );
+
+        /**
+         *  Get the default overflow policy of the sinks.
+         *
+         *  @return the default overflow policy.
+         */
+        inline OverflowPolicy
+        getQueuePolicy ( void ) const                   throw ()
+        {
+            return queuePolicy;
+        }
+
+        /**
+         *  Run the capture thread with real-time scheduling.
+         *
+         *  @param priority the SCHED_FIFO priority of the capture thread,
+         *                  0 to keep the scheduling of the thread
+         *                  calling transfer().
+         */
+        inline void
+        setCapturePriority ( int    priority )          throw ()
+        {
+            capturePriority = priority;
+        }
+
+        /**
+         *  Run the worker threads with real-time scheduling.
+         *
+         *  @param priority the SCHED_FIFO priority of the worker threads,
+         *                  0 to run them with SCHED_OTHER.
+         */
+        inline void
+        setWorkerPriority ( int     priority )          throw ()
+        {
+            workerPriority = priority;
+        }
+
+        /**
+         *  Tell the rate the source delivers data at, so that the capture
+         *  thread can tell if it reads blocks late.
+         *
+         *  @param bytesPerSec the data rate of the source,
+         *                     0 if not known.
+         */
+        inline void
+        setCaptureRate ( unsigned int   bytesPerSec )   throw ()
+        {
+            captureRate = bytesPerSec;
+        }
+
+        /**
+         *  Set the number of worker threads encoding for the sinks.
+         *  Takes effect when the connector is opened. No more threads
+         *  are started than there are sinks.
+         *
+         *  @param threads the number of worker threads,
+         *                 0 for as many as there are CPUs online.
+         */
+        inline void
+        setWorkerThreads ( unsigned int     threads )   throw ()
+        {
+            workerThreads = threads;
+        }
+
+        /**
+         *  Attach a Sink to the Source of this Connector, with the default
+         *  queue depth and overflow policy.
+         *
+         *  @param sink the Sink to attach.
+         *  @exception Exception
+         */
+        virtual void
+        attach (    Sink          * sink )              ;
+
+        /**
+         *  Attach a Sink to the Source of this Connector.
+         *
+         *  @param sink the Sink to attach.
+         *  @param queueDepth the maximum number of blocks queued for the
+         *                    sink. If 0, the default depth is used.
+         *  @param policy what to do when the queue of the sink is full.
+         *  @exception Exception
+         */
+        virtual void
+        attach (    Sink          * sink,
+                    unsigned int    queueDepth,
+                    OverflowPolicy  policy )            ;
+
         /**
          *  Open the connector. Opens the Source and the Sinks if necessary.
          *
@@ -294,7 +986,8 @@ class MultiThreadedConnector : public virtual Connector
 
         /**
          *  Transfer a given amount of data from the Source to all the
-         *  Sinks attached.
+         *  Sinks attached. The Source is read by the capture thread,
+         *  which runs while this function runs.
          *  If an attached Sink closes or encounteres an error during the
          *  process, it is detached and the function carries on with the
          *  rest of the Sinks. If no Sinks remain, or an error is encountered
@@ -339,12 +1032,13 @@ class MultiThreadedConnector : public virtual Connector
 
         /**
          *  This is the worker function for each thread.
-         *  This function has to return fast
+         *  The sinks are written to without holding any lock, so the
+         *  threads encode in parallel.
          *
-         *  @param ixSink the index of the sink this thread works on.
+         *  @param threadData the worker thread.
          */
         void
-        sinkThread( int     ixSink );
+        workerThread( ThreadData    * threadData );
 };
 
 
@@ -0,0 +1,373 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : NetworkThread.cpp
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+   
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License  
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+   
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+    GNU General Public License for more details.
+   
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#else
+#error need unistd.h
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#else
+#error need errno.h
+#endif
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
+
+#include "Exception.h"
+#include "Util.h"
+#include "BufferedSink.h"
+#include "NetworkThread.h"
+
+
+/* ===================================================  local data structures */
+
+
+/* ================================================  local constants & macros */
+
+/*------------------------------------------------------------------------------
+ *  File identity
+ *----------------------------------------------------------------------------*/
+static const char fileid[] = "$Id$";
+
+/*------------------------------------------------------------------------------
+ *  The epoll key of the wakeup notifier, no slot has this key
+ *----------------------------------------------------------------------------*/
+#define WAKEUP_KEY      (~0ULL)
+
+
+/* ===============================================  local function prototypes */
+
+
+/* =============================================================  module code */
+
+/*------------------------------------------------------------------------------
+ *  Constructor
+ *----------------------------------------------------------------------------*/
+NetworkThread :: NetworkThread ( void )
+{
+#ifdef HAVE_SYS_EPOLL_H
+    struct epoll_event      event;
+    unsigned int            u;
+
+    for ( u = 0; u < maxSockets; ++u ) {
+        slots[u].sink       = 0;
+        slots[u].fd         = -1;
+        slots[u].generation = 0;
+        slots[u].idle.store( false);
+        slots[u].kicked.store( false);
+        slots[u].failed.store( false);
+    }
+
+    if ( (epollFd = epoll_create1( EPOLL_CLOEXEC)) == -1 ) {
+        throw Exception( __FILE__, __LINE__, "epoll_create1 error", errno);
+    }
+
+    // level triggered, the notifier is read when woken up
+    event.events   = EPOLLIN;
+    event.data.u64 = WAKEUP_KEY;
+    if ( epoll_ctl( epollFd, EPOLL_CTL_ADD, wakeup.getFd(), &event) == -1 ) {
+        ::close( epollFd);
+        throw Exception( __FILE__, __LINE__, "epoll_ctl error", errno);
+    }
+
+    pthread_mutex_init( &mutex, 0);
+    started = false;
+    running.store( false);
+#else
+    throw Exception( __FILE__, __LINE__,
+                     "no epoll support, can't send in a network thread");
+#endif
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Destructor
+ *----------------------------------------------------------------------------*/
+NetworkThread :: ~NetworkThread ( void )                    throw ()
+{
+#ifdef HAVE_SYS_EPOLL_H
+    if ( started ) {
+        running.store( false);
+        wakeup.notify();
+        pthread_join( thread, 0);
+    }
+
+    pthread_mutex_destroy( &mutex);
+    ::close( epollFd);
+#endif
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Start sending to a socket
+ *----------------------------------------------------------------------------*/
+unsigned int
+NetworkThread :: add (  int             fd,
+                        BufferedSink  * sink )
+{
+#ifdef HAVE_SYS_EPOLL_H
+    struct epoll_event      event;
+    unsigned int            u;
+    int                     ret;
+
+    lock();
+    for ( u = 0; u < maxSockets && slots[u].sink; ++u );
+    if ( u == maxSockets ) {
+        unlock();
+        throw Exception( __FILE__, __LINE__,
+                         "too many sockets for the network thread");
+    }
+
+    Slot      * slot = slots + u;
+
+    slot->sink = sink;
+    slot->fd   = fd;
+    ++slot->generation;
+    slot->idle.store( false);
+    slot->kicked.store( false);
+    slot->failed.store( false);
+    slot->resumeAt = 0;
+
+    // the socket is reported writable right away, and from then on
+    // each time it becomes writable after taking no more
+    event.events   = EPOLLOUT | EPOLLET;
+    event.data.u64 = ((unsigned long long) slot->generation << 32) | u;
+    ret = epoll_ctl( epollFd, EPOLL_CTL_ADD, fd, &event);
+    if ( ret == -1 ) {
+        slot->sink = 0;
+        unlock();
+        throw Exception( __FILE__, __LINE__, "epoll_ctl error", errno);
+    }
+
+    // under the mutex, as encoders attach from threads of their own
+    if ( !started ) {
+        running.store( true);
+        if ( pthread_create( &thread, 0, threadFunction, this) ) {
+            running.store( false);
+            epoll_ctl( epollFd, EPOLL_CTL_DEL, fd, 0);
+            slot->sink = 0;
+            slot->fd   = -1;
+            unlock();
+            throw Exception( __FILE__, __LINE__, "pthread_create error");
+        }
+        started = true;
+    }
+    unlock();
+
+    return u;
+#else
+    throw Exception( __FILE__, __LINE__, "no epoll support");
+#endif
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Stop sending to a socket
+ *----------------------------------------------------------------------------*/
+void
+NetworkThread :: remove ( unsigned int  ix )                throw ()
+{
+#ifdef HAVE_SYS_EPOLL_H
+    Slot      * slot = slots + ix;
+
+    lock();
+    if ( slot->sink ) {
+        // a failed socket was taken out already, and may be closed
+        if ( !slot->failed.load() ) {
+            epoll_ctl( epollFd, EPOLL_CTL_DEL, slot->fd, 0);
+        }
+        slot->sink = 0;
+        slot->fd   = -1;
+    }
+    unlock();
+#endif
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Send what is queued for a socket
+ *----------------------------------------------------------------------------*/
+void
+NetworkThread :: send ( unsigned int    ix )                throw ()
+{
+    Slot      * slot = slots + ix;
+
+    try {
+        while ( slot->sink->sendQueued( &slot->resumeAt) ) {
+            // all sent, and the socket could take more: nothing but the
+            // encoder will tell about new data. look once more, in case
+            // it was queued before the encoder could see the queue idle
+            slot->idle.store( true);
+            std::atomic_thread_fence( std::memory_order_seq_cst);
+            if ( !slot->sink->hasQueued() || !slot->idle.exchange( false) ) {
+                return;
+            }
+        }
+        // the socket takes no more, wait for it to become writable,
+        // or pacing holds it back, wait for resumeAt
+    } catch ( Exception     & e ) {
+        fail( ix);
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Mark a connection broken
+ *----------------------------------------------------------------------------*/
+void
+NetworkThread :: fail ( unsigned int    ix )                throw ()
+{
+#ifdef HAVE_SYS_EPOLL_H
+    Slot      * slot = slots + ix;
+
+    if ( slot->failed.load() ) {
+        return;
+    }
+
+    reportEvent( 4, "NetworkThread :: fail, connection lost, socket", ix);
+
+    // the socket may be closed already, then it's not watched anyway
+    epoll_ctl( epollFd, EPOLL_CTL_DEL, slot->fd, 0);
+    slot->failed.store( true, std::memory_order_release);
+#endif
+}
+
+
+/*------------------------------------------------------------------------------
+ *  The thread function
+ *----------------------------------------------------------------------------*/
+void *
+NetworkThread :: threadFunction ( void     * param )
+{
+    NetworkThread     * networkThread = (NetworkThread *) param;
+
+    networkThread->run();
+
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  The loop of the thread
+ *----------------------------------------------------------------------------*/
+void
+NetworkThread :: run ( void )                               throw ()
+{
+#ifdef HAVE_SYS_EPOLL_H
+    struct epoll_event      events[maxSockets + 1];
+    unsigned long long      now;
+    unsigned long long      next;
+    int                     timeout;
+    int                     n;
+    int                     i;
+    unsigned int            u;
+
+    while ( running.load() ) {
+        // sleep until the earliest paced socket may send again
+        lock();
+        next = 0;
+        for ( u = 0; u < maxSockets; ++u ) {
+            if ( slots[u].sink && !slots[u].failed.load()
+              && slots[u].resumeAt
+              && (next == 0 || slots[u].resumeAt < next) ) {
+                next = slots[u].resumeAt;
+            }
+        }
+        unlock();
+
+        timeout = -1;
+        if ( next ) {
+            now     = Util::getMonotonicTime();
+            timeout = next > now ? (int) ((next - now + 999) / 1000) : 0;
+        }
+
+        n = epoll_wait( epollFd, events, maxSockets + 1, timeout);
+        if ( n == -1 ) {
+            if ( errno != EINTR ) {
+                reportEvent( 1, "NetworkThread :: run, epoll_wait error",
+                                errno);
+                break;
+            }
+            continue;
+        }
+
+        lock();
+        for ( i = 0; i < n; ++i ) {
+            unsigned long long  key = events[i].data.u64;
+
+            if ( key == WAKEUP_KEY ) {
+                wakeup.wait();
+                for ( u = 0; u < maxSockets; ++u ) {
+                    if ( slots[u].sink && !slots[u].failed.load()
+                      && slots[u].kicked.exchange( false) ) {
+                        send( u);
+                    }
+                }
+                continue;
+            }
+
+            Slot      * slot = slots + (unsigned int) (key & 0xffffffffULL);
+
+            // the socket may have been removed since the event
+            if ( !slot->sink || slot->failed.load()
+              || slot->generation != (unsigned int) (key >> 32) ) {
+                continue;
+            }
+
+            if ( events[i].events & (EPOLLERR | EPOLLHUP) ) {
+                fail( slot - slots);
+            } else if ( events[i].events & EPOLLOUT ) {
+                send( slot - slots);
+            }
+        }
+
+        now = Util::getMonotonicTime();
+        for ( u = 0; u < maxSockets; ++u ) {
+            if ( slots[u].sink && !slots[u].failed.load()
+              && slots[u].resumeAt && slots[u].resumeAt <= now ) {
+                slots[u].resumeAt = 0;
+                send( u);
+            }
+        }
+        unlock();
+    }
+#endif
+}
+
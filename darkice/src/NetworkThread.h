@@ -0,0 +1,312 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : NetworkThread.h
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+   
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License  
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+   
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+    GNU General Public License for more details.
+   
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+#ifndef NETWORK_THREAD_H
+#define NETWORK_THREAD_H
+
+#ifndef __cplusplus
+#error This is a C++ include file
+#endif
+
+
+/* ============================================================ include files */
+
+#include <pthread.h>
+#include <atomic>
+
+#include "Referable.h"
+#include "Reporter.h"
+#include "Notifier.h"
+
+
+/* ================================================================ constants */
+
+
+/* =================================================================== macros */
+
+
+/* =============================================================== data types */
+
+class BufferedSink;
+
+/**
+ *  A thread that sends the data queued in BufferedSinks to their
+ *  sockets, so that the encoders only ever append to a queue, and a
+ *  slow server does not hold them up.
+ *
+ *  The sockets are non-blocking and watched with epoll, edge triggered:
+ *  a socket is written until it takes no more, and written again when
+ *  it becomes writable. A queue emptied while its socket could take
+ *  more is marked idle, and the encoder appending to an idle queue
+ *  wakes the thread up. Otherwise appending is just a store.
+ *
+ *  A connection found broken is marked failed, and left for the owner
+ *  of the BufferedSink to reopen, in its own thread.
+ *
+ *  @author  $Author$
+ *  @version $Revision$
+ */
+class NetworkThread : public virtual Referable, public virtual Reporter
+{
+    public:
+
+        /**
+         *  The most sockets the thread sends to.
+         */
+        static const unsigned int   maxSockets = 64;
+
+
+    private:
+
+        /**
+         *  A socket the thread sends to, and the queue it sends from.
+         */
+        class Slot
+        {
+            public:
+                /**
+                 *  The sink the queue belongs to, 0 if the slot is free.
+                 */
+                BufferedSink              * sink;
+
+                /**
+                 *  The socket.
+                 */
+                int                         fd;
+
+                /**
+                 *  Counts the uses of the slot, to tell events of an
+                 *  earlier socket in the slot from those of this one.
+                 */
+                unsigned int                generation;
+
+                /**
+                 *  Set when the queue was emptied while the socket
+                 *  could take more, so nothing wakes the thread up
+                 *  for this socket but the encoder.
+                 */
+                std::atomic<bool>           idle;
+
+                /**
+                 *  Set by the encoder waking the thread up.
+                 */
+                std::atomic<bool>           kicked;
+
+                /**
+                 *  Set when the connection is found broken.
+                 */
+                std::atomic<bool>           failed;
+
+                /**
+                 *  When pacing allows sending to the socket again,
+                 *  see Util::getMonotonicTime(). 0 if not held back.
+                 */
+                unsigned long long          resumeAt;
+        };
+
+        /**
+         *  The sockets.
+         */
+        Slot                        slots[maxSockets];
+
+        /**
+         *  The epoll instance.
+         */
+        int                         epollFd;
+
+        /**
+         *  Wakes the thread up, when a queue stops being idle or when
+         *  the thread has to stop.
+         */
+        Notifier                    wakeup;
+
+        /**
+         *  Held by the thread while it handles the events, and while
+         *  the sockets are added and removed.
+         */
+        pthread_mutex_t             mutex;
+
+        /**
+         *  The thread.
+         */
+        pthread_t                   thread;
+
+        /**
+         *  Tells if the thread was started. Guarded by mutex.
+         */
+        bool                        started;
+
+        /**
+         *  Tells if the thread is to run on.
+         */
+        std::atomic<bool>           running;
+
+        /**
+         *  Copy constructor. Not supported.
+         */
+        NetworkThread ( const NetworkThread &   thread );
+
+        /**
+         *  Assignment operator. Not supported.
+         */
+        NetworkThread &
+        operator= ( const NetworkThread &       thread );
+
+        /**
+         *  Send what is queued for a socket, until the queue is empty
+         *  or the socket takes no more.
+         *
+         *  @param ix the index of the slot of the socket.
+         */
+        void
+        send (  unsigned int    ix )                        throw ();
+
+        /**
+         *  Mark a connection broken, and stop watching its socket.
+         *
+         *  @param ix the index of the slot of the socket.
+         */
+        void
+        fail (  unsigned int    ix )                        throw ();
+
+        /**
+         *  The thread function.
+         *
+         *  @param param a pointer to the NetworkThread.
+         *  @return nothing
+         */
+        static void *
+        threadFunction ( void     * param );
+
+        /**
+         *  The loop of the thread.
+         */
+        void
+        run ( void )                                        throw ();
+
+
+    public:
+
+        /**
+         *  Constructor.
+         *
+         *  @exception Exception
+         */
+        NetworkThread ( void );
+
+        /**
+         *  Destructor. Stops the thread.
+         */
+        virtual
+        ~NetworkThread ( void )                             throw ();
+
+        /**
+         *  Start sending what is queued in a BufferedSink to a socket.
+         *  The socket is made non-blocking. Starts the thread when
+         *  called the first time.
+         *
+         *  @param fd the socket.
+         *  @param sink the sink holding the queue.
+         *  @return the index of the slot of the socket.
+         *  @exception Exception
+         */
+        unsigned int
+        add (   int             fd,
+                BufferedSink  * sink );
+
+        /**
+         *  Stop sending to a socket. The thread does not touch the
+         *  sink or the socket any more once this returns.
+         *
+         *  @param ix the index of the slot of the socket.
+         */
+        void
+        remove ( unsigned int   ix )                        throw ();
+
+        /**
+         *  Tell the thread that data was queued for a socket. Only wakes
+         *  the thread up if the queue was idle.
+         *
+         *  @param ix the index of the slot of the socket.
+         */
+        inline void
+        wake (  unsigned int    ix )                        throw ()
+        {
+            Slot      * slot = slots + ix;
+
+            // pairs with the fence in send(), one of the two sides sees
+            // the data queued or the queue idle
+            std::atomic_thread_fence( std::memory_order_seq_cst);
+            if ( slot->idle.load( std::memory_order_relaxed)
+              && slot->idle.exchange( false) ) {
+                slot->kicked.store( true, std::memory_order_release);
+                wakeup.notify();
+            }
+        }
+
+        /**
+         *  Tell if the connection of a socket was found broken.
+         *
+         *  @param ix the index of the slot of the socket.
+         *  @return true if the connection is broken.
+         */
+        inline bool
+        hasFailed ( unsigned int    ix ) const              throw ()
+        {
+            return slots[ix].failed.load( std::memory_order_acquire);
+        }
+
+        /**
+         *  Keep the thread from sending, to touch a sink it sends to.
+         */
+        inline void
+        lock ( void )                                       throw ()
+        {
+            pthread_mutex_lock( &mutex);
+        }
+
+        /**
+         *  Let the thread send again.
+         */
+        inline void
+        unlock ( void )                                     throw ()
+        {
+            pthread_mutex_unlock( &mutex);
+        }
+};
+
+
+/* ================================================= external data structures */
+
+
+/* ====================================================== function prototypes */
+
+
+
+#endif  /* NETWORK_THREAD_H */
+
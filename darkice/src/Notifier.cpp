@@ -0,0 +1,193 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : Notifier.cpp
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#else
+#error need unistd.h
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#else
+#error need errno.h
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#else
+#error need fcntl.h
+#endif
+
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#else
+#error need sys/time.h
+#endif
+
+#ifdef HAVE_SIGNAL_H
+#include <signal.h>
+#else
+#error need signal.h
+#endif
+
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
+
+#include <stdint.h>
+
+#include "Notifier.h"
+
+
+/* ===================================================  local data structures */
+
+
+/* ================================================  local constants & macros */
+
+/*------------------------------------------------------------------------------
+ *  File identity
+ *----------------------------------------------------------------------------*/
+static const char fileid[] = "$Id$";
+
+
+/* ===============================================  local function prototypes */
+
+
+/* =============================================================  module code */
+
+/*------------------------------------------------------------------------------
+ *  Constructor
+ *----------------------------------------------------------------------------*/
+Notifier :: Notifier ( void )
+{
+#ifdef HAVE_SYS_EVENTFD_H
+    if ( (readFd = eventfd( 0, EFD_CLOEXEC)) == -1 ) {
+        throw Exception( __FILE__, __LINE__, "eventfd error", errno);
+    }
+    writeFd = readFd;
+#else
+    int     fds[2];
+
+    if ( pipe( fds) == -1 ) {
+        throw Exception( __FILE__, __LINE__, "pipe error", errno);
+    }
+    readFd  = fds[0];
+    writeFd = fds[1];
+
+    // a full pipe already means a pending notification
+    fcntl( writeFd, F_SETFL, fcntl( writeFd, F_GETFL) | O_NONBLOCK);
+    fcntl( readFd, F_SETFD, FD_CLOEXEC);
+    fcntl( writeFd, F_SETFD, FD_CLOEXEC);
+#endif
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Destructor
+ *----------------------------------------------------------------------------*/
+Notifier :: ~Notifier ( void )                              throw ()
+{
+    if ( writeFd != readFd ) {
+        ::close( writeFd);
+    }
+    ::close( readFd);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Wake up the waiting thread
+ *----------------------------------------------------------------------------*/
+void
+Notifier :: notify ( void )                                 throw ()
+{
+#ifdef HAVE_SYS_EVENTFD_H
+    uint64_t        value = 1;
+#else
+    unsigned char   value = 1;
+#endif
+
+    while ( ::write( writeFd, &value, sizeof(value)) == -1 && errno == EINTR );
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Wait to be notified
+ *----------------------------------------------------------------------------*/
+void
+Notifier :: wait ( void )                                   throw ()
+{
+#ifdef HAVE_SYS_EVENTFD_H
+    uint64_t        value;
+#else
+    // take all the notifications at once, if possible
+    unsigned char   value[64];
+#endif
+
+    while ( ::read( readFd, &value, sizeof(value)) == -1 && errno == EINTR );
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Wait to be notified, for some time at most
+ *----------------------------------------------------------------------------*/
+bool
+Notifier :: wait (  unsigned int    sec,
+                    unsigned int    usec )                  throw ()
+{
+    fd_set              fdset;
+    struct timespec     timespec;
+    sigset_t            sigset;
+    int                 ret;
+
+    FD_ZERO( &fdset);
+    FD_SET( readFd, &fdset);
+
+    timespec.tv_sec  = sec + usec / 1000000;
+    timespec.tv_nsec = (usec % 1000000) * 1000L;
+
+    // mask out SIGUSR1, as we're expecting that signal for other reasons
+    sigemptyset( &sigset);
+    sigaddset( &sigset, SIGUSR1);
+
+    ret = pselect( readFd + 1, &fdset, NULL, NULL, &timespec, &sigset);
+    if ( ret <= 0 ) {
+        return false;
+    }
+
+    wait();
+    return true;
+}
+
@@ -0,0 +1,151 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : Notifier.h
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+#ifndef NOTIFIER_H
+#define NOTIFIER_H
+
+#ifndef __cplusplus
+#error This is a C++ include file
+#endif
+
+
+/* ============================================================ include files */
+
+#include "Exception.h"
+
+
+/* ================================================================ constants */
+
+
+/* =================================================================== macros */
+
+
+/* =============================================================== data types */
+
+/**
+ *  A way to wake up one particular thread, without a mutex.
+ *
+ *  Notifications are counted by the kernel, so a notification sent
+ *  before the thread starts to wait is not lost: the wait returns
+ *  right away. Several notifications may be merged into one wakeup.
+ *  Uses an eventfd where available, and a pipe otherwise.
+ *
+ *  @author  $Author$
+ *  @version $Revision$
+ */
+class Notifier
+{
+    private:
+
+        /**
+         *  The file descriptor waited on.
+         */
+        int             readFd;
+
+        /**
+         *  The file descriptor notified on. The same as readFd for
+         *  an eventfd.
+         */
+        int             writeFd;
+
+        /**
+         *  Copy constructor. Not supported.
+         */
+        Notifier ( const Notifier &     notifier );
+
+        /**
+         *  Assignment operator. Not supported.
+         */
+        Notifier &
+        operator= ( const Notifier &    notifier );
+
+
+    public:
+
+        /**
+         *  Constructor.
+         *
+         *  @exception Exception
+         */
+        Notifier ( void );
+
+        /**
+         *  Destructor.
+         */
+        ~Notifier ( void )                                  throw ();
+
+        /**
+         *  Wake up the thread waiting, or the next one to wait.
+         *  Safe to call from any thread.
+         */
+        void
+        notify ( void )                                     throw ();
+
+        /**
+         *  Wait until notified. Returns right away if notified since the
+         *  last wait. Only one thread should wait at a time.
+         */
+        void
+        wait ( void )                                       throw ();
+
+        /**
+         *  Wait until notified, or until some time passed.
+         *  Returns right away if notified since the last wait.
+         *  Only one thread should wait at a time.
+         *
+         *  @param sec the seconds to wait at most.
+         *  @param usec micro seconds to wait after the full seconds.
+         *  @return true if notified, false if the time passed.
+         */
+        bool
+        wait (  unsigned int    sec,
+                unsigned int    usec )                      throw ();
+
+        /**
+         *  Get the file descriptor that becomes readable when notified,
+         *  to wait for it together with other file descriptors.
+         *
+         *  @return the file descriptor to poll for reading.
+         */
+        inline int
+        getFd ( void ) const                                throw ()
+        {
+            return readFd;
+        }
+};
+
+
+/* ================================================= external data structures */
+
+
+/* ====================================================== function prototypes */
+
+
+
+#endif  /* NOTIFIER_H */
+
@@ -0,0 +1,121 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : NullSink.cpp
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+   
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License  
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+   
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+    GNU General Public License for more details.
+   
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "Exception.h"
+#include "Util.h"
+#include "NullSink.h"
+
+
+/* ===================================================  local data structures */
+
+
+/* ================================================  local constants & macros */
+
+/*------------------------------------------------------------------------------
+ *  File identity
+ *----------------------------------------------------------------------------*/
+static const char fileid[] = "$Id$";
+
+
+/* ===============================================  local function prototypes */
+
+
+/* =============================================================  module code */
+
+/*------------------------------------------------------------------------------
+ *  Initialize the object
+ *----------------------------------------------------------------------------*/
+void
+NullSink :: init (  const char    * configName )
+{
+    this->configName = Util::strDup( configName);
+    opened           = false;
+    bytes            = 0;
+    openTime         = 0;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  De-initialize the object
+ *----------------------------------------------------------------------------*/
+void
+NullSink :: strip ( void )
+{
+    if ( isOpen() ) {
+        close();
+    }
+
+    delete[] configName;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Open the sink
+ *----------------------------------------------------------------------------*/
+bool
+NullSink :: open ( void )
+{
+    if ( isOpen() ) {
+        return false;
+    }
+
+    bytes    = 0;
+    openTime = Util::getMonotonicTime();
+    opened   = true;
+
+    return true;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Close the sink
+ *----------------------------------------------------------------------------*/
+void
+NullSink :: close ( void )
+{
+    unsigned long long  usec;
+
+    if ( !isOpen() ) {
+        return;
+    }
+
+    usec = Util::getMonotonicTime() - openTime;
+    reportEvent( 2, configName, "bytes discarded:", bytes);
+    reportEvent( 2, configName, "kbit/s:",
+                    usec ? (unsigned long) (bytes * 8000 / usec) : 0UL);
+
+    opened = false;
+}
+
@@ -0,0 +1,272 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : NullSink.h
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+   
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License  
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+   
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+    GNU General Public License for more details.
+   
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+#ifndef NULL_SINK_H
+#define NULL_SINK_H
+
+#ifndef __cplusplus
+#error This is a C++ include file
+#endif
+
+
+/* ============================================================ include files */
+
+#include "Reporter.h"
+#include "Sink.h"
+
+
+/* ================================================================ constants */
+
+
+/* =================================================================== macros */
+
+
+/* =============================================================== data types */
+
+/**
+ *  An output that counts the data written to it, and throws it away.
+ *  Used to measure the cost of encoding without a server to send to.
+ *
+ *  @author  $Author$
+ *  @version $Revision$
+ */
+class NullSink : public Sink, public virtual Reporter
+{
+    private:
+
+        /**
+         *  The name of the configuration related to this sink,
+         *  something like "null-0".
+         */
+        char                  * configName;
+
+        /**
+         *  Tells if the sink is open.
+         */
+        bool                    opened;
+
+        /**
+         *  The number of bytes written since opening.
+         */
+        unsigned long long      bytes;
+
+        /**
+         *  The time of opening.
+         */
+        unsigned long long      openTime;
+
+        /**
+         *  Initialize the object.
+         *
+         *  @param configName the name of the configuration related to
+         *         this sink.
+         *  @exception Exception
+         */
+        void
+        init (  const char    * configName );
+
+        /**
+         *  De-initialize the object.
+         *
+         *  @exception Exception
+         */
+        void
+        strip ( void );
+
+
+    protected:
+
+        /**
+         *  Default constructor. Always throws an Exception.
+         *
+         *  @exception Exception
+         */
+        inline
+        NullSink ( void )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+
+    public:
+
+        /**
+         *  Constructor.
+         *
+         *  @param configName the name of the configuration related to
+         *         this sink, something like "null-0".
+         *  @exception Exception
+         */
+        inline
+        NullSink (  const char        * configName )
+        {
+            init( configName);
+        }
+
+        /**
+         *  Copy constructor. The copy is not open.
+         *
+         *  @param sink the NullSink to copy.
+         *  @exception Exception
+         */
+        inline
+        NullSink (  const NullSink &    sink )
+                : Sink( sink)
+        {
+            init( sink.configName);
+        }
+
+        /**
+         *  Destructor.
+         *
+         *  @exception Exception
+         */
+        inline virtual
+        ~NullSink ( void )
+        {
+            strip();
+        }
+
+        /**
+         *  Assignment operator. This object is not open afterwards.
+         *
+         *  @param sink the NullSink to assign to this object.
+         *  @return a reference to this object.
+         *  @exception Exception
+         */
+        inline virtual NullSink &
+        operator= ( const NullSink &    sink )
+        {
+            if ( this != &sink ) {
+                strip();
+                Sink::operator=( sink);
+                init( sink.configName);
+            }
+            return *this;
+        }
+
+        /**
+         *  Get the number of bytes written since opening.
+         *
+         *  @return the number of bytes written.
+         */
+        inline unsigned long long
+        getBytes ( void ) const                         throw ()
+        {
+            return bytes;
+        }
+
+        /**
+         *  Open the sink.
+         *
+         *  @return true if opening was successful, false otherwise.
+         *  @exception Exception
+         */
+        virtual bool
+        open ( void );
+
+        /**
+         *  Check if the sink is open.
+         *
+         *  @return true if the sink is open, false otherwise.
+         */
+        inline virtual bool
+        isOpen ( void ) const                           throw ()
+        {
+            return opened;
+        }
+
+        /**
+         *  Check if the sink is ready to accept data, which it always
+         *  is when open.
+         *
+         *  @param sec the maximum seconds to block.
+         *  @param usec micro seconds to block after the full seconds.
+         *  @return true if the sink is open, false otherwise.
+         */
+        inline virtual bool
+        canWrite (  unsigned int    sec,
+                    unsigned int    usec )              throw ()
+        {
+            return opened;
+        }
+
+        /**
+         *  Count the data, and throw it away.
+         *
+         *  @param buf the data to write.
+         *  @param len number of bytes to write from buf.
+         *  @return len if open, 0 otherwise.
+         */
+        inline virtual unsigned int
+        write (     const void    * buf,
+                    unsigned int    len )               throw ()
+        {
+            if ( !opened ) {
+                return 0;
+            }
+            bytes += len;
+            return len;
+        }
+
+        /**
+         *  Flush the data written. There is nothing to do.
+         */
+        inline virtual void
+        flush ( void )                                  throw ()
+        {
+        }
+
+        /**
+         *  Cut what the sink has been doing so far. There is nothing
+         *  to do.
+         */
+        inline virtual void
+        cut ( void )                                    throw ()
+        {
+        }
+
+        /**
+         *  Close the sink, and report the amount of data written.
+         *
+         *  @exception Exception
+         */
+        virtual void
+        close ( void );
+};
+
+
+/* ================================================= external data structures */
+
+
+/* ====================================================== function prototypes */
+
+
+
+#endif  /* NULL_SINK_H */
+
@@ -42,6 +42,7 @@
 
 #include "Exception.h"
 #include "Util.h"
+#include "ConvKernels.h"
 #include "OpusLibEncoder.h"
 #include "CastSink.h"
 #include <cstring>
@@ -71,9 +72,12 @@ void
 OpusLibEncoder :: init ( unsigned int     outMaxBitrate )
                                                             
 {
-    this->outMaxBitrate = outMaxBitrate;
+    this->outMaxBitrate     = outMaxBitrate;
+    this->resampledBuffer   = 0;
+    this->resampledFrames   = 0;
+    this->resampledCapacity = 0;
 
-    if ( getInBitsPerSample() != 16 && getInBitsPerSample() != 8 ) {
+    if ( getInSampleFormat() == SampleFormat::unknown ) {
         throw Exception( __FILE__, __LINE__,
                          "specified bits per sample not supported",
                          getInBitsPerSample() );
@@ -125,18 +129,20 @@ OpusLibEncoder :: init ( unsigned int     outMaxBitrate )
         // If we get here and useLinear is still true, then we have
         // a power of two.
 
-        // open the aflibConverter in
-        // - high quality
-        // - linear or quadratic (non-linear) based on algorithm
-        // - not filter interpolation
+        // open the converter with linear or sinc interpolation
+        // based on the ratio
 #ifdef HAVE_SRC_LIB
         int srcError = 0;
         converter = src_new(useLinear == true ? SRC_LINEAR : SRC_SINC_FASTEST,
-                            getInChannel(), &srcError);
+                            getOutChannel(), &srcError);
         if(srcError)
             throw Exception (__FILE__, __LINE__, "libsamplerate error: ", src_strerror (srcError));
 #else
-        converter = new aflibConverter( true, useLinear, false);
+        converter = new Resampler( getInSampleRate(),
+                                   getOutSampleRate(),
+                                   getOutChannel(),
+                                   useLinear ? Resampler::low
+                                             : Resampler::medium);
 #endif
     }
 
@@ -167,10 +173,11 @@ OpusLibEncoder :: open ( void )
     internalBuffer = new unsigned char[bufferSize];
     internalBufferLength = 0;
     memset( internalBuffer, 0, bufferSize);
+    resampledFrames = 0;
 
     int err;
     opusEncoder = opus_encoder_create( getOutSampleRate(),
-                                       getInChannel(),
+                                       getOutChannel(),
                                        OPUS_APPLICATION_AUDIO,
                                        &err);
     if( err != OPUS_OK ) {
@@ -305,13 +312,11 @@ OpusLibEncoder :: open ( void )
     if ( converter ) {
 #ifdef HAVE_SRC_LIB
         converterData.input_frames   = 4096/((getInBitsPerSample() / 8) * getInChannel());
-        converterData.data_in        = new float[converterData.input_frames*getInChannel()];
+        converterData.data_in        = new float[converterData.input_frames*getOutChannel()];
         converterData.output_frames  = (int) (converterData.input_frames * resampleRatio + 1);
-        converterData.data_out       = new float[getInChannel() * converterData.output_frames];
+        converterData.data_out       = new float[getOutChannel() * converterData.output_frames];
         converterData.src_ratio      = resampleRatio;
         converterData.end_of_input   = 0;
-#else
-        converter->initialize( resampleRatio, getInChannel());
 #endif
     }
 
@@ -335,26 +340,39 @@ OpusLibEncoder :: write ( const void    * buf,
 
     unsigned int    channels      = getInChannel();
     unsigned int    bitsPerSample = getInBitsPerSample();
-    unsigned int    sampleSize = (bitsPerSample / 8) * channels;
+    bool            bigEndian     = isInBigEndian();
+    int16_t       * narrowBuffer  = narrowInput( buf, len);
+    unsigned char * mixBuffer  = NULL;
 
     unsigned int i;
 
+    // samples wider than 16 bits are encoded as 16 bit ones here
+    if ( narrowBuffer ) {
+        buf           = narrowBuffer;
+        bitsPerSample = 16;
+        bigEndian     = SampleFormat::isHostBigEndian();
+    }
+
+    unsigned int    sampleSize = (bitsPerSample / 8) * channels;
+
+    // mix down into a buffer of our own, the input is not ours to change
     if ( getInChannel() == 2 && getOutChannel() == 1 ) {
-        for ( i = 0; i < len/sampleSize; i++) {
-            if ( bitsPerSample == 8 ) {
-                char          * buf8 = (char *) buf;
-                unsigned int    ix   = sampleSize * i;
-                unsigned int    iix  = ix;
-                buf8[i] = (buf8[ix] + buf8[++iix]) / 2;
-            }
-            if ( bitsPerSample == 16 ) {
-                short         * buf16 = (short *) buf;
-                unsigned int    ix    = (bitsPerSample >> 3) * i;
-                unsigned int    iix   = ix;
-                buf16[i] = (buf16[ix] + buf16[++iix]) / 2;
+        unsigned int    frames = len / sampleSize;
+
+        mixBuffer = new unsigned char[frames * (bitsPerSample / 8)];
+        if ( bitsPerSample == 8 ) {
+            const char    * buf8 = (const char *) buf;
+            char          * mix8 = (char *) mixBuffer;
+
+            for ( i = 0; i < frames; i++) {
+                mix8[i] = (buf8[2 * i] + buf8[2 * i + 1]) / 2;
             }
         }
-        len      >>= 1;
+        if ( bitsPerSample == 16 ) {
+            Util::downmix( (const int16_t *) buf, frames, (int16_t *) mixBuffer);
+        }
+        buf        = mixBuffer;
+        len        = frames * (bitsPerSample / 8);
         channels   = 1;
     }
 
@@ -392,16 +410,14 @@ OpusLibEncoder :: write ( const void    * buf,
         unsigned int    totalSamples = processed * channels;
         short int     * shortBuffer  = new short int[totalSamples];
 
-        Util::conv( bitsPerSample, b, processed*sampleSize, shortBuffer, isInBigEndian());
+        Util::conv( bitsPerSample, b, processed*sampleSize, shortBuffer, bigEndian);
 
         if ( converter && processed > 0 ) {
             // resample if needed
-            int         inCount  = processed;
-            int         outCount = 480; //(int) (inCount * resampleRatio);
-            short int * resampledBuffer = new short int[(outCount+1)* channels];
-            int         converted;
 #ifdef HAVE_SRC_LIB
-            (void)inCount;
+            short int * resampledBuffer = new short int[481 * channels];
+            int         converted;
+
             converterData.input_frames   = processed;
             src_short_to_float_array (shortBuffer, (float *) converterData.data_in, totalSamples);
             int srcError = src_process (converter, &converterData);
@@ -411,12 +427,6 @@ OpusLibEncoder :: write ( const void    * buf,
 
             src_float_to_short_array(converterData.data_out, resampledBuffer, converted*channels);
 
-#else
-            converted = converter->resample( inCount,
-                                             outCount,
-                                             shortBuffer,
-                                             resampledBuffer );
-#endif
             if( converted != 480) {
                 throw Exception( __FILE__, __LINE__, "resampler error: expected 480 samples", converted);
             }
@@ -428,6 +438,26 @@ OpusLibEncoder :: write ( const void    * buf,
             opusBlocksOut( encBytes, opusBuffer);
 
             delete[] resampledBuffer;
+#else
+            // the converter keeps its own fraction of a frame, so the
+            // output is not always exactly 480 frames
+            short int * outBuffer = new short int[
+                                converter->getMaxOutFrames( processed)
+                                * channels];
+            unsigned int    converted;
+            float         * out;
+
+            converted = converter->resample( shortBuffer,
+                                             processed,
+                                             outBuffer );
+            out = reserveFrames( converted);
+            ConvKernels::get()->toFloat16( outBuffer,
+                                           converted * channels,
+                                           1,
+                                           &out);
+            encodeFrames( converted);
+            delete[] outBuffer;
+#endif
 
         } else if( processed > 0) {
             memset( opusBuffer, 0, opusBufferSize);
@@ -461,11 +491,124 @@ OpusLibEncoder :: write ( const void    * buf,
         delete[] tempBuffer;
         tempBuffer = NULL;
     }
+    delete[] mixBuffer;
+    delete[] narrowBuffer;
 
     return totalProcessed;
 }
 
 
+/*------------------------------------------------------------------------------
+ *  Encode one Opus frame
+ *----------------------------------------------------------------------------*/
+void
+OpusLibEncoder :: encodeFrame ( const float       * pcm )
+{
+    int             opusBufferSize = (1275*3+7)*getOutChannel();
+    unsigned char * opusBuffer     = new unsigned char[opusBufferSize];
+
+    int encBytes = opus_encode_float( opusEncoder, pcm, 480, opusBuffer, opusBufferSize);
+    if( encBytes < 0 ) {
+        delete[] opusBuffer;
+        throw Exception( __FILE__, __LINE__, "opus encoder error");
+    }
+    oggGranulePosition += 480;
+    opusBlocksOut( encBytes, opusBuffer);
+
+    delete[] opusBuffer;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Encode a block of audio, taking it from the shared resampler
+ *----------------------------------------------------------------------------*/
+unsigned int
+OpusLibEncoder :: writeBlock ( AudioBlock     * block )
+{
+    if ( !isOpen() || block->size == 0 ) {
+        return 0;
+    }
+
+    unsigned int        channels = getOutChannel();
+    bool                mixDown  = getInChannel() == 2 && channels == 1;
+    unsigned int        frames   = 0;
+    const float       * floats   = 0;
+
+    // Opus works on float samples, and keeps the precision of sources
+    // wider than 16 bits this way, also when resampled or mixed down
+    if ( canUseViews( block) ) {
+        if ( converter ) {
+            floats = block->getResampledFloat( getOutSampleRate(),
+                                               channels,
+                                               frames);
+        } else if ( mixDown ) {
+            floats = block->getMonoFloat();
+            frames = block->frames;
+        } else {
+            floats = block->getInterleavedFloat();
+            frames = block->frames;
+        }
+    }
+
+    if ( !floats ) {
+        return write( block->data, block->size);
+    }
+    memcpy( reserveFrames( frames), floats, frames * channels * sizeof(float));
+    encodeFrames( frames);
+
+    return block->frames * getInChannel() * (block->bitsPerSample / 8);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Make room for audio at the output sample rate in resampledBuffer
+ *----------------------------------------------------------------------------*/
+float *
+OpusLibEncoder :: reserveFrames (   unsigned int        frames )
+{
+    unsigned int        channels = getOutChannel();
+
+    if ( resampledFrames + frames > resampledCapacity ) {
+        float         * buffer = new float[(resampledFrames + frames)
+                                           * channels];
+
+        if ( resampledFrames ) {
+            memcpy( buffer,
+                    resampledBuffer,
+                    resampledFrames * channels * sizeof(float));
+        }
+        delete[] resampledBuffer;
+        resampledBuffer   = buffer;
+        resampledCapacity = resampledFrames + frames;
+    }
+
+    return resampledBuffer + resampledFrames * channels;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Encode the whole Opus frames of the audio at the output sample rate
+ *----------------------------------------------------------------------------*/
+void
+OpusLibEncoder :: encodeFrames (    unsigned int        frames )
+{
+    unsigned int        channels = getOutChannel();
+
+    // the audio is at 48kHz already, only has to be cut into Opus frames
+    resampledFrames += frames;
+
+    unsigned int        done = 0;
+    while ( resampledFrames - done >= 480 ) {
+        encodeFrame( resampledBuffer + done * channels);
+        done += 480;
+    }
+    resampledFrames -= done;
+    memmove( resampledBuffer,
+             resampledBuffer + done * channels,
+             resampledFrames * channels * sizeof(float));
+}
+
+
 /*------------------------------------------------------------------------------
  *  Flush the data from the encoder
  *----------------------------------------------------------------------------*/
@@ -58,7 +58,7 @@
 #ifdef HAVE_SRC_LIB
 #include <samplerate.h>
 #else
-#include "aflibConverter.h"
+#include "Resampler.h"
 #endif
 
 #include <stdio.h>
@@ -222,6 +222,22 @@ class OpusLibEncoder : public AudioEncoder, public virtual Reporter
         int                             internalBufferLength;
         bool                            reconnectError;
 
+        /**
+         *  Audio taken from the views of the blocks, not yet encoded,
+         *  at the output sample rate and channels, interleaved.
+         */
+        float                         * resampledBuffer;
+
+        /**
+         *  The number of sample frames in resampledBuffer.
+         */
+        unsigned int                    resampledFrames;
+
+        /**
+         *  The number of sample frames resampledBuffer can hold.
+         */
+        unsigned int                    resampledCapacity;
+
         /**
          *  Maximum bitrate of the output in kbits/sec. If 0, don't care.
          */
@@ -239,7 +255,7 @@ class OpusLibEncoder : public AudioEncoder, public virtual Reporter
         SRC_STATE                     * converter;
         SRC_DATA                      converterData;
 #else
-        aflibConverter                * converter;
+        Resampler                     * converter;
 #endif
 
         /**
@@ -259,6 +275,7 @@ class OpusLibEncoder : public AudioEncoder, public virtual Reporter
         inline void
         strip ( void )                                  
         {
+            delete[] resampledBuffer;
             if ( converter ) {
 #ifdef HAVE_SRC_LIB
                 delete [] converterData.data_in;
@@ -278,6 +295,37 @@ class OpusLibEncoder : public AudioEncoder, public virtual Reporter
                        unsigned char* data,
                        bool eos = false )               ;
 
+        /**
+         *  Encode one Opus frame of 480 samples at the output sample
+         *  rate, and send it to the underlying stream.
+         *
+         *  @param pcm the samples, channels interleaved.
+         *  @exception Exception
+         */
+        void
+        encodeFrame ( const float       * pcm )         ;
+
+        /**
+         *  Make room for samples at the output sample rate at the end
+         *  of resampledBuffer.
+         *
+         *  @param frames the number of sample frames to put there.
+         *  @return where to put the samples, channels interleaved.
+         *  @exception Exception
+         */
+        float *
+        reserveFrames ( unsigned int    frames )        ;
+
+        /**
+         *  Take the samples put where reserveFrames() told, and encode
+         *  all whole Opus frames in resampledBuffer.
+         *
+         *  @param frames the number of sample frames put there.
+         *  @exception Exception
+         */
+        void
+        encodeFrames ( unsigned int     frames )        ;
+
 
     protected:
 
@@ -536,6 +584,32 @@ class OpusLibEncoder : public AudioEncoder, public virtual Reporter
         write (        const void    * buf,
                        unsigned int    len )        ;
 
+        /**
+         *  Encode a block of audio. If the connector resampled the block
+         *  to the output sample rate, that audio is encoded. If there is
+         *  no need to resample, the samples of the block are encoded,
+         *  mixed down to mono by the block if needed. Otherwise the raw
+         *  data of the block is given to write().
+         *
+         *  @param block the audio to encode.
+         *  @return the number of bytes of the block processed.
+         *  @exception Exception
+         */
+        virtual unsigned int
+        writeBlock (   AudioBlock    * block )      ;
+
+        /**
+         *  Tell that the encoder can take audio already resampled
+         *  to its output sample rate.
+         *
+         *  @return true
+         */
+        inline virtual bool
+        canTakeResampled ( void ) const             throw ()
+        {
+            return true;
+        }
+
         /**
          *  Flush all data that was written to the encoder to the underlying
          *  connection.
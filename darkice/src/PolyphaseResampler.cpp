@@ -0,0 +1,433 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : PolyphaseResampler.cpp
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#error need string.h
+#endif
+
+#ifdef HAVE_MATH_H
+#include <math.h>
+#else
+#error need math.h
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define POLYPHASE_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON)
+#define POLYPHASE_NEON
+#include <arm_neon.h>
+#endif
+
+#include "PolyphaseResampler.h"
+
+
+/* ===================================================  local data structures */
+
+/*------------------------------------------------------------------------------
+ *  The design of the filter for a quality level: the part of the band up
+ *  to the Nyquist frequency that is passed, and the stopband attenuation
+ *----------------------------------------------------------------------------*/
+typedef struct {
+    double      passband;
+    double      attenuation;
+} FilterDesign;
+
+/*------------------------------------------------------------------------------
+ *  The inner loop of the filter
+ *----------------------------------------------------------------------------*/
+typedef float (*DotFunction) ( const float    * x,
+                               const float    * h,
+                               unsigned int     taps );
+
+
+/* ================================================  local constants & macros */
+
+/*------------------------------------------------------------------------------
+ *  File identity
+ *----------------------------------------------------------------------------*/
+static const char fileid[] = "$Id$";
+
+/*------------------------------------------------------------------------------
+ *  The filter designs, by quality
+ *----------------------------------------------------------------------------*/
+static const FilterDesign filterDesigns[] = {
+    { 0.80,  60.0 },        // low
+    { 0.80,  97.0 },        // medium
+    { 0.90, 120.0 }         // high
+};
+
+/*------------------------------------------------------------------------------
+ *  The smallest number of samples a ring holds
+ *----------------------------------------------------------------------------*/
+#define MIN_RING_SIZE   4096
+
+
+/* ===============================================  local function prototypes */
+
+
+/* =============================================================  module code */
+
+/*------------------------------------------------------------------------------
+ *  The inner loop of the filter: the dot product of a window of the
+ *  input and a phase of the filter, the number of taps a multiple of 8
+ *----------------------------------------------------------------------------*/
+static float
+dotScalar ( const float   * x,
+            const float   * h,
+            unsigned int    taps )
+{
+    float   sum[4] = { 0.f, 0.f, 0.f, 0.f };
+
+    for ( unsigned int i = 0; i < taps; i += 4 ) {
+        sum[0] += x[i]     * h[i];
+        sum[1] += x[i + 1] * h[i + 1];
+        sum[2] += x[i + 2] * h[i + 2];
+        sum[3] += x[i + 3] * h[i + 3];
+    }
+
+    return (sum[0] + sum[1]) + (sum[2] + sum[3]);
+}
+
+#ifdef POLYPHASE_X86
+__attribute__((target("sse")))
+static float
+dotSse (    const float   * x,
+            const float   * h,
+            unsigned int    taps )
+{
+    __m128      a = _mm_setzero_ps();
+    __m128      b = _mm_setzero_ps();
+    float       sum[4];
+
+    for ( unsigned int i = 0; i < taps; i += 8 ) {
+        a = _mm_add_ps( a, _mm_mul_ps( _mm_loadu_ps( x + i),
+                                       _mm_loadu_ps( h + i)));
+        b = _mm_add_ps( b, _mm_mul_ps( _mm_loadu_ps( x + i + 4),
+                                       _mm_loadu_ps( h + i + 4)));
+    }
+    _mm_storeu_ps( sum, _mm_add_ps( a, b));
+
+    return (sum[0] + sum[1]) + (sum[2] + sum[3]);
+}
+
+__attribute__((target("avx2,fma")))
+static float
+dotAvx2 (   const float   * x,
+            const float   * h,
+            unsigned int    taps )
+{
+    __m256      a = _mm256_setzero_ps();
+    __m256      b = _mm256_setzero_ps();
+    unsigned int i = 0;
+    float       sum[4];
+
+    for ( ; i + 16 <= taps; i += 16 ) {
+        a = _mm256_fmadd_ps( _mm256_loadu_ps( x + i),
+                             _mm256_loadu_ps( h + i), a);
+        b = _mm256_fmadd_ps( _mm256_loadu_ps( x + i + 8),
+                             _mm256_loadu_ps( h + i + 8), b);
+    }
+    if ( i < taps ) {
+        a = _mm256_fmadd_ps( _mm256_loadu_ps( x + i),
+                             _mm256_loadu_ps( h + i), a);
+    }
+    a = _mm256_add_ps( a, b);
+    _mm_storeu_ps( sum, _mm_add_ps( _mm256_castps256_ps128( a),
+                                    _mm256_extractf128_ps( a, 1)));
+
+    return (sum[0] + sum[1]) + (sum[2] + sum[3]);
+}
+#endif
+
+#ifdef POLYPHASE_NEON
+static float
+dotNeon (   const float   * x,
+            const float   * h,
+            unsigned int    taps )
+{
+    float32x4_t     a = vdupq_n_f32( 0.f);
+    float32x4_t     b = vdupq_n_f32( 0.f);
+    float           sum[4];
+
+    for ( unsigned int i = 0; i < taps; i += 8 ) {
+        a = vmlaq_f32( a, vld1q_f32( x + i),     vld1q_f32( h + i));
+        b = vmlaq_f32( b, vld1q_f32( x + i + 4), vld1q_f32( h + i + 4));
+    }
+    vst1q_f32( sum, vaddq_f32( a, b));
+
+    return (sum[0] + sum[1]) + (sum[2] + sum[3]);
+}
+#endif
+
+/*------------------------------------------------------------------------------
+ *  Choose the inner loop for the processor
+ *----------------------------------------------------------------------------*/
+static DotFunction
+selectDot ( void )
+{
+#ifdef POLYPHASE_X86
+    __builtin_cpu_init();
+    if ( __builtin_cpu_supports( "avx2") && __builtin_cpu_supports( "fma") ) {
+        return dotAvx2;
+    }
+    if ( __builtin_cpu_supports( "sse") ) {
+        return dotSse;
+    }
+#endif
+#ifdef POLYPHASE_NEON
+    return dotNeon;
+#endif
+    return dotScalar;
+}
+
+/*------------------------------------------------------------------------------
+ *  The inner loop in use, chosen before main() starts
+ *----------------------------------------------------------------------------*/
+static const DotFunction dotProduct = selectDot();
+
+
+/*------------------------------------------------------------------------------
+ *  The modified Bessel function of the first kind, order 0
+ *----------------------------------------------------------------------------*/
+static double
+besselI0 ( double   x )
+{
+    double      sum  = 1.0;
+    double      term = 1.0;
+
+    for ( unsigned int k = 1; k < 64 && term > sum * 1e-12; ++k ) {
+        double  f = x / (2.0 * k);
+
+        term *= f * f;
+        sum  += term;
+    }
+
+    return sum;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  The greatest common divisor
+ *----------------------------------------------------------------------------*/
+static unsigned int
+gcd (   unsigned int    a,
+        unsigned int    b )
+{
+    while ( b ) {
+        unsigned int    t = a % b;
+
+        a = b;
+        b = t;
+    }
+
+    return a;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Constructor
+ *----------------------------------------------------------------------------*/
+PolyphaseResampler :: PolyphaseResampler (  unsigned int    inSampleRate,
+                                            unsigned int    outSampleRate,
+                                            unsigned int    channels,
+                                            Quality         quality )
+{
+    unsigned int    g;
+
+    if ( inSampleRate == 0 || outSampleRate == 0 || channels == 0 ) {
+        throw Exception( __FILE__, __LINE__, "bad resampler format");
+    }
+
+    g                = gcd( inSampleRate, outSampleRate);
+    this->channels   = channels;
+    this->upFactor   = outSampleRate / g;
+    this->downFactor = inSampleRate / g;
+    this->phases     = upFactor < maxPhases ? upFactor : maxPhases;
+    this->coefs      = 0;
+    this->rings      = 0;
+
+    makeFilter( quality);
+
+    for ( ringSize = MIN_RING_SIZE; ringSize < 4 * taps; ringSize <<= 1 );
+    rings = new float[2 * ringSize * channels];
+    memset( rings, 0, 2 * ringSize * channels * sizeof(float));
+
+    // start with half a filter of silence, so that the first output
+    // sample is at the first input sample
+    written  = taps / 2 - 1;
+    position = 0;
+    phase    = 0;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Destructor
+ *----------------------------------------------------------------------------*/
+PolyphaseResampler :: ~PolyphaseResampler ( void )          throw ()
+{
+    delete[] coefs;
+    delete[] rings;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Make the filter table
+ *----------------------------------------------------------------------------*/
+void
+PolyphaseResampler :: makeFilter ( Quality      quality )
+{
+    const FilterDesign    * design = filterDesigns + quality;
+    double                  scale;
+    double                  transition;
+    double                  cutoff;
+    double                  beta;
+    double                  a = design->attenuation;
+    unsigned int            half;
+
+    // when making the rate lower, the filter has to cut at the
+    // output Nyquist frequency instead of the input one
+    scale      = upFactor < downFactor
+               ? (double) upFactor / (double) downFactor
+               : 1.0;
+    transition = (1.0 - design->passband) / 2.0 * scale;
+    cutoff     = (1.0 + design->passband) / 2.0 * scale;
+
+    // the Kaiser estimates for the length and the shape of the window
+    taps = (unsigned int) ceil( (a - 7.95) / (14.36 * transition));
+    taps = (taps + 7) & ~7u;
+    beta = a > 50.0 ? 0.1102 * (a - 8.7)
+                    : 0.5842 * pow( a - 21.0, 0.4) + 0.07886 * (a - 21.0);
+    half = taps / 2;
+
+    // one phase more than needed, for rounding up to the next input
+    // sample when the phases are not exact
+    coefs = new float[(phases + 1) * taps];
+    for ( unsigned int p = 0; p <= phases; ++p ) {
+        float     * row = coefs + p * taps;
+        double      sum = 0.0;
+
+        for ( unsigned int k = 0; k < taps; ++k ) {
+            // the distance of the tap from the output sample
+            double  t = (double) k - (half - 1) - (double) p / phases;
+            double  x = M_PI * cutoff * t;
+            double  r = t / half;
+            double  w = besselI0( beta * sqrt( r < 1.0 ? 1.0 - r * r : 0.0))
+                      / besselI0( beta);
+            double  v = cutoff * (x == 0.0 ? 1.0 : sin( x) / x) * w;
+
+            row[k] = (float) v;
+            sum   += v;
+        }
+
+        // unity gain at DC for every phase, to keep out a ripple
+        for ( unsigned int k = 0; k < taps; ++k ) {
+            row[k] = (float) (row[k] / sum);
+        }
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Convert the next chunk of the stream
+ *----------------------------------------------------------------------------*/
+unsigned int
+PolyphaseResampler :: process ( const float * const   * in,
+                                unsigned int            frames,
+                                float * const         * out )   throw ()
+{
+    const unsigned int  mask     = ringSize - 1;
+    unsigned int        produced = 0;
+    unsigned int        consumed = 0;
+
+    for (;;) {
+        // make all the output the input so far allows
+        while ( position + taps <= written ) {
+            unsigned int    row;
+            unsigned int    offset = (unsigned int) (position & mask);
+
+            if ( phases == upFactor ) {
+                row = phase;
+            } else {
+                row = (unsigned int) (((unsigned long long) phase * phases
+                                       + upFactor / 2) / upFactor);
+            }
+
+            for ( unsigned int c = 0; c < channels; ++c ) {
+                out[c][produced] = dotProduct( rings + c * 2 * ringSize
+                                                     + offset,
+                                               coefs + row * taps,
+                                               taps);
+            }
+            ++produced;
+
+            phase    += downFactor;
+            position += phase / upFactor;
+            phase    %= upFactor;
+        }
+
+        if ( consumed == frames ) {
+            break;
+        }
+
+        // put as much input into the rings as they have room for,
+        // each sample both in the first and the second half
+        unsigned int    room  = ringSize - (unsigned int) (written - position);
+        unsigned int    n     = frames - consumed < room
+                              ? frames - consumed
+                              : room;
+        unsigned int    start = (unsigned int) (written & mask);
+        unsigned int    first = n < ringSize - start ? n : ringSize - start;
+
+        for ( unsigned int c = 0; c < channels; ++c ) {
+            float         * ring = rings + c * 2 * ringSize;
+            const float   * src  = in[c] + consumed;
+
+            memcpy( ring + start, src, first * sizeof(float));
+            memcpy( ring + start + ringSize, src, first * sizeof(float));
+            memcpy( ring, src + first, (n - first) * sizeof(float));
+            memcpy( ring + ringSize, src + first, (n - first) * sizeof(float));
+        }
+        written  += n;
+        consumed += n;
+    }
+
+    return produced;
+}
+
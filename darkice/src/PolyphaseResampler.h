@@ -0,0 +1,235 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : PolyphaseResampler.h
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+#ifndef POLYPHASE_RESAMPLER_H
+#define POLYPHASE_RESAMPLER_H
+
+#ifndef __cplusplus
+#error This is a C++ include file
+#endif
+
+
+/* ============================================================ include files */
+
+#include "Exception.h"
+
+
+/* ================================================================ constants */
+
+
+/* =================================================================== macros */
+
+
+/* =============================================================== data types */
+
+/**
+ *  A sample rate converter for planar float audio, converting by a
+ *  rational ratio with a polyphase Kaiser windowed sinc filter.
+ *
+ *  The ratio outRate / inRate is reduced to L / M. The filter has L
+ *  phases, one for each position of an output sample between two
+ *  input samples, made when the converter is constructed. Ratios
+ *  with more than maxPhases phases use the nearest of maxPhases.
+ *
+ *  The input of each channel goes into a ring buffer that holds every
+ *  sample twice, one ring length apart, so that the filter always
+ *  reads a contiguous window and nothing is ever moved at the block
+ *  boundaries. The output lags the input by half the filter length.
+ *
+ *  @author  $Author$
+ *  @version $Revision$
+ */
+class PolyphaseResampler
+{
+    public:
+
+        /**
+         *  The quality of the filter: the number of input samples it
+         *  spans, its stopband attenuation and its passband width.
+         *  low is designed for 60 dB, medium for 97 dB, high for 120 dB.
+         */
+        enum Quality { low, medium, high };
+
+        /**
+         *  The most phases a filter table has.
+         */
+        static const unsigned int   maxPhases = 1024;
+
+
+    private:
+
+        /**
+         *  The number of channels.
+         */
+        unsigned int                channels;
+
+        /**
+         *  The upsampling factor, the reduced output rate.
+         */
+        unsigned int                upFactor;
+
+        /**
+         *  The downsampling factor, the reduced input rate.
+         */
+        unsigned int                downFactor;
+
+        /**
+         *  The number of phases in the filter table.
+         */
+        unsigned int                phases;
+
+        /**
+         *  The number of taps of each phase, a multiple of 8.
+         */
+        unsigned int                taps;
+
+        /**
+         *  The filter table, phases * taps coefficients, phase by phase.
+         */
+        float                     * coefs;
+
+        /**
+         *  The ring buffers, 2 * ringSize samples for each channel.
+         */
+        float                     * rings;
+
+        /**
+         *  The number of samples a ring holds, a power of 2.
+         */
+        unsigned int                ringSize;
+
+        /**
+         *  The number of samples written into the rings so far.
+         */
+        unsigned long long          written;
+
+        /**
+         *  The ring position of the first input sample of the filter
+         *  window of the next output sample.
+         */
+        unsigned long long          position;
+
+        /**
+         *  The position of the next output sample between two input
+         *  samples, in 1 / upFactor units.
+         */
+        unsigned int                phase;
+
+        /**
+         *  Copy constructor. Not supported.
+         */
+        PolyphaseResampler ( const PolyphaseResampler &     resampler );
+
+        /**
+         *  Assignment operator. Not supported.
+         */
+        PolyphaseResampler &
+        operator= ( const PolyphaseResampler &      resampler );
+
+        /**
+         *  Make the filter table.
+         *
+         *  @param quality the quality of the filter.
+         *  @exception Exception
+         */
+        void
+        makeFilter ( Quality    quality );
+
+
+    public:
+
+        /**
+         *  Constructor.
+         *
+         *  @param inSampleRate the sample rate of the input.
+         *  @param outSampleRate the sample rate of the output.
+         *  @param channels the number of channels.
+         *  @param quality the quality of the filter.
+         *  @exception Exception
+         */
+        PolyphaseResampler (    unsigned int    inSampleRate,
+                                unsigned int    outSampleRate,
+                                unsigned int    channels,
+                                Quality         quality );
+
+        /**
+         *  Destructor.
+         */
+        ~PolyphaseResampler ( void )                        throw ();
+
+        /**
+         *  Get the number of taps of each filter phase.
+         *
+         *  @return the number of input samples an output sample is
+         *          made of.
+         */
+        inline unsigned int
+        getTaps ( void ) const                              throw ()
+        {
+            return taps;
+        }
+
+        /**
+         *  Tell how many output frames at most a number of input frames
+         *  may produce.
+         *
+         *  @param frames the number of input frames.
+         *  @return the maximum number of output frames.
+         */
+        inline unsigned int
+        getMaxOutFrames ( unsigned int  frames ) const      throw ()
+        {
+            return (unsigned int) (((unsigned long long) frames * upFactor)
+                                   / downFactor) + 1;
+        }
+
+        /**
+         *  Convert the next chunk of the stream.
+         *
+         *  @param in the input samples, one buffer for each channel.
+         *  @param frames the number of input frames.
+         *  @param out the output buffers, one for each channel, room for
+         *             getMaxOutFrames( frames) samples each.
+         *  @return the number of output frames.
+         */
+        unsigned int
+        process (   const float * const   * in,
+                    unsigned int            frames,
+                    float * const         * out )           throw ();
+};
+
+
+/* ================================================= external data structures */
+
+
+/* ====================================================== function prototypes */
+
+
+
+#endif  /* POLYPHASE_RESAMPLER_H */
+
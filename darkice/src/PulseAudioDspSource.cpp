@@ -44,6 +44,12 @@
 #include "config.h"
 #endif
 
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#error need string.h
+#endif
+
 #include "Util.h"
 #include "Exception.h"
 #include "PulseAudioDspSource.h"
@@ -90,49 +96,18 @@ PulseAudioDspSource :: init (  const char      * paSourceName )
     ss.channels = getChannel();
     ss.rate = getSampleRate();
 
-    running = 0;
-    
-    //Supported for some bits per sample, both Big and Little endian
-    if (isBigEndian())
-    {
-       switch (getBitsPerSample())
-       {
-         case 8: 
-                 ss.format = PA_SAMPLE_U8;
-                 break;
-         case 16:
-                 ss.format = PA_SAMPLE_S16BE;
-                 break;
-         case 24:
-                 ss.format = PA_SAMPLE_S24BE;
-                 break;
-         case 32:
-                 ss.format = PA_SAMPLE_S32BE;
-                 break;
-         default:
-                 ss.format = PA_SAMPLE_INVALID;
-       }
-    }
-    else 
-    {
-       switch (getBitsPerSample())
-       {
-         case 8: 
-                 ss.format = PA_SAMPLE_U8;
-                 break;
-         case 16:
-                 ss.format = PA_SAMPLE_S16LE;
-                 break;
-         case 24:
-                 ss.format = PA_SAMPLE_S24LE;
-                 break;
-         case 32:
-                 ss.format = PA_SAMPLE_S32LE;
-                 break;
-         default:
-                 ss.format = PA_SAMPLE_INVALID;
-       }
-    }
+    s              = NULL;
+    mainloop       = NULL;
+    context        = NULL;
+    stream         = NULL;
+    dataReady      = new Notifier();  // Told of each fragment arrived
+    fragmentOffset = 0;
+    latency        = 0;
+    useSimple      = false;
+    overflows      = 0;
+
+    // chosen on open, as the sample format may be set after construction
+    ss.format      = PA_SAMPLE_INVALID;
 }
 
 
@@ -147,6 +122,7 @@ PulseAudioDspSource :: strip ( void )
     }
 
     delete[] sourceName;
+    delete dataReady;
 }
 
 
@@ -157,21 +133,200 @@ bool
 PulseAudioDspSource :: open ( void )                       
 {
   
-    char         client_name[255];
+    char            client_name[255];
+    pa_buffer_attr  attr;
+
+    if ( isOpen() ) {
+        return false;
+    }
+
+    //Supported for some sample formats, both Big and Little endian
+    switch ( getSampleFormat() ) {
+        case SampleFormat::u8:
+            ss.format = PA_SAMPLE_U8;
+            break;
+
+        case SampleFormat::s16:
+            ss.format = isBigEndian() ? PA_SAMPLE_S16BE : PA_SAMPLE_S16LE;
+            break;
+
+        case SampleFormat::s24_3:
+            ss.format = isBigEndian() ? PA_SAMPLE_S24BE : PA_SAMPLE_S24LE;
+            break;
+
+        case SampleFormat::s32:
+            ss.format = isBigEndian() ? PA_SAMPLE_S32BE : PA_SAMPLE_S32LE;
+            break;
+
+        case SampleFormat::float32:
+            ss.format = isBigEndian() ? PA_SAMPLE_FLOAT32BE
+                                      : PA_SAMPLE_FLOAT32LE;
+            break;
+
+        default:
+            return false;
+    }
 
     //to identify each darkice on pulseaudio server
     snprintf(client_name, 255, "darkice-%d", getpid());
 
-    if (!(s = pa_simple_new(NULL, client_name, PA_STREAM_RECORD, sourceName, "darkice record", &ss, NULL, NULL, &error))) {
-        throw Exception( __FILE__, __LINE__, ": pa_simple_new() failed: %s\n", pa_strerror(error));
+    // leave everything to the server, but the size of the fragments
+    attr.maxlength = (uint32_t) -1;
+    attr.tlength   = (uint32_t) -1;
+    attr.prebuf    = (uint32_t) -1;
+    attr.minreq    = (uint32_t) -1;
+    attr.fragsize  = latency ? pa_usec_to_bytes( latency * 1000ULL, &ss)
+                             : (uint32_t) -1;
+
+    overflows      = 0;
+    fragmentOffset = 0;
+
+    if ( useSimple ) {
+        openSimple( client_name, &attr);
+    } else {
+        openAsync( client_name, &attr);
     }
-
-    running = 1;
   
     return true;
 }
 
 
+/*------------------------------------------------------------------------------
+ *  Open the audio source through the simple API
+ *----------------------------------------------------------------------------*/
+void
+PulseAudioDspSource :: openSimple ( const char            * clientName,
+                                    const pa_buffer_attr  * attr )
+{
+    if (!(s = pa_simple_new(NULL, clientName, PA_STREAM_RECORD, sourceName, "darkice record", &ss, NULL, attr, &error))) {
+        throw Exception( __FILE__, __LINE__, "pa_simple_new() failed: ",
+                         pa_strerror(error));
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Open the audio source through the async API
+ *----------------------------------------------------------------------------*/
+void
+PulseAudioDspSource :: openAsync (  const char            * clientName,
+                                    const pa_buffer_attr  * attr )
+{
+    const char    * failed;
+
+    if ( !(mainloop = pa_threaded_mainloop_new()) ) {
+        throw Exception( __FILE__, __LINE__,
+                         "pa_threaded_mainloop_new() failed");
+    }
+    if ( !(context = pa_context_new( pa_threaded_mainloop_get_api( mainloop),
+                                     clientName)) ) {
+        closeAsync();
+        throw Exception( __FILE__, __LINE__, "pa_context_new() failed");
+    }
+    pa_context_set_state_callback( context, contextStateCallback, this);
+
+    pa_threaded_mainloop_lock( mainloop);
+
+    if ( pa_context_connect( context, NULL, PA_CONTEXT_NOFLAGS, NULL) < 0 ) {
+        failed = "pa_context_connect() failed: ";
+    } else if ( pa_threaded_mainloop_start( mainloop) < 0 ) {
+        failed = "pa_threaded_mainloop_start() failed: ";
+    } else {
+        failed = connectStream( attr);
+    }
+
+    if ( failed ) {
+        error = pa_context_errno( context);
+        pa_threaded_mainloop_unlock( mainloop);
+        closeAsync();
+        throw Exception( __FILE__, __LINE__, failed, pa_strerror( error));
+    }
+
+    reportLatency();
+
+    pa_threaded_mainloop_unlock( mainloop);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Connect the record stream
+ *----------------------------------------------------------------------------*/
+const char *
+PulseAudioDspSource :: connectStream ( const pa_buffer_attr   * attr )
+{
+    pa_context_state_t  contextState;
+    pa_stream_state_t   streamState;
+    int                 flags;
+
+    while ( (contextState = pa_context_get_state( context))
+                                                    != PA_CONTEXT_READY ) {
+        if ( !PA_CONTEXT_IS_GOOD( contextState) ) {
+            return "could not connect to the PulseAudio server: ";
+        }
+        pa_threaded_mainloop_wait( mainloop);
+    }
+
+    if ( !(stream = pa_stream_new( context, "darkice record", &ss, NULL)) ) {
+        return "pa_stream_new() failed: ";
+    }
+    pa_stream_set_state_callback( stream, streamStateCallback, this);
+    pa_stream_set_read_callback( stream, streamReadCallback, this);
+    pa_stream_set_overflow_callback( stream, streamOverflowCallback, this);
+
+    // with ADJUST_LATENCY the server sizes its own buffers after the
+    // fragment size too, so that it is the latency of the whole source
+    flags = PA_STREAM_INTERPOLATE_TIMING | PA_STREAM_AUTO_TIMING_UPDATE;
+    if ( latency ) {
+        flags |= PA_STREAM_ADJUST_LATENCY;
+    }
+    if ( pa_stream_connect_record( stream,
+                                   sourceName,
+                                   attr,
+                                   (pa_stream_flags_t) flags) < 0 ) {
+        return "pa_stream_connect_record() failed: ";
+    }
+
+    while ( (streamState = pa_stream_get_state( stream)) != PA_STREAM_READY ) {
+        if ( !PA_STREAM_IS_GOOD( streamState) ) {
+            return "could not connect the PulseAudio record stream: ";
+        }
+        pa_threaded_mainloop_wait( mainloop);
+    }
+
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Tell the latency achieved
+ *----------------------------------------------------------------------------*/
+void
+PulseAudioDspSource :: reportLatency ( void )
+{
+    const pa_buffer_attr  * attr = pa_stream_get_buffer_attr( stream);
+    pa_operation          * op;
+    pa_usec_t               usec;
+    int                     negative;
+
+    // ask the server for the timing now, not at the first automatic update
+    if ( (op = pa_stream_update_timing_info( stream,
+                                             streamSuccessCallback,
+                                             this)) ) {
+        while ( pa_operation_get_state( op) == PA_OPERATION_RUNNING ) {
+            pa_threaded_mainloop_wait( mainloop);
+        }
+        pa_operation_unref( op);
+    }
+
+    if ( attr && pa_stream_get_latency( stream, &usec, &negative) == 0 ) {
+        reportEvent( 2, "PulseAudioDspSource :: open, latency usec:",
+                        negative ? 0ULL : (unsigned long long) usec,
+                        "fragment bytes:",
+                        attr->fragsize);
+    }
+}
+
+
 /*------------------------------------------------------------------------------
  *  Check whether read() would return anything
  *----------------------------------------------------------------------------*/
@@ -179,27 +334,47 @@ bool
 PulseAudioDspSource :: canRead ( unsigned int    sec,
                            unsigned int    usec )    
 {
-  
-  /** Strange have to remove this, need to investigate... */
-  /*  if ( !isOpen() ) {
-        return false;
-      }
-  */
+    unsigned long long  deadline;
 
-    if (running == 0) {
-      char         client_name[255];
-      
-      //to identify each darkice on pulseaudio server
-      snprintf(client_name, 255, "darkice-%d", getpid());
-      
-      if (!(s = pa_simple_new(NULL, client_name, PA_STREAM_RECORD, sourceName, "darkice record", &ss, NULL, NULL, &error))) {
-        throw Exception( __FILE__, __LINE__, ": pa_simple_new() failed: %s\n", pa_strerror(error));
-      }
-      
-      running = 1;
+    if ( !isOpen() ) {
+        return false;
+    }
+    if ( s ) {
+        // the simple API can only wait in read()
+        return true;
     }
 
-    return true; 
+    deadline = Util::getMonotonicTime() + sec * 1000000ULL + usec;
+
+    // sleep until the read callback tells of a fragment arrived, one
+    // arriving after the check below is not lost, as it is counted
+    for (;;) {
+        pa_stream_state_t   state;
+        size_t              readable;
+        unsigned long long  now;
+
+        pa_threaded_mainloop_lock( mainloop);
+        state    = pa_stream_get_state( stream);
+        readable = pa_stream_readable_size( stream);
+        error    = pa_context_errno( context);
+        pa_threaded_mainloop_unlock( mainloop);
+
+        if ( state != PA_STREAM_READY ) {
+            throw Exception( __FILE__, __LINE__,
+                             "PulseAudio record stream failed: ",
+                             pa_strerror( error));
+        }
+        if ( readable != (size_t) -1 && readable > fragmentOffset ) {
+            return true;
+        }
+
+        now = Util::getMonotonicTime();
+        if ( now >= deadline ) {
+            return false;
+        }
+        dataReady->wait( (deadline - now) / 1000000,
+                         (deadline - now) % 1000000);
+    }
 }
 
 
@@ -210,13 +385,67 @@ unsigned int
 PulseAudioDspSource :: read (    void          * buf,
                            unsigned int    len )     
 {
-    int ret;
+    unsigned char     * b    = (unsigned char*) buf;
+    unsigned int        done = 0;
     
-    ret = pa_simple_read(s, buf, len, &error);
-    if ( ret < 0) {
-        throw Exception(__FILE__, __LINE__, ": pa_simple_read() failed: %s\n", pa_strerror(error));
+    if ( s ) {
+        if ( pa_simple_read(s, buf, len, &error) < 0 ) {
+            throw Exception( __FILE__, __LINE__, "pa_simple_read() failed: ",
+                             pa_strerror(error));
+        }
+        return len;
     }
-    return len;
+
+    // copy the fragments straight out of the stream buffer, one at a
+    // time, keeping the place in a fragment that does not fit
+    for (;;) {
+        pa_threaded_mainloop_lock( mainloop);
+        while ( done < len ) {
+            const void    * data;
+            size_t          size;
+            size_t          n;
+
+            if ( pa_stream_peek( stream, &data, &size) < 0 ) {
+                error = pa_context_errno( context);
+                pa_threaded_mainloop_unlock( mainloop);
+                throw Exception( __FILE__, __LINE__,
+                                 "pa_stream_peek() failed: ",
+                                 pa_strerror( error));
+            }
+            if ( size == 0 ) {
+                break;
+            }
+            if ( data == NULL ) {
+                // a hole in the stream, nothing to read there
+                pa_stream_drop( stream);
+                fragmentOffset = 0;
+                continue;
+            }
+
+            n = size - fragmentOffset;
+            if ( n > len - done ) {
+                n = len - done;
+            }
+            memcpy( b + done,
+                    (const unsigned char*) data + fragmentOffset,
+                    n);
+            done           += n;
+            fragmentOffset += n;
+
+            if ( fragmentOffset == size ) {
+                pa_stream_drop( stream);
+                fragmentOffset = 0;
+            }
+        }
+        pa_threaded_mainloop_unlock( mainloop);
+
+        // the holes dropped may have been all there was to read
+        if ( done > 0 || !canRead( 1, 0) ) {
+            break;
+        }
+    }
+
+    return done;
 }
 
 
@@ -230,8 +459,112 @@ PulseAudioDspSource :: close ( void )
         return;
     }
 
-    pa_simple_free(s);
-    running = 0;
+    if ( s ) {
+        pa_simple_free(s);
+        s = NULL;
+    }
+    closeAsync();
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Free the objects of the async API
+ *----------------------------------------------------------------------------*/
+void
+PulseAudioDspSource :: closeAsync ( void )                     throw ()
+{
+    // with the mainloop stopped, no callback runs any more
+    if ( mainloop ) {
+        pa_threaded_mainloop_stop( mainloop);
+    }
+    if ( stream ) {
+        pa_stream_disconnect( stream);
+        pa_stream_unref( stream);
+        stream = NULL;
+    }
+    if ( context ) {
+        pa_context_disconnect( context);
+        pa_context_unref( context);
+        context = NULL;
+    }
+    if ( mainloop ) {
+        pa_threaded_mainloop_free( mainloop);
+        mainloop = NULL;
+    }
+    fragmentOffset = 0;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  The state of the connection changed
+ *----------------------------------------------------------------------------*/
+void
+PulseAudioDspSource :: contextStateCallback (   pa_context    * c,
+                                                void          * userdata )
+{
+    PulseAudioDspSource   * self = (PulseAudioDspSource*) userdata;
+
+    pa_threaded_mainloop_signal( self->mainloop, 0);
+    self->dataReady->notify();
+}
+
+
+/*------------------------------------------------------------------------------
+ *  The state of the stream changed
+ *----------------------------------------------------------------------------*/
+void
+PulseAudioDspSource :: streamStateCallback (    pa_stream     * st,
+                                                void          * userdata )
+{
+    PulseAudioDspSource   * self = (PulseAudioDspSource*) userdata;
+
+    pa_threaded_mainloop_signal( self->mainloop, 0);
+    self->dataReady->notify();
+}
+
+
+/*------------------------------------------------------------------------------
+ *  A fragment arrived
+ *----------------------------------------------------------------------------*/
+void
+PulseAudioDspSource :: streamReadCallback ( pa_stream     * st,
+                                            size_t          nbytes,
+                                            void          * userdata )
+{
+    PulseAudioDspSource   * self = (PulseAudioDspSource*) userdata;
+
+    self->dataReady->notify();
+}
+
+
+/*------------------------------------------------------------------------------
+ *  The stream buffer overflowed
+ *----------------------------------------------------------------------------*/
+void
+PulseAudioDspSource :: streamOverflowCallback ( pa_stream     * st,
+                                                void          * userdata )
+{
+    PulseAudioDspSource   * self = (PulseAudioDspSource*) userdata;
+    unsigned long           n    = ++self->overflows;
+
+    if ( (n & (n - 1)) == 0 ) {
+        reportEvent( 1, "PulseAudioDspSource :: Buffer overrun! overruns:",
+                        n);
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  An operation on the stream is done
+ *----------------------------------------------------------------------------*/
+void
+PulseAudioDspSource :: streamSuccessCallback (  pa_stream     * st,
+                                                int             success,
+                                                void          * userdata )
+{
+    PulseAudioDspSource   * self = (PulseAudioDspSource*) userdata;
+
+    pa_threaded_mainloop_signal( self->mainloop, 0);
 }
 
 #endif // HAVE_PULSEAUDIO_LIB
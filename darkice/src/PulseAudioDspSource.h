@@ -44,11 +44,15 @@
 #include "config.h"
 #endif
 
+#include <atomic>
+
 #include "Reporter.h"
 #include "AudioSource.h"
+#include "Notifier.h"
 
 #ifdef HAVE_PULSEAUDIO_LIB
 
+#include <pulse/pulseaudio.h>
 #include <pulse/simple.h>
 #include <pulse/error.h>
 #include <pulse/gccmacro.h>
@@ -65,6 +69,14 @@
 /**
  *  An audio input based on the PULSEAUDIO sound system 
  *
+ *  The stream is run by a threaded mainloop of the PulseAudio library.
+ *  Its read callback only tells the capture thread that a fragment
+ *  arrived; the capture thread then copies the fragments straight out
+ *  of the buffer of the stream into the audio blocks. The size of the
+ *  fragments, and thus the latency of the source, can be set with
+ *  setLatency(). The blocking simple API is still there to fall back
+ *  to, see setSimple().
+ *
  *  @author  $Author$
  *  @version $Revision$
  */
@@ -78,264 +90,161 @@ class PulseAudioDspSource : public AudioSource, public virtual Reporter
         char *sourceName;
 
         /**
-         *  Handle for PulseAudio 
+         *  Handle for PulseAudio, when using the simple API.
          */
         pa_simple *s ;
 
         /**
-         * format definitions for pulseaudio
-          */
-        pa_sample_spec ss;
-
-	int running;
-        int error;
-
-    protected:
+         *  The mainloop running the stream, when using the async API.
+         */
+        pa_threaded_mainloop      * mainloop;
 
         /**
-         *  Default constructor. Always throws an Exception.
-         *
-         *  @exception Exception
+         *  The connection to the server, when using the async API.
          */
-        inline
-        PulseAudioDspSource ( void )                       
-        {
-            throw Exception( __FILE__, __LINE__);
-        }
+        pa_context                * context;
 
         /**
-         *  Initialize the object
-         *
-         *  @param name the PCM to open.
-         *  @exception Exception
+         *  The record stream, when using the async API.
          */
-        void
-        init (  const char    * name )              ;
+        pa_stream                 * stream;
 
         /**
-         *  De-iitialize the object
-         *
-         *  @exception Exception
+         *  Tells the capture thread that a fragment arrived, or that
+         *  the state of the stream changed.
          */
-        void
-        strip ( void )                              ;
+        Notifier                  * dataReady;
 
+        /**
+         *  The number of bytes already read of the fragment at the head
+         *  of the stream buffer.
+         */
+        size_t                      fragmentOffset;
 
-    public:
+        /**
+         *  The latency asked for, in milli-seconds, 0 for the default of
+         *  the server.
+         */
+        unsigned int                latency;
 
         /**
-         *  Constructor.
-         *
-         *  @param name the PCM (e.g. "hwplug:0,0").
-         *  @param sampleRate samples per second (e.g. 44100 for 44.1kHz).
-         *  @param bitsPerSample bits per sample (e.g. 16 bits).
-         *  @param channel number of channels of the audio source
-         *                 (e.g. 1 for mono, 2 for stereo, etc.).
-         *  @exception Exception
+         *  Use the simple API instead of the async one.
          */
-        inline
-        PulseAudioDspSource (  const char    * paSourceName,
-                         int             sampleRate    = 44100,
-                         int             bitsPerSample = 16,
-                         int             channel       = 2 )
-                                                        
-                    : AudioSource( sampleRate, bitsPerSample, channel)
-        {
-            init( paSourceName);
-        }
+        bool                        useSimple;
 
         /**
-         *  Copy Constructor.
-         *
-         *  @param ds the object to copy.
-         *  @exception Exception
+         *  The number of overflows of the stream buffer since opening.
          */
-        inline
-        PulseAudioDspSource (  const PulseAudioDspSource &    ds )    
-                    : AudioSource( ds )
-        {
-            init( ds.sourceName);
-        }
+        std::atomic<unsigned long>  overflows;
 
         /**
-         *  Destructor.
+         * format definitions for pulseaudio
+          */
+        pa_sample_spec ss;
+
+        int error;
+
+        /**
+         *  Open the source through the simple API.
          *
+         *  @param clientName the name of this client on the server.
+         *  @param attr the buffer attributes of the stream.
          *  @exception Exception
          */
-        inline virtual
-        ~PulseAudioDspSource ( void )                          
-        {
-            strip();
-        }
+        void
+        openSimple ( const char             * clientName,
+                     const pa_buffer_attr   * attr );
 
         /**
-         *  Assignment operator.
+         *  Open the source through the async API.
          *
-         *  @param ds the object to assign to this one.
-         *  @return a reference to this object.
+         *  @param clientName the name of this client on the server.
+         *  @param attr the buffer attributes of the stream.
          *  @exception Exception
          */
-        inline virtual PulseAudioDspSource &
-        operator= (     const PulseAudioDspSource &     ds )   
-        {
-            if ( this != &ds ) {
-                strip();
-                AudioSource::operator=( ds);
-                init( ds.sourceName);
-            }
-            return *this;
-        }
+        void
+        openAsync ( const char              * clientName,
+                    const pa_buffer_attr    * attr );
 
         /**
-         *  Open the PulseAudioDspSource.
+         *  Connect the record stream, and wait until it is ready.
+         *  Call with the mainloop locked.
          *
-         *  @return true if opening was successful, false otherwise
-         *  @exception Exception
+         *  @param attr the buffer attributes of the stream.
+         *  @return a description of the step that failed, 0 on success.
          */
-        virtual bool
-        open ( void )                                   ;
+        const char *
+        connectStream ( const pa_buffer_attr    * attr );
 
         /**
-         *  Check if the PulseAudioDspSource is open.
-         *
-         *  @return true if the PulseAudioDspSource is open, false otherwise.
+         *  Tell the stream latency achieved.
+         *  Call with the mainloop locked, the stream ready.
          */
-        inline virtual bool
-        isOpen ( void ) const                           throw ()
-        {
-            return s==NULL;
-        }
+        void
+        reportLatency ( void );
 
         /**
-         *  Check if the PulseAudioDspSource can be read from.
-         *
-         *  @param sec the maximum seconds to block.
-         *  @param usec micro seconds to block after the full seconds.
-         *  @return true if the PulseAudioDspSource is ready to be read from,
-         *          false otherwise.
-         *  @exception Exception
+         *  Stop the mainloop, and free the stream, the connection
+         *  and the mainloop.
          */
-        virtual bool
-        canRead (               unsigned int    sec,
-                                unsigned int    usec )  ;
+        void
+        closeAsync ( void )                             throw ();
 
         /**
-         *  Read from the PulseAudioDspSource.
+         *  Called by the mainloop when the state of the connection
+         *  changes.
          *
-         *  @param buf the buffer to read into.
-         *  @param len the number of bytes to read into buf
-         *  @return the number of bytes read (may be less than len).
-         *  @exception Exception
+         *  @param c the connection.
+         *  @param userdata the PulseAudioDspSource.
          */
-        virtual unsigned int
-        read (                  void          * buf,
-                                unsigned int    len )   ;
+        static void
+        contextStateCallback (  pa_context    * c,
+                                void          * userdata );
 
         /**
-         *  Close the PulseAudioDspSource.
+         *  Called by the mainloop when the state of the stream changes.
          *
-         *  @exception Exception
+         *  @param st the stream.
+         *  @param userdata the PulseAudioDspSource.
          */
-        virtual void
-        close ( void )                                  ;
-
-};
-
-/* ================================================= external data structures */
-
-/* ====================================================== function prototypes */
-
-#endif  /* PULSEAUDIO_SOURCE_H */
-/*------------------------------------------------------------------------------
-
-   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
-
-   Copyright (c) 2004 
-   LS Informationstechnik (LIKE)
-   University of Erlangen Nuremberg
-   All rights reserved.
-
-   Tyrell DarkIce
-
-   File     : PulseAudioDspSource.h
-   Version  : $Revision$
-   Author   : $Author$
-   Location : $HeadURL$
-   
-   Copyright notice:
-
-    This program is free software; you can redistribute it and/or
-    modify it under the terms of the GNU General Public License  
-    as published by the Free Software Foundation; either version 2
-    of the License, or (at your option) any later version.
-   
-    This program is distributed in the hope that it will be useful,
-    but WITHOUT ANY WARRANTY; without even the implied warranty of 
-    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
-    GNU General Public License for more details.
-   
-    You should have received a copy of the GNU General Public License
-    along with this program; if not, write to the Free Software
-    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
-
-------------------------------------------------------------------------------*/
-#ifndef PULSEAUDIO_SOURCE_H
-#define PULSEAUDIO_SOURCE_H
-
-#ifndef __cplusplus
-#error This is a C++ include file
-#endif
-
-/* ============================================================ include files */
-
-#ifdef HAVE_CONFIG_H
-#include "config.h"
-#endif
-
-#include "Reporter.h"
-#include "AudioSource.h"
-
-#ifdef HAVE_PULSEAUDIO_LIB
-
-#include <pulse/simple.h>
-#include <pulse/error.h>
-#include <pulse/gccmacro.h>
-#else
-#error configure for PULSEAUDIO 
-#endif
-
-/* ================================================================ constants */
-
-/* =================================================================== macros */
-
-/* =============================================================== data types */
-
-/**
- *  An audio input based on the PULSEAUDIO sound system 
- *
- *  @author  $Author$
- *  @version $Revision$
- */
-class PulseAudioDspSource : public AudioSource, public virtual Reporter
-{
-    private:
+        static void
+        streamStateCallback (   pa_stream     * st,
+                                void          * userdata );
 
         /**
-         *  Name of the capture PCM stream.
+         *  Called by the mainloop when a fragment arrived.
+         *
+         *  @param st the stream.
+         *  @param nbytes the number of bytes readable.
+         *  @param userdata the PulseAudioDspSource.
          */
-        char *sourceName;
+        static void
+        streamReadCallback (    pa_stream     * st,
+                                size_t          nbytes,
+                                void          * userdata );
 
         /**
-         *  Handle for PulseAudio 
+         *  Called by the mainloop when the stream buffer overflowed.
+         *
+         *  @param st the stream.
+         *  @param userdata the PulseAudioDspSource.
          */
-        pa_simple *s ;
+        static void
+        streamOverflowCallback ( pa_stream    * st,
+                                 void         * userdata );
 
         /**
-         * format definitions for pulseaudio
-          */
-        pa_sample_spec ss;
-
-        int error;
+         *  Called by the mainloop when an operation on the stream is
+         *  done.
+         *
+         *  @param st the stream.
+         *  @param success tells if the operation succeeded.
+         *  @param userdata the PulseAudioDspSource.
+         */
+        static void
+        streamSuccessCallback ( pa_stream     * st,
+                                int             success,
+                                void          * userdata );
 
     protected:
 
@@ -402,6 +311,8 @@ class PulseAudioDspSource : public AudioSource, public virtual Reporter
                     : AudioSource( ds )
         {
             init( ds.sourceName);
+            latency   = ds.latency;
+            useSimple = ds.useSimple;
         }
 
         /**
@@ -429,10 +340,37 @@ class PulseAudioDspSource : public AudioSource, public virtual Reporter
                 strip();
                 AudioSource::operator=( ds);
                 init( ds.sourceName);
+                latency   = ds.latency;
+                useSimple = ds.useSimple;
             }
             return *this;
         }
 
+        /**
+         *  Set the latency of the source, the length of the fragments
+         *  the server sends. Call before open().
+         *
+         *  @param msec the latency in milli-seconds,
+         *              0 for the default of the server.
+         */
+        inline void
+        setLatency ( unsigned int   msec )
+        {
+            latency = msec;
+        }
+
+        /**
+         *  Set whether to use the blocking simple API of PulseAudio
+         *  instead of the async one. Call before open().
+         *
+         *  @param simple true to use the simple API.
+         */
+        inline void
+        setSimple ( bool    simple )
+        {
+            useSimple = simple;
+        }
+
         /**
          *  Open the PulseAudioDspSource.
          *
@@ -450,7 +388,7 @@ class PulseAudioDspSource : public AudioSource, public virtual Reporter
         inline virtual bool
         isOpen ( void ) const                           throw ()
         {
-            return s==NULL;
+            return s != NULL || stream != NULL;
         }
 
         /**
@@ -486,6 +424,18 @@ class PulseAudioDspSource : public AudioSource, public virtual Reporter
         virtual void
         close ( void )                                  ;
 
+        /**
+         *  Get the number of overflows of the stream buffer since the
+         *  source was opened.
+         *
+         *  @return the number of overflows.
+         */
+        inline virtual unsigned long
+        getOverruns ( void ) const                      throw ()
+        {
+            return overflows;
+        }
+
 };
 
 /* ================================================= external data structures */
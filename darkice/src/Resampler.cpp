@@ -0,0 +1,281 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : Resampler.cpp
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "ConvKernels.h"
+#include "Resampler.h"
+
+
+/* ===================================================  local data structures */
+
+
+/* ================================================  local constants & macros */
+
+/*------------------------------------------------------------------------------
+ *  File identity
+ *----------------------------------------------------------------------------*/
+static const char fileid[] = "$Id$";
+
+
+/* ===============================================  local function prototypes */
+
+
+/* =============================================================  module code */
+
+/*------------------------------------------------------------------------------
+ *  Constructor
+ *----------------------------------------------------------------------------*/
+Resampler :: Resampler (    unsigned int    inSampleRate,
+                            unsigned int    outSampleRate,
+                            unsigned int    channels,
+                            Quality         quality )
+{
+    if ( inSampleRate == 0 || outSampleRate == 0 || channels == 0 ) {
+        throw Exception( __FILE__, __LINE__, "bad resampler format");
+    }
+
+    this->inSampleRate  = inSampleRate;
+    this->outSampleRate = outSampleRate;
+    this->channels      = channels;
+    this->quality       = quality;
+    this->inFrames      = 0;
+    this->inBuffer      = 0;
+
+#ifdef HAVE_AFLIB
+    // high quality, not filter interpolation, as the encoders used it
+    converter = new aflibConverter( true, quality == low, false);
+    converter->initialize( (double) outSampleRate / (double) inSampleRate,
+                           channels);
+    inTotal   = 0;
+    outTotal  = 0;
+#else
+    PolyphaseResampler::Quality     q;
+
+    switch ( quality ) {
+        case low:       q = PolyphaseResampler::low;       break;
+        case high:      q = PolyphaseResampler::high;      break;
+        default:        q = PolyphaseResampler::medium;    break;
+    }
+
+    converter   = new PolyphaseResampler( inSampleRate,
+                                          outSampleRate,
+                                          channels,
+                                          q);
+    outBuffer   = 0;
+    inChannels  = new float*[channels];
+    outChannels = new float*[channels];
+#endif
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Destructor
+ *----------------------------------------------------------------------------*/
+Resampler :: ~Resampler ( void )                            throw ()
+{
+    delete[] inBuffer;
+    delete converter;
+#ifndef HAVE_AFLIB
+    delete[] outBuffer;
+    delete[] inChannels;
+    delete[] outChannels;
+#endif
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Make room for the input
+ *----------------------------------------------------------------------------*/
+void
+Resampler :: reserve ( unsigned int     frames )
+{
+    if ( frames <= inFrames ) {
+        return;
+    }
+
+#ifdef HAVE_AFLIB
+    delete[] inBuffer;
+    inBuffer = 0;
+    inBuffer = new short int[(frames + getMaxOutFrames( frames)) * channels];
+#else
+    unsigned int    outFrames = getMaxOutFrames( frames);
+
+    delete[] inBuffer;
+    delete[] outBuffer;
+    inBuffer  = 0;
+    outBuffer = 0;
+    inBuffer  = new float[frames * channels];
+    // the output is interleaved in the second half before the conversion
+    outBuffer = new float[2 * outFrames * channels];
+    for ( unsigned int c = 0; c < channels; ++c ) {
+        inChannels[c]  = inBuffer + c * frames;
+        outChannels[c] = outBuffer + c * outFrames;
+    }
+#endif
+    inFrames = frames;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Convert the next chunk of the stream
+ *----------------------------------------------------------------------------*/
+unsigned int
+Resampler :: resample ( const int16_t     * in,
+                        unsigned int        frames,
+                        int16_t           * out )
+{
+    int     converted;
+
+    if ( frames == 0 ) {
+        return 0;
+    }
+
+    reserve( frames);
+
+#ifdef HAVE_AFLIB
+    // aflibConverter works on channels one after the other, both for the
+    // input and the output. ask for the output due by now, so that the
+    // rounding does not add up over the blocks
+    int         inCount  = frames;
+    int         outCount = (int) ((inTotal + frames) * outSampleRate
+                                  / inSampleRate - outTotal);
+    short int * planarIn  = inBuffer;
+    short int * planarOut = inBuffer + frames * channels;
+
+    if ( outCount > (int) getMaxOutFrames( frames) ) {
+        outCount = getMaxOutFrames( frames);
+    }
+
+    for ( unsigned int c = 0; c < channels; ++c ) {
+        for ( unsigned int i = 0; i < frames; ++i ) {
+            planarIn[c * frames + i] = in[i * channels + c];
+        }
+    }
+
+    converted = converter->resample( inCount, outCount, planarIn, planarOut);
+    if ( converted < 0 ) {
+        throw Exception( __FILE__, __LINE__, "resampler error", converted);
+    }
+
+    for ( unsigned int c = 0; c < channels; ++c ) {
+        for ( int i = 0; i < converted; ++i ) {
+            out[i * channels + c] = planarOut[c * outCount + i];
+        }
+    }
+    inTotal  += frames;
+    outTotal += converted;
+#else
+    const ConvKernels::Set    * kernels     = ConvKernels::get();
+    unsigned int                outFrames   = getMaxOutFrames( inFrames);
+    float                     * interleaved = outBuffer
+                                            + outFrames * channels;
+
+    kernels->toFloat16( in, frames, channels, inChannels);
+    converted = converter->process( inChannels, frames, outChannels);
+
+    if ( channels == 1 ) {
+        kernels->toInt16( outChannels[0], converted, out);
+    } else {
+        for ( int i = 0, j = 0; i < converted; ++i ) {
+            for ( unsigned int c = 0; c < channels; ++c ) {
+                interleaved[j++] = outChannels[c][i];
+            }
+        }
+        kernels->toInt16( interleaved, converted * channels, out);
+    }
+#endif
+
+    return converted;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Convert the next chunk of the stream, of float samples
+ *----------------------------------------------------------------------------*/
+unsigned int
+Resampler :: resample ( const float       * in,
+                        unsigned int        frames,
+                        float             * out )
+{
+    unsigned int    converted;
+
+    if ( frames == 0 ) {
+        return 0;
+    }
+
+#ifdef HAVE_AFLIB
+    // aflibConverter only knows 16 bit samples
+    const ConvKernels::Set    * kernels = ConvKernels::get();
+    int16_t                   * shorts  = new int16_t[
+                                    (frames + getMaxOutFrames( frames))
+                                    * channels];
+    int16_t                   * outShorts = shorts + frames * channels;
+
+    try {
+        kernels->toInt16( in, frames * channels, shorts);
+        converted = resample( shorts, frames, outShorts);
+    } catch ( ... ) {
+        delete[] shorts;
+        throw;
+    }
+    kernels->toFloat16( outShorts, converted * channels, 1, &out);
+    delete[] shorts;
+#else
+    reserve( frames);
+
+    if ( channels == 1 ) {
+        // a single channel is planar already
+        converted = converter->process( &in, frames, &out);
+        return converted;
+    }
+
+    for ( unsigned int c = 0; c < channels; ++c ) {
+        float         * planar = inChannels[c];
+
+        for ( unsigned int i = 0, j = c; i < frames; ++i, j += channels ) {
+            planar[i] = in[j];
+        }
+    }
+    converted = converter->process( inChannels, frames, outChannels);
+
+    for ( unsigned int i = 0, j = 0; i < converted; ++i ) {
+        for ( unsigned int c = 0; c < channels; ++c ) {
+            out[j++] = outChannels[c][i];
+        }
+    }
+#endif
+
+    return converted;
+}
+
@@ -0,0 +1,299 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : Resampler.h
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#ifndef __cplusplus
+#error This is a C++ include file
+#endif
+
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdint.h>
+
+#include "Exception.h"
+#ifdef HAVE_AFLIB
+#include "aflibConverter.h"
+#else
+#include "PolyphaseResampler.h"
+#endif
+
+
+/* ================================================================ constants */
+
+
+/* =================================================================== macros */
+
+
+/* =============================================================== data types */
+
+/**
+ *  A sample rate converter for interleaved 16 bit or float audio,
+ *  working on a continuous stream fed in chunks of any size. Uses the
+ *  built in PolyphaseResampler, which works on float samples, or the
+ *  bundled aflibConverter if configured with --with-aflib, which works
+ *  on 16 bit samples.
+ *
+ *  @author  $Author$
+ *  @version $Revision$
+ */
+class Resampler
+{
+    public:
+
+        /**
+         *  The quality of the conversion, see PolyphaseResampler.
+         *  aflibConverter knows linear interpolation for low, and
+         *  its sinc filter for the others.
+         */
+        enum Quality { low, medium, high };
+
+
+    private:
+
+        /**
+         *  The sample rate of the input.
+         */
+        unsigned int                inSampleRate;
+
+        /**
+         *  The sample rate of the output.
+         */
+        unsigned int                outSampleRate;
+
+        /**
+         *  The number of channels.
+         */
+        unsigned int                channels;
+
+        /**
+         *  The quality of the conversion.
+         */
+        Quality                     quality;
+
+        /**
+         *  The number of frames the buffers can take as input.
+         */
+        unsigned int                inFrames;
+
+#ifdef HAVE_AFLIB
+        /**
+         *  The aflib converter.
+         */
+        aflibConverter            * converter;
+
+        /**
+         *  A copy of the input, as aflibConverter wants to write it.
+         */
+        short int                 * inBuffer;
+
+        /**
+         *  The number of frames converted so far.
+         */
+        unsigned long long          inTotal;
+
+        /**
+         *  The number of frames output so far.
+         */
+        unsigned long long          outTotal;
+#else
+        /**
+         *  The converter.
+         */
+        PolyphaseResampler        * converter;
+
+        /**
+         *  The input as float, channel after channel.
+         */
+        float                     * inBuffer;
+
+        /**
+         *  The output as float, channel after channel.
+         */
+        float                     * outBuffer;
+
+        /**
+         *  The start of each channel in inBuffer.
+         */
+        float                    ** inChannels;
+
+        /**
+         *  The start of each channel in outBuffer.
+         */
+        float                    ** outChannels;
+#endif
+
+        /**
+         *  Copy constructor. Not supported.
+         */
+        Resampler ( const Resampler &   resampler );
+
+        /**
+         *  Assignment operator. Not supported.
+         */
+        Resampler &
+        operator= ( const Resampler &   resampler );
+
+        /**
+         *  Make sure the buffers can take a number of input frames.
+         *
+         *  @param frames the number of input frames.
+         *  @exception Exception
+         */
+        void
+        reserve ( unsigned int      frames );
+
+
+    public:
+
+        /**
+         *  Constructor.
+         *
+         *  @param inSampleRate the sample rate of the input.
+         *  @param outSampleRate the sample rate of the output.
+         *  @param channels the number of channels.
+         *  @param quality the quality of the conversion.
+         *  @exception Exception
+         */
+        Resampler ( unsigned int    inSampleRate,
+                    unsigned int    outSampleRate,
+                    unsigned int    channels,
+                    Quality         quality = medium );
+
+        /**
+         *  Destructor.
+         */
+        ~Resampler ( void )                                 throw ();
+
+        /**
+         *  Get the sample rate of the input.
+         *
+         *  @return the sample rate of the input.
+         */
+        inline unsigned int
+        getInSampleRate ( void ) const                      throw ()
+        {
+            return inSampleRate;
+        }
+
+        /**
+         *  Get the sample rate of the output.
+         *
+         *  @return the sample rate of the output.
+         */
+        inline unsigned int
+        getOutSampleRate ( void ) const                     throw ()
+        {
+            return outSampleRate;
+        }
+
+        /**
+         *  Get the number of channels.
+         *
+         *  @return the number of channels.
+         */
+        inline unsigned int
+        getChannels ( void ) const                          throw ()
+        {
+            return channels;
+        }
+
+        /**
+         *  Get the quality of the conversion.
+         *
+         *  @return the quality of the conversion.
+         */
+        inline Quality
+        getQuality ( void ) const                           throw ()
+        {
+            return quality;
+        }
+
+        /**
+         *  Tell how many output frames at most a number of input frames
+         *  may produce.
+         *
+         *  @param frames the number of input frames.
+         *  @return the maximum number of output frames.
+         */
+        inline unsigned int
+        getMaxOutFrames ( unsigned int  frames ) const      throw ()
+        {
+            return (unsigned int) (((unsigned long long) frames
+                                    * outSampleRate) / inSampleRate) + 1;
+        }
+
+        /**
+         *  Convert the next chunk of the stream.
+         *
+         *  @param in the input samples, channels interleaved.
+         *  @param frames the number of input frames.
+         *  @param out the output samples, channels interleaved, room for
+         *             getMaxOutFrames( frames) frames.
+         *  @return the number of output frames.
+         *  @exception Exception
+         */
+        unsigned int
+        resample (  const int16_t     * in,
+                    unsigned int        frames,
+                    int16_t           * out );
+
+        /**
+         *  Convert the next chunk of the stream, of float samples.
+         *  Keeps the precision of the input, but with aflibConverter,
+         *  which converts 16 bit samples.
+         *
+         *  @param in the input samples, channels interleaved.
+         *  @param frames the number of input frames.
+         *  @param out the output samples, channels interleaved, room for
+         *             getMaxOutFrames( frames) frames.
+         *  @return the number of output frames.
+         *  @exception Exception
+         */
+        unsigned int
+        resample (  const float       * in,
+                    unsigned int        frames,
+                    float             * out );
+};
+
+
+/* ================================================= external data structures */
+
+
+/* ====================================================== function prototypes */
+
+
+
+#endif  /* RESAMPLER_H */
+
@@ -0,0 +1,409 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : SampleFormat.cpp
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#error need string.h
+#endif
+
+#ifdef HAVE_MATH_H
+#include <math.h>
+#else
+#error need math.h
+#endif
+
+#include "Util.h"
+#include "ConvKernels.h"
+#include "SampleFormat.h"
+
+
+/* ===================================================  local data structures */
+
+
+/* ================================================  local constants & macros */
+
+/*------------------------------------------------------------------------------
+ *  File identity
+ *----------------------------------------------------------------------------*/
+static const char fileid[] = "$Id$";
+
+/*------------------------------------------------------------------------------
+ *  The byte order of this machine
+ *----------------------------------------------------------------------------*/
+#ifdef WORDS_BIGENDIAN
+static const bool hostBigEndian = true;
+#else
+static const bool hostBigEndian = false;
+#endif
+
+/*------------------------------------------------------------------------------
+ *  The number of samples converted at a time through a buffer on the stack
+ *----------------------------------------------------------------------------*/
+#define CHUNK_SAMPLES   256
+
+
+/* ===============================================  local function prototypes */
+
+
+/* =============================================================  module code */
+
+/*------------------------------------------------------------------------------
+ *  Read a packed 24 bit sample
+ *----------------------------------------------------------------------------*/
+static inline int32_t
+read24 (    const unsigned char   * in,
+            bool                    isBigEndian )
+{
+    uint32_t    v;
+
+    if ( isBigEndian ) {
+        v = (in[0] << 24) | (in[1] << 16) | (in[2] << 8);
+    } else {
+        v = (in[2] << 24) | (in[1] << 16) | (in[0] << 8);
+    }
+
+    return ((int32_t) v) >> 8;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Read a 32 bit sample
+ *----------------------------------------------------------------------------*/
+static inline uint32_t
+read32 (    const unsigned char   * in,
+            bool                    isBigEndian )
+{
+    if ( isBigEndian ) {
+        return ((uint32_t) in[0] << 24) | (in[1] << 16) | (in[2] << 8) | in[3];
+    } else {
+        return ((uint32_t) in[3] << 24) | (in[2] << 16) | (in[1] << 8) | in[0];
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Read a float sample
+ *----------------------------------------------------------------------------*/
+static inline float
+readFloat ( const unsigned char   * in,
+            bool                    isBigEndian )
+{
+    uint32_t    v = read32( in, isBigEndian);
+    float       f;
+
+    memcpy( &f, &v, sizeof(f));
+    return f;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Get the format of samples of a number of bits
+ *----------------------------------------------------------------------------*/
+SampleFormat::Format
+SampleFormat :: fromBits ( unsigned int     bitsPerSample )     throw ()
+{
+    switch ( bitsPerSample ) {
+        case 8:     return u8;
+        case 16:    return s16;
+        case 24:    return s24_3;
+        case 32:    return s32;
+        default:    return unknown;
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Get a format by its name
+ *----------------------------------------------------------------------------*/
+SampleFormat::Format
+SampleFormat :: fromName ( const char     * name )
+{
+    if ( Util::strEq( name, "s16") ) {
+        return s16;
+    } else if ( Util::strEq( name, "s24") || Util::strEq( name, "s24_3le") ) {
+        return s24_3;
+    } else if ( Util::strEq( name, "s32") ) {
+        return s32;
+    } else if ( Util::strEq( name, "float") || Util::strEq( name, "float32") ) {
+        return float32;
+    }
+
+    throw Exception( __FILE__, __LINE__, "unknown sample format", name);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Get the name of a format
+ *----------------------------------------------------------------------------*/
+const char *
+SampleFormat :: getName ( Format    format )                    throw ()
+{
+    switch ( format ) {
+        case u8:        return "u8";
+        case s16:       return "s16";
+        case s24_3:     return "s24";
+        case s32:       return "s32";
+        case float32:   return "float";
+        default:        return "unknown";
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Get the size of a sample
+ *----------------------------------------------------------------------------*/
+unsigned int
+SampleFormat :: getBytes ( Format   format )                    throw ()
+{
+    switch ( format ) {
+        case u8:        return 1;
+        case s16:       return 2;
+        case s24_3:     return 3;
+        case s32:
+        case float32:   return 4;
+        default:        return 0;
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Get the number of significant bits of a sample
+ *----------------------------------------------------------------------------*/
+unsigned int
+SampleFormat :: getPrecision ( Format   format )                throw ()
+{
+    switch ( format ) {
+        case u8:        return 8;
+        case s16:       return 16;
+        case s24_3:
+        case float32:   return 24;
+        case s32:       return 32;
+        default:        return 0;
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Convert samples into 16 bit samples
+ *----------------------------------------------------------------------------*/
+void
+SampleFormat :: toInt16 (   Format                  format,
+                            const unsigned char   * in,
+                            size_t                  samples,
+                            int16_t               * out,
+                            bool                    isBigEndian )
+{
+    switch ( format ) {
+        case u8:
+        case s16:
+            Util::conv( getBytes( format) * 8,
+                        const_cast<unsigned char*>( in),
+                        samples * getBytes( format),
+                        out,
+                        isBigEndian);
+            break;
+
+        case float32:
+            if ( isBigEndian == hostBigEndian ) {
+                ConvKernels::get()->toInt16( (const float *) in, samples, out);
+                break;
+            }
+            // fall through, to be put in host byte order first
+
+        case s24_3:
+        case s32: {
+            float       chunk[CHUNK_SAMPLES];
+
+            for ( size_t i = 0; i < samples; i += CHUNK_SAMPLES ) {
+                size_t  n = samples - i < CHUNK_SAMPLES
+                          ? samples - i : CHUNK_SAMPLES;
+
+                toFloat( format,
+                         in + i * getBytes( format),
+                         n,
+                         chunk,
+                         isBigEndian);
+                ConvKernels::get()->toInt16( chunk, n, out + i);
+            }
+        } break;
+
+        default:
+            throw Exception( __FILE__, __LINE__, "unknown sample format");
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Convert samples into float samples
+ *----------------------------------------------------------------------------*/
+void
+SampleFormat :: toFloat (   Format                  format,
+                            const unsigned char   * in,
+                            size_t                  samples,
+                            float                 * out,
+                            bool                    isBigEndian )
+{
+    const ConvKernels::Set    * kernels = ConvKernels::get();
+
+    switch ( format ) {
+        case s16:
+            if ( isBigEndian == hostBigEndian ) {
+                kernels->toFloat16( (const int16_t *) in, samples, 1, &out);
+                break;
+            }
+            // fall through, to be converted to 16 bit samples first
+
+        case u8: {
+            int16_t     chunk[CHUNK_SAMPLES];
+
+            for ( size_t i = 0; i < samples; i += CHUNK_SAMPLES ) {
+                size_t  n = samples - i < CHUNK_SAMPLES
+                          ? samples - i : CHUNK_SAMPLES;
+                float * o = out + i;
+
+                toInt16( format,
+                         in + i * getBytes( format),
+                         n,
+                         chunk,
+                         isBigEndian);
+                kernels->toFloat16( chunk, n, 1, &o);
+            }
+        } break;
+
+        case s24_3:
+            if ( !isBigEndian ) {
+                kernels->toFloat24( in, samples, out);
+            } else {
+                for ( size_t i = 0; i < samples; ++i, in += 3 ) {
+                    out[i] = ((float) read24( in, true)) / 8388608.f;
+                }
+            }
+            break;
+
+        case s32:
+            if ( isBigEndian == hostBigEndian ) {
+                kernels->toFloat32( (const int32_t *) in, samples, out);
+            } else {
+                for ( size_t i = 0; i < samples; ++i, in += 4 ) {
+                    out[i] = ((float) (int32_t) read32( in, isBigEndian))
+                           / 2147483648.f;
+                }
+            }
+            break;
+
+        case float32:
+            if ( isBigEndian == hostBigEndian ) {
+                memcpy( out, in, samples * sizeof(float));
+            } else {
+                for ( size_t i = 0; i < samples; ++i, in += 4 ) {
+                    out[i] = readFloat( in, isBigEndian);
+                }
+            }
+            break;
+
+        default:
+            throw Exception( __FILE__, __LINE__, "unknown sample format");
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Convert samples into 32 bit integers of some precision
+ *----------------------------------------------------------------------------*/
+void
+SampleFormat :: toInt32 (   Format                  format,
+                            const unsigned char   * in,
+                            size_t                  samples,
+                            int32_t               * out,
+                            unsigned int            bits,
+                            bool                    isBigEndian )
+{
+    if ( bits < 16 || bits > 32 ) {
+        throw Exception( __FILE__, __LINE__, "bad sample precision", bits);
+    }
+
+    switch ( format ) {
+        case u8:
+        case s16: {
+            int16_t     chunk[CHUNK_SAMPLES];
+
+            for ( size_t i = 0; i < samples; i += CHUNK_SAMPLES ) {
+                size_t  n = samples - i < CHUNK_SAMPLES
+                          ? samples - i : CHUNK_SAMPLES;
+
+                toInt16( format,
+                         in + i * getBytes( format),
+                         n,
+                         chunk,
+                         isBigEndian);
+                for ( size_t j = 0; j < n; ++j ) {
+                    out[i + j] = (int32_t) chunk[j] * (1 << (bits - 16));
+                }
+            }
+        } break;
+
+        case s24_3:
+            for ( size_t i = 0; i < samples; ++i, in += 3 ) {
+                int32_t     v = read24( in, isBigEndian);
+
+                out[i] = bits >= 24 ? v * (1 << (bits - 24))
+                                    : v >> (24 - bits);
+            }
+            break;
+
+        case s32:
+            for ( size_t i = 0; i < samples; ++i, in += 4 ) {
+                out[i] = ((int32_t) read32( in, isBigEndian)) >> (32 - bits);
+            }
+            break;
+
+        case float32: {
+            double      scale = ldexp( 1.0, bits - 1);
+
+            for ( size_t i = 0; i < samples; ++i, in += 4 ) {
+                double  s = readFloat( in, isBigEndian) * scale;
+
+                // written so that not-a-number gives the lowest value
+                s      = s > -scale ? s : -scale;
+                s      = s < scale - 1.0 ? s : scale - 1.0;
+                out[i] = (int32_t) lrint( s);
+            }
+        } break;
+
+        default:
+            throw Exception( __FILE__, __LINE__, "unknown sample format");
+    }
+}
+
@@ -0,0 +1,242 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : SampleFormat.h
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+#ifndef SAMPLE_FORMAT_H
+#define SAMPLE_FORMAT_H
+
+#ifndef __cplusplus
+#error This is a C++ include file
+#endif
+
+
+/* ============================================================ include files */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Exception.h"
+
+
+/* ================================================================ constants */
+
+
+/* =================================================================== macros */
+
+
+/* =============================================================== data types */
+
+/**
+ *  The format of the audio samples of a source, and conversions from
+ *  it to the formats the encoders take. Apart from 8 bit samples, all
+ *  formats are signed, and their byte order is told separately, as
+ *  with the sources. On little endian sources, s24_3 is what ALSA
+ *  calls S24_3LE.
+ *
+ *  Typical usage:
+ *
+ *  <pre>
+ *  SampleFormat::Format    format = SampleFormat::fromName( "s24");
+ *
+ *  SampleFormat::toFloat( format, data, samples, floats, bigEndian);
+ *  </pre>
+ *
+ *  @author  $Author$
+ *  @version $Revision$
+ */
+class SampleFormat
+{
+    public:
+
+        /**
+         *  The sample formats.
+         *  - unknown - not a format
+         *  - u8 - 8 bit unsigned
+         *  - s16 - 16 bit signed
+         *  - s24_3 - 24 bit signed, packed in 3 bytes
+         *  - s32 - 32 bit signed
+         *  - float32 - 32 bit float, in [-1, 1]
+         */
+        enum Format { unknown, u8, s16, s24_3, s32, float32 };
+
+
+    private:
+
+        /**
+         *  Default constructor. Not supported.
+         */
+        SampleFormat ( void );
+
+
+    public:
+
+        /**
+         *  Get the format of the integer samples of a number of bits,
+         *  as given by bitsPerSample in the configuration.
+         *
+         *  @param bitsPerSample the number of bits of a sample.
+         *  @return the format, or unknown if there is none of that size.
+         */
+        static Format
+        fromBits ( unsigned int     bitsPerSample )         throw ();
+
+        /**
+         *  Get a format by its name in the configuration:
+         *  s16, s24, s32 or float.
+         *
+         *  @param name the name of the format.
+         *  @return the format.
+         *  @exception Exception if there is no such format.
+         */
+        static Format
+        fromName ( const char     * name );
+
+        /**
+         *  Get the name of a format.
+         *
+         *  @param format the format.
+         *  @return the name of the format.
+         */
+        static const char *
+        getName ( Format    format )                        throw ();
+
+        /**
+         *  Get the number of bytes a sample takes.
+         *
+         *  @param format the format.
+         *  @return the size of a sample, 0 for unknown.
+         */
+        static unsigned int
+        getBytes ( Format   format )                        throw ();
+
+        /**
+         *  Get the number of significant bits of a sample, that is,
+         *  the precision an encoder has to keep.
+         *
+         *  @param format the format.
+         *  @return 8, 16, 24 or 32; 24 for float samples.
+         */
+        static unsigned int
+        getPrecision ( Format   format )                    throw ();
+
+        /**
+         *  Tell if the samples are more precise than 16 bits, that is,
+         *  if converting them to 16 bits loses precision.
+         *
+         *  @param format the format.
+         *  @return true for s24_3, s32 and float32.
+         */
+        static inline bool
+        isWide ( Format     format )                        throw ()
+        {
+            return getPrecision( format) > 16;
+        }
+
+        /**
+         *  Tell the byte order of this machine, that of the samples
+         *  made by the conversions.
+         *
+         *  @return true if this machine is big endian.
+         */
+        static inline bool
+        isHostBigEndian ( void )                            throw ()
+        {
+#ifdef WORDS_BIGENDIAN
+            return true;
+#else
+            return false;
+#endif
+        }
+
+        /**
+         *  Convert samples into 16 bit samples. Wider samples are
+         *  made float first, and rounded as ConvKernels does.
+         *  8 bit samples are taken as Util::conv() does.
+         *
+         *  @param format the format of the samples.
+         *  @param in the samples.
+         *  @param samples the number of samples.
+         *  @param out put the 16 bit samples here.
+         *  @param isBigEndian true if the samples are big endian.
+         *  @exception Exception if the format is unknown.
+         */
+        static void
+        toInt16 (   Format                  format,
+                    const unsigned char   * in,
+                    size_t                  samples,
+                    int16_t               * out,
+                    bool                    isBigEndian );
+
+        /**
+         *  Convert samples into float samples in [-1, 1].
+         *
+         *  @param format the format of the samples.
+         *  @param in the samples.
+         *  @param samples the number of samples.
+         *  @param out put the float samples here.
+         *  @param isBigEndian true if the samples are big endian.
+         *  @exception Exception if the format is unknown.
+         */
+        static void
+        toFloat (   Format                  format,
+                    const unsigned char   * in,
+                    size_t                  samples,
+                    float                 * out,
+                    bool                    isBigEndian );
+
+        /**
+         *  Convert samples into 32 bit integers holding a number of
+         *  significant bits, as FLAC takes them. Samples are shifted
+         *  to that precision, float samples rounded and clipped.
+         *
+         *  @param format the format of the samples.
+         *  @param in the samples.
+         *  @param samples the number of samples.
+         *  @param out put the integer samples here.
+         *  @param bits the number of significant bits, 16 to 32.
+         *  @param isBigEndian true if the samples are big endian.
+         *  @exception Exception if the format is unknown.
+         */
+        static void
+        toInt32 (   Format                  format,
+                    const unsigned char   * in,
+                    size_t                  samples,
+                    int32_t               * out,
+                    unsigned int            bits,
+                    bool                    isBigEndian );
+};
+
+
+/* ================================================= external data structures */
+
+
+/* ====================================================== function prototypes */
+
+
+
+#endif  /* SAMPLE_FORMAT_H */
+
@@ -0,0 +1,279 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : SpillBuffer.cpp
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#error need string.h
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#else
+#error need unistd.h
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#else
+#error need errno.h
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#else
+#error need fcntl.h
+#endif
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#else
+#error need sys/mman.h
+#endif
+
+#include "Util.h"
+#include "SpillBuffer.h"
+
+
+/* ===================================================  local data structures */
+
+
+/* ================================================  local constants & macros */
+
+/*------------------------------------------------------------------------------
+ *  File identity
+ *----------------------------------------------------------------------------*/
+static const char fileid[] = "$Id$";
+
+
+/* ===============================================  local function prototypes */
+
+
+/* =============================================================  module code */
+
+/*------------------------------------------------------------------------------
+ *  Initialize the object
+ *----------------------------------------------------------------------------*/
+void
+SpillBuffer :: init (   const char            * fileName,
+                        unsigned long long      size )
+{
+    int     ret;
+
+    if ( !fileName ) {
+        throw Exception( __FILE__, __LINE__, "no file name");
+    }
+
+    this->size         = ((size + segmentSize - 1) / segmentSize) * segmentSize;
+    if ( this->size == 0 ) {
+        this->size = segmentSize;
+    }
+    this->written      = 0;
+    this->taken        = 0;
+    this->peak         = 0;
+    this->writeMap     = 0;
+    this->writeSegment = 0;
+    this->readMap      = 0;
+    this->readSegment  = 0;
+
+    this->fd = ::open( fileName, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if ( this->fd == -1 ) {
+        throw Exception( __FILE__, __LINE__,
+                         "can't create spill file", fileName, errno);
+    }
+
+    // take all the disk space now, not when the server is gone already
+#ifdef HAVE_POSIX_FALLOCATE
+    ret = posix_fallocate( this->fd, 0, this->size);
+#else
+    ret = ftruncate( this->fd, this->size) == -1 ? errno : 0;
+#endif
+    if ( ret ) {
+        ::close( this->fd);
+        unlink( fileName);
+        throw Exception( __FILE__, __LINE__,
+                         "can't allocate spill file", fileName, ret);
+    }
+
+    this->fileName = Util::strDup( fileName);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  De-initialize the object
+ *----------------------------------------------------------------------------*/
+void
+SpillBuffer :: strip ( void )                               throw ()
+{
+    if ( writeMap ) {
+        munmap( writeMap, segmentSize);
+    }
+    if ( readMap ) {
+        munmap( readMap, segmentSize);
+    }
+    ::close( fd);
+    unlink( fileName);
+    delete[] fileName;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Map a segment of the file
+ *----------------------------------------------------------------------------*/
+unsigned char *
+SpillBuffer :: mapSegment ( unsigned long long      segment,
+                            unsigned char        ** map,
+                            unsigned long long    * mapped )
+{
+    void  * p;
+
+    if ( *map && *mapped == segment ) {
+        return *map;
+    }
+
+    if ( *map ) {
+        munmap( *map, segmentSize);
+        *map = 0;
+    }
+
+    p = mmap( 0, segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+              fd, segment * segmentSize);
+    if ( p == MAP_FAILED ) {
+        throw Exception( __FILE__, __LINE__,
+                         "can't map spill file", fileName, errno);
+    }
+
+    *map    = (unsigned char *) p;
+    *mapped = segment;
+
+    return *map;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Append data to the buffer
+ *----------------------------------------------------------------------------*/
+bool
+SpillBuffer :: append (     const unsigned char   * buf,
+                            unsigned int            len )
+{
+    unsigned long long  pos;
+    unsigned int        offset;
+    unsigned int        n;
+
+    if ( len > size - getUsed() ) {
+        return false;
+    }
+
+    // the file size is a multiple of segmentSize, so a piece never
+    // spans the end of the file
+    while ( len ) {
+        pos    = written % size;
+        offset = pos % segmentSize;
+        n      = segmentSize - offset;
+        if ( n > len ) {
+            n = len;
+        }
+
+        memcpy( mapSegment( pos / segmentSize, &writeMap, &writeSegment)
+                    + offset,
+                buf,
+                n);
+
+        written += n;
+        buf     += n;
+        len     -= n;
+    }
+
+    if ( getUsed() > peak ) {
+        peak = getUsed();
+    }
+
+    return true;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Take data out of the buffer
+ *----------------------------------------------------------------------------*/
+unsigned int
+SpillBuffer :: take (       unsigned char         * buf,
+                            unsigned int            len )
+{
+    unsigned long long  pos;
+    unsigned int        offset;
+    unsigned int        n;
+    unsigned int        total;
+
+    if ( len > getUsed() ) {
+        len = getUsed();
+    }
+
+    total = 0;
+    while ( total < len ) {
+        pos    = taken % size;
+        offset = pos % segmentSize;
+        n      = segmentSize - offset;
+        if ( n > len - total ) {
+            n = len - total;
+        }
+
+        memcpy( buf + total,
+                mapSegment( pos / segmentSize, &readMap, &readSegment)
+                    + offset,
+                n);
+
+        taken += n;
+        total += n;
+    }
+
+    if ( isEmpty() ) {
+        peak = 0;
+    }
+
+    return total;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Drop all the data
+ *----------------------------------------------------------------------------*/
+void
+SpillBuffer :: clear ( void )                               throw ()
+{
+    taken = written;
+    peak  = 0;
+}
+
@@ -0,0 +1,301 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : SpillBuffer.h
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+#ifndef SPILL_BUFFER_H
+#define SPILL_BUFFER_H
+
+#ifndef __cplusplus
+#error This is a C++ include file
+#endif
+
+
+/* ============================================================ include files */
+
+#include "Referable.h"
+#include "Reporter.h"
+#include "Exception.h"
+
+
+/* ================================================================ constants */
+
+
+/* =================================================================== macros */
+
+
+/* =============================================================== data types */
+
+/**
+ *  A First-In First-Out buffer in a file, to keep an encoded stream on
+ *  disk while its server can't be reached.
+ *
+ *  The file is made in full when the buffer is constructed, so that
+ *  spilling never runs out of disk space, and is removed when the
+ *  buffer is destructed. The file is a ring of segments, of which only
+ *  the one being written and the one being read are mapped into
+ *  memory at a time. Data that does not fit is not stored.
+ *
+ *  The class is not thread-safe.
+ *
+ *  @author  $Author$
+ *  @version $Revision$
+ */
+class SpillBuffer : public virtual Referable, public virtual Reporter
+{
+    public:
+
+        /**
+         *  The size of a segment mapped into memory, a multiple of
+         *  the page size.
+         */
+        static const unsigned int   segmentSize = 1024 * 1024;
+
+
+    private:
+
+        /**
+         *  The name of the file.
+         */
+        char                  * fileName;
+
+        /**
+         *  The file descriptor of the file.
+         */
+        int                     fd;
+
+        /**
+         *  The size of the file, a multiple of segmentSize.
+         */
+        unsigned long long      size;
+
+        /**
+         *  The number of bytes appended so far.
+         */
+        unsigned long long      written;
+
+        /**
+         *  The number of bytes taken so far.
+         */
+        unsigned long long      taken;
+
+        /**
+         *  The most bytes held at a time, since the buffer was last empty.
+         */
+        unsigned long long      peak;
+
+        /**
+         *  The segment being written, mapped into memory, or 0.
+         */
+        unsigned char         * writeMap;
+
+        /**
+         *  The index of the segment at writeMap.
+         */
+        unsigned long long      writeSegment;
+
+        /**
+         *  The segment being read, mapped into memory, or 0.
+         */
+        unsigned char         * readMap;
+
+        /**
+         *  The index of the segment at readMap.
+         */
+        unsigned long long      readSegment;
+
+        /**
+         *  Initialize the object.
+         *
+         *  @param fileName the name of the file to spill to.
+         *  @param size the size of the file, in bytes.
+         *  @exception Exception
+         */
+        void
+        init (  const char            * fileName,
+                unsigned long long      size );
+
+        /**
+         *  De-initialize the object.
+         */
+        void
+        strip ( void )                                      throw ();
+
+        /**
+         *  Get a segment of the file mapped into memory, unmapping
+         *  the one mapped before.
+         *
+         *  @param segment the index of the segment.
+         *  @param map the memory the segment is mapped at, if any.
+         *  @param mapped the index of the segment mapped at map.
+         *  @return the memory the segment is mapped at.
+         *  @exception Exception
+         */
+        unsigned char *
+        mapSegment (    unsigned long long      segment,
+                        unsigned char        ** map,
+                        unsigned long long    * mapped );
+
+        /**
+         *  Default constructor. Not supported.
+         */
+        SpillBuffer ( void );
+
+        /**
+         *  Copy constructor. Not supported.
+         */
+        SpillBuffer ( const SpillBuffer &   buffer );
+
+        /**
+         *  Assignment operator. Not supported.
+         */
+        SpillBuffer &
+        operator= ( const SpillBuffer &     buffer );
+
+
+    public:
+
+        /**
+         *  Constructor. Makes the file, of its full size.
+         *
+         *  @param fileName the name of the file to spill to.
+         *  @param size the size of the file, in bytes, rounded up to
+         *              whole segments.
+         *  @exception Exception
+         */
+        inline
+        SpillBuffer (   const char            * fileName,
+                        unsigned long long      size )
+        {
+            init( fileName, size);
+        }
+
+        /**
+         *  Destructor. Removes the file.
+         */
+        inline virtual
+        ~SpillBuffer ( void )                               throw ()
+        {
+            strip();
+        }
+
+        /**
+         *  Get the name of the file.
+         *
+         *  @return the name of the file.
+         */
+        inline const char *
+        getFileName ( void ) const                          throw ()
+        {
+            return fileName;
+        }
+
+        /**
+         *  Get the size of the file.
+         *
+         *  @return the most bytes the buffer holds.
+         */
+        inline unsigned long long
+        getSize ( void ) const                              throw ()
+        {
+            return size;
+        }
+
+        /**
+         *  Get the number of bytes in the buffer.
+         *
+         *  @return the number of bytes appended and not taken yet.
+         */
+        inline unsigned long long
+        getUsed ( void ) const                              throw ()
+        {
+            return written - taken;
+        }
+
+        /**
+         *  Get the most bytes held at a time since the buffer was
+         *  last empty.
+         *
+         *  @return the peak usage of the buffer.
+         */
+        inline unsigned long long
+        getPeak ( void ) const                              throw ()
+        {
+            return peak;
+        }
+
+        /**
+         *  Tell if the buffer is empty.
+         *
+         *  @return true if all that was appended was taken.
+         */
+        inline bool
+        isEmpty ( void ) const                              throw ()
+        {
+            return written == taken;
+        }
+
+        /**
+         *  Append data to the buffer, all of it or nothing.
+         *
+         *  @param buf the data to append.
+         *  @param len the number of bytes to append.
+         *  @return true if appended, false if it does not fit.
+         *  @exception Exception
+         */
+        bool
+        append (    const unsigned char   * buf,
+                    unsigned int            len );
+
+        /**
+         *  Take the oldest data out of the buffer.
+         *
+         *  @param buf put the data here.
+         *  @param len the most bytes to take.
+         *  @return the number of bytes taken.
+         *  @exception Exception
+         */
+        unsigned int
+        take (      unsigned char         * buf,
+                    unsigned int            len );
+
+        /**
+         *  Drop all the data in the buffer.
+         */
+        void
+        clear ( void )                                      throw ();
+};
+
+
+/* ================================================= external data structures */
+
+
+/* ====================================================== function prototypes */
+
+
+
+#endif  /* SPILL_BUFFER_H */
+
@@ -0,0 +1,279 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : SpscQueue.h
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#ifndef __cplusplus
+#error This is a C++ include file
+#endif
+
+
+/* ============================================================ include files */
+
+#include <atomic>
+
+#include "Exception.h"
+
+
+/* ================================================================ constants */
+
+
+/* =================================================================== macros */
+
+
+/* =============================================================== data types */
+
+/**
+ *  A bounded, lock-free single producer / single consumer queue.
+ *
+ *  One thread may push() and dropOldest(), another thread may pop().
+ *  dropOldest() lets the producer make room in a full queue by taking
+ *  away the oldest element, thus it competes with pop() for the head of
+ *  the queue. Both sides take the head with a compare-and-swap, so an
+ *  element is always handed to exactly one of them.
+ *
+ *  T must be a type that fits into a std::atomic, typically a pointer.
+ *
+ *  @author  $Author$
+ *  @version $Revision$
+ */
+template <class T>
+class SpscQueue
+{
+    private:
+
+        /**
+         *  The slots of the ring, the number of slots is a power of 2.
+         */
+        std::atomic<T>            * slots;
+
+        /**
+         *  The number of slots minus one, to mask the indexes with.
+         */
+        unsigned int                mask;
+
+        /**
+         *  The maximum number of elements in the queue.
+         */
+        unsigned int                capacity;
+
+        /**
+         *  The index of the oldest element. Only ever increases.
+         */
+        std::atomic<unsigned int>   head;
+
+        /**
+         *  The index of the next element to push. Only ever increases.
+         */
+        std::atomic<unsigned int>   tail;
+
+        /**
+         *  Copy constructor. Not supported.
+         */
+        SpscQueue ( const SpscQueue<T> &    queue );
+
+        /**
+         *  Assignment operator. Not supported.
+         */
+        SpscQueue<T> &
+        operator= ( const SpscQueue<T> &    queue );
+
+
+    public:
+
+        /**
+         *  Constructor.
+         *
+         *  @param capacity the maximum number of elements in the queue.
+         *  @exception Exception
+         */
+        inline
+        SpscQueue ( unsigned int    capacity = 1 )
+        {
+            slots = 0;
+            setCapacity( capacity);
+        }
+
+        /**
+         *  Destructor.
+         */
+        inline
+        ~SpscQueue ( void )
+        {
+            delete[] slots;
+        }
+
+        /**
+         *  Set the capacity of the queue. The queue is emptied.
+         *  Must not be called while the queue is in use.
+         *
+         *  @param capacity the maximum number of elements in the queue.
+         *  @exception Exception
+         */
+        inline void
+        setCapacity ( unsigned int      capacity )
+        {
+            unsigned int    size;
+
+            if ( capacity == 0 ) {
+                throw Exception( __FILE__, __LINE__, "zero queue capacity");
+            }
+
+            for ( size = 1; size < capacity; size <<= 1 );
+
+            delete[] slots;
+            this->slots    = new std::atomic<T>[size];
+            this->mask     = size - 1;
+            this->capacity = capacity;
+            this->head.store( 0);
+            this->tail.store( 0);
+        }
+
+        /**
+         *  Get the maximum number of elements in the queue.
+         *
+         *  @return the capacity of the queue.
+         */
+        inline unsigned int
+        getCapacity ( void ) const                          throw ()
+        {
+            return capacity;
+        }
+
+        /**
+         *  Get the number of elements in the queue.
+         *  Only a snapshot if the other side is active at the same time.
+         *
+         *  @return the number of elements in the queue.
+         */
+        inline unsigned int
+        size ( void ) const                                 throw ()
+        {
+            return tail.load( std::memory_order_acquire)
+                 - head.load( std::memory_order_acquire);
+        }
+
+        /**
+         *  Tell if the queue is empty.
+         *
+         *  @return true if there are no elements in the queue.
+         */
+        inline bool
+        isEmpty ( void ) const                              throw ()
+        {
+            return size() == 0;
+        }
+
+        /**
+         *  Tell if the queue is full. Only meaningful for the producer.
+         *
+         *  @return true if push() would fail.
+         */
+        inline bool
+        isFull ( void ) const                               throw ()
+        {
+            return size() >= capacity;
+        }
+
+        /**
+         *  Add an element to the queue. Producer side only.
+         *
+         *  @param element the element to add.
+         *  @return true if the element was added, false if the queue
+         *          is full.
+         */
+        inline bool
+        push ( T    element )                               throw ()
+        {
+            unsigned int    t = tail.load( std::memory_order_relaxed);
+
+            if ( t - head.load( std::memory_order_acquire) >= capacity ) {
+                return false;
+            }
+
+            slots[t & mask].store( element, std::memory_order_relaxed);
+            tail.store( t + 1, std::memory_order_release);
+
+            return true;
+        }
+
+        /**
+         *  Take the oldest element from the queue. Consumer side.
+         *
+         *  @param element the element taken, if any.
+         *  @return true if an element was taken, false if the queue
+         *          was empty.
+         */
+        inline bool
+        pop ( T   & element )                               throw ()
+        {
+            unsigned int    h = head.load( std::memory_order_acquire);
+
+            while ( h != tail.load( std::memory_order_acquire) ) {
+                T   e = slots[h & mask].load( std::memory_order_relaxed);
+
+                // the slot is only ours if nobody moved the head meanwhile
+                if ( head.compare_exchange_weak( h,
+                                                 h + 1,
+                                                 std::memory_order_acq_rel,
+                                                 std::memory_order_acquire) ) {
+                    element = e;
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        /**
+         *  Take the oldest element from the queue, to make room for a
+         *  new one. Producer side. The same as pop(), but documents that
+         *  the producer is stealing from the consumer.
+         *
+         *  @param element the element taken, if any.
+         *  @return true if an element was taken, false if the queue
+         *          was empty.
+         */
+        inline bool
+        dropOldest ( T    & element )                       throw ()
+        {
+            return pop( element);
+        }
+};
+
+
+/* ================================================= external data structures */
+
+
+/* ====================================================== function prototypes */
+
+
+
+#endif  /* SPSC_QUEUE_H */
+
@@ -51,6 +51,12 @@
 #error need errno.h
 #endif
 
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#else
+#error need fcntl.h
+#endif
+
 #ifdef HAVE_SYS_SOCKET_H
 #include <sys/socket.h>
 #else
@@ -63,6 +69,12 @@
 #error need netinet/in.h
 #endif
 
+#ifdef HAVE_NETINET_TCP_H
+#include <netinet/tcp.h>
+#else
+#error need netinet/tcp.h
+#endif
+
 #ifdef HAVE_NETDB_H
 #include <netdb.h>
 #else
@@ -75,6 +87,18 @@
 #error need unistd.h
 #endif
 
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#else
+#error need poll.h
+#endif
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#else
+#error need pthread.h
+#endif
+
 #ifdef HAVE_SYS_TIME_H
 #include <sys/time.h>
 #else
@@ -103,12 +127,249 @@
  *----------------------------------------------------------------------------*/
 static const char fileid[] = "$Id$";
 
+/*------------------------------------------------------------------------------
+ *  The most addresses of a host tried when connecting
+ *----------------------------------------------------------------------------*/
+#define MAX_ADDRESSES       8
+
+/*------------------------------------------------------------------------------
+ *  The number of hosts whose addresses are kept
+ *----------------------------------------------------------------------------*/
+#define DNS_CACHE_SIZE      32
+
+/*------------------------------------------------------------------------------
+ *  The time the addresses of a host are kept for, in seconds
+ *----------------------------------------------------------------------------*/
+#define DNS_CACHE_SECONDS   300
+
+/*------------------------------------------------------------------------------
+ *  The addresses of a host, as resolved at some time
+ *----------------------------------------------------------------------------*/
+typedef struct {
+    char                        host[256];
+    unsigned short              port;
+    unsigned int                count;
+    struct sockaddr_storage     addrs[MAX_ADDRESSES];
+    unsigned int                lens[MAX_ADDRESSES];
+    unsigned long long          resolvedAt;
+} ResolvedHost;
+
+/*------------------------------------------------------------------------------
+ *  The addresses of the hosts connected to lately, shared by all sockets
+ *----------------------------------------------------------------------------*/
+static ResolvedHost     dnsCache[DNS_CACHE_SIZE];
+static pthread_mutex_t  dnsCacheMutex = PTHREAD_MUTEX_INITIALIZER;
+
 
 /* ===============================================  local function prototypes */
 
+/*------------------------------------------------------------------------------
+ *  Look up the addresses of a host, IPv6 and IPv4 ones interleaved
+ *----------------------------------------------------------------------------*/
+static unsigned int
+lookup (    const char                * host,
+            unsigned short              port,
+            struct sockaddr_storage   * addrs,
+            unsigned int              * lens );
+
+/*------------------------------------------------------------------------------
+ *  Get the addresses of a host, from the cache if known lately
+ *----------------------------------------------------------------------------*/
+static unsigned int
+resolve (   const char                * host,
+            unsigned short              port,
+            struct sockaddr_storage   * addrs,
+            unsigned int              * lens );
+
 
 /* =============================================================  module code */
 
+/*------------------------------------------------------------------------------
+ *  Look up the addresses of a host
+ *----------------------------------------------------------------------------*/
+static unsigned int
+lookup (    const char                * host,
+            unsigned short              port,
+            struct sockaddr_storage   * addrs,
+            unsigned int              * lens )
+{
+    struct sockaddr_storage     found[MAX_ADDRESSES];
+    unsigned int                foundLens[MAX_ADDRESSES];
+    unsigned int                n;
+    unsigned int                u;
+    unsigned int                first;
+    unsigned int                other;
+    unsigned int                count;
+#ifdef HAVE_GETADDRINFO
+    struct addrinfo             hints;
+    struct addrinfo           * info;
+    struct addrinfo           * ptr;
+    char                        portstr[6];
+    int                         ret;
+
+    memset( &hints, 0, sizeof(hints));
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_family   = AF_UNSPEC;
+    snprintf( portstr, sizeof(portstr), "%d", port);
+
+    if ( (ret = getaddrinfo( host, portstr, &hints, &info)) ) {
+        throw Exception( __FILE__, __LINE__,
+                         "getaddrinfo error: ", gai_strerror( ret));
+    }
+
+    n = 0;
+    for ( ptr = info; ptr && n < MAX_ADDRESSES; ptr = ptr->ai_next ) {
+        if ( ptr->ai_family != AF_INET && ptr->ai_family != AF_INET6 ) {
+            continue;
+        }
+        memcpy( found + n, ptr->ai_addr, ptr->ai_addrlen);
+        foundLens[n] = ptr->ai_addrlen;
+        ++n;
+    }
+    freeaddrinfo( info);
+#else
+    struct hostent            * pHostEntry;
+    struct sockaddr_in        * addr;
+
+    if ( !(pHostEntry = gethostbyname( host)) ) {
+        throw Exception( __FILE__, __LINE__, "gethostbyname error", errno);
+    }
+
+    for ( n = 0; n < MAX_ADDRESSES && pHostEntry->h_addr_list[n]; ++n ) {
+        addr = (struct sockaddr_in *) (found + n);
+        memset( addr, 0, sizeof(found[n]));
+        addr->sin_family = AF_INET;
+        addr->sin_port   = htons( port);
+        memcpy( &addr->sin_addr, pHostEntry->h_addr_list[n],
+                sizeof(addr->sin_addr));
+        foundLens[n] = sizeof(struct sockaddr_in);
+    }
+#endif
+
+    if ( n == 0 ) {
+        throw Exception( __FILE__, __LINE__, "no address for host", host);
+    }
+
+    // take the preferred family first, then alternate between the two,
+    // keeping the order within each family
+    first = 0;
+    other = 0;
+    count = 0;
+    while ( count < n ) {
+        while ( first < n && found[first].ss_family != found[0].ss_family ) {
+            ++first;
+        }
+        if ( first < n ) {
+            addrs[count]  = found[first];
+            lens[count++] = foundLens[first++];
+        }
+        while ( other < n && found[other].ss_family == found[0].ss_family ) {
+            ++other;
+        }
+        if ( other < n ) {
+            addrs[count]  = found[other];
+            lens[count++] = foundLens[other++];
+        }
+    }
+
+    for ( u = 0; u < count; ++u ) {
+        if ( lens[u] > sizeof(addrs[u]) ) {
+            throw Exception( __FILE__, __LINE__, "address too long");
+        }
+    }
+
+    return count;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Get the addresses of a host
+ *----------------------------------------------------------------------------*/
+static unsigned int
+resolve (   const char                * host,
+            unsigned short              port,
+            struct sockaddr_storage   * addrs,
+            unsigned int              * lens )
+{
+    ResolvedHost          * entry;
+    ResolvedHost          * oldest;
+    unsigned long long      now;
+    unsigned int            count;
+    unsigned int            u;
+
+    if ( strlen( host) >= sizeof(dnsCache[0].host) ) {
+        return lookup( host, port, addrs, lens);
+    }
+
+    now = Util::getMonotonicTime();
+
+    pthread_mutex_lock( &dnsCacheMutex);
+    for ( u = 0; u < DNS_CACHE_SIZE; ++u ) {
+        entry = dnsCache + u;
+        if ( entry->count && entry->port == port
+          && !strcmp( entry->host, host)
+          && now - entry->resolvedAt < DNS_CACHE_SECONDS * 1000000ULL ) {
+            count = entry->count;
+            memcpy( addrs, entry->addrs, count * sizeof(addrs[0]));
+            memcpy( lens, entry->lens, count * sizeof(lens[0]));
+            pthread_mutex_unlock( &dnsCacheMutex);
+            return count;
+        }
+    }
+    pthread_mutex_unlock( &dnsCacheMutex);
+
+    // not holding the lock while asking the name server
+    try {
+        count = lookup( host, port, addrs, lens);
+    } catch ( Exception     & e ) {
+        // rather connect to where the host was, than not at all
+        count = 0;
+        pthread_mutex_lock( &dnsCacheMutex);
+        for ( u = 0; u < DNS_CACHE_SIZE; ++u ) {
+            entry = dnsCache + u;
+            if ( entry->count && entry->port == port
+              && !strcmp( entry->host, host) ) {
+                count = entry->count;
+                memcpy( addrs, entry->addrs, count * sizeof(addrs[0]));
+                memcpy( lens, entry->lens, count * sizeof(lens[0]));
+                break;
+            }
+        }
+        pthread_mutex_unlock( &dnsCacheMutex);
+        if ( count == 0 ) {
+            throw;
+        }
+        return count;
+    }
+
+    // keep the addresses, in place of the earlier ones of the host,
+    // or of the host resolved longest ago
+    pthread_mutex_lock( &dnsCacheMutex);
+    oldest = dnsCache;
+    for ( u = 0; u < DNS_CACHE_SIZE; ++u ) {
+        entry = dnsCache + u;
+        if ( entry->count && entry->port == port
+          && !strcmp( entry->host, host) ) {
+            oldest = entry;
+            break;
+        }
+        if ( !entry->count
+          || (oldest->count && entry->resolvedAt < oldest->resolvedAt) ) {
+            oldest = entry;
+        }
+    }
+    strcpy( oldest->host, host);
+    oldest->port       = port;
+    oldest->count      = count;
+    oldest->resolvedAt = now;
+    memcpy( oldest->addrs, addrs, count * sizeof(addrs[0]));
+    memcpy( oldest->lens, lens, count * sizeof(lens[0]));
+    pthread_mutex_unlock( &dnsCacheMutex);
+
+    return count;
+}
+
+
 /*------------------------------------------------------------------------------
  *  Initialize the object
  *----------------------------------------------------------------------------*/
@@ -119,6 +380,11 @@ TcpSocket :: init (   const char    * host,
     this->host   = Util::strDup( host);
     this->port   = port;
     this->sockfd = 0;
+    this->connectTimeout = defaultConnectTimeout;
+    this->sendBufferBytes = 0;
+    this->notSentLowat    = 0;
+    this->noDelay         = false;
+    this->userTimeout     = 0;
 }
 
 
@@ -145,6 +411,9 @@ TcpSocket :: TcpSocket (  const TcpSocket &    ss )
     int     fd;
     
     init( ss.host, ss.port);
+    connectTimeout = ss.connectTimeout;
+    setSocketOptions( ss.sendBufferBytes, ss.notSentLowat,
+                      ss.noDelay, ss.userTimeout);
 
     if ( (fd = ss.sockfd ? dup( ss.sockfd) : 0) == -1 ) {
         strip();
@@ -173,6 +442,9 @@ TcpSocket :: operator= (  const TcpSocket &    ss )
         Source::operator=( ss );
 
         init( ss.host, ss.port);
+        connectTimeout = ss.connectTimeout;
+        setSocketOptions( ss.sendBufferBytes, ss.notSentLowat,
+                          ss.noDelay, ss.userTimeout);
         
         if ( (fd = ss.sockfd ? dup( ss.sockfd) : 0) == -1 ) {
             strip();
@@ -186,85 +458,248 @@ TcpSocket :: operator= (  const TcpSocket &    ss )
 }
 
 
+/*------------------------------------------------------------------------------
+ *  Connect to one of the addresses, racing them
+ *----------------------------------------------------------------------------*/
+int
+TcpSocket :: connectAny (   const struct sockaddr_storage * addrs,
+                            const unsigned int            * lens,
+                            unsigned int                    count )
+{
+    struct pollfd           fds[MAX_ADDRESSES];
+    unsigned int            pending;
+    unsigned int            started;
+    unsigned int            u;
+    unsigned long long      now;
+    unsigned long long      deadline;
+    unsigned long long      nextStart;
+    unsigned long long      until;
+    int                     winner;
+    int                     lastError;
+    int                     fd;
+    int                     err;
+    int                     ret;
+    socklen_t               errlen;
+
+    now       = Util::getMonotonicTime();
+    deadline  = now + connectTimeout * 1000ULL;
+    nextStart = now;
+    pending   = 0;
+    started   = 0;
+    winner    = -1;
+    lastError = ETIMEDOUT;
+
+    while ( winner == -1 ) {
+        // start the next attempt if it's time, or if all others failed
+        if ( started < count && (now >= nextStart || pending == 0) ) {
+            const struct sockaddr_storage * addr = addrs + started++;
+
+            fd = ::socket( addr->ss_family, SOCK_STREAM, IPPROTO_TCP);
+            if ( fd == -1 ) {
+                lastError = errno;
+                continue;
+            }
+            fcntl( fd, F_SETFL, fcntl( fd, F_GETFL) | O_NONBLOCK);
+
+            if ( ::connect( fd, (const struct sockaddr *) addr,
+                            lens[started - 1]) == 0 ) {
+                winner = fd;
+                break;
+            }
+            if ( errno != EINPROGRESS ) {
+                lastError = errno;
+                ::close( fd);
+                continue;
+            }
+
+            fds[pending].fd      = fd;
+            fds[pending].events  = POLLOUT;
+            fds[pending].revents = 0;
+            ++pending;
+            nextStart = now + connectAttemptDelay * 1000ULL;
+        }
+
+        if ( pending == 0 ) {
+            if ( started == count ) {
+                break;
+            }
+            continue;
+        }
+        if ( now >= deadline ) {
+            lastError = ETIMEDOUT;
+            break;
+        }
+
+        until = started < count && nextStart < deadline ? nextStart
+                                                        : deadline;
+        ret = poll( fds, pending, (until - now + 999) / 1000);
+        now = Util::getMonotonicTime();
+        if ( ret == -1 ) {
+            if ( errno != EINTR ) {
+                lastError = errno;
+                break;
+            }
+            // revents tell nothing, as the connects still go on
+            continue;
+        }
+
+        for ( u = 0; u < pending; ) {
+            if ( !fds[u].revents ) {
+                ++u;
+                continue;
+            }
+
+            err    = 0;
+            errlen = sizeof(err);
+            if ( getsockopt( fds[u].fd, SOL_SOCKET, SO_ERROR,
+                             &err, &errlen) == -1 ) {
+                err = errno;
+            }
+            if ( err == 0 ) {
+                winner = fds[u].fd;
+                fds[u] = fds[--pending];
+                break;
+            }
+
+            // failed, let the next address have a go right away
+            lastError = err;
+            ::close( fds[u].fd);
+            fds[u]    = fds[--pending];
+            nextStart = now;
+        }
+    }
+
+    // the losers of the race
+    for ( u = 0; u < pending; ++u ) {
+        ::close( fds[u].fd);
+    }
+
+    if ( winner == -1 ) {
+        throw Exception( __FILE__, __LINE__, "connect error", lastError);
+    }
+
+    // the login is sent and read blocking
+    fcntl( winner, F_SETFL, fcntl( winner, F_GETFL) & ~O_NONBLOCK);
+
+    return winner;
+}
+
+
 /*------------------------------------------------------------------------------
  *  Open the file
  *----------------------------------------------------------------------------*/
 bool
 TcpSocket :: open ( void )                       
 {
+    struct sockaddr_storage addrs[MAX_ADDRESSES];
+    unsigned int            lens[MAX_ADDRESSES];
+    unsigned int            count;
     int                     optval;
     socklen_t               optlen;
-#ifdef HAVE_GETADDRINFO
-    struct addrinfo         hints;
-    struct addrinfo       * ptr;
-    struct sockaddr_storage addr;
-    char                    portstr[6];
-#else
-    struct sockaddr_in      addr;
-    struct hostent        * pHostEntry;
-#endif
  
     if ( isOpen() ) {
         return false;
     }
 
-#ifdef HAVE_GETADDRINFO
-    memset(&hints, 0, sizeof(hints));
-    hints.ai_socktype = SOCK_STREAM;
-    hints.ai_family = AF_UNSPEC;
-    snprintf(portstr, sizeof(portstr), "%d", port);
+    count  = resolve( host, port, addrs, lens);
+    sockfd = connectAny( addrs, lens, count);
 
-    if (getaddrinfo(host , portstr, &hints, &ptr)) {
-        sockfd = 0;
-        throw Exception( __FILE__, __LINE__, "getaddrinfo error", errno);
+    // set TCP keep-alive
+    optval = 1;
+    optlen = sizeof(optval);
+    if (setsockopt(sockfd, SOL_SOCKET, SO_KEEPALIVE, &optval, optlen) == -1) {
+        reportEvent(5, "can't set TCP socket keep-alive mode", errno);
     }
-    memcpy ( &addr, ptr->ai_addr, ptr->ai_addrlen);
-    freeaddrinfo(ptr);
-#else
-    if ( !(pHostEntry = gethostbyname( host)) ) {
-        sockfd = 0;
-        throw Exception( __FILE__, __LINE__, "gethostbyname error", errno);
+
+    setOptions();
+
+    return true;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Set the socket options asked for
+ *----------------------------------------------------------------------------*/
+void
+TcpSocket :: setOptions ( void )                            throw ()
+{
+    int             optval;
+    socklen_t       optlen = sizeof(optval);
+    unsigned int    level;
+
+    if ( sendBufferBytes ) {
+        optval = sendBufferBytes;
+        if ( setsockopt( sockfd, SOL_SOCKET, SO_SNDBUF, &optval, optlen)
+                                                                    == -1 ) {
+            reportEvent( 3, "can't set TCP socket send buffer size", errno);
+        }
     }
 
-    memset( &addr, 0, sizeof(addr));
-    addr.sin_family      = AF_INET;
-    addr.sin_port        = htons(port);
-    addr.sin_addr.s_addr = *((long*) pHostEntry->h_addr_list[0]);
+#ifdef TCP_NOTSENT_LOWAT
+    if ( notSentLowat ) {
+        optval = notSentLowat;
+        if ( setsockopt( sockfd, IPPROTO_TCP, TCP_NOTSENT_LOWAT,
+                         &optval, optlen) == -1 ) {
+            reportEvent( 3, "can't set TCP socket not sent low mark", errno);
+        }
+    }
 #endif
 
-    if ( (sockfd = socket( addr.ss_family, SOCK_STREAM,  IPPROTO_TCP)) == -1 ) {
-        sockfd = 0;
-        throw Exception( __FILE__, __LINE__, "socket error", errno);
+#ifdef TCP_NODELAY
+    if ( noDelay ) {
+        optval = 1;
+        if ( setsockopt( sockfd, IPPROTO_TCP, TCP_NODELAY, &optval, optlen)
+                                                                    == -1 ) {
+            reportEvent( 3, "can't set TCP socket no delay mode", errno);
+        }
     }
+#endif
 
-    // set TCP keep-alive
-    optval = 1;
-    optlen = sizeof(optval);
-    if (setsockopt(sockfd, SOL_SOCKET, SO_KEEPALIVE, &optval, optlen) == -1) {
-        reportEvent(5, "can't set TCP socket keep-alive mode", errno);
+#ifdef TCP_USER_TIMEOUT
+    if ( userTimeout ) {
+        optval = userTimeout;
+        if ( setsockopt( sockfd, IPPROTO_TCP, TCP_USER_TIMEOUT,
+                         &optval, optlen) == -1 ) {
+            reportEvent( 3, "can't set TCP socket user timeout", errno);
+        }
     }
+#endif
 
-    // connect
-    socklen_t addrlen;
-    switch (addr.ss_family) {
-        case AF_INET:
-            addrlen = sizeof(struct sockaddr_in);
-            break;
-        case AF_INET6:
-            addrlen = sizeof(struct sockaddr_in6);
-            break;
-        default:
-            throw Exception( __FILE__, __LINE__, "invalid address family", errno);
-    }
+    // the kernel may round the send buffer, and count its own overhead in
+    optval = 0;
+    optlen = sizeof(optval);
+    getsockopt( sockfd, SOL_SOCKET, SO_SNDBUF, &optval, &optlen);
+
+    // tell what was asked for only when something was
+    level = sendBufferBytes || notSentLowat || noDelay || userTimeout ? 3 : 5;
+    reportEvent( level, "TcpSocket, connected to", host, "port", port);
+    reportEvent( level, "TcpSocket, send buffer asked for:", sendBufferBytes,
+                 "bytes, kernel reports:", optval);
+    reportEvent( level, "TcpSocket, not sent low mark:", notSentLowat,
+                 "bytes, user timeout ms:", userTimeout);
+    reportEvent( level, "TcpSocket, no delay:", noDelay ? "yes" : "no");
+}
 
 
-    if ( connect( sockfd, (struct sockaddr*)&addr, addrlen) == -1 ) {
-        ::close( sockfd);
-        sockfd = 0;
-        throw Exception( __FILE__, __LINE__, "connect error", errno);
+/*------------------------------------------------------------------------------
+ *  Make the socket non-blocking, or blocking
+ *----------------------------------------------------------------------------*/
+void
+TcpSocket :: setNonBlocking ( bool      nonBlocking )
+{
+    int         flags;
+
+    if ( !isOpen() ) {
+        return;
     }
 
-    return true;
+    if ( (flags = fcntl( sockfd, F_GETFL)) == -1 ) {
+        throw Exception( __FILE__, __LINE__, "fcntl error", errno);
+    }
+    flags = nonBlocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+    if ( fcntl( sockfd, F_SETFL, flags) == -1 ) {
+        throw Exception( __FILE__, __LINE__, "fcntl error", errno);
+    }
 }
 
 
@@ -399,7 +834,7 @@ TcpSocket :: write (    const void    * buf,
 #endif
 
     if ( ret == -1 ) {
-        if ( errno == EAGAIN ) {
+        if ( errno == EAGAIN || errno == EWOULDBLOCK ) {
             ret = 0;
         } else {
             ::close( sockfd);
@@ -52,11 +52,32 @@
 /**
  *  A TCP network socket
  *
+ *  Opening connects to all the addresses of the host in turn, IPv6 and
+ *  IPv4 ones interleaved, starting the next attempt if the previous one
+ *  has not succeeded in connectAttemptDelay milli-seconds, without
+ *  giving up on it (RFC 8305). The first connection made wins. The
+ *  addresses of a host are kept for a while, so that reconnecting does
+ *  not have to wait for a name server.
+ *
  *  @author  $Author$
  *  @version $Revision$
  */
 class TcpSocket : public Source, public Sink, public virtual Reporter
 {
+    public:
+
+        /**
+         *  The time to wait for a connection attempt before starting
+         *  the next one, in milli-seconds.
+         */
+        static const unsigned int   connectAttemptDelay = 250;
+
+        /**
+         *  The default time to wait for a connection, in milli-seconds.
+         */
+        static const unsigned int   defaultConnectTimeout = 10000;
+
+
     private:
 
         /**
@@ -73,6 +94,55 @@ class TcpSocket : public Source, public Sink, public virtual Reporter
          *  Low-level socket descriptor.
          */
         int                 sockfd;
+
+        /**
+         *  The time to wait for a connection, in milli-seconds.
+         */
+        unsigned int        connectTimeout;
+
+        /**
+         *  The size of the kernel send buffer to ask for, in bytes,
+         *  0 for the default.
+         */
+        unsigned int        sendBufferBytes;
+
+        /**
+         *  The most unsent bytes the kernel holds before the socket
+         *  stops being writable, 0 for the default.
+         */
+        unsigned int        notSentLowat;
+
+        /**
+         *  Send small writes right away, without waiting to coalesce them.
+         */
+        bool                noDelay;
+
+        /**
+         *  The time sent data may stay unacknowledged before the
+         *  connection is dropped, in milli-seconds, 0 for the default.
+         */
+        unsigned int        userTimeout;
+
+        /**
+         *  Set the socket options asked for on the connected socket,
+         *  and report them.
+         */
+        void
+        setOptions ( void )                             throw ();
+
+        /**
+         *  Connect to one of a list of addresses, racing them.
+         *
+         *  @param addrs the addresses, in the order to try them.
+         *  @param lens the lengths of the addresses.
+         *  @param count the number of addresses.
+         *  @return the connected socket.
+         *  @exception Exception if none could be connected to in time.
+         */
+        int
+        connectAny (    const struct sockaddr_storage * addrs,
+                        const unsigned int            * lens,
+                        unsigned int                    count );
         
         /**
          *  Initialize the object.
@@ -175,6 +245,76 @@ class TcpSocket : public Source, public Sink, public virtual Reporter
             return port;
         }
 
+        /**
+         *  Set the time to wait for a connection when opening.
+         *
+         *  @param msec the time to wait, in milli-seconds.
+         */
+        inline void
+        setConnectTimeout ( unsigned int   msec )       throw ()
+        {
+            connectTimeout = msec;
+        }
+
+        /**
+         *  Get the time to wait for a connection when opening.
+         *
+         *  @return the time to wait, in milli-seconds.
+         */
+        inline unsigned int
+        getConnectTimeout ( void ) const            throw ()
+        {
+            return connectTimeout;
+        }
+
+        /**
+         *  Set the options of the socket when opening, to bound the
+         *  data the kernel holds and to notice a dead peer early.
+         *  0 leaves an option at the default of the system.
+         *
+         *  @param sendBufferBytes the size of the kernel send buffer,
+         *                         in bytes (SO_SNDBUF).
+         *  @param notSentLowat the most unsent bytes the kernel holds
+         *                      before the socket stops being writable
+         *                      (TCP_NOTSENT_LOWAT).
+         *  @param noDelay send small writes right away (TCP_NODELAY).
+         *  @param userTimeout the time sent data may stay unacknowledged
+         *                     before the connection is dropped, in
+         *                     milli-seconds (TCP_USER_TIMEOUT).
+         */
+        inline void
+        setSocketOptions (  unsigned int    sendBufferBytes,
+                            unsigned int    notSentLowat,
+                            bool            noDelay,
+                            unsigned int    userTimeout )   throw ()
+        {
+            this->sendBufferBytes = sendBufferBytes;
+            this->notSentLowat    = notSentLowat;
+            this->noDelay         = noDelay;
+            this->userTimeout     = userTimeout;
+        }
+
+        /**
+         *  Get the file descriptor of the socket.
+         *
+         *  @return the file descriptor, 0 if the socket is not open.
+         */
+        inline int
+        getFd ( void ) const                        throw ()
+        {
+            return sockfd;
+        }
+
+        /**
+         *  Make the socket non-blocking, or blocking again. When
+         *  non-blocking, write() returns 0 if the socket takes no more.
+         *
+         *  @param nonBlocking true to make the socket non-blocking.
+         *  @exception Exception
+         */
+        void
+        setNonBlocking ( bool       nonBlocking )       ;
+
         /**
          *  Open the TcpSocket.
          *
@@ -69,7 +69,8 @@ TwoLameLibEncoder :: init ( void )
 {
 	this->twolame_opts    = NULL;
 
-	if ( getInBitsPerSample() != 16 ) {
+	if ( getInSampleFormat() != SampleFormat::s16
+	  && !SampleFormat::isWide( getInSampleFormat()) ) {
 		throw Exception( __FILE__, __LINE__,
 						 "specified bits per sample not supported",
 						 getInBitsPerSample() );
@@ -190,6 +191,17 @@ TwoLameLibEncoder :: write (   const void    * buf,
 
     unsigned int    bitsPerSample = getInBitsPerSample();
     unsigned int    inChannels    = getInChannel();
+    unsigned int    inSampleSize  = (bitsPerSample / 8) * inChannels;
+    unsigned int    inProcessed   = len - (len % inSampleSize);
+    bool            bigEndian     = isInBigEndian();
+    int16_t       * narrowBuffer  = narrowInput( buf, len);
+
+    // samples wider than 16 bits are encoded as 16 bit ones here
+    if ( narrowBuffer ) {
+        buf           = narrowBuffer;
+        bitsPerSample = 16;
+        bigEndian     = SampleFormat::isHostBigEndian();
+    }
 
     unsigned int    sampleSize = (bitsPerSample / 8) * inChannels;
     unsigned char * b = (unsigned char*) buf;
@@ -206,15 +218,46 @@ TwoLameLibEncoder :: write (   const void    * buf,
                       leftBuffer,
                       rightBuffer,
                       inChannels,
-                      isInBigEndian());
+                      bigEndian);
     } else {
         delete[] leftBuffer;
         delete[] rightBuffer;
+        delete[] narrowBuffer;
         throw Exception( __FILE__, __LINE__,
                         "unsupported number of bits per sample for the encoder",
                          bitsPerSample );
     }
 
+    bool            encoded;
+
+    // the sink may throw, let go of the buffers then too
+    try {
+        encoded = encode( leftBuffer,
+                          inChannels == 2 ? rightBuffer : leftBuffer,
+                          nSamples);
+    } catch ( ... ) {
+        delete[] leftBuffer;
+        delete[] rightBuffer;
+        delete[] narrowBuffer;
+        throw;
+    }
+
+    delete[] leftBuffer;
+    delete[] rightBuffer;
+    delete[] narrowBuffer;
+
+    return encoded ? inProcessed : 0;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Encode planar samples and send them to the sink
+ *----------------------------------------------------------------------------*/
+bool
+TwoLameLibEncoder :: encode (  const short int   * leftBuffer,
+                               const short int   * rightBuffer,
+                               unsigned int        nSamples )
+{
     // data chunk size estimate according to TwoLAME documentation
     // NOTE: mp2Size is calculated based on the number of input channels
     //       which may be bigger than need, as output channels can be less
@@ -224,21 +267,59 @@ TwoLameLibEncoder :: write (   const void    * buf,
 
     ret = twolame_encode_buffer( twolame_opts,
                               leftBuffer,
-                              inChannels == 2 ? rightBuffer : leftBuffer,
+                              rightBuffer,
                               nSamples,
                               mp2Buf,
                               mp2Size );
 
-    delete[] leftBuffer;
-    delete[] rightBuffer;
+    return sendEncoded( mp2Buf, ret);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Encode planar float samples and send them to the sink
+ *----------------------------------------------------------------------------*/
+bool
+TwoLameLibEncoder :: encode (  const float       * leftBuffer,
+                               const float       * rightBuffer,
+                               unsigned int        nSamples )
+{
+    unsigned int    mp2Size = (unsigned int) (1.25 * nSamples + 7200);
+    unsigned char * mp2Buf  = new unsigned char[mp2Size];
+    int             ret;
+
+    ret = twolame_encode_buffer_float32( twolame_opts,
+                                         leftBuffer,
+                                         rightBuffer,
+                                         nSamples,
+                                         mp2Buf,
+                                         mp2Size );
+
+    return sendEncoded( mp2Buf, ret);
+}
+
 
+/*------------------------------------------------------------------------------
+ *  Send the output of the encoder to the sink
+ *----------------------------------------------------------------------------*/
+bool
+TwoLameLibEncoder :: sendEncoded ( unsigned char      * mp2Buf,
+                                   int                  ret )
+{
     if ( ret < 0 ) {
         reportEvent( 3, "TwoLAME encoding error", ret);
         delete[] mp2Buf;
-        return 0;
+        return false;
     }
 
-    unsigned int    written = getSink()->write( mp2Buf, ret);
+    unsigned int    written;
+
+    try {
+        written = getSink()->write( mp2Buf, ret);
+    } catch ( ... ) {
+        delete[] mp2Buf;
+        throw;
+    }
     delete[] mp2Buf;
     // just let go data that could not be written
     if ( written < (unsigned int) ret ) {
@@ -247,7 +328,48 @@ TwoLameLibEncoder :: write (   const void    * buf,
                      ret - written);
     }
 
-    return processed;
+    return true;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Encode a block of audio, using its planar view
+ *----------------------------------------------------------------------------*/
+unsigned int
+TwoLameLibEncoder :: writeBlock ( AudioBlock     * block )
+{
+    if ( !isOpen() || block->size == 0 ) {
+        return 0;
+    }
+
+    if ( !canUseViews( block) ) {
+        return write( block->data, block->size);
+    }
+
+    bool                encoded;
+
+    if ( SampleFormat::isWide( block->sampleFormat) ) {
+        // TwoLAME takes float samples, keeping the precision of the source
+        const float       * leftBuffer  = block->getPlanarFloat( 0);
+        const float       * rightBuffer = getInChannel() == 2
+                                        ? block->getPlanarFloat( 1)
+                                        : leftBuffer;
+
+        encoded = encode( leftBuffer, rightBuffer, block->frames);
+    } else {
+        const short int   * leftBuffer  = block->getPlanar16( 0);
+        const short int   * rightBuffer = getInChannel() == 2
+                                        ? block->getPlanar16( 1)
+                                        : leftBuffer;
+
+        encoded = encode( leftBuffer, rightBuffer, block->frames);
+    }
+
+    if ( !encoded ) {
+        return 0;
+    }
+
+    return block->frames * block->channels * (block->bitsPerSample / 8);
 }
 
 
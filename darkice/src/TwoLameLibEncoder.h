@@ -87,6 +87,52 @@ class TwoLameLibEncoder : public AudioEncoder, public virtual Reporter
         void
         init ( void )                               ;
 
+        /**
+         *  Encode samples and send the encoded data to the sink.
+         *
+         *  @param leftBuffer the samples of the left channel.
+         *  @param rightBuffer the samples of the right channel, the same
+         *                     as leftBuffer for mono input.
+         *  @param nSamples the number of samples in each buffer.
+         *  @return true if the samples were encoded, false on
+         *          an encoding error.
+         *  @exception Exception
+         */
+        bool
+        encode (    const short int   * leftBuffer,
+                    const short int   * rightBuffer,
+                    unsigned int        nSamples )      ;
+
+        /**
+         *  Encode float samples in [-1, 1] and send the encoded data
+         *  to the sink.
+         *
+         *  @param leftBuffer the samples of the left channel.
+         *  @param rightBuffer the samples of the right channel, the same
+         *                     as leftBuffer for mono input.
+         *  @param nSamples the number of samples in each buffer.
+         *  @return true if the samples were encoded, false on
+         *          an encoding error.
+         *  @exception Exception
+         */
+        bool
+        encode (    const float       * leftBuffer,
+                    const float       * rightBuffer,
+                    unsigned int        nSamples )      ;
+
+        /**
+         *  Send the output of TwoLAME to the sink.
+         *
+         *  @param mp2Buf the encoded data, freed here with delete[].
+         *  @param ret what the TwoLAME encoding function returned:
+         *             the number of bytes in mp2Buf, or an error code.
+         *  @return true if there was no encoding error.
+         *  @exception Exception
+         */
+        bool
+        sendEncoded (   unsigned char     * mp2Buf,
+                        int                 ret )       ;
+
         /**
          *  De-initialize the object.
          *
@@ -338,6 +384,17 @@ class TwoLameLibEncoder : public AudioEncoder, public virtual Reporter
         write (        const void    * buf,
                        unsigned int    len )        ;
 
+        /**
+         *  Encode a block of audio, taking the planar 16 bit or float
+         *  samples of the block instead of converting the raw data.
+         *
+         *  @param block the audio to encode.
+         *  @return the number of bytes of the block processed.
+         *  @exception Exception
+         */
+        virtual unsigned int
+        writeBlock (   AudioBlock    * block )      ;
+
         /**
          *  Flush all data that was written to the encoder to the underlying
          *  connection.
@@ -92,6 +92,7 @@
 #endif
 
 #include "Util.h"
+#include "ConvKernels.h"
 
 
 /* ===================================================  local data structures */
@@ -104,6 +105,15 @@
  *----------------------------------------------------------------------------*/
 static const char fileid[] = "$Id$";
 
+/*------------------------------------------------------------------------------
+ *  The byte order of this machine
+ *----------------------------------------------------------------------------*/
+#ifdef WORDS_BIGENDIAN
+static const bool hostBigEndian = true;
+#else
+static const bool hostBigEndian = false;
+#endif
+
 
 /* ===============================================  local function prototypes */
 
@@ -355,6 +365,11 @@ Util :: conv (  unsigned int        bitsPerSample,
             outBuffer[j] = pcmBuffer[i++];
             ++j;
         }
+    } else if ( bitsPerSample == 16 && sizeof(T) == sizeof(int16_t) ) {
+        ConvKernels::get()->copy16( (const int16_t *) pcmBuffer,
+                                    lenPcmBuffer / 2,
+                                    (int16_t *) outBuffer,
+                                    isBigEndian != hostBigEndian);
     } else if ( bitsPerSample == 16 ) {
 
         if ( isBigEndian ) {
@@ -395,19 +410,15 @@ template void Util::conv<int32_t>(unsigned int, unsigned char *, size_t, int32_t
  *  to one or more float buffers, one for each channel
  *----------------------------------------------------------------------------*/
 void
-Util :: conv (  int16_t           * shortBuffer,
+Util :: conv (  const int16_t     * shortBuffer,
                 size_t              lenShortBuffer,
                 float            ** floatBuffers,
                 unsigned int        channels )
 {
-    unsigned int    i, j;
-
-    for ( i = 0, j = 0; i < lenShortBuffer; ) {
-        for ( unsigned int c = 0; c < channels; ++c ) {
-            floatBuffers[c][j] = ((float) shortBuffer[i++]) / 32768.f;
-        }
-        ++j;
-    }
+    ConvKernels::get()->toFloat16( shortBuffer,
+                                   lenShortBuffer / channels,
+                                   channels,
+                                   floatBuffers);
 }
 
 
@@ -456,61 +467,32 @@ Util :: conv16 (    unsigned char     * pcmBuffer,
                     unsigned int        channels,
                     bool                isBigEndian )
 {
-    if ( isBigEndian ) {
-        if ( channels == 1 ) {
-            unsigned int    i, j;
-
-            for ( i = 0, j = 0; i < lenPcmBuffer; ) {
-                int16_t           value;
-
-                value           = pcmBuffer[i++] << 8;
-                value          |= pcmBuffer[i++];
-                leftBuffer[j]  =  value;
-                ++j;
-            }
-        } else {
-            unsigned int    i, j;
+    bool    swap = isBigEndian != hostBigEndian;
 
-            for ( i = 0, j = 0; i < lenPcmBuffer; ) {
-                int16_t           value;
-
-                value           = pcmBuffer[i++] << 8;
-                value          |= pcmBuffer[i++];
-                leftBuffer[j]   = value;
-                value           = pcmBuffer[i++] << 8;
-                value          |= pcmBuffer[i++];
-                rightBuffer[j]  = value;
-                ++j;
-            }
-        }
+    if ( channels == 1 ) {
+        ConvKernels::get()->copy16( (const int16_t *) pcmBuffer,
+                                    lenPcmBuffer / 2,
+                                    leftBuffer,
+                                    swap);
     } else {
-        if ( channels == 1 ) {
-            unsigned int    i, j;
-
-            for ( i = 0, j = 0; i < lenPcmBuffer; ) {
-                int16_t          value;
+        ConvKernels::get()->split16( (const int16_t *) pcmBuffer,
+                                     lenPcmBuffer / 4,
+                                     leftBuffer,
+                                     rightBuffer,
+                                     swap);
+    }
+}
 
-                value          = pcmBuffer[i++];
-                value         |= pcmBuffer[i++] << 8;
-                leftBuffer[j]  = value;
-                ++j;
-            }
-        } else {
-            unsigned int    i, j;
 
-            for ( i = 0, j = 0; i < lenPcmBuffer; ) {
-                int16_t           value;
-
-                value           = pcmBuffer[i++];
-                value          |= pcmBuffer[i++] << 8;
-                leftBuffer[j]   = value;
-                value           = pcmBuffer[i++];
-                value          |= pcmBuffer[i++] << 8;
-                rightBuffer[j]  = value;
-                ++j;
-            }
-        }
-    }
+/*------------------------------------------------------------------------------
+ *  Mix interleaved stereo samples down to mono
+ *----------------------------------------------------------------------------*/
+void
+Util :: downmix (   const int16_t     * stereoBuffer,
+                    size_t              frames,
+                    int16_t           * monoBuffer )
+{
+    ConvKernels::get()->downmix( stereoBuffer, frames, monoBuffer);
 }
 
 
@@ -533,3 +515,18 @@ Util :: sleep   (   long            sec,
 
     pselect( 0, NULL, NULL, NULL, &timespec, &sigset);
 }
+
+
+/*------------------------------------------------------------------------------
+ *  Get the time of the monotonic clock in micro-seconds.
+ *----------------------------------------------------------------------------*/
+unsigned long long
+Util :: getMonotonicTime( void )
+{
+    struct timespec     timespec;
+
+    clock_gettime( CLOCK_MONOTONIC, &timespec);
+
+    return (unsigned long long) timespec.tv_sec * 1000000ULL
+         + timespec.tv_nsec / 1000;
+}
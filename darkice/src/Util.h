@@ -260,7 +260,7 @@ class Util
          *  @param channels number of channels to separate the input to
          */
         static void
-        conv (  int16_t           * shortBuffer,
+        conv (  const int16_t     * shortBuffer,
                 size_t              lenShortBuffer,
                 float            ** floatBuffers,
                 unsigned int        channels )              ;
@@ -303,6 +303,23 @@ class Util
                     unsigned int        channels,
                     bool                isBigEndian )       ;
 
+        /**
+         *  Mix interleaved stereo 16 bit samples down to mono, by taking
+         *  the average of the two channels, rounded towards zero.
+         *  The mono samples may be put over the stereo ones, by passing
+         *  the same buffer for both.
+         *
+         *  @param stereoBuffer interleaved stereo samples,
+         *                      2 * frames values.
+         *  @param frames the number of frames in stereoBuffer.
+         *  @param monoBuffer put the mono samples here,
+         *                    must hold frames values.
+         */
+        static void
+        downmix (   const int16_t     * stereoBuffer,
+                    size_t              frames,
+                    int16_t           * monoBuffer )        ;
+
         /**
          *  Make a thread sleep for specified amount of time.
          *  Only the thread which this is called in will sleep.
@@ -314,6 +331,15 @@ class Util
         static void
         sleep(  long    sec,
                 long    nsec);
+
+        /**
+         *  Get the current time of a clock that is not affected by
+         *  changes to the system time, to measure intervals with.
+         *
+         *  @return the time in micro-seconds, from an arbitrary start.
+         */
+        static unsigned long long
+        getMonotonicTime( void );
                 
 };
 
@@ -36,6 +36,12 @@
 // compile only if configured for Ogg Vorbis
 #ifdef HAVE_VORBIS_LIB
 
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#error need string.h
+#endif
+
 
 #include "Exception.h"
 #include "Util.h"
@@ -67,7 +73,7 @@ VorbisLibEncoder :: init ( unsigned int     outMaxBitrate )
 {
     this->outMaxBitrate = outMaxBitrate;
 
-    if ( getInBitsPerSample() != 16 && getInBitsPerSample() != 8 ) {
+    if ( getInSampleFormat() == SampleFormat::unknown ) {
         throw Exception( __FILE__, __LINE__,
                          "specified bits per sample not supported",
                          getInBitsPerSample() );
@@ -122,18 +128,20 @@ VorbisLibEncoder :: init ( unsigned int     outMaxBitrate )
         // If we get here and useLinear is still true, then we have
         // a power of two.
            
-        // open the aflibConverter in
-        // - high quality
-        // - linear or quadratic (non-linear) based on algorithm
-        // - not filter interpolation
+        // open the converter with linear or sinc interpolation
+        // based on the ratio
 #ifdef HAVE_SRC_LIB
         int srcError = 0;
         converter = src_new(useLinear == true ? SRC_LINEAR : SRC_SINC_FASTEST,
-                            getInChannel(), &srcError);
+                            getOutChannel(), &srcError);
         if(srcError)
             throw Exception (__FILE__, __LINE__, "libsamplerate error: ", src_strerror (srcError));
 #else
-        converter = new aflibConverter( true, useLinear, false);
+        converter = new Resampler( getInSampleRate(),
+                                   getOutSampleRate(),
+                                   getOutChannel(),
+                                   useLinear ? Resampler::low
+                                             : Resampler::medium);
 #endif
     }
 
@@ -262,13 +270,11 @@ VorbisLibEncoder :: open ( void )
     if ( converter ) {
 #ifdef HAVE_SRC_LIB
         converterData.input_frames   = 4096/((getInBitsPerSample() / 8) * getInChannel());
-        converterData.data_in        = new float[converterData.input_frames*getInChannel()];
+        converterData.data_in        = new float[converterData.input_frames*getOutChannel()];
         converterData.output_frames  = (int) (converterData.input_frames * resampleRatio + 1);
-        converterData.data_out       = new float[getInChannel() * converterData.output_frames];
+        converterData.data_out       = new float[getOutChannel() * converterData.output_frames];
         converterData.src_ratio      = resampleRatio;
         converterData.end_of_input   = 0;
-#else
-        converter->initialize( resampleRatio, getInChannel());
 #endif
     }
 
@@ -291,51 +297,54 @@ VorbisLibEncoder :: write ( const void    * buf,
 
     unsigned int    channels      = getInChannel();
     unsigned int    bitsPerSample = getInBitsPerSample();
-    unsigned int    sampleSize = (bitsPerSample / 8) * channels;
+    unsigned int    sampleSize    = (bitsPerSample / 8) * channels;
+    unsigned char * b             = (unsigned char*) buf;
+    unsigned int    processed     = len - (len % sampleSize);
+    unsigned int    nSamples      = processed / sampleSize;
+
+    // convert the byte-based raw input into a short buffer
+    // with channels still interleaved
+    unsigned int    totalSamples = nSamples * channels;
+    short int     * shortBuffer  = new short int[totalSamples];
 
-    unsigned int i;
+    SampleFormat::toInt16( getInSampleFormat(),
+                           b,
+                           totalSamples,
+                           shortBuffer,
+                           isInBigEndian());
 
-    if ( getInChannel() == 2 && getOutChannel() == 1 ) {
-        for ( i = 0; i < len/sampleSize; i++) {
-            if ( bitsPerSample == 8 ) {
-                char          * buf8 = (char *) buf;
-                unsigned int    ix   = sampleSize * i;
-                unsigned int    iix  = ix;
-                buf8[i] = (buf8[ix] + buf8[++iix]) / 2;
-            }
-            if ( bitsPerSample == 16 ) {
-                short         * buf16 = (short *) buf;
-                unsigned int    ix    = (bitsPerSample >> 3) * i;
-                unsigned int    iix   = ix;
-                buf16[i] = (buf16[ix] + buf16[++iix]) / 2;
-            }
-        }
-        len      >>= 1;
-        channels   = 1;
+    // mix down in our own buffer, the input is not ours to change
+    if ( channels == 2 && getOutChannel() == 1 ) {
+        Util::downmix( shortBuffer, nSamples, shortBuffer);
+        channels = 1;
     }
 
-    sampleSize = (bitsPerSample / 8) * channels;
-    unsigned char * b = (unsigned char*) buf;
-    unsigned int    processed = len - (len % sampleSize);
-    unsigned int    nSamples = processed / sampleSize;
-    float        ** vorbisBuffer;
+    encode( shortBuffer, nSamples, channels);
 
+    delete[] shortBuffer;
 
-    // convert the byte-based raw input into a short buffer
-    // with channels still interleaved
-    unsigned int    totalSamples = nSamples * channels;
-    short int     * shortBuffer  = new short int[totalSamples];
+    return processed;
+}
 
 
-    Util::conv( bitsPerSample, b, processed, shortBuffer, isInBigEndian());
+/*------------------------------------------------------------------------------
+ *  Encode interleaved samples, resampling them if needed
+ *----------------------------------------------------------------------------*/
+void
+VorbisLibEncoder :: encode (    short int     * shortBuffer,
+                                unsigned int    nSamples,
+                                unsigned int    channels )
+{
+    unsigned int    totalSamples = nSamples * channels;
+    float        ** vorbisBuffer;
 
     if ( converter ) {
         // resample if needed
-        int         inCount  = nSamples;
-        int         outCount = (int) (inCount * resampleRatio);
-        short int * resampledBuffer = new short int[(outCount+1)* channels];
         int         converted;
 #ifdef HAVE_SRC_LIB
+        int         outCount = (int) (nSamples * resampleRatio);
+        short int * resampledBuffer = new short int[(outCount+1)* channels];
+
         converterData.input_frames   = nSamples;
         src_short_to_float_array (shortBuffer, (float *) converterData.data_in, totalSamples);
         int srcError = src_process (converter, &converterData);
@@ -346,32 +355,109 @@ VorbisLibEncoder :: write ( const void    * buf,
         src_float_to_short_array(converterData.data_out, resampledBuffer, converted*channels);
 
 #else
-        converted = converter->resample( inCount,
-                                         outCount,
-                                         shortBuffer,
+        short int * resampledBuffer = new short int[
+                                converter->getMaxOutFrames( nSamples)
+                                * channels];
+
+        converted = converter->resample( shortBuffer,
+                                         nSamples,
                                          resampledBuffer );
 #endif
 
-        vorbisBuffer = vorbis_analysis_buffer( &vorbisDspState,
-                                               converted);
-        Util::conv( resampledBuffer,
-                    converted * channels,
-                    vorbisBuffer,
-                    channels);
+        // writing 0 samples would tell libvorbis the stream ended
+        if ( converted > 0 ) {
+            vorbisBuffer = vorbis_analysis_buffer( &vorbisDspState,
+                                                   converted);
+            Util::conv( resampledBuffer,
+                        converted * channels,
+                        vorbisBuffer,
+                        channels);
+            vorbis_analysis_wrote( &vorbisDspState, converted);
+        }
         delete[] resampledBuffer;
 
-        vorbis_analysis_wrote( &vorbisDspState, converted);
-
-    } else {
+    } else if ( nSamples > 0 ) {
 
         vorbisBuffer = vorbis_analysis_buffer( &vorbisDspState, nSamples);
         Util::conv( shortBuffer, totalSamples, vorbisBuffer, channels);
         vorbis_analysis_wrote( &vorbisDspState, nSamples);
     }
 
-    delete[] shortBuffer;
-    
     vorbisBlocksOut();
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Encode a block of audio, using its views
+ *----------------------------------------------------------------------------*/
+unsigned int
+VorbisLibEncoder :: writeBlock ( AudioBlock   * block )
+{
+    if ( !isOpen() || block->size == 0 ) {
+        return 0;
+    }
+
+    if ( !canUseViews( block) ) {
+        return write( block->data, block->size);
+    }
+
+    unsigned int    channels  = getInChannel();
+    unsigned int    nSamples  = block->frames;
+    unsigned int    processed = nSamples * channels
+                              * (block->bitsPerSample / 8);
+    bool            mixDown   = channels == 2 && getOutChannel() == 1;
+    const float   * resampled;
+    unsigned int    frames;
+
+    if ( mixDown ) {
+        channels = 1;
+    }
+
+    if ( converter
+      && (resampled = block->getResampledFloat( getOutSampleRate(),
+                                                channels,
+                                                frames)) ) {
+        // the connector did the resampling for us. a short block may
+        // give no samples, and writing 0 samples would end the stream
+        float        ** vorbisBuffer;
+
+        if ( frames > 0 ) {
+            vorbisBuffer = vorbis_analysis_buffer( &vorbisDspState, frames);
+            for ( unsigned int i = 0, j = 0; i < frames; ++i ) {
+                for ( unsigned int c = 0; c < channels; ++c, ++j ) {
+                    vorbisBuffer[c][i] = resampled[j];
+                }
+            }
+            vorbis_analysis_wrote( &vorbisDspState, frames);
+            vorbisBlocksOut();
+        }
+
+    } else if ( converter ) {
+        // the mono mix down is shared by all encoders of the block,
+        // and the resampler only reads its input
+        const int16_t * in = mixDown ? block->getMono16()
+                                     : block->getInterleaved16();
+
+        encode( const_cast<int16_t*>( in), nSamples, channels);
+
+    } else if ( nSamples > 0 ) {
+        float        ** vorbisBuffer;
+
+        vorbisBuffer = vorbis_analysis_buffer( &vorbisDspState, nSamples);
+        if ( mixDown ) {
+            memcpy( vorbisBuffer[0],
+                    block->getMonoFloat(),
+                    nSamples * sizeof(float));
+        } else {
+            for ( unsigned int c = 0; c < channels; ++c ) {
+                memcpy( vorbisBuffer[c],
+                        block->getPlanarFloat( c),
+                        nSamples * sizeof(float));
+            }
+        }
+        vorbis_analysis_wrote( &vorbisDspState, nSamples);
+        vorbisBlocksOut();
+    }
 
     return processed;
 }
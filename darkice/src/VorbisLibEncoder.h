@@ -55,7 +55,7 @@
 #ifdef HAVE_SRC_LIB
 #include <samplerate.h>
 #else
-#include "aflibConverter.h"
+#include "Resampler.h"
 #endif
 
 
@@ -125,7 +125,7 @@ class VorbisLibEncoder : public AudioEncoder, public virtual Reporter
         SRC_STATE                     * converter;
         SRC_DATA                      converterData;
 #else
-        aflibConverter                * converter;
+        Resampler                     * converter;
 #endif
 
         /**
@@ -162,6 +162,21 @@ class VorbisLibEncoder : public AudioEncoder, public virtual Reporter
         void
         vorbisBlocksOut( void )                         ;
 
+        /**
+         *  Encode samples, resampling them if needed, and send the
+         *  encoded data to the underlying stream.
+         *
+         *  @param shortBuffer the samples, channels interleaved.
+         *                     Only read.
+         *  @param nSamples the number of samples per channel.
+         *  @param channels the number of channels in shortBuffer.
+         *  @exception Exception
+         */
+        void
+        encode (    short int     * shortBuffer,
+                    unsigned int    nSamples,
+                    unsigned int    channels )          ;
+
 
     protected:
 
@@ -424,6 +439,31 @@ class VorbisLibEncoder : public AudioEncoder, public virtual Reporter
         write (        const void    * buf,
                        unsigned int    len )        ;
 
+        /**
+         *  Encode a block of audio, taking the prepared samples of the
+         *  block instead of converting the raw data, resampled by the
+         *  connector if it did so. When mixing down to mono, the
+         *  mono view of the block is taken, made once for all encoders.
+         *
+         *  @param block the audio to encode.
+         *  @return the number of bytes of the block processed.
+         *  @exception Exception
+         */
+        virtual unsigned int
+        writeBlock (   AudioBlock    * block )      ;
+
+        /**
+         *  Tell that the encoder can take audio already resampled
+         *  to its output sample rate.
+         *
+         *  @return true
+         */
+        inline virtual bool
+        canTakeResampled ( void ) const             throw ()
+        {
+            return true;
+        }
+
         /**
          *  Flush all data that was written to the encoder to the underlying
          *  connection.
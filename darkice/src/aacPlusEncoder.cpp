@@ -217,7 +217,6 @@ aacPlusEncoder :: open ( void )
         converterData.src_ratio      = resampleRatio;
         converterData.end_of_input   = 0;
 #else
-        converter->initialize( resampleRatio, getInChannel());
         //needed 2x(converted input samples) to handle offsets
         int outCount                 = 2 * getInChannel() * (inputSamples + 1);
         if (resampleRatio > 1)
@@ -248,6 +247,16 @@ aacPlusEncoder :: write (  const void    * buf,
 
     unsigned int    channels         = getInChannel();
     unsigned int    bitsPerSample    = getInBitsPerSample();
+    unsigned int    inSampleSize     = (bitsPerSample / 8) * channels;
+    unsigned int    inProcessed      = len - (len % inSampleSize);
+    int16_t       * narrowBuffer     = narrowInput( buf, len);
+
+    // samples wider than 16 bits are encoded as 16 bit ones
+    if ( narrowBuffer ) {
+        buf           = narrowBuffer;
+        bitsPerSample = 16;
+    }
+
     unsigned int    sampleSize       = (bitsPerSample / 8) * channels;
     unsigned char * b                = (unsigned char*) buf;
     unsigned int    processed        = len - (len % sampleSize);
@@ -268,7 +277,7 @@ aacPlusEncoder :: write (  const void    * buf,
     int out_size, out_elem_size;
     int input_size;
 
-    in_elem_size = (getInBitsPerSample() / 8);
+    in_elem_size = (bitsPerSample / 8);
     in_buf.bufElSizes = &in_elem_size;
     in_buf.numBufs = 1;
     in_buf.bufferIdentifiers = &in_identifier;
@@ -292,71 +301,21 @@ aacPlusEncoder :: write (  const void    * buf,
              throw Exception (__FILE__, __LINE__, "libsamplerate error: ", src_strerror (srcError));
         converted = converterData.output_frames_gen;
 #else
-        int         inCount  = nSamples;
         short int     * shortBuffer  = new short int[samples];
-        int         outCount = (int) (inCount * resampleRatio);
-        Util::conv( bitsPerSample, b, processed, shortBuffer, isInBigEndian());
-        converted = converter->resample( inCount,
-                                         outCount+1,
-                                         shortBuffer,
+        Util::conv( bitsPerSample,
+                    b,
+                    processed,
+                    shortBuffer,
+                    narrowBuffer ? SampleFormat::isHostBigEndian()
+                                 : isInBigEndian());
+        converted = converter->resample( shortBuffer,
+                                         nSamples,
                                          &resampledOffset[resampledOffsetSize*channels]);
         delete[] shortBuffer;
 #endif
         resampledOffsetSize += converted;
 
-        // encode samples (if enough)
-        while(resampledOffsetSize - processedSamples >= inputSamples / channels) {
-#ifdef HAVE_SRC_LIB
-            input_size = inputSamples * (bitsPerSample / 8);
-            short *shortData = (int16_t*) malloc(input_size);
-
-            src_float_to_short_array(resampledOffset + (processedSamples * channels),
-                                     shortData, inputSamples) ;
-
-            in_buf.bufs = (void **) &shortData;
-
-            in_args.numInSamples = inputSamples;
-            in_buf.bufSizes = &input_size;
-
-            if ((err = aacEncEncode(encoderHandle, &in_buf, &out_buf, &in_args, &out_args)) != AACENC_OK)
-                throw Exception( __FILE__, __LINE__, "fdk-aac aacEncEncode error");
-
-            outputBytes = out_args.numOutBytes;
-
-            free(shortData);
-#else
-            in_buf.bufs = &(resampledOffset + (processedSamples * channels));
-            input_size = inputSamples * (bitsPerSample / 8);
-            in_args.numInSamples = inputSamples;
-            in_buf.bufSizes = &input_size;
-
-            if ((err = aacEncEncode(encoderHandle, &in_buf, &out_buf, &in_args, &out_args)) != AACENC_OK)
-                throw Exception( __FILE__, __LINE__, "fdk-aac aacEncEncode error");
-
-            outputBytes = out_args.numOutBytes;
-
-#endif
-            unsigned int wrote = getSink()->write(aacplusBuf, outputBytes);
-            
-            if (wrote < outputBytes) {
-                reportEvent(3, "aacPlusEncoder :: write, couldn't write full data to underlying sink");
-            }
-
-            processedSamples+=inputSamples/channels;
-        }
-
-        if (processedSamples && (int) resampledOffsetSize >= processedSamples) {
-            resampledOffsetSize -= processedSamples;
-            //move least part of resampled data to beginning
-            if(resampledOffsetSize)
-#ifdef HAVE_SRC_LIB
-                resampledOffset = (float *) memmove(resampledOffset, &resampledOffset[processedSamples*channels],
-                                                    resampledOffsetSize*channels*sizeof(float));
-#else
-                resampledOffset = (short *) memmove(resampledOffset, &resampledOffset[processedSamples*channels],
-                                                    resampledOffsetSize*sampleSize);
-#endif
-        }
+        encodeResampled();
     } else {
         while (processedSamples < samples) {
             int     inSamples = samples - processedSamples < (int) inputSamples
@@ -385,11 +344,151 @@ aacPlusEncoder :: write (  const void    * buf,
     }
 
     free(aacplusBuf);
+    delete[] narrowBuffer;
 
 //    return processedSamples;
-    return samples * sampleSize;
+    return inProcessed;
+}
+
+/*------------------------------------------------------------------------------
+ *  Encode the resampled audio collected so far
+ *----------------------------------------------------------------------------*/
+void
+aacPlusEncoder :: encodeResampled ( void )
+{
+    unsigned int    channels         = getInChannel();
+    // the resampled audio is always 16 bit
+    unsigned int    bitsPerSample    = 16;
+    unsigned char * aacplusBuf       = (unsigned char *) malloc(maxOutputBytes);
+    int             processedSamples = 0;
+
+    unsigned int outputBytes;
+    // aac encoder cruft
+    AACENC_ERROR err;
+    AACENC_BufDesc in_buf = { 0 }, out_buf = { 0 };
+    AACENC_InArgs in_args = { 0 };
+    AACENC_OutArgs out_args = { 0 };
+    int in_identifier = IN_AUDIO_DATA;
+    int in_elem_size;
+    int out_identifier = OUT_BITSTREAM_DATA;
+    int out_size, out_elem_size;
+    int input_size;
+
+    in_elem_size = (bitsPerSample / 8);
+    in_buf.bufElSizes = &in_elem_size;
+    in_buf.numBufs = 1;
+    in_buf.bufferIdentifiers = &in_identifier;
+
+    out_size = maxOutputBytes;
+    out_elem_size = 1;
+    out_buf.numBufs = 1;
+    out_buf.bufs = (void **)&aacplusBuf;
+    out_buf.bufferIdentifiers = &out_identifier;
+    out_buf.bufSizes = &out_size;
+    out_buf.bufElSizes = &out_elem_size;
+
+    // encode samples (if enough)
+    while(resampledOffsetSize - processedSamples >= inputSamples / channels) {
+#ifdef HAVE_SRC_LIB
+        input_size = inputSamples * (bitsPerSample / 8);
+        short *shortData = (int16_t*) malloc(input_size);
+
+        src_float_to_short_array(resampledOffset + (processedSamples * channels),
+                                 shortData, inputSamples) ;
+
+        in_buf.bufs = (void **) &shortData;
+
+        in_args.numInSamples = inputSamples;
+        in_buf.bufSizes = &input_size;
+
+        if ((err = aacEncEncode(encoderHandle, &in_buf, &out_buf, &in_args, &out_args)) != AACENC_OK)
+            throw Exception( __FILE__, __LINE__, "fdk-aac aacEncEncode error");
+
+        outputBytes = out_args.numOutBytes;
+
+        free(shortData);
+#else
+        void *tmp = resampledOffset + (processedSamples * channels);
+        in_buf.bufs = &tmp;
+        input_size = inputSamples * (bitsPerSample / 8);
+        in_args.numInSamples = inputSamples;
+        in_buf.bufSizes = &input_size;
+
+        if ((err = aacEncEncode(encoderHandle, &in_buf, &out_buf, &in_args, &out_args)) != AACENC_OK)
+            throw Exception( __FILE__, __LINE__, "fdk-aac aacEncEncode error");
+
+        outputBytes = out_args.numOutBytes;
+
+#endif
+        unsigned int wrote = getSink()->write(aacplusBuf, outputBytes);
+
+        if (wrote < outputBytes) {
+            reportEvent(3, "aacPlusEncoder :: write, couldn't write full data to underlying sink");
+        }
+
+        processedSamples+=inputSamples/channels;
+    }
+
+    if (processedSamples && (int) resampledOffsetSize >= processedSamples) {
+        resampledOffsetSize -= processedSamples;
+        //move least part of resampled data to beginning
+        if(resampledOffsetSize)
+#ifdef HAVE_SRC_LIB
+            resampledOffset = (float *) memmove(resampledOffset, &resampledOffset[processedSamples*channels],
+                                                resampledOffsetSize*channels*sizeof(float));
+#else
+            resampledOffset = (short *) memmove(resampledOffset, &resampledOffset[processedSamples*channels],
+                                                resampledOffsetSize*channels*sizeof(short));
+#endif
+    }
+
+    free(aacplusBuf);
+
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Encode a block of audio, taking it from the shared resampler
+ *----------------------------------------------------------------------------*/
+unsigned int
+aacPlusEncoder :: writeBlock ( AudioBlock     * block )
+{
+    if ( !isOpen() || block->size == 0 ) {
+        return 0;
+    }
+
+    unsigned int        channels = getInChannel();
+    unsigned int        frames   = 0;
+#ifdef HAVE_SRC_LIB
+    // resampledOffset holds float samples, as the shared resampler makes
+    const float       * samples  = 0;
+
+    if ( converter && canUseViews( block) ) {
+        samples = block->getResampledFloat( getOutSampleRate(),
+                                            channels,
+                                            frames);
+    }
+#else
+    const int16_t     * samples  = 0;
+
+    if ( converter && canUseViews( block) ) {
+        samples = block->getResampled16( getOutSampleRate(), channels, frames);
+    }
+#endif
+    if ( !samples ) {
+        return write( block->data, block->size);
+    }
+
+    memcpy( resampledOffset + resampledOffsetSize * channels,
+            samples,
+            frames * channels * sizeof(*samples));
+    resampledOffsetSize += frames;
+    encodeResampled();
+
+    return block->frames * channels * (block->bitsPerSample / 8);
 }
 
+
 /*------------------------------------------------------------------------------
  *  Flush the data from the encoder
  *----------------------------------------------------------------------------*/
@@ -57,7 +57,7 @@
 #ifdef HAVE_SRC_LIB
 #include <samplerate.h>
 #else
-#include "aflibConverter.h"
+#include "Resampler.h"
 #endif
 
 
@@ -97,7 +97,7 @@ class aacPlusEncoder : public AudioEncoder, public virtual Reporter
         SRC_DATA                    converterData;
         float                       *resampledOffset;
 #else
-        aflibConverter              *converter;
+        Resampler                   *converter;
         short                       *resampledOffset;
 #endif
         unsigned int                resampledOffsetSize;
@@ -143,7 +143,8 @@ class aacPlusEncoder : public AudioEncoder, public virtual Reporter
             this->lowpass         = lowpass;
 	    
 	    /* TODO: if we have float as input, we don't need conversion */
-            if ( getInBitsPerSample() != 16 && getInBitsPerSample() != 32 ) {
+            if ( getInSampleFormat() != SampleFormat::s16
+              && !SampleFormat::isWide( getInSampleFormat()) ) {
                 throw Exception( __FILE__, __LINE__,
                                  "specified bits per sample not supported",
                                  getInBitsPerSample() );
@@ -163,7 +164,8 @@ class aacPlusEncoder : public AudioEncoder, public virtual Reporter
             if ( getOutSampleRate() == getInSampleRate() ) {
                 resampleRatio = 1;
                 converter     = 0;
-            } else if (getInBitsPerSample() == 16) {
+            } else if (getInBitsPerSample() == 16
+                    || SampleFormat::isWide( getInSampleFormat())) {
                 resampleRatio = ( (double) getOutSampleRate() /
                                   (double) getInSampleRate() );
 
@@ -194,10 +196,8 @@ class aacPlusEncoder : public AudioEncoder, public virtual Reporter
                 // If we get here and useLinear is still true, then we have
                 // a power of two.
 
-                // open the aflibConverter in
-                // - high quality
-                // - linear or quadratic (non-linear) based on algorithm
-                // - not filter interpolation
+                // open the converter with linear or sinc interpolation
+                // based on the ratio
 #ifdef HAVE_SRC_LIB
                 int srcError = 0;
                 converter = src_new(useLinear == true ? SRC_LINEAR : SRC_SINC_FASTEST,
@@ -205,7 +205,11 @@ class aacPlusEncoder : public AudioEncoder, public virtual Reporter
                 if(srcError)
                     throw Exception (__FILE__, __LINE__, "libsamplerate error: ", src_strerror (srcError));
 #else
-                converter = new aflibConverter( true, useLinear, false);
+                converter = new Resampler( getInSampleRate(),
+                                           getOutSampleRate(),
+                                           getInChannel(),
+                                           useLinear ? Resampler::low
+                                                     : Resampler::medium);
 #endif
             } else {
                 throw Exception( __FILE__, __LINE__,
@@ -233,6 +237,16 @@ class aacPlusEncoder : public AudioEncoder, public virtual Reporter
             }
         }
 
+        /**
+         *  Encode the resampled audio collected in resampledOffset,
+         *  as far as it makes whole encoder frames, and keep the rest.
+         *
+         *  @exception Exception
+         */
+        void
+        encodeResampled ( void )                        ;
+
+
     protected:
 
         /**
@@ -488,6 +502,30 @@ class aacPlusEncoder : public AudioEncoder, public virtual Reporter
         write (        const void    * buf,
                        unsigned int    len );
 
+        /**
+         *  Encode a block of audio. If the connector resampled the block
+         *  to the output sample rate, that audio is encoded, otherwise
+         *  the raw data of the block is given to write().
+         *
+         *  @param block the audio to encode.
+         *  @return the number of bytes of the block processed.
+         *  @exception Exception
+         */
+        virtual unsigned int
+        writeBlock (   AudioBlock    * block )      ;
+
+        /**
+         *  Tell that the encoder can take audio already resampled
+         *  to its output sample rate.
+         *
+         *  @return true
+         */
+        inline virtual bool
+        canTakeResampled ( void ) const             throw ()
+        {
+            return true;
+        }
+
         /**
          *  Flush all data that was written to the encoder to the underlying
          *  connection.